@@ -0,0 +1,500 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "SDL_mixer.h"
+#include "audio_config_generated.h"
+#include "audio_engine_internal_state.h"
+#include "buses_generated.h"
+#include "flatbuffers/flatbuffers.h"
+#include "pindrop/pindrop.h"
+#include "sound_bank_def_generated.h"
+#include "sound_collection.h"
+#include "sound_collection_def_generated.h"
+
+// Stubs for SDL_mixer functions so that the benchmarks measure the engine
+// itself and do not need an audio device. Channels always report that they
+// are playing so that looping sounds stay alive for the whole run.
+extern "C" {
+Mix_Chunk* Mix_LoadWAV_RW(SDL_RWops*, int) { return NULL; }
+Mix_Music* Mix_LoadMUS(const char*) { return NULL; }
+Mix_Music* Mix_LoadMUS_RW(SDL_RWops*, int) { return NULL; }
+Mix_Chunk* Mix_QuickLoad_RAW(Uint8*, Uint32) { return NULL; }
+Mix_Chunk* Mix_GetChunk(int) { return NULL; }
+int Mix_QuerySpec(int*, Uint16*, int*) { return 0; }
+int Mix_AllocateChannels(int) { return 0; }
+int Mix_FadeOutChannel(int, int) { return 0; }
+int Mix_HaltChannel(int) { return 0; }
+int Mix_Init(int) { return 0; }
+int Mix_OpenAudio(int, Uint16, int, int) { return 0; }
+int Mix_Paused(int) { return 0; }
+int Mix_Playing(int) { return 1; }
+int Mix_SetPanning(int, Uint8, Uint8) { return 0; }
+int Mix_Volume(int, int) { return MIX_MAX_VOLUME; }
+void Mix_CloseAudio() {}
+void Mix_FreeChunk(Mix_Chunk*) {}
+void Mix_FreeMusic(Mix_Music*) {}
+#ifdef PINDROP_MULTISTREAM
+int Mix_FadeOutMusicCh(int, int) { return 0; }
+int Mix_HaltMusicCh(int) { return 0; }
+int Mix_PausedMusicCh(int) { return 0; }
+int Mix_PlayChannelTimed(int, Mix_Chunk*, int, int, int) { return 0; }
+int Mix_PlayMusicCh(Mix_Music*, int, int) { return 0; }
+int Mix_PlayingMusicCh(int) { return 1; }
+int Mix_VolumeMusicCh(int, int) { return MIX_MAX_VOLUME; }
+void Mix_HookMusicFinishedCh(void*, void (*)(void* userdata, Mix_Music* music,
+                                             int channel)) {}
+void Mix_PauseMusicCh(int) {}
+void Mix_ResumeMusicCh(int) {}
+#else
+int Mix_FadeOutMusic(int) { return 0; }
+int Mix_HaltMusic() { return 0; }
+int Mix_PausedMusic() { return 0; }
+int Mix_PlayChannelTimed(int, Mix_Chunk*, int, int) { return 0; }
+int Mix_PlayMusic(Mix_Music*, int) { return 0; }
+int Mix_PlayingMusic() { return 1; }
+int Mix_SetMusicPosition(double) { return 0; }
+int Mix_VolumeMusic(int) { return MIX_MAX_VOLUME; }
+void Mix_HookMusicFinished(void (*)(void)) {}
+void Mix_Pause(int) {}
+void Mix_PauseMusic() {}
+void Mix_Resume(int) {}
+void Mix_ResumeMusic() {}
+#endif  // PINDROP_MULTISTREAM
+}
+
+// Every allocation made through operator new is counted, so that each
+// benchmark can report how many allocations its operation makes.
+static std::atomic<uint64_t> g_allocation_count(0);
+
+void* operator new(std::size_t size) {
+  ++g_allocation_count;
+  void* pointer = malloc(size ? size : 1);
+  if (!pointer) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void* pointer) noexcept { free(pointer); }
+
+void operator delete[](void* pointer) noexcept { free(pointer); }
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const char* kBusFile = "pindrop_benchmark.pinbus";
+const char* kBankFile = "pindrop_benchmark.pinbank";
+const char* kSampleFile = "pindrop_benchmark.wav";
+const unsigned int kCollectionCount = 16;
+const int kWarmupFrames = 16;
+const int kMeasuredFrames = 256;
+const int kMeasuredBursts = 64;
+const int kMeasuredLoads = 32;
+const float kDeltaTime = 1.0f / 60.0f;
+const float kWorldSize = 300.0f;
+
+// The engine setup a benchmark runs with.
+struct Workload {
+  Workload()
+      : real_channels(32),
+        virtual_channels(1024),
+        listeners(1),
+        bus_depth(1),
+        burst(0),
+        moving_listeners(false) {}
+
+  unsigned int real_channels;
+  unsigned int virtual_channels;
+  unsigned int listeners;
+
+  // The number of buses from the master bus down to the one the sounds play
+  // on, inclusive.
+  unsigned int bus_depth;
+
+  // The number of sounds played at once, or collections loaded at once.
+  unsigned int burst;
+
+  bool moving_listeners;
+};
+
+// The time and allocations taken by some number of operations.
+class Measurement {
+ public:
+  Measurement()
+      : start_allocations_(0), elapsed_(0), allocations_(0), operations_(0) {}
+
+  void Start() {
+    start_allocations_ = g_allocation_count.load();
+    start_ = Clock::now();
+  }
+
+  void Stop(uint64_t operations) {
+    elapsed_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - start_);
+    allocations_ += g_allocation_count.load() - start_allocations_;
+    operations_ += operations;
+  }
+
+  double nanoseconds_per_operation() const {
+    return operations_ ? static_cast<double>(elapsed_.count()) / operations_
+                       : 0.0;
+  }
+
+  double allocations_per_operation() const {
+    return operations_ ? static_cast<double>(allocations_) / operations_
+                       : 0.0;
+  }
+
+ private:
+  Clock::time_point start_;
+  uint64_t start_allocations_;
+  std::chrono::nanoseconds elapsed_;
+  uint64_t allocations_;
+  uint64_t operations_;
+};
+
+// Print one result as a row of CSV.
+void Report(const char* benchmark, const Workload& workload,
+            const Measurement& measurement) {
+  double nanoseconds = measurement.nanoseconds_per_operation();
+  printf("%s,%u,%u,%u,%u,%u,%u,%.0f,%.0f,%.2f\n", benchmark,
+         workload.real_channels, workload.virtual_channels,
+         workload.listeners, workload.moving_listeners ? 1 : 0,
+         workload.bus_depth, workload.burst, nanoseconds,
+         nanoseconds > 0.0 ? 1e9 / nanoseconds : 0.0,
+         measurement.allocations_per_operation());
+}
+
+float RandomFloat(float range) {
+  return range * (static_cast<float>(rand()) / static_cast<float>(RAND_MAX));
+}
+
+mathfu::Vector<float, 3> RandomLocation() {
+  return mathfu::Vector<float, 3>(RandomFloat(kWorldSize), 0.0f,
+                                  RandomFloat(kWorldSize));
+}
+
+std::string BusName(unsigned int depth) {
+  return depth == 0 ? "master" : "bus_" + std::to_string(depth);
+}
+
+bool WriteFile(const char* filename,
+               const flatbuffers::FlatBufferBuilder& fbb) {
+  std::ofstream file(filename, std::ios::binary);
+  file.write(reinterpret_cast<const char*>(fbb.GetBufferPointer()),
+             fbb.GetSize());
+  return file.good();
+}
+
+// Write a chain of buses, each the child of the one before, bus_depth long.
+bool WriteBusFile(unsigned int bus_depth) {
+  flatbuffers::FlatBufferBuilder fbb;
+  std::vector<flatbuffers::Offset<pindrop::BusDef>> buses;
+  for (unsigned int i = 0; i < bus_depth; ++i) {
+    flatbuffers::Offset<
+        flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>>
+        children;
+    if (i + 1 < bus_depth) {
+      std::vector<flatbuffers::Offset<flatbuffers::String>> child(
+          1, fbb.CreateString(BusName(i + 1)));
+      children = fbb.CreateVector(child);
+    }
+    buses.push_back(pindrop::CreateBusDef(fbb, fbb.CreateString(BusName(i)),
+                                          1.0f, children));
+  }
+  auto bus_def_list =
+      pindrop::CreateBusDefList(fbb, fbb.CreateVector(buses));
+  pindrop::FinishBusDefListBuffer(fbb, bus_def_list);
+  return WriteFile(kBusFile, fbb);
+}
+
+// Write a short, silent wave file for collections to load.
+bool WriteSampleFile(const std::string& filename) {
+  static const unsigned char kSilentWav[] = {
+      'R', 'I', 'F', 'F', 40, 0, 0, 0, 'W', 'A', 'V', 'E', 'f', 'm', 't',
+      ' ', 16, 0, 0, 0, 1, 0, 1, 0, 0x44, 0xac, 0, 0, 0x88, 0x58, 0x01, 0,
+      2, 0, 16, 0, 'd', 'a', 't', 'a', 4, 0, 0, 0, 0, 0, 0, 0};
+  std::ofstream file(filename.c_str(), std::ios::binary);
+  file.write(reinterpret_cast<const char*>(kSilentWav), sizeof(kSilentWav));
+  return file.good();
+}
+
+std::string BuildSoundCollectionDef(const std::string& name, float priority,
+                                    const std::string& bus,
+                                    const std::string& sample_file) {
+  flatbuffers::FlatBufferBuilder fbb;
+  auto sample =
+      pindrop::CreateAudioSample(fbb, 1.0f, fbb.CreateString(sample_file));
+  std::vector<flatbuffers::Offset<pindrop::AudioSampleSetEntry>> entries;
+  entries.push_back(pindrop::CreateAudioSampleSetEntry(fbb, 1.0f, sample));
+  auto def = pindrop::CreateSoundCollectionDef(
+      fbb, fbb.CreateString(name), priority, 1.0f, fbb.CreateString(bus),
+      true, fbb.CreateVector(entries), false, pindrop::Mode_Positional, 0.0f,
+      100.0f, 0.0f, 10.0f, 2.0f, 0.5f);
+  pindrop::FinishSoundCollectionDefBuffer(fbb, def);
+  return std::string(reinterpret_cast<const char*>(fbb.GetBufferPointer()),
+                     fbb.GetSize());
+}
+
+std::string CollectionFile(unsigned int index) {
+  return "pindrop_benchmark_" + std::to_string(index) + ".pinsound";
+}
+
+std::string BankSampleFile(unsigned int index) {
+  return "pindrop_benchmark_" + std::to_string(index) + ".wav";
+}
+
+// Write a sound bank of collection_count collections, each in a file of its
+// own with a sample file of its own, so that every load reads them all.
+bool WriteBankFile(unsigned int collection_count) {
+  flatbuffers::FlatBufferBuilder fbb;
+  std::vector<flatbuffers::Offset<flatbuffers::String>> filenames;
+  for (unsigned int i = 0; i < collection_count; ++i) {
+    std::string source = BuildSoundCollectionDef(
+        "bank_" + std::to_string(i), 1.0f, BusName(0), BankSampleFile(i));
+    std::ofstream file(CollectionFile(i).c_str(), std::ios::binary);
+    file.write(source.data(), source.size());
+    if (!file.good() || !WriteSampleFile(BankSampleFile(i))) {
+      return false;
+    }
+    filenames.push_back(fbb.CreateString(CollectionFile(i)));
+  }
+  auto bank =
+      pindrop::CreateSoundBankDef(fbb, fbb.CreateVector(filenames));
+  pindrop::FinishSoundBankDefBuffer(fbb, bank);
+  return WriteFile(kBankFile, fbb);
+}
+
+void RemoveBankFiles(unsigned int collection_count) {
+  for (unsigned int i = 0; i < collection_count; ++i) {
+    remove(CollectionFile(i).c_str());
+    remove(BankSampleFile(i).c_str());
+  }
+  remove(kBankFile);
+}
+
+// Holds an initialized AudioEngine with a set of positional, looping sound
+// collections loaded directly into it.
+class BenchmarkEngine {
+ public:
+  bool Initialize(const Workload& workload) {
+    if (!WriteBusFile(workload.bus_depth)) {
+      return false;
+    }
+    flatbuffers::FlatBufferBuilder fbb;
+    auto config = pindrop::CreateAudioConfig(
+        fbb, 44100, pindrop::OutputChannels_Stereo, 2048,
+        workload.real_channels, workload.virtual_channels, workload.listeners,
+        fbb.CreateString(kBusFile));
+    fbb.Finish(config);
+    config_source_.assign(
+        reinterpret_cast<const char*>(fbb.GetBufferPointer()), fbb.GetSize());
+    if (!engine_.Initialize(pindrop::GetAudioConfig(config_source_.c_str()))) {
+      return false;
+    }
+    pindrop::AudioEngineInternalState* state = engine_.state();
+    std::string bus = BusName(workload.bus_depth - 1);
+    for (unsigned int i = 0; i < kCollectionCount; ++i) {
+      std::string name = "benchmark_" + std::to_string(i);
+      std::unique_ptr<pindrop::SoundCollection> collection(
+          new pindrop::SoundCollection());
+      if (!collection->LoadSoundCollectionDef(
+              BuildSoundCollectionDef(name, 1.0f + i, bus, kSampleFile),
+              state)) {
+        return false;
+      }
+      collection->ref_counter()->Increment();
+      handles_.push_back(collection.get());
+      state->sound_collection_table.Insert(collection->id(), collection.get());
+      collections_.push_back(std::move(collection));
+    }
+    for (unsigned int i = 0; i < workload.listeners; ++i) {
+      pindrop::Listener listener = engine_.AddListener();
+      listener.SetLocation(RandomLocation());
+      listeners_.push_back(listener);
+    }
+    return true;
+  }
+
+  void PlaySounds(unsigned int count) {
+    for (unsigned int i = 0; i < count; ++i) {
+      engine_.PlaySound(handles_[i % handles_.size()], RandomLocation());
+    }
+  }
+
+  void MoveListeners() {
+    for (size_t i = 0; i < listeners_.size(); ++i) {
+      listeners_[i].SetLocation(listeners_[i].Location() +
+                                mathfu::Vector<float, 3>(0.5f, 0.0f, 0.25f));
+    }
+  }
+
+  pindrop::AudioEngine& engine() { return engine_; }
+
+ private:
+  std::string config_source_;
+  // Declared before the engine so that they outlive it.
+  std::vector<std::unique_ptr<pindrop::SoundCollection>> collections_;
+  pindrop::AudioEngine engine_;
+  std::vector<pindrop::SoundHandle> handles_;
+  std::vector<pindrop::Listener> listeners_;
+};
+
+void InitializeOrExit(BenchmarkEngine* benchmark, const Workload& workload) {
+  srand(0);
+  if (!benchmark->Initialize(workload)) {
+    fprintf(stderr, "Could not initialize the audio engine.\n");
+    exit(1);
+  }
+}
+
+// Measure AdvanceFrame with every channel playing.
+void BenchmarkAdvanceFrame(const Workload& workload) {
+  BenchmarkEngine benchmark;
+  InitializeOrExit(&benchmark, workload);
+  benchmark.PlaySounds(workload.real_channels + workload.virtual_channels);
+  for (int i = 0; i < kWarmupFrames; ++i) {
+    benchmark.engine().AdvanceFrame(kDeltaTime);
+  }
+  Measurement measurement;
+  for (int i = 0; i < kMeasuredFrames; ++i) {
+    if (workload.moving_listeners) {
+      benchmark.MoveListeners();
+    }
+    measurement.Start();
+    benchmark.engine().AdvanceFrame(kDeltaTime);
+    measurement.Stop(1);
+  }
+  Report("advance_frame", workload, measurement);
+}
+
+// Measure PlaySound when bursts of sounds are played between frames into an
+// engine whose channels are already all in use.
+void BenchmarkPlaySound(const Workload& workload) {
+  BenchmarkEngine benchmark;
+  InitializeOrExit(&benchmark, workload);
+  benchmark.PlaySounds(workload.real_channels + workload.virtual_channels);
+  benchmark.engine().AdvanceFrame(kDeltaTime);
+  Measurement measurement;
+  for (int i = 0; i < kMeasuredBursts; ++i) {
+    measurement.Start();
+    benchmark.PlaySounds(workload.burst);
+    measurement.Stop(workload.burst);
+    benchmark.engine().AdvanceFrame(kDeltaTime);
+  }
+  Report("play_sound", workload, measurement);
+}
+
+// Measure loading a sound bank of workload.burst collections, waiting for its
+// sound files, and unloading it again.
+void BenchmarkBankLoad(const Workload& workload) {
+  if (!WriteBankFile(workload.burst)) {
+    fprintf(stderr, "Could not write %s.\n", kBankFile);
+    exit(1);
+  }
+  BenchmarkEngine benchmark;
+  InitializeOrExit(&benchmark, workload);
+  pindrop::AudioEngine& engine = benchmark.engine();
+  engine.StartLoadingSoundFiles();
+  Measurement measurement;
+  for (int i = 0; i < kMeasuredLoads; ++i) {
+    measurement.Start();
+    engine.LoadSoundBank(kBankFile);
+    while (!engine.TryFinalize()) {
+    }
+    engine.UnloadSoundBank(kBankFile);
+    measurement.Stop(workload.burst);
+  }
+  Report("bank_load", workload, measurement);
+  RemoveBankFiles(workload.burst);
+}
+
+}  // namespace
+
+// Runs each benchmark over a range of workloads and prints the results as CSV.
+// Each row gives the time and allocations per operation: per frame for
+// advance_frame, per sound for play_sound and per collection loaded and
+// unloaded for bank_load, along with how many operations that is per second.
+int main(int /*argc*/, char** /*argv*/) {
+  if (!WriteSampleFile(kSampleFile)) {
+    fprintf(stderr, "Could not write %s.\n", kSampleFile);
+    return 1;
+  }
+  printf(
+      "benchmark,real_channels,virtual_channels,listeners,moving_listeners,"
+      "bus_depth,burst,ns_per_op,ops_per_second,allocations_per_op\n");
+
+  static const unsigned int kRealChannelCounts[] = {8, 32, 128};
+  static const unsigned int kVirtualChannelCounts[] = {64, 256, 1024, 4096};
+  for (size_t i = 0; i < sizeof(kRealChannelCounts) / sizeof(unsigned int);
+       ++i) {
+    for (size_t j = 0;
+         j < sizeof(kVirtualChannelCounts) / sizeof(unsigned int); ++j) {
+      Workload workload;
+      workload.real_channels = kRealChannelCounts[i];
+      workload.virtual_channels = kVirtualChannelCounts[j];
+      BenchmarkAdvanceFrame(workload);
+      workload.moving_listeners = true;
+      BenchmarkAdvanceFrame(workload);
+    }
+  }
+
+  static const unsigned int kListenerCounts[] = {1, 4, 16};
+  for (size_t i = 0; i < sizeof(kListenerCounts) / sizeof(unsigned int);
+       ++i) {
+    Workload workload;
+    workload.listeners = kListenerCounts[i];
+    workload.moving_listeners = true;
+    BenchmarkAdvanceFrame(workload);
+  }
+
+  static const unsigned int kBusDepths[] = {1, 4, 16};
+  for (size_t i = 0; i < sizeof(kBusDepths) / sizeof(unsigned int); ++i) {
+    Workload workload;
+    workload.bus_depth = kBusDepths[i];
+    BenchmarkAdvanceFrame(workload);
+  }
+
+  static const unsigned int kBurstSizes[] = {1, 16, 256};
+  for (size_t i = 0; i < sizeof(kBurstSizes) / sizeof(unsigned int); ++i) {
+    Workload workload;
+    workload.burst = kBurstSizes[i];
+    BenchmarkPlaySound(workload);
+  }
+
+  static const unsigned int kBankSizes[] = {1, 16, 128};
+  for (size_t i = 0; i < sizeof(kBankSizes) / sizeof(unsigned int); ++i) {
+    Workload workload;
+    workload.burst = kBankSizes[i];
+    BenchmarkBankLoad(workload);
+  }
+
+  remove(kBusFile);
+  remove(kSampleFile);
+  return 0;
+}
@@ -0,0 +1,59 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_ASSET_STORE_H_
+#define PINDROP_ASSET_STORE_H_
+
+#include <cstddef>
+#include <memory>
+
+namespace pindrop {
+
+struct AssetStoreInternalState;
+
+/// @class AssetStore
+///
+/// @brief The loaded sound data shared by a number of AudioEngines.
+///
+/// Each AudioEngine normally loads its own copy of every sound it plays.
+/// AudioEngines initialized with the same AssetStore instead share one copy of
+/// each sound, and load sound files on one shared loader, so the memory held
+/// grows with the number of distinct sounds rather than with the number of
+/// engines. Each engine still has its own channels, buses and listeners, and
+/// its own view of the sound banks and sound collections it has loaded.
+///
+/// The store is safe to share between engines updated on different threads.
+/// Copies of an AssetStore refer to the same store, and its data lives until
+/// every copy and every engine using it have been destroyed.
+class AssetStore {
+ public:
+  /// @brief Construct an empty store.
+  AssetStore();
+
+  /// @brief Get the number of distinct sounds held by the store.
+  ///
+  /// @return The number of sounds.
+  size_t sound_count() const;
+
+  const std::shared_ptr<AssetStoreInternalState>& state() const {
+    return state_;
+  }
+
+ private:
+  std::shared_ptr<AssetStoreInternalState> state_;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_ASSET_STORE_H_
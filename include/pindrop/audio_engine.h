@@ -15,11 +15,15 @@
 #ifndef PINDROP_AUDIO_ENGINE_H_
 #define PINDROP_AUDIO_ENGINE_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #include "mathfu/matrix.h"
 #include "mathfu/matrix_4x4.h"
 #include "mathfu/vector.h"
+#include "pindrop/asset_store.h"
 #include "pindrop/bus.h"
 #include "pindrop/channel.h"
 #include "pindrop/listener.h"
@@ -40,6 +44,228 @@ struct AudioEngineInternalState;
 
 typedef SoundCollection* SoundHandle;
 
+/// @brief An integer id for a sound collection, which is the hash of its name.
+///
+/// The id of every sound collection is computed by build_assets.py when the
+/// assets are built, and can be computed at runtime with HashSoundName.
+typedef uint32_t SoundId;
+
+/// @brief Returns the SoundId of the sound collection with the given name.
+///
+/// @param name The unique name as defined in the JSON data.
+SoundId HashSoundName(const char* name);
+
+/// @struct PlayRequest
+///
+/// @brief A description of one sound to play with AudioEngine::PlaySounds.
+struct PlayRequest {
+  PlayRequest()
+      : sound_handle(nullptr), location(0.0f, 0.0f, 0.0f), gain(1.0f) {}
+  PlayRequest(SoundHandle sound_handle,
+              const mathfu::Vector<float, 3>& location, float gain)
+      : sound_handle(sound_handle), location(location), gain(gain) {}
+
+  /// @brief A handle to the sound to play.
+  SoundHandle sound_handle;
+
+  /// @brief The location of the sound.
+  mathfu::Vector<float, 3> location;
+
+  /// @brief The gain of the sound.
+  float gain;
+};
+
+/// @brief A function called once every sound file in a sound bank has been
+///        loaded.
+///
+/// @param filename The file the sound bank was loaded from.
+/// @param userdata The userdata given to AudioEngine::LoadSoundBank.
+typedef void (*SoundBankLoadedCallback)(const std::string& filename,
+                                        void* userdata);
+
+/// @struct SoundMemoryStats
+///
+/// @brief The memory held by loaded sounds, as reported by
+///        AudioEngine::GetSoundMemoryStats.
+struct SoundMemoryStats {
+  SoundMemoryStats()
+      : decoded_bytes(0),
+        compressed_bytes(0),
+        decode_cache_bytes(0),
+        decode_cache_capacity(0),
+        saved_bytes(0),
+        sample_budget(0),
+        budgeted_bytes(0) {}
+
+  /// @brief The decoded audio held by sounds stored decoded.
+  size_t decoded_bytes;
+
+  /// @brief The compressed audio held by sounds stored compressed.
+  size_t compressed_bytes;
+
+  /// @brief The decoded audio currently held in the decode cache for sounds
+  ///        stored compressed.
+  size_t decode_cache_bytes;
+
+  /// @brief The size the decode cache tries to stay within.
+  size_t decode_cache_capacity;
+
+  /// @brief An estimate of the memory saved by storing sounds compressed.
+  ///
+  /// A compressed sound's decoded size is only known once it has been played,
+  /// so this counts only sounds that have played at least once. It is their
+  /// decoded size less their compressed size, less what the decode cache
+  /// holds.
+  size_t saved_bytes;
+
+  /// @brief The sample budget set by the AudioConfig, or zero if there is
+  ///        none.
+  size_t sample_budget;
+
+  /// @brief The audio held by sounds loaded on demand, which the sample
+  ///        budget applies to.
+  size_t budgeted_bytes;
+};
+
+/// @struct ChannelUpdateStats
+///
+/// @brief How the playing channels were updated on the last frame, as
+///        reported by AudioEngine::GetChannelUpdateStats.
+struct ChannelUpdateStats {
+  ChannelUpdateStats()
+      : every_frame(0),
+        scheduled(0),
+        extrapolated(0),
+        unchanged(0),
+        sleeping(0),
+        swaps(0),
+        stealing(0),
+        streams(0) {}
+
+  /// @brief The channels updated every frame: the real channels and the
+  ///        virtual channels near the lowest real channel's priority.
+  size_t every_frame;
+
+  /// @brief The far virtual channels whose turn it was to be updated.
+  size_t scheduled;
+
+  /// @brief The far virtual channels whose gain and priority were
+  ///        extrapolated from their earlier updates.
+  size_t extrapolated;
+
+  /// @brief The channels whose gain and pan were kept from their last update
+  ///        because neither they, their bus nor the listeners had changed.
+  size_t unchanged;
+
+  /// @brief The channels asleep because they are too far from every listener
+  ///        to be heard.
+  size_t sleeping;
+
+  /// @brief The real channels handed from one channel to another.
+  size_t swaps;
+
+  /// @brief The real channels fading out to be handed to a higher priority
+  ///        channel.
+  size_t stealing;
+
+  /// @brief The stream channels playing streamed sounds, of the
+  ///        AudioConfig::mixer_stream_channels.
+  size_t streams;
+};
+
+/// @struct SoundBankStats
+///
+/// @brief The audio held by one loaded sound bank, as reported by
+///        AudioEngine::GetStats.
+struct SoundBankStats {
+  SoundBankStats() : sample_bytes(0) {}
+
+  /// @brief The file the sound bank was loaded from.
+  std::string filename;
+
+  /// @brief The decoded and compressed audio held by the sounds of the bank's
+  ///        sound collections. Audio shared with other banks is counted in
+  ///        each of them.
+  size_t sample_bytes;
+};
+
+/// @struct EngineStats
+///
+/// @brief Counters and timings of the engine's work, as reported by
+///        AudioEngine::GetStats.
+///
+/// The engine only gathers them when it is built with the `pindrop_stats`
+/// CMake option, which defines `PINDROP_STATS`. Otherwise `enabled` is false
+/// and everything else is zero.
+struct EngineStats {
+  EngineStats()
+      : enabled(false),
+        frame_nanoseconds(0),
+        erase_finished_sounds_nanoseconds(0),
+        bus_update_nanoseconds(0),
+        channel_update_nanoseconds(0),
+        sort_nanoseconds(0),
+        real_channel_update_nanoseconds(0),
+        real_channels(0),
+        virtual_channels(0),
+        evictions(0),
+        devirtualizations(0),
+        rejected_plays(0),
+        loader_queue_depth(0) {}
+
+  /// @brief True if the engine was built to gather statistics.
+  bool enabled;
+
+  /// @brief The time the last call to AudioEngine::AdvanceFrame spent
+  ///        updating the engine, in nanoseconds.
+  uint64_t frame_nanoseconds;
+
+  /// @brief The part of the last frame spent stopping finished sounds.
+  uint64_t erase_finished_sounds_nanoseconds;
+
+  /// @brief The part of the last frame spent updating the buses' gains.
+  uint64_t bus_update_nanoseconds;
+
+  /// @brief The part of the last frame spent updating the gain, pan and
+  ///        priority of the playing channels.
+  uint64_t channel_update_nanoseconds;
+
+  /// @brief The part of the last frame spent putting the channels whose
+  ///        priority changed back in order.
+  uint64_t sort_nanoseconds;
+
+  /// @brief The part of the last frame spent deciding which channels are
+  ///        real.
+  uint64_t real_channel_update_nanoseconds;
+
+  /// @brief The playing channels backed by a real channel.
+  size_t real_channels;
+
+  /// @brief The playing channels not backed by a real channel.
+  size_t virtual_channels;
+
+  /// @brief The sounds stopped to make room for a new one since the engine
+  ///        was initialized, either because every channel was in use or
+  ///        because a sound collection was playing as many instances as it
+  ///        may.
+  uint64_t evictions;
+
+  /// @brief The times a virtual channel was given a real channel since the
+  ///        engine was initialized.
+  uint64_t devirtualizations;
+
+  /// @brief The plays turned away since the engine was initialized, because
+  ///        of a sound collection's instance limit or retrigger interval, or
+  ///        because every channel was playing a higher priority sound.
+  uint64_t rejected_plays;
+
+  /// @brief The sound files queued or being loaded.
+  size_t loader_queue_depth;
+
+  /// @brief The audio held by each loaded sound bank.
+  std::vector<SoundBankStats> sound_banks;
+};
+
 /// @class AudioEngine
 ///
 /// @brief The central class of the library that manages the Listeners,
@@ -64,9 +290,37 @@ class AudioEngine {
   /// @return Whether initialization was successful.
   bool Initialize(const AudioConfig* config);
 
+  /// @brief Initialize the audio engine, sharing loaded sounds with every
+  /// other engine initialized with the same AssetStore.
+  ///
+  /// @param config_file the path to the file containing an AudioConfig
+  /// Flatbuffer binary.
+  /// @param asset_store The store to load sounds into.
+  /// @return Whether initialization was successful.
+  bool Initialize(const char* config_file, const AssetStore& asset_store);
+
+  /// @brief Initialize the audio engine, sharing loaded sounds with every
+  /// other engine initialized with the same AssetStore.
+  ///
+  /// @param config A pointer to a loaded AudioConfig object.
+  /// @param asset_store The store to load sounds into.
+  /// @return Whether initialization was successful.
+  bool Initialize(const AudioConfig* config, const AssetStore& asset_store);
+
   /// @brief Update audio volume per channel each frame.
   ///
+  /// If the AudioConfig sets an update_frequency, the engine instead updates
+  /// itself at that rate on a thread of its own, and AdvanceFrame only
+  /// publishes the listeners as the game last set them. In that mode the
+  /// Listener functions only affect the engine once published. PlaySound,
+  /// PlaySounds and the Channel functions never wait for an update: they go
+  /// through the command queue like the Queue functions, so the AudioConfig
+  /// must also set a command_queue_size, and sounds start on the engine's
+  /// next update. The remaining AudioEngine and Bus functions wait for any
+  /// update in progress to finish.
+  ///
   /// @param delta_time the number of elapsed seconds since the last frame.
+  ///        Ignored when the engine updates on its own thread.
   void AdvanceFrame(float delta_time);
 
   /// @brief Load a sound bank from a file. Queue the sound files in that sound
@@ -77,6 +331,60 @@ class AudioEngine {
   /// @return Returns true on success
   bool LoadSoundBank(const std::string& filename);
 
+  /// @brief Load a sound bank from a file, and queue its sound files for
+  ///        loading with the given priority.
+  ///
+  /// The sound files of banks with a higher priority are loaded first. If a
+  /// sound collection in the bank is already queued by another bank, it is
+  /// loaded with the higher of the two priorities.
+  ///
+  /// @param filename The file containing the SoundBank flatbuffer binary data.
+  /// @param priority How urgently the bank's sound files should be loaded.
+  /// @param callback If not null, called from TryFinalize() once all of the
+  ///        bank's sound files have loaded. It is not called if the bank is
+  ///        unloaded first.
+  /// @param userdata Passed to the callback.
+  /// @return Returns true on success
+  bool LoadSoundBank(const std::string& filename, int priority,
+                     SoundBankLoadedCallback callback, void* userdata);
+
+  /// @brief Load several sound banks without waiting for their files to be
+  ///        read.
+  ///
+  /// The bank files are read on the loading threads, all at once, and each
+  /// bank is loaded by TryFinalize() once its files have been read, which
+  /// queues its sound files for loading. Sounds in a bank that is not loaded
+  /// yet cannot be played. A bank that cannot be loaded is logged and its
+  /// callback is not called.
+  ///
+  /// @param filenames The files containing the SoundBank flatbuffer binary
+  ///        data.
+  /// @param callback If not null, called from TryFinalize() once each bank's
+  ///        sound files have loaded, with that bank's filename.
+  /// @param userdata Passed to the callback.
+  void LoadSoundBanksAsync(const std::vector<std::string>& filenames,
+                           SoundBankLoadedCallback callback, void* userdata);
+
+  /// @brief Load several sound banks without waiting for their files to be
+  ///        read, and queue their sound files for loading with the given
+  ///        priority.
+  ///
+  /// @param filenames The files containing the SoundBank flatbuffer binary
+  ///        data.
+  /// @param priority How urgently the banks' sound files should be loaded.
+  /// @param callback If not null, called from TryFinalize() once each bank's
+  ///        sound files have loaded, with that bank's filename.
+  /// @param userdata Passed to the callback.
+  void LoadSoundBanksAsync(const std::vector<std::string>& filenames,
+                           int priority, SoundBankLoadedCallback callback,
+                           void* userdata);
+
+  /// @brief Return true if a sound bank and all of its sound files have
+  ///        loaded.
+  ///
+  /// @param filename The file the bank was loaded from.
+  bool SoundBankLoaded(const std::string& filename) const;
+
   /// @brief Unload a sound bank.
   ///
   /// @param filename The file to unload.
@@ -87,14 +395,65 @@ class AudioEngine {
   void StartLoadingSoundFiles();
 
   /// @brief Return true if all sound files have been loaded. Must call
-  ///        StartLoadingSoundFiles() first.
+  ///        StartLoadingSoundFiles() first. Loads any banks queued with
+  ///        LoadSoundBanksAsync() whose files have been read, and calls the
+  ///        callbacks of any sound banks that have finished loading.
   bool TryFinalize();
 
+  /// @brief Return how much of the loading queued since loading was last
+  ///        finished has been done.
+  ///
+  /// @return The fraction of the queued sound files that have been loaded,
+  ///         between 0 and 1.
+  float LoadProgress() const;
+
+  /// @brief Start loading the sound files of a sound collection ahead of it
+  ///        being played.
+  ///
+  /// Only needed when the AudioConfig sets a sample budget, in which case
+  /// sound files are otherwise only loaded when they are first played, and a
+  /// sound played before its file has loaded starts late. Prefetched sounds
+  /// count as just played, so they are the last to be unloaded.
+  ///
+  /// @param sound_handle A handle to the sound collection to load.
+  void PrefetchSound(SoundHandle sound_handle);
+
+  /// @brief Replace a loaded sound collection's definition with a recompiled
+  ///        version of its SoundCollectionDef file.
+  ///
+  /// The collection keeps its loaded audio, and the channels playing it carry
+  /// on with its new gain, radii, priority and bus. The new definition must
+  /// have the same name, audio samples and streaming setting as the old one;
+  /// changing those still needs the bank to be reloaded. Storage settings
+  /// take effect when the collection's sounds are next loaded.
+  ///
+  /// @param filename The SoundCollectionDef file the collection was loaded
+  ///        from.
+  /// @return Returns true on success
+  bool ReloadSoundCollectionDef(const std::string& filename);
+
+  /// @brief Replace the bus definitions with a recompiled version of the bus
+  ///        file.
+  ///
+  /// The buses keep their fades and the sounds playing on them. The new file
+  /// must have the same buses, with the same parents, as the old one; only
+  /// their gains and ducking may change.
+  ///
+  /// @param filename The file containing the BusDefList flatbuffer binary
+  ///        data.
+  /// @return Returns true on success
+  bool ReloadBusFile(const std::string& filename);
+
   /// @brief Get a SoundHandle given its name as defined in its JSON data.
   ///
   /// @param name The unique name as defined in the JSON data.
   SoundHandle GetSoundHandle(const std::string& name) const;
 
+  /// @brief Get a SoundHandle given its SoundId.
+  ///
+  /// @param id The id of the sound collection.
+  SoundHandle GetSoundHandle(SoundId id) const;
+
   /// @brief Get a SoundHandle given its SoundCollectionDef filename.
   ///
   /// @param name The filename containing the flatbuffer binary data.
@@ -168,10 +527,55 @@ class AudioEngine {
   Channel PlaySound(SoundHandle sound_handle,
                     const mathfu::Vector<float, 3>& location, float gain);
 
+  /// @brief Play a batch of sounds at once.
+  ///
+  /// This gives the same results as calling PlaySound on each request, except
+  /// that the sounds are started from highest to lowest priority. The gain and
+  /// priority of the whole batch are calculated together, which is
+  /// considerably faster than playing many sounds in the same frame one at a
+  /// time.
+  ///
+  /// @param requests The sounds to play.
+  /// @param count The number of requests.
+  /// @param channels An array of count Channels. Each is set to the channel
+  ///        the corresponding request is played on, or to an invalid Channel
+  ///        if that sound could not be played.
+  void PlaySounds(const PlayRequest* requests, size_t count,
+                  Channel* channels);
+
+  /// @brief Play a sound associated with the given SoundId.
+  ///
+  /// Playing a sound by id avoids constructing a string and hashing the name.
+  ///
+  /// @param sound_id The id of the sound to play.
+  /// @return The channel the sound is played on. If the sound could not be
+  ///         played, an invalid Channel is returned.
+  Channel PlaySound(SoundId sound_id);
+
+  /// @brief Play a sound associated with the given SoundId at the given
+  ///        location.
+  ///
+  /// @param sound_id The id of the sound to play.
+  /// @param location The location of the sound.
+  /// @return The channel the sound is played on. If the sound could not be
+  ///         played, an invalid Channel is returned.
+  Channel PlaySound(SoundId sound_id, const mathfu::Vector<float, 3>& location);
+
+  /// @brief Play a sound associated with the given SoundId at the given
+  ///        location with the given gain.
+  ///
+  /// @param sound_id The id of the sound to play.
+  /// @param location The location of the sound.
+  /// @param gain The gain of the sound.
+  /// @return The channel the sound is played on. If the sound could not be
+  ///         played, an invalid Channel is returned.
+  Channel PlaySound(SoundId sound_id, const mathfu::Vector<float, 3>& location,
+                    float gain);
+
   /// @brief Play a sound associated with the given sound name.
   ///
-  /// Note: Playing a sound with its SoundHandle is faster than using the sound
-  /// name as using the name requires a map lookup internally.
+  /// Note: Playing a sound with its SoundHandle or SoundId is faster than
+  /// using the sound name as using the name requires hashing it internally.
   ///
   /// @param sound_name A handle to the sound to play.
   /// @return The channel the sound is played on. If the sound could not be
@@ -181,8 +585,8 @@ class AudioEngine {
   /// @brief Play a sound associated with the given sound name at the given
   ///        location.
   ///
-  /// Note: Playing a sound with its SoundHandle is faster than using the sound
-  /// name as using the name requires a map lookup internally.
+  /// Note: Playing a sound with its SoundHandle or SoundId is faster than
+  /// using the sound name as using the name requires hashing it internally.
   ///
   /// @param sound_name A handle to the sound to play.
   /// @param location The location of the sound.
@@ -194,8 +598,8 @@ class AudioEngine {
   /// @brief Play a sound associated with the given sound name at the given
   ///        location with the given gain.
   ///
-  /// Note: Playing a sound with its SoundHandle is faster than using the sound
-  /// name as using the name requires a map lookup internally.
+  /// Note: Playing a sound with its SoundHandle or SoundId is faster than
+  /// using the sound name as using the name requires hashing it internally.
   ///
   /// @param sound_name A handle to the sound to play.
   /// @param location The location of the sound.
@@ -205,6 +609,163 @@ class AudioEngine {
   Channel PlaySound(const std::string& sound_name,
                     const mathfu::Vector<float, 3>& location, float gain);
 
+  /// @brief Queue a sound to be played on the next call to AdvanceFrame.
+  ///
+  /// Unlike the rest of the AudioEngine, the Queue functions may be called
+  /// from any thread, concurrently with each other and with the thread that
+  /// calls AdvanceFrame. They never block. Queued commands are carried out in
+  /// the order they were queued, and queued sounds are started together as
+  /// if by PlaySounds.
+  ///
+  /// @param sound_handle A handle to the sound to play.
+  /// @param location The location of the sound.
+  /// @param gain The gain of the sound.
+  /// @return A ticket for the sound, or kInvalidChannelTicket if the command
+  ///         queue is full.
+  ChannelTicket QueuePlaySound(SoundHandle sound_handle,
+                               const mathfu::Vector<float, 3>& location,
+                               float gain);
+
+  /// @brief Queue a Stop of the sound with the given ticket.
+  ///
+  /// @param ticket The ticket returned by QueuePlaySound.
+  /// @return False if the command queue is full.
+  bool QueueStop(ChannelTicket ticket);
+
+  /// @brief Queue a Stop of the sound playing on the given channel.
+  ///
+  /// @param channel The channel to stop.
+  /// @return False if the command queue is full.
+  bool QueueStop(const Channel& channel);
+
+  /// @brief Queue a SetLocation on the sound with the given ticket.
+  ///
+  /// @param ticket The ticket returned by QueuePlaySound.
+  /// @param location The new location of the sound.
+  /// @return False if the command queue is full.
+  bool QueueSetLocation(ChannelTicket ticket,
+                        const mathfu::Vector<float, 3>& location);
+
+  /// @brief Queue a SetLocation on the given channel.
+  ///
+  /// @param channel The channel to move.
+  /// @param location The new location of the sound.
+  /// @return False if the command queue is full.
+  bool QueueSetLocation(const Channel& channel,
+                        const mathfu::Vector<float, 3>& location);
+
+  /// @brief Queue a SetGain on the sound with the given ticket.
+  ///
+  /// @param ticket The ticket returned by QueuePlaySound.
+  /// @param gain The new gain of the sound.
+  /// @return False if the command queue is full.
+  bool QueueSetGain(ChannelTicket ticket, float gain);
+
+  /// @brief Queue a SetGain on the given channel.
+  ///
+  /// @param channel The channel to change.
+  /// @param gain The new gain of the sound.
+  /// @return False if the command queue is full.
+  bool QueueSetGain(const Channel& channel, float gain);
+
+  /// @brief Get the channel a queued sound is playing on.
+  ///
+  /// This must be called from the same thread as AdvanceFrame.
+  ///
+  /// @param ticket The ticket returned by QueuePlaySound.
+  /// @return The channel the sound is played on. If the sound has not been
+  ///         started yet, could not be played, or its channel has since been
+  ///         given to another sound, an invalid Channel is returned.
+  Channel FindQueuedChannel(ChannelTicket ticket) const;
+
+  /// @brief Get the Channel with the given id.
+  ///
+  /// @param id The id of the channel, as returned by Channel::id().
+  /// @return The channel, or an invalid Channel if the id is no longer valid.
+  Channel FindChannel(ChannelId id) const;
+
+  /// @brief Get the memory held by the loaded sounds.
+  ///
+  /// If the engine shares an AssetStore, this counts the sounds loaded by
+  /// every engine using the store.
+  ///
+  /// @param stats The memory statistics to fill in.
+  void GetSoundMemoryStats(SoundMemoryStats* stats) const;
+
+  /// @brief Get the number of gain and pan changes that were held back from
+  ///        the mixer because they were smaller than the
+  ///        `mixer_update_threshold` in the AudioConfig.
+  ///
+  /// A change is counted on each frame it is held back. Held back changes are
+  /// still sent once the gain or pan stops changing.
+  ///
+  /// @return The number of skipped changes since the engine was initialized.
+  uint64_t skipped_mixer_updates() const;
+
+  /// @brief Get the number of playing channels that are asleep because they
+  ///        are too far from every listener to be heard.
+  ///
+  /// Sleeping channels are not updated until they or a listener move to
+  /// another cell of the grid set up by `culling_cell_size` in the
+  /// AudioConfig.
+  ///
+  /// @return The number of sleeping channels.
+  size_t sleeping_channel_count() const;
+
+  /// @brief Get how the playing channels were updated on the last frame.
+  ///
+  /// Far virtual channels are updated less often according to
+  /// `lod_update_interval` and `lod_cutoff_ratio` in the AudioConfig. Real
+  /// channels change hands according to `steal_priority_margin`,
+  /// `min_real_channel_time` and `steal_fade_time`.
+  ///
+  /// @param stats The update statistics to fill in.
+  void GetChannelUpdateStats(ChannelUpdateStats* stats) const;
+
+  /// @brief Get the engine's counters and the timings of its last frame.
+  ///
+  /// Nothing is gathered unless the engine was built with the `pindrop_stats`
+  /// CMake option, so that builds without it pay nothing for them.
+  ///
+  /// @param stats The statistics to fill in.
+  void GetStats(EngineStats* stats) const;
+
+  /// @brief Start recording channel and bus events for GetTrace.
+  ///
+  /// Plays, evictions, changes between real and virtual, stops and bus ducking
+  /// are recorded with the sound collection or bus they concern. Only the most
+  /// recent events are kept. Any events already recorded are discarded.
+  ///
+  /// @param event_count The number of events to keep.
+  void StartTrace(size_t event_count);
+
+  /// @brief Stop recording events. The recorded events are kept until the next
+  ///        call to StartTrace.
+  void StopTrace();
+
+  /// @brief Get the recorded events in the Chrome trace event format, which
+  ///        can be opened in about:tracing or Perfetto.
+  ///
+  /// @param json The string to write the JSON document to.
+  void GetTrace(std::string* json) const;
+
+  /// @brief Write the recorded events to a file in the Chrome trace event
+  ///        format.
+  ///
+  /// @param filename The file to write.
+  /// @return Whether the file was written.
+  bool WriteTrace(const std::string& filename) const;
+
+  /// @brief Restart the random number generator that chooses which sample of
+  ///        a sound collection to play.
+  ///
+  /// Playing the same sounds in the same order after seeding with the same
+  /// value chooses the same samples. The generator is first seeded from
+  /// `random_seed` in the AudioConfig.
+  ///
+  /// @param seed The seed to restart from.
+  void SeedRandom(uint32_t seed);
+
   /// @brief Get the version structure.
   ///
   /// @return The version string structure
@@ -15,6 +15,8 @@
 #ifndef PINDROP_CHANNEL_H_
 #define PINDROP_CHANNEL_H_
 
+#include <cstdint>
+
 #include "mathfu/matrix.h"
 #include "mathfu/matrix_4x4.h"
 #include "mathfu/vector.h"
@@ -22,6 +24,28 @@
 namespace pindrop {
 
 class ChannelInternalState;
+struct AudioEngineInternalState;
+
+/// @brief A compact identifier for a Channel.
+///
+/// A ChannelId holds the index of the channel in the engine's channel pool
+/// and a generation count that changes each time the channel is given to a
+/// new sound. An id that outlives its sound is invalid, instead of referring
+/// to whichever sound took over its channel. Ids are plain integers, so they
+/// may be stored anywhere and passed between threads.
+typedef uint32_t ChannelId;
+
+/// @brief An id that never refers to a channel.
+static const ChannelId kNullChannelId = 0;
+
+/// @brief Identifies a sound started with AudioEngine::QueuePlaySound.
+///
+/// A ticket can be used to queue more commands for its sound as soon as it is
+/// returned, before the sound has actually started.
+typedef uint32_t ChannelTicket;
+
+/// @brief The ticket returned when a sound could not be queued.
+static const ChannelTicket kInvalidChannelTicket = 0;
 
 /// @class Channel
 ///
@@ -30,6 +54,12 @@ class ChannelInternalState;
 /// The Channel class is a lightweight reference to a ChannelInternalState
 /// which is managed by the AudioEngine. Multiple Channel objects may point to
 /// the same underlying data.
+///
+/// While the engine updates on its own thread, a Channel never waits for the
+/// update. Its changes are queued for the engine's next update, and it reports
+/// the state of its channel as of the engine's last update. A sound the engine
+/// has not started yet reports that it is playing, at the location and gain
+/// it was played with.
 class Channel {
  public:
   /// @brief Construct an uninitialized Listener.
@@ -37,9 +67,17 @@ class Channel {
   /// An uninitialized Construct can not have its location set or queried.
   ///
   /// To initialize the Channel, use <code>AudioEngine::PlaySound();</code>
-  Channel() : state_(nullptr) {}
+  Channel()
+      : engine_state_(nullptr),
+        id_(kNullChannelId),
+        ticket_(kInvalidChannelTicket) {}
 
-  explicit Channel(ChannelInternalState* state) : state_(state) {}
+  Channel(AudioEngineInternalState* engine_state, ChannelId id)
+      : engine_state_(engine_state), id_(id), ticket_(kInvalidChannelTicket) {}
+
+  Channel(AudioEngineInternalState* engine_state, ChannelId id,
+          ChannelTicket ticket)
+      : engine_state_(engine_state), id_(id), ticket_(ticket) {}
 
   /// @brief Uninitializes this Channel.
   ///
@@ -48,9 +86,23 @@ class Channel {
   /// to it. To stop the Channel use <code>Channel::Stop();</code>
   void Clear();
 
-  /// @brief Checks whether this Channel has been initialized.
+  /// @brief Checks whether this Channel still refers to the sound it was
+  ///        returned for.
+  ///
+  /// A Channel stays valid after its sound finishes, until its channel is
+  /// given to another sound. Calls on an invalid Channel do nothing.
   bool Valid() const;
 
+  /// @brief Returns the id of this Channel.
+  ///
+  /// A sound played while the engine updates on its own thread has no id until
+  /// the engine has started it.
+  ChannelId id() const;
+
+  /// @brief Returns the ticket of the sound, if it was played while the engine
+  ///        updates on its own thread, or kInvalidChannelTicket otherwise.
+  ChannelTicket ticket() const { return ticket_; }
+
   /// @brief Checks if the sound playing on a given Channel is playing.
   ///
   /// @return Whether the Channel is currently playing.
@@ -100,7 +152,16 @@ class Channel {
   float Gain() const;
 
  private:
-  ChannelInternalState* state_;
+  // Returns the state of the channel, or null if this Channel is not valid.
+  ChannelInternalState* state() const;
+
+  // Returns true if the engine updates on its own thread, in which case the
+  // channel is controlled through the engine's command queue.
+  bool Queued() const;
+
+  AudioEngineInternalState* engine_state_;
+  ChannelId id_;
+  ChannelTicket ticket_;
 };
 
 }  // namespace pindrop
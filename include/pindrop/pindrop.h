@@ -15,6 +15,7 @@
 #ifndef PINDROP_PINDROP_H_
 #define PINDROP_PINDROP_H_
 
+#include "pindrop/asset_store.h"
 #include "pindrop/audio_engine.h"
 #include "pindrop/bus.h"
 #include "pindrop/channel.h"
@@ -31,6 +31,9 @@ PINDROP_DIR := $(LOCAL_PATH)
 
 PINDROP_ASYNC_LOADING ?= 0
 
+# Set to 1 to gather the statistics reported by AudioEngine::GetStats.
+PINDROP_STATS ?= 0
+
 PINDROP_MIXER ?= sdl_mixer
 
 PINDROP_MIXER_DIR ?= $(PINDROP_DIR)/src/mixer/$(PINDROP_MIXER)
@@ -45,8 +48,17 @@ ifeq ("$(PINDROP_MIXER)",sdl_mixer)
   PINDROP_SDL_MIXER_MULTISTREAM ?= 0
 endif
 
+# The software mixer plays through AAudio, or OpenSL ES where AAudio is
+# missing, for lower latency than SDL's audio path. Set to 0 to use SDL's.
+ifeq ("$(PINDROP_MIXER)",software_mixer)
+  PINDROP_NATIVE_AUDIO ?= 1
+endif
+
 PINDROP_GENERATED_OUTPUT_DIR := $(PINDROP_DIR)/gen/include
 
+# FileBuffer reads assets through the NDK asset manager.
+LOCAL_EXPORT_LDLIBS := -landroid
+
 LOCAL_EXPORT_C_INCLUDES := \
   $(DEPENDENCIES_FLATBUFFERS_DIR)/include \
   $(PINDROP_DIR)/include \
@@ -63,34 +75,73 @@ LOCAL_C_INCLUDES := \
   $(DEPENDENCIES_SDL_DIR)/include \
   $(DEPENDENCIES_SDL_MIXER_DIR)
 
-ifneq (0,$(PINDROP_ASYNC_LOADING))
-LOCAL_STATIC_LIBRARIES += libfplbase
-LOCAL_C_INCLUDES += $(DEPENDENCIES_FPLBASE_DIR)/include
-endif
-
 LOCAL_SRC_FILES := \
+  src/arena.cpp \
+  src/asset_store.cpp \
   src/audio_engine.cpp \
   src/bus.cpp \
   src/bus_internal_state.cpp \
   src/channel.cpp \
   src/channel_internal_state.cpp \
+  src/command_queue.cpp \
+  src/file_buffer.cpp \
   src/listener.cpp \
   src/log.cpp \
+  src/pcm_file.cpp \
+  src/priority_index.cpp \
   src/ref_counter.cpp \
+  src/sample_cache.cpp \
   src/sound_bank.cpp \
+  src/sound_bank_archive.cpp \
   src/sound_collection.cpp \
+  src/sound_file_duration.cpp \
+  src/sound_id_table.cpp \
+  src/spatial_grid.cpp \
+  src/trace_recorder.cpp \
   src/version.cpp \
   $(PINDROP_MIXER_DIR)/mixer.cpp \
   $(PINDROP_MIXER_DIR)/real_channel.cpp \
   $(PINDROP_MIXER_DIR)/sound.cpp \
   $(PINDROP_FILE_LOADER_DIR)/file_loader.cpp
 
+ifeq ("$(PINDROP_MIXER)",sdl_mixer)
+  LOCAL_SRC_FILES += $(PINDROP_MIXER_DIR)/decode_cache.cpp
+endif
+
+ifeq ("$(PINDROP_MIXER)",software_mixer)
+  # The software mixer decodes Ogg files itself with the Tremor decoder that
+  # is built into SDL_mixer.
+  LOCAL_C_INCLUDES += \
+    $(DEPENDENCIES_SDL_MIXER_DIR)/external/libogg-1.3.1/include \
+    $(DEPENDENCIES_SDL_MIXER_DIR)/external/libvorbisidec-1.2.1
+  LOCAL_CFLAGS += -DPINDROP_USE_TREMOR
+  # The mixing kernels are built with NEON on ARMv7, which nearly every
+  # ARMv7 Android device has. It is always available on arm64.
+  ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+    LOCAL_SRC_FILES += $(PINDROP_MIXER_DIR)/mix_kernels.cpp.neon
+  else
+    LOCAL_SRC_FILES += $(PINDROP_MIXER_DIR)/mix_kernels.cpp
+  endif
+  ifneq (0,$(PINDROP_NATIVE_AUDIO))
+    # AAudio is opened at run time, so only OpenSL ES is linked.
+    LOCAL_SRC_FILES += $(PINDROP_MIXER_DIR)/audio_device_android.cpp
+    LOCAL_EXPORT_LDLIBS += -lOpenSLES -ldl
+  else
+    LOCAL_SRC_FILES += $(PINDROP_MIXER_DIR)/audio_device_sdl.cpp
+  endif
+endif
+
+ifneq (0,$(PINDROP_STATS))
+  LOCAL_CFLAGS += -DPINDROP_STATS
+endif
+
 PINDROP_SCHEMA_DIR := $(PINDROP_DIR)/schemas
 PINDROP_SCHEMA_INCLUDE_DIRS :=
 
 PINDROP_SCHEMA_FILES := \
   $(PINDROP_SCHEMA_DIR)/audio_config.fbs \
   $(PINDROP_SCHEMA_DIR)/buses.fbs \
+  $(PINDROP_SCHEMA_DIR)/sound_bank_archive.fbs \
   $(PINDROP_SCHEMA_DIR)/sound_bank_def.fbs \
   $(PINDROP_SCHEMA_DIR)/sound_collection_def.fbs
 
@@ -17,17 +17,24 @@
 
 Finds the flatbuffer compiler then uses it to convert the JSON files to
 flatbuffer binary files.  If you would like to clean all generated files, you
-can call this script with the argument 'clean'.
+can call this script with the argument 'clean'.  With --archive, each sound
+bank is also packed into a single .pinarchive file together with the sound
+collections and audio files it uses.  With --pcm, the samples of buffered
+sound collections are decoded ahead of time to .pcm files in the output format
+given by audio_config.json, so they can be played without decoding them.
 """
 
 import argparse
 import distutils.spawn
 import glob
+import json
 import os
 import platform
 import shutil
+import struct
 import subprocess
 import sys
+import tempfile
 
 # The project root directory, which is one level up from this script's
 # directory.
@@ -56,6 +63,37 @@ RAW_SOUND_BANK_PATH = os.path.join(RAW_ASSETS_PATH, 'sound_banks')
 # Directory where unprocessed assets can be found.
 SCHEMA_PATHS = [ os.path.join(PROJECT_ROOT, 'schemas') ]
 
+# Schema of the sound bank archives.
+SOUND_BANK_ARCHIVE_SCHEMA = os.path.join(PROJECT_ROOT, 'schemas',
+                                         'sound_bank_archive.fbs')
+
+# Extensions of the files produced from sound bank and sound archive json.
+SOUND_BANK_EXTENSION = '.pinbank'
+SOUND_BANK_ARCHIVE_EXTENSION = '.pinarchive'
+
+# Extension of the files recording the build options a file was built with,
+# kept next to it.
+OPTIONS_STAMP_EXTENSION = '.options'
+
+# The alignment of each file's contents in a sound bank archive. This must
+# match schemas/sound_bank_archive.fbs.
+ARCHIVE_ALIGNMENT = 16
+
+# Raw audio config, which gives the format of prebuilt PCM.
+RAW_AUDIO_CONFIG = os.path.join(RAW_ASSETS_PATH, 'audio_config.json')
+
+# Header and extension of prebuilt PCM files. These must match src/pcm_file.h.
+PCM_EXTENSION = '.pcm'
+PCM_MAGIC = b'PPCM'
+PCM_HEADER_FORMAT = '<4sIHHI'
+
+# The sample format of prebuilt PCM, AUDIO_S16LSB in SDL. This is the format
+# the SDL_mixer backend opens the audio device with.
+PCM_SAMPLE_FORMAT = 0x8010
+
+# The number of channels for each value of OutputChannels in audio_config.fbs.
+OUTPUT_CHANNELS = {'Mono': 1, 'Stereo': 2}
+
 # Windows uses the .exe extension on executables.
 EXECUTABLE_EXTENSION = '.exe' if platform.system() == 'Windows' else ''
 
@@ -69,12 +107,58 @@ class FlatbuffersConversionData(object):
   Attributes:
     schema: The path to the flatbuffer schema file.
     input_files: A list of input files to convert.
+    preprocess: An optional function that takes the parsed json data of an
+        input file and the build options, and modifies the data before it is
+        converted.
   """
 
-  def __init__(self, schema, input_files):
-    """Initializes this object's schema and input_files."""
+  def __init__(self, schema, input_files, preprocess=None):
+    """Initializes this object's schema, input_files and preprocess."""
     self.schema = schema
     self.input_files = input_files
+    self.preprocess = preprocess
+
+
+def hash_sound_name(name):
+  """Returns the 32 bit FNV-1a hash of a sound collection name.
+
+  This must match HashSoundName in src/sound_id_table.cpp.
+  """
+  result = 2166136261
+  for byte in bytearray(name.encode('utf-8')):
+    result = ((result ^ byte) * 16777619) & 0xffffffff
+  return result
+
+
+def add_sound_id(data):
+  """Fills in the id of a sound collection from its name."""
+  if 'name' in data:
+    data['id'] = hash_sound_name(data['name'])
+
+
+def pcm_filename(filename):
+  """Returns the name of the prebuilt PCM file for the given audio file."""
+  return os.path.splitext(filename)[0] + PCM_EXTENSION
+
+
+def use_prebuilt_pcm(data):
+  """Points the samples of a buffered sound collection at prebuilt PCM.
+
+  Streamed collections keep their compressed audio.
+  """
+  if data.get('stream'):
+    return
+  for entry in data.get('audio_sample_set', []):
+    sample = entry.get('audio_sample', {})
+    if 'filename' in sample:
+      sample['filename'] = pcm_filename(sample['filename'])
+
+
+def preprocess_sound_collection(data, options):
+  """Prepares the json data of a sound collection for conversion."""
+  add_sound_id(data)
+  if options.pcm:
+    use_prebuilt_pcm(data)
 
 
 def find_in_paths(name, paths):
@@ -101,7 +185,8 @@ FLATBUFFERS_CONVERSION_DATA = [
         input_files=glob.glob(os.path.join(RAW_SOUND_BANK_PATH, '*.json'))),
     FlatbuffersConversionData(
         schema=find_in_paths('sound_collection_def.fbs', SCHEMA_PATHS),
-        input_files=glob.glob(os.path.join(RAW_SOUND_PATH, '*.json')))
+        input_files=glob.glob(os.path.join(RAW_SOUND_PATH, '*.json')),
+        preprocess=preprocess_sound_collection)
     ]
 
 
@@ -119,6 +204,14 @@ class BuildError(Exception):
     self.message = message if message else ''
 
 
+class AssetError(Exception):
+  """Error indicating an asset could not be processed."""
+
+  def __init__(self, message):
+    Exception.__init__(self)
+    self.message = message
+
+
 def run_subprocess(argv):
   try:
     process = subprocess.Popen(argv)
@@ -129,23 +222,89 @@ def run_subprocess(argv):
     raise BuildError(argv, process.returncode)
 
 
-def convert_json_to_flatbuffer_binary(flatc, json, schema, out_dir):
+def write_file_atomically(target, write):
+  """Writes a file next to the target, then moves it over the target.
+
+  The engine maps the files it loads into memory, so a file that is rewritten
+  in place changes under a running game that is about to reload it. Replacing
+  the file leaves the old mapping intact.
+
+  Args:
+    target: The path of the file to write.
+    write: A function that writes the file to the path it is given.
+  """
+  temp_file = target + '.tmp'
+  try:
+    write(temp_file)
+    os.replace(temp_file, target)
+  finally:
+    if os.path.exists(temp_file):
+      os.remove(temp_file)
+
+
+def convert_json_to_flatbuffer_binary(flatc, json_file, schema, out_dir):
   """Run the flatbuffer compiler on the given json file and schema.
 
+  flatc writes its output to a temporary directory, and the output is then
+  moved into out_dir, so that no binary is ever rewritten in place.
+
+  Args:
+    flatc: Path to the flatc binary.
+    json_file: The path to the json file to convert to a flatbuffer binary.
+    schema: The path to the schema to use in the conversion process.
+    out_dir: The directory to write the flatbuffer binary.
+
+  Raises:
+    BuildError: Process return code was nonzero.
+  """
+  temp_dir = tempfile.mkdtemp(dir=out_dir)
+  try:
+    command = [flatc, '-o', temp_dir]
+    for path in SCHEMA_PATHS:
+      command.extend(['-I', path])
+    command.extend(['-b', schema, json_file])
+    run_subprocess(command)
+    for name in os.listdir(temp_dir):
+      os.replace(os.path.join(temp_dir, name), os.path.join(out_dir, name))
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def convert_preprocessed_json_to_flatbuffer_binary(flatc, json_file, schema,
+                                                    out_dir, preprocess,
+                                                    options):
+  """Run preprocess on the json data, then convert it to a flatbuffer binary.
+
+  The modified json is written next to the binary and removed afterwards, so
+  the binary keeps the name of the original json file.
+
   Args:
     flatc: Path to the flatc binary.
-    json: The path to the json file to convert to a flatbuffer binary.
+    json_file: The path to the json file to convert to a flatbuffer binary.
     schema: The path to the schema to use in the conversion process.
     out_dir: The directory to write the flatbuffer binary.
+    preprocess: A function that modifies the parsed json data.
+    options: The build options, passed on to preprocess.
 
   Raises:
     BuildError: Process return code was nonzero.
   """
-  command = [flatc, '-o', out_dir]
-  for path in SCHEMA_PATHS:
-    command.extend(['-I', path])
-  command.extend(['-b', schema, json])
-  run_subprocess(command)
+  try:
+    with open(json_file) as f:
+      data = json.load(f)
+  except ValueError:
+    # flatc accepts json that Python does not, such as unquoted keys. Convert
+    # those files unmodified.
+    convert_json_to_flatbuffer_binary(flatc, json_file, schema, out_dir)
+    return
+  preprocess(data, options)
+  processed_file = os.path.join(out_dir, os.path.basename(json_file))
+  with open(processed_file, 'w') as f:
+    json.dump(data, f, indent=2)
+  try:
+    convert_json_to_flatbuffer_binary(flatc, processed_file, schema, out_dir)
+  finally:
+    os.remove(processed_file)
 
 
 def needs_rebuild(source, target):
@@ -163,6 +322,43 @@ def needs_rebuild(source, target):
       os.path.getmtime(source) > os.path.getmtime(target))
 
 
+def options_stamp_path(target):
+  """Returns the path of the file recording the options a target was built
+  with."""
+  return target + OPTIONS_STAMP_EXTENSION
+
+
+def options_stamp(options):
+  """Returns the build options that change the contents of built files."""
+  return json.dumps({'pcm': bool(options.pcm)}, sort_keys=True)
+
+
+def options_changed(target, options):
+  """Checks if the target was built with different options.
+
+  Args:
+    target: The built file.
+    options: The build options.
+
+  Returns:
+    True if the options differ from the ones recorded next to the target, or
+    if none were recorded.
+  """
+  try:
+    with open(options_stamp_path(target)) as f:
+      return f.read() != options_stamp(options)
+  except IOError:
+    return True
+
+
+def write_options_stamp(target, options):
+  """Records the options the target was built with next to it."""
+  def write(temp_file):
+    with open(temp_file, 'w') as f:
+      f.write(options_stamp(options))
+  write_file_atomically(options_stamp_path(target), write)
+
+
 def processed_json_path(path, target_directory):
   """Take the path to a raw json asset and convert it to target bin path.
 
@@ -173,22 +369,264 @@ def processed_json_path(path, target_directory):
       '.json', '.bin')
 
 
-def generate_flatbuffer_binaries(flatc, target_directory):
+def generate_flatbuffer_binaries(flatc, target_directory, options):
   """Run the flatbuffer compiler on the all of the flatbuffer json files.
 
   Args:
     flatc: Path to the flatc binary.
     target_directory: Path to the target assets directory.
+    options: The build options.
   """
   for element in FLATBUFFERS_CONVERSION_DATA:
     schema = element.schema
-    for json in element.input_files:
-      target = processed_json_path(json, target_directory)
+    for json_file in element.input_files:
+      target = processed_json_path(json_file, target_directory)
       target_file_dir = os.path.dirname(target)
       if not os.path.exists(target_file_dir):
         os.makedirs(target_file_dir)
-      if needs_rebuild(json, target) or needs_rebuild(schema, target):
-        convert_json_to_flatbuffer_binary(flatc, json, schema, target_file_dir)
+      # Preprocessing depends on the options, so a change of options rebuilds
+      # the files that are preprocessed.
+      if (needs_rebuild(json_file, target) or needs_rebuild(schema, target) or
+          (element.preprocess and options_changed(target, options))):
+        if element.preprocess:
+          convert_preprocessed_json_to_flatbuffer_binary(
+              flatc, json_file, schema, target_file_dir, element.preprocess,
+              options)
+          write_options_stamp(target, options)
+        else:
+          convert_json_to_flatbuffer_binary(flatc, json_file, schema,
+                                            target_file_dir)
+
+
+def load_json(path):
+  """Loads the given json file.
+
+  Raises:
+    AssetError: The file could not be parsed.
+  """
+  try:
+    with open(path) as f:
+      return json.load(f)
+  except ValueError as e:
+    raise AssetError('Could not parse %s: %s' % (path, str(e)))
+
+
+def align_offset(offset):
+  """Rounds offset up to the alignment of files in a sound bank archive."""
+  return (offset + ARCHIVE_ALIGNMENT - 1) // ARCHIVE_ALIGNMENT * (
+      ARCHIVE_ALIGNMENT)
+
+
+def sound_bank_binary_path(json_file, target_directory):
+  """Returns the path flatc writes the given sound bank json file to."""
+  name = os.path.splitext(os.path.basename(json_file))[0]
+  target_dir = os.path.dirname(processed_json_path(json_file,
+                                                   target_directory))
+  return os.path.join(target_dir, name + SOUND_BANK_EXTENSION)
+
+
+def sound_bank_archive_path(json_file, target_directory):
+  """Returns the path of the archive built from the given sound bank."""
+  return os.path.splitext(sound_bank_binary_path(
+      json_file, target_directory))[0] + SOUND_BANK_ARCHIVE_EXTENSION
+
+
+def build_archive_index(flatc, sound_bank, files):
+  """Converts the index of a sound bank archive to a flatbuffer binary.
+
+  Args:
+    flatc: Path to the flatc binary.
+    sound_bank: A (filename, offset, size) tuple for the sound bank.
+    files: A list of (filename, offset, size) tuples, sorted by filename.
+
+  Returns:
+    The flatbuffer binary as a string of bytes.
+  """
+  def entry(filename, offset, size):
+    return {'filename': filename, 'offset': offset, 'size': size}
+  index = {'sound_bank': entry(*sound_bank),
+           'files': [entry(*f) for f in files]}
+  temp_dir = tempfile.mkdtemp()
+  try:
+    index_file = os.path.join(temp_dir, 'index.json')
+    with open(index_file, 'w') as f:
+      json.dump(index, f, indent=2)
+    convert_json_to_flatbuffer_binary(flatc, index_file,
+                                      SOUND_BANK_ARCHIVE_SCHEMA, temp_dir)
+    binary_file = os.path.join(temp_dir,
+                               'index' + SOUND_BANK_ARCHIVE_EXTENSION)
+    with open(binary_file, 'rb') as f:
+      return f.read()
+  finally:
+    shutil.rmtree(temp_dir)
+
+
+def build_sound_bank_archive(flatc, json_file, target_directory, asset_root,
+                             options):
+  """Packs a built sound bank and everything it uses into a single file.
+
+  The archive starts with a SoundBankArchiveDef indexing the files, followed
+  by the contents of the sound bank, its sound collections and their audio
+  files. The index records where each file's contents are, and so its size
+  must be known before the contents can be placed. Offsets are written as
+  64 bit values, which flatc always stores in full unless they are zero, so
+  the index is built once with placeholder offsets to find its size and then
+  again with the real ones.
+
+  Args:
+    flatc: Path to the flatc binary.
+    json_file: The sound bank json file.
+    target_directory: Path to the target assets directory.
+    asset_root: The directory the filenames in sound banks and sound
+        collections are relative to.
+    options: The build options.
+
+  Raises:
+    AssetError: A file used by the sound bank could not be found.
+    BuildError: Process return code was nonzero.
+  """
+  bank_binary = sound_bank_binary_path(json_file, target_directory)
+  archive = sound_bank_archive_path(json_file, target_directory)
+
+  # Find the collections in the bank and the audio files they use.
+  sound_json_files = dict(
+      (os.path.splitext(os.path.basename(path))[0], path)
+      for path in glob.glob(os.path.join(RAW_SOUND_PATH, '*.json')))
+  paths = {}
+  for collection in load_json(json_file).get('filenames', []):
+    paths[collection] = os.path.join(asset_root, collection)
+    name = os.path.splitext(os.path.basename(collection))[0]
+    if name not in sound_json_files:
+      raise AssetError('No sound collection json for %s' % collection)
+    collection_data = load_json(sound_json_files[name])
+    if options.pcm:
+      use_prebuilt_pcm(collection_data)
+    for entry in collection_data.get('audio_sample_set', []):
+      filename = entry['audio_sample']['filename']
+      paths[filename] = os.path.join(asset_root, filename)
+  for path in [bank_binary] + list(paths.values()):
+    if not os.path.isfile(path):
+      raise AssetError('Could not find %s' % path)
+
+  sources = [json_file, bank_binary] + list(paths.values())
+  if (not options_changed(archive, options) and
+      not any(needs_rebuild(source, archive) for source in sources)):
+    return
+
+  # The engine binary searches the files, comparing names as bytes, so sort
+  # them the same way.
+  filenames = sorted(paths, key=lambda name: name.encode('utf-8'))
+  contents = [bank_binary] + [paths[name] for name in filenames]
+  sizes = [os.path.getsize(path) for path in contents]
+
+  def lay_out(start):
+    offsets = []
+    for size in sizes:
+      offsets.append(start)
+      start = align_offset(start + size)
+    return offsets
+
+  def index_for(offsets):
+    bank_entry = (os.path.basename(bank_binary), offsets[0], sizes[0])
+    file_entries = list(zip(filenames, offsets[1:], sizes[1:]))
+    return build_archive_index(flatc, bank_entry, file_entries)
+
+  # Placeholder offsets must be non-zero so that flatc writes them.
+  index = index_for(lay_out(ARCHIVE_ALIGNMENT))
+  offsets = lay_out(align_offset(len(index)))
+  final_index = index_for(offsets)
+  if len(final_index) != len(index):
+    raise AssetError('The index of %s changed size' % archive)
+
+  def write(temp_file):
+    with open(temp_file, 'wb') as out:
+      out.write(final_index)
+      for path, offset in zip(contents, offsets):
+        out.write(b'\0' * (offset - out.tell()))
+        with open(path, 'rb') as f:
+          shutil.copyfileobj(f, out)
+  write_file_atomically(archive, write)
+  write_options_stamp(archive, options)
+
+
+def generate_sound_bank_archives(flatc, target_directory, asset_root,
+                                 options):
+  """Builds a sound bank archive for every sound bank.
+
+  Args:
+    flatc: Path to the flatc binary.
+    target_directory: Path to the target assets directory.
+    asset_root: The directory the filenames in sound banks and sound
+        collections are relative to.
+    options: The build options.
+  """
+  for json_file in glob.glob(os.path.join(RAW_SOUND_BANK_PATH, '*.json')):
+    build_sound_bank_archive(flatc, json_file, target_directory, asset_root,
+                             options)
+
+
+def decode_to_pcm(ffmpeg, source, target, frequency, channels):
+  """Decodes an audio file to a prebuilt PCM file.
+
+  Args:
+    ffmpeg: Path to the ffmpeg binary.
+    source: The audio file to decode.
+    target: The PCM file to write.
+    frequency: The sample rate to resample the audio to.
+    channels: The number of channels to mix the audio to.
+
+  Raises:
+    BuildError: Process return code was nonzero.
+  """
+  raw_file = target + '.raw'
+  run_subprocess([ffmpeg, '-v', 'error', '-y', '-i', source,
+                  '-f', 's16le', '-acodec', 'pcm_s16le',
+                  '-ar', str(frequency), '-ac', str(channels), raw_file])
+  try:
+    with open(raw_file, 'rb') as f:
+      samples = f.read()
+  finally:
+    os.remove(raw_file)
+  def write(temp_file):
+    with open(temp_file, 'wb') as f:
+      f.write(struct.pack(PCM_HEADER_FORMAT, PCM_MAGIC, frequency,
+                          PCM_SAMPLE_FORMAT, channels, len(samples)))
+      f.write(samples)
+  write_file_atomically(target, write)
+
+
+def generate_prebuilt_pcm(ffmpeg, asset_root):
+  """Decodes the samples of every buffered sound collection to PCM.
+
+  Each .pcm file is written next to the audio file it was decoded from, in the
+  output format given by audio_config.json.
+
+  Args:
+    ffmpeg: Path to the ffmpeg binary.
+    asset_root: The directory the filenames in sound collections are relative
+        to.
+
+  Raises:
+    AssetError: An audio file could not be found.
+    BuildError: Process return code was nonzero.
+  """
+  config = load_json(RAW_AUDIO_CONFIG)
+  frequency = config['output_frequency']
+  channels = config.get('output_channels', 'Stereo')
+  channels = OUTPUT_CHANNELS.get(channels, channels)
+  for json_file in glob.glob(os.path.join(RAW_SOUND_PATH, '*.json')):
+    data = load_json(json_file)
+    if data.get('stream'):
+      continue
+    for entry in data.get('audio_sample_set', []):
+      filename = entry['audio_sample']['filename']
+      source = os.path.join(asset_root, filename)
+      target = os.path.join(asset_root, pcm_filename(filename))
+      if not os.path.isfile(source):
+        raise AssetError('Could not find %s' % source)
+      if needs_rebuild(source, target) or needs_rebuild(RAW_AUDIO_CONFIG,
+                                                        target):
+        decode_to_pcm(ffmpeg, source, target, frequency, channels)
 
 
 def copy_assets(target_directory):
@@ -215,7 +653,9 @@ def copy_assets(target_directory):
         if (not os.path.exists(target_filename) or
             (os.path.getmtime(target_filename) <
              os.path.getmtime(source_filename))):
-              shutil.copy2(source_filename, target_filename)
+              write_file_atomically(
+                  target_filename,
+                  lambda temp_file: shutil.copy2(source_filename, temp_file))
 
 
 def clean_flatbuffer_binaries(target_directory):
@@ -225,10 +665,16 @@ def clean_flatbuffer_binaries(target_directory):
     target_directory: Path to the target assets directory.
   """
   for element in FLATBUFFERS_CONVERSION_DATA:
-    for json in element.input_files:
-      path = processed_json_path(json, target_directory)
-      if os.path.isfile(path):
-        os.remove(path)
+    for json_file in element.input_files:
+      path = processed_json_path(json_file, target_directory)
+      for built in [path, options_stamp_path(path)]:
+        if os.path.isfile(built):
+          os.remove(built)
+  for json_file in glob.glob(os.path.join(RAW_SOUND_BANK_PATH, '*.json')):
+    path = sound_bank_archive_path(json_file, target_directory)
+    for built in [path, options_stamp_path(path)]:
+      if os.path.isfile(built):
+        os.remove(built)
 
 
 def clean():
@@ -256,16 +702,38 @@ def main(argv):
                       help='Location of the flatbuffers compiler.')
   parser.add_argument('--output', default=ASSETS_PATH,
                       help='Assets output directory.')
+  parser.add_argument('--archive', action='store_true',
+                      help='Also pack each sound bank into a .pinarchive.')
+  parser.add_argument('--pcm', action='store_true',
+                      help='Decode the samples of buffered sound collections '
+                      'to PCM in the output format ahead of time.')
+  parser.add_argument('--ffmpeg', default='ffmpeg',
+                      help='Location of ffmpeg, used to decode audio for '
+                      '--pcm.')
+  parser.add_argument('--asset_root', default=None,
+                      help='Directory that the filenames in sound banks and '
+                      'sound collections are relative to. Defaults to the '
+                      'parent of the output directory.')
   parser.add_argument('args', nargs=argparse.REMAINDER)
   args = parser.parse_args()
   target = args.args[1] if len(args.args) >= 2 else 'all'
   if target != 'clean':
     copy_assets(args.output)
     try:
-      generate_flatbuffer_binaries(args.flatc, args.output)
+      asset_root = args.asset_root or os.path.dirname(
+          os.path.abspath(args.output))
+      if args.pcm:
+        generate_prebuilt_pcm(args.ffmpeg, asset_root)
+      generate_flatbuffer_binaries(args.flatc, args.output, args)
+      if args.archive:
+        generate_sound_bank_archives(args.flatc, args.output, asset_root,
+                                     args)
     except BuildError as error:
       handle_build_error(error)
       return 1
+    except AssetError as error:
+      sys.stderr.write('Error building assets: %s\n' % error.message)
+      return 1
   else:
     try:
       clean()
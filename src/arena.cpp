@@ -0,0 +1,103 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace pindrop {
+
+const size_t Arena::kDefaultBlockSize;
+
+// Round the address up to the given power of two.
+static char* AlignUp(char* pointer, size_t alignment) {
+  uintptr_t address = reinterpret_cast<uintptr_t>(pointer);
+  address = (address + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+  return reinterpret_cast<char*>(address);
+}
+
+Arena::Arena()
+    : block_size_(kDefaultBlockSize),
+      blocks_(nullptr),
+      current_(nullptr),
+      position_(nullptr),
+      end_(nullptr),
+      bytes_allocated_(0),
+      capacity_(0) {}
+
+Arena::Arena(size_t block_size)
+    : block_size_(block_size),
+      blocks_(nullptr),
+      current_(nullptr),
+      position_(nullptr),
+      end_(nullptr),
+      bytes_allocated_(0),
+      capacity_(0) {}
+
+Arena::~Arena() {
+  while (blocks_) {
+    Block* next = blocks_->next;
+    ::operator delete(blocks_);
+    blocks_ = next;
+  }
+}
+
+void* Arena::Allocate(size_t size, size_t alignment) {
+  char* start = AlignUp(position_, alignment);
+  if (!position_ || start + size > end_) {
+    NextBlock(size, alignment);
+    start = AlignUp(position_, alignment);
+  }
+  position_ = start + size;
+  bytes_allocated_ += size;
+  return start;
+}
+
+void Arena::NextBlock(size_t size, size_t alignment) {
+  size_t needed = size + alignment;
+  // Kept blocks are tried in order, so after a reset the same allocations
+  // land in the same blocks again.
+  Block* previous = current_;
+  Block* block = current_ ? current_->next : blocks_;
+  while (block && block->size < needed) {
+    previous = block;
+    block = block->next;
+  }
+  if (!block) {
+    size_t block_size = std::max(block_size_, needed);
+    block = static_cast<Block*>(::operator new(sizeof(Block) + block_size));
+    block->size = block_size;
+    capacity_ += block_size;
+    if (previous) {
+      block->next = previous->next;
+      previous->next = block;
+    } else {
+      block->next = blocks_;
+      blocks_ = block;
+    }
+  }
+  current_ = block;
+  position_ = BlockData(block);
+  end_ = position_ + block->size;
+}
+
+void Arena::Reset() {
+  current_ = nullptr;
+  position_ = nullptr;
+  end_ = nullptr;
+  bytes_allocated_ = 0;
+}
+
+}  // namespace pindrop
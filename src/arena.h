@@ -0,0 +1,149 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_ARENA_H_
+#define PINDROP_ARENA_H_
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace pindrop {
+
+// A linear allocator. Memory is handed out in order from large blocks and is
+// only given back all at once, so everything allocated from an arena is freed
+// with one call per block rather than one per allocation, and allocations that
+// live and die together do not fragment the heap.
+//
+// Destructors are not run by the arena. Objects that need them must be
+// destroyed explicitly before the arena is reset or destroyed.
+class Arena {
+ public:
+  // The size of the blocks memory is handed out from. Larger allocations get a
+  // block of their own.
+  static const size_t kDefaultBlockSize = 16 * 1024;
+
+  Arena();
+  explicit Arena(size_t block_size);
+  ~Arena();
+
+  // Return size bytes aligned to the given power of two.
+  void* Allocate(size_t size, size_t alignment);
+
+  // Return uninitialized space for count objects of type T.
+  template <typename T>
+  T* Allocate(size_t count) {
+    return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+  }
+
+  // Forget everything allocated so far, keeping the blocks to allocate from
+  // again.
+  void Reset();
+
+  // Return the bytes handed out since the arena was created or last reset.
+  size_t bytes_allocated() const { return bytes_allocated_; }
+
+  // Return the bytes held in blocks.
+  size_t capacity() const { return capacity_; }
+
+ private:
+  Arena(const Arena&);
+  Arena& operator=(const Arena&);
+
+  struct Block {
+    Block* next;
+    size_t size;
+  };
+
+  // Return the first usable byte of the block.
+  static char* BlockData(Block* block) {
+    return reinterpret_cast<char*>(block) + sizeof(Block);
+  }
+
+  // Start allocating from the next kept block that can hold the given
+  // allocation, or from a new one.
+  void NextBlock(size_t size, size_t alignment);
+
+  size_t block_size_;
+
+  // Every block, in the order they are allocated from, and the block being
+  // allocated from now.
+  Block* blocks_;
+  Block* current_;
+
+  // The free space left in the current block.
+  char* position_;
+  char* end_;
+
+  size_t bytes_allocated_;
+  size_t capacity_;
+};
+
+// A standard allocator that takes its memory from an arena, so that standard
+// containers can live in one. Deallocation does nothing; the memory is
+// reclaimed with the arena. Containers should be reserved up front where the
+// size is known, since the space they grow out of is not reused. With a null
+// arena it allocates from the heap instead.
+template <typename T>
+class ArenaAllocator {
+ public:
+  typedef T value_type;
+
+  ArenaAllocator() : arena_(nullptr) {}
+  explicit ArenaAllocator(Arena* arena) : arena_(arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t count) {
+    if (arena_) {
+      return arena_->Allocate<T>(count);
+    }
+    return static_cast<T*>(::operator new(sizeof(T) * count));
+  }
+
+  void deallocate(T* pointer, size_t /*count*/) {
+    if (!arena_) {
+      ::operator delete(pointer);
+    }
+  }
+
+  Arena* arena() const { return arena_; }
+
+  template <typename U>
+  struct rebind {
+    typedef ArenaAllocator<U> other;
+  };
+
+ private:
+  Arena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+// A vector whose storage comes from an arena, or from the heap if its
+// allocator was given no arena.
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+}  // namespace pindrop
+
+#endif  // PINDROP_ARENA_H_
@@ -0,0 +1,46 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_ASSET_STORE_INTERNAL_STATE_H_
+#define PINDROP_ASSET_STORE_INTERNAL_STATE_H_
+
+#include <mutex>
+
+#include "file_loader.h"
+#include "sample_cache.h"
+
+namespace pindrop {
+
+// The sound data an AssetStore shares between engines.
+//
+// The loader and the sample cache are only used with the mutex held. An
+// engine holds it for as long as it is loading or unloading a sound bank, so
+// that the loader groups and sample cache entries of one engine's bank are
+// not interleaved with another's. The loader locks itself, so checking on
+// loading progress does not need the mutex.
+struct AssetStoreInternalState {
+  std::mutex mutex;
+
+  // The Sounds of the loaded SoundCollections of every engine, shared between
+  // collections that play the same file.
+  SampleCache sample_cache;
+
+  // Loads the sound files. Declared after the sample cache so that it stops
+  // loading before the Sounds it loads into are destroyed.
+  FileLoader loader;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_ASSET_STORE_INTERNAL_STATE_H_
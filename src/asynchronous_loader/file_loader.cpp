@@ -14,17 +14,216 @@
 
 #include "file_loader.h"
 
+#include <algorithm>
+#include <cassert>
+
 namespace pindrop {
 
-void FileLoader::StartLoading() { loader.StartLoading(); }
+// Resources queued outside of a group belong to this one.
+static const LoadGroupId kDefaultLoadGroup = 0;
+
+FileLoader::FileLoader()
+    : thread_count_(0),
+      started_(false),
+      stopping_(false),
+      current_group_(kDefaultLoadGroup),
+      current_priority_(0),
+      next_group_(kDefaultLoadGroup + 1),
+      next_sequence_(0),
+      queued_count_(0),
+      loaded_count_(0) {}
+
+FileLoader::~FileLoader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  job_condition_.notify_all();
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i].join();
+  }
+}
+
+void FileLoader::Initialize(unsigned int thread_count) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  thread_count_ = thread_count;
+}
+
+LoadGroupId FileLoader::BeginGroup(int priority) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  current_group_ = next_group_++;
+  if (next_group_ == kDefaultLoadGroup) {
+    ++next_group_;
+  }
+  current_priority_ = priority;
+  return current_group_;
+}
+
+void FileLoader::EndGroup() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  current_group_ = kDefaultLoadGroup;
+  current_priority_ = 0;
+}
+
+LoadGroupId FileLoader::current_group() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return current_group_;
+}
+
+void FileLoader::RaiseGroupPriority(LoadGroupId group, int priority) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto iter = jobs_.begin(); iter != jobs_.end(); ++iter) {
+    if (iter->group == group && iter->priority < priority) {
+      iter->priority = priority;
+    }
+  }
+  std::make_heap(jobs_.begin(), jobs_.end(), LessUrgent);
+}
+
+void FileLoader::CancelJob(Resource* resource) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto queued = std::find_if(
+      jobs_.begin(), jobs_.end(),
+      [resource](const Job& job) { return job.resource == resource; });
+  if (queued != jobs_.end()) {
+    LoadGroupId group = queued->group;
+    jobs_.erase(queued);
+    std::make_heap(jobs_.begin(), jobs_.end(), LessUrgent);
+    --queued_count_;
+    auto pending = pending_groups_.find(group);
+    assert(pending != pending_groups_.end());
+    if (--pending->second == 0) {
+      pending_groups_.erase(pending);
+    }
+    return;
+  }
+  finished_condition_.wait(lock, [this, resource]() {
+    return std::none_of(
+        loading_.begin(), loading_.end(),
+        [resource](const Job& job) { return job.resource == resource; });
+  });
+}
+
+bool FileLoader::GroupLoaded(LoadGroupId group) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_groups_.find(group) == pending_groups_.end();
+}
+
+void FileLoader::StartLoading() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (started_) {
+    return;
+  }
+  started_ = true;
+  unsigned int thread_count = thread_count_;
+  if (thread_count == 0) {
+    thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  for (unsigned int i = 0; i < thread_count; ++i) {
+    workers_.push_back(std::thread(&FileLoader::RunWorker, this));
+  }
+}
+
+bool FileLoader::TryFinalize() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_groups_.empty();
+}
+
+float FileLoader::Progress() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (queued_count_ == 0) {
+    return 1.0f;
+  }
+  return static_cast<float>(loaded_count_) / queued_count_;
+}
 
-bool FileLoader::TryFinalize() { return loader.TryFinalize(); }
+size_t FileLoader::queue_depth() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return jobs_.size() + loading_.size();
+}
+
+void FileLoader::QueueJob(Resource* resource) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Start counting progress afresh once everything queued so far is done.
+    if (loaded_count_ == queued_count_) {
+      loaded_count_ = 0;
+      queued_count_ = 0;
+    }
+    Job job;
+    job.resource = resource;
+    job.group = current_group_;
+    job.priority = current_priority_;
+    job.sequence = next_sequence_++;
+    jobs_.push_back(job);
+    std::push_heap(jobs_.begin(), jobs_.end(), LessUrgent);
+    ++pending_groups_[job.group];
+    ++queued_count_;
+  }
+  job_condition_.notify_one();
+}
+
+bool FileLoader::LessUrgent(const Job& a, const Job& b) {
+  if (a.priority != b.priority) {
+    return a.priority < b.priority;
+  }
+  // Compare the difference so that the order survives the sequence number
+  // wrapping around.
+  return static_cast<int>(a.sequence - b.sequence) > 0;
+}
 
-void FileLoader::QueueJob(Resource* resource) { loader.QueueJob(resource); }
+void FileLoader::RunWorker() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    job_condition_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+    if (stopping_) {
+      return;
+    }
+    std::pop_heap(jobs_.begin(), jobs_.end(), LessUrgent);
+    Job job = jobs_.back();
+    jobs_.pop_back();
+    loading_.push_back(job);
+
+    lock.unlock();
+    job.resource->Load();
+    job.resource->ready_.store(true, std::memory_order_release);
+    lock.lock();
+
+    FinishJob(job);
+  }
+}
+
+void FileLoader::FinishJob(const Job& job) {
+  auto loading =
+      std::find_if(loading_.begin(), loading_.end(), [&job](const Job& other) {
+        return other.resource == job.resource;
+      });
+  assert(loading != loading_.end());
+  loading_.erase(loading);
+  auto pending = pending_groups_.find(job.group);
+  assert(pending != pending_groups_.end());
+  if (--pending->second == 0) {
+    pending_groups_.erase(pending);
+  }
+  ++loaded_count_;
+  finished_condition_.notify_all();
+}
 
 void Resource::LoadFile(const char* filename, FileLoader* loader) {
   set_filename(filename);
   loader->QueueJob(this);
 }
 
+void Resource::LoadMemory(const char* filename, const char* data, size_t size,
+                          FileLoader* loader) {
+  data_ = data;
+  size_ = size;
+  LoadFile(filename, loader);
+}
+
+void Resource::Unload() {
+  ready_.store(false, std::memory_order_release);
+  Free();
+}
+
 }  // namespace pindrop
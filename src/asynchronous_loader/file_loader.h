@@ -15,33 +15,170 @@
 #ifndef PINDROP_ASYNCHRONOUS_LOADER_FILE_LOADER_H_
 #define PINDROP_ASYNCHRONOUS_LOADER_FILE_LOADER_H_
 
-#include "fplbase/async_loader.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace pindrop {
 
 class FileLoader;
 
-class Resource : public fplbase::AsyncAsset {
+// Identifies a group of resources queued together, such as the sounds of a
+// sound bank, so that they can be tracked and cancelled together.
+typedef unsigned int LoadGroupId;
+
+class Resource {
  public:
+  Resource() : data_(nullptr), size_(0), ready_(false) {}
+
   virtual ~Resource() {}
 
   void LoadFile(const char* filename, FileLoader* loader);
 
+  // Load the resource from memory rather than from a file. The memory must
+  // stay valid for as long as the resource is in use. The filename is only
+  // used to identify the resource.
+  void LoadMemory(const char* filename, const char* data, size_t size,
+                  FileLoader* loader);
+
+  void set_filename(const std::string& filename) { filename_ = filename; }
+
+  const std::string& filename() const { return filename_; }
+
+  // The memory to load from, or null if the resource is loaded from a file.
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Return true once the resource has been loaded, until it is unloaded. Safe
+  // to call from any thread.
+  bool ready() const { return ready_.load(std::memory_order_acquire); }
+
+  // Free what was loaded, so that the resource can be loaded again later. The
+  // resource must not be queued or being loaded.
+  void Unload();
+
  private:
-  virtual bool Finalize() { return true; };
-  virtual bool IsValid() { return true; };
+  friend class FileLoader;
+
+  // Called on one of the loader's worker threads.
+  virtual void Load() = 0;
+
+  // Called by Unload. Resources that can not be unloaded keep what they
+  // loaded.
+  virtual void Free() {}
+
+  std::string filename_;
+  const char* data_;
+  size_t size_;
+  std::atomic<bool> ready_;
 };
 
+// Loads resources on a pool of worker threads. Resources are queued in groups,
+// each with a priority, and the resources of higher priority groups are loaded
+// first. Resources of the same priority are loaded in the order they were
+// queued.
 class FileLoader {
  public:
+  FileLoader();
+
+  // Stops the worker threads. Resources still queued are not loaded.
+  ~FileLoader();
+
+  // Set the number of worker threads to start when loading begins. If zero,
+  // one thread is started per hardware thread.
+  void Initialize(unsigned int thread_count);
+
+  // Start a new group with the given priority. Resources queued until the
+  // matching EndGroup() call belong to it. Resources queued outside of a group
+  // have priority zero.
+  LoadGroupId BeginGroup(int priority);
+
+  void EndGroup();
+
+  // Return the group resources queued now are added to.
+  LoadGroupId current_group() const;
+
+  // Raise the priority of the resources of the group that are still queued to
+  // the given priority, if it is higher.
+  void RaiseGroupPriority(LoadGroupId group, int priority);
+
+  // Remove the resource from the queue, or wait for it to finish loading if it
+  // is being loaded, so that it can be safely destroyed.
+  void CancelJob(Resource* resource);
+
+  // Return true if every resource queued in the group has been loaded.
+  bool GroupLoaded(LoadGroupId group) const;
+
+  // Start loading queued resources. Resources queued from then on are loaded
+  // as soon as a worker thread is free.
   void StartLoading();
 
+  // Return true if every queued resource has been loaded.
   bool TryFinalize();
 
+  // Return the fraction of the resources queued since the loader was last idle
+  // that have been loaded, between 0 and 1.
+  float Progress() const;
+
+  // Return the number of resources queued or being loaded.
+  size_t queue_depth() const;
+
   void QueueJob(Resource* resource);
 
  private:
-  fplbase::AsyncLoader loader;
+  struct Job {
+    Resource* resource;
+    LoadGroupId group;
+    int priority;
+    // The order the job was queued in, to load jobs of the same priority
+    // first come, first served.
+    unsigned int sequence;
+  };
+
+  // Orders the heap of queued jobs so that the most urgent job is on top.
+  static bool LessUrgent(const Job& a, const Job& b);
+
+  void RunWorker();
+
+  void FinishJob(const Job& job);
+
+  mutable std::mutex mutex_;
+
+  // Signalled when a job is queued or the workers need to stop.
+  std::condition_variable job_condition_;
+
+  // Signalled when a job finishes.
+  std::condition_variable finished_condition_;
+
+  // A heap of queued jobs, ordered by LessUrgent.
+  std::vector<Job> jobs_;
+
+  // The jobs being loaded right now.
+  std::vector<Job> loading_;
+
+  // The number of resources of each group that are queued or being loaded.
+  // Groups are removed once all of their resources have been loaded.
+  std::map<LoadGroupId, unsigned int> pending_groups_;
+
+  std::vector<std::thread> workers_;
+  unsigned int thread_count_;
+  bool started_;
+  bool stopping_;
+
+  // The group and priority given to newly queued jobs.
+  LoadGroupId current_group_;
+  int current_priority_;
+  LoadGroupId next_group_;
+  unsigned int next_sequence_;
+
+  // The number of jobs queued and loaded since the loader was last idle.
+  unsigned int queued_count_;
+  unsigned int loaded_count_;
 };
 
 }  // namespace pindrop
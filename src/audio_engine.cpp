@@ -15,8 +15,14 @@
 #include "pindrop/audio_engine.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
 #include <map>
+#include <mutex>
+#include <thread>
 
 #include "SDL.h"
 #include "audio_config_generated.h"
@@ -24,6 +30,7 @@
 #include "bus_internal_state.h"
 #include "buses_generated.h"
 #include "channel_internal_state.h"
+#include "file_buffer.h"
 #include "file_loader.h"
 #include "listener_internal_state.h"
 #include "mathfu/constants.h"
@@ -38,27 +45,68 @@ namespace pindrop {
 typedef flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>
     BusNameList;
 
-bool LoadFile(const char* filename, std::string* dest) {
-  auto handle = SDL_RWFromFile(filename, "rb");
-  if (!handle) {
-    CallLogFunc("LoadFile fail on %s", filename);
-    return false;
+ChannelInternalState* FindChannelInternalState(AudioEngineInternalState* state,
+                                               ChannelId id) {
+  size_t index = ChannelIdIndex(id);
+  if (index >= state->channel_state_memory.size() ||
+      state->channel_table.generation[index] != ChannelIdGeneration(id)) {
+    return nullptr;
+  }
+  return &state->channel_state_memory[index];
+}
+
+// Returns a Channel referring to the given channel state, which may be null.
+static Channel MakeChannel(AudioEngineInternalState* state,
+                           const ChannelInternalState* channel) {
+  return channel ? Channel(state, channel->id()) : Channel();
+}
+
+static void RunUpdateThread(AudioEngineInternalState* state);
+static void PublishChannel(const ChannelInternalState& channel,
+                           PublishedChannel* published);
+static void PublishChannels(AudioEngineInternalState* state);
+
+static void StopUpdateThread(AudioEngineInternalState* state) {
+  if (!state->update_thread.joinable()) {
+    return;
   }
-  size_t len = static_cast<size_t>(SDL_RWsize(handle));
-  dest->assign(len + 1, 0);
-  size_t rlen = SDL_RWread(handle, &(*dest)[0], 1, len);
-  SDL_RWclose(handle);
-  return len == rlen && len > 0;
+  {
+    std::lock_guard<std::mutex> lock(state->publish_mutex);
+    state->stop_update_thread = true;
+  }
+  state->update_condition.notify_one();
+  state->update_thread.join();
 }
 
-AudioEngine::~AudioEngine() { delete state_; }
+AudioEngine::~AudioEngine() {
+  if (state_) {
+    StopUpdateThread(state_);
+    // The loader may outlive the engine, so it must let go of the files it is
+    // reading for the engine's banks.
+    std::vector<PendingSoundBank>& pending = state_->pending_sound_banks;
+    for (size_t i = 0; i < pending.size(); ++i) {
+      state_->assets->loader.CancelJob(pending[i].files.get());
+    }
+    // The sound collections live in their banks' arenas, so they are destroyed
+    // by unloading the banks rather than along with the state.
+    std::lock_guard<std::mutex> assets_lock(state_->assets->mutex);
+    for (auto iter = state_->sound_bank_map.begin();
+         iter != state_->sound_bank_map.end(); ++iter) {
+      if (iter->second->ref_counter()->count() > 0) {
+        iter->second->Deinitialize(this);
+      }
+    }
+    state_->assets->sample_cache.RemoveMixer(&state_->mixer);
+  }
+  delete state_;
+}
 
 BusInternalState* FindBusInternalState(AudioEngineInternalState* state,
                                        const char* name) {
   auto it =
       std::find_if(state->buses.begin(), state->buses.end(),
                    [name](const BusInternalState& bus) {
-                     return strcmp(bus.bus_def()->name()->c_str(), name) == 0;
+                     return bus.name() == name;
                    });
   if (it != state->buses.end()) {
     return &*it;
@@ -85,27 +133,128 @@ static bool PopulateBuses(AudioEngineInternalState* state,
   return true;
 }
 
+static int FindBusDefIndex(const BusDefList* bus_def_list, const char* name) {
+  for (flatbuffers::uoffset_t i = 0; i < bus_def_list->buses()->Length(); ++i) {
+    if (strcmp(bus_def_list->buses()->Get(i)->name()->c_str(), name) == 0) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+// Order the bus definitions so that every bus comes after its parent, starting
+// with the master bus. The order is given as indices into the BusDefList, and
+// the parent of each bus as an index into the new order. Buses that are not
+// the child of any other bus have no parent. If a bus is listed as the child of
+// more than one bus, only the first parent found is used.
+static void SortBusDefs(const BusDefList* bus_def_list, std::vector<int>* order,
+                        std::vector<int>* parents) {
+  int bus_count = static_cast<int>(bus_def_list->buses()->Length());
+  order->clear();
+  parents->clear();
+
+  // Buses are visited starting from the master bus, then from any other bus
+  // that is not a child, and finally from anything left over (which can only
+  // happen if the child lists form a cycle).
+  std::vector<int> roots;
+  std::vector<bool> is_child(bus_count, false);
+  for (int i = 0; i < bus_count; ++i) {
+    auto child_buses = bus_def_list->buses()->Get(i)->child_buses();
+    for (flatbuffers::uoffset_t j = 0; child_buses && j < child_buses->Length();
+         ++j) {
+      int child = FindBusDefIndex(bus_def_list, child_buses->Get(j)->c_str());
+      if (child >= 0) {
+        is_child[child] = true;
+      }
+    }
+  }
+  int master = FindBusDefIndex(bus_def_list, "master");
+  if (master >= 0) {
+    roots.push_back(master);
+  }
+  for (int i = 0; i < bus_count; ++i) {
+    if (!is_child[i]) {
+      roots.push_back(i);
+    }
+  }
+  for (int i = 0; i < bus_count; ++i) {
+    roots.push_back(i);
+  }
+
+  std::vector<int> position(bus_count, -1);
+  for (size_t root = 0; root < roots.size(); ++root) {
+    int start = roots[root];
+    if (position[start] >= 0) {
+      continue;
+    }
+    // Breadth first, so each bus is added once all of the buses above it are.
+    position[start] = static_cast<int>(order->size());
+    order->push_back(start);
+    parents->push_back(BusInternalState::kNoParent);
+    for (size_t i = order->size() - 1; i < order->size(); ++i) {
+      auto child_buses = bus_def_list->buses()->Get((*order)[i])->child_buses();
+      for (flatbuffers::uoffset_t j = 0;
+           child_buses && j < child_buses->Length(); ++j) {
+        int child = FindBusDefIndex(bus_def_list, child_buses->Get(j)->c_str());
+        if (child < 0) {
+          // Unknown buses are reported by PopulateBuses.
+          continue;
+        }
+        if (position[child] >= 0) {
+          CallLogFunc("Bus \"%s\" is the child of more than one bus.\n",
+                      child_buses->Get(j)->c_str());
+          continue;
+        }
+        position[child] = static_cast<int>(order->size());
+        order->push_back(child);
+        parents->push_back(static_cast<int>(i));
+      }
+    }
+  }
+}
+
+// The number of times over the command queue can be filled before the
+// channel a ticket was played on can no longer be looked up.
+static const size_t kTicketLaps = 4;
+
+static const float kMillisecondsPerSecond = 1000.0f;
+
+// The priority of the group that reads the files of the sound banks queued by
+// LoadSoundBanksAsync, which is above that of any sound file.
+static const int kSoundBankFilesPriority = std::numeric_limits<int>::max();
+
 // The InternalChannelStates have three lists they are a part of: The engine's
 // priority list, the bus's playing sound list, and which free list they are in.
 // Initially, all nodes are in a free list becuase nothing is playing. Seperate
-// free lists are kept for real channels and virtual channels (where 'real'
-// channels are channels that have a channel_id
+// free lists are kept for real channels, stream channels and virtual channels
+// (where 'real' channels are channels that have a channel_id, and stream
+// channels are the real channels kept for streamed sounds). The real and stream
+// channels play on the given mixer.
 static void InitializeChannelFreeLists(
-    FreeList* real_channel_free_list, FreeList* virtual_channel_free_list,
-    std::vector<ChannelInternalState>* channels, unsigned int virtual_channels,
-    unsigned int real_channels) {
+    Mixer* mixer, FreeList* real_channel_free_list,
+    FreeList* stream_channel_free_list, FreeList* virtual_channel_free_list,
+    std::vector<ChannelInternalState>* channels, ChannelTable* channel_table,
+    unsigned int virtual_channels, unsigned int real_channels,
+    unsigned int stream_channels) {
   // We do our own tracking of audio channels so that when a new sound is
   // played we can determine if one of the currently playing channels is lower
   // priority so that we can drop it.
-  unsigned int total_channels = real_channels + virtual_channels;
+  unsigned int total_channels =
+      real_channels + stream_channels + virtual_channels;
   channels->resize(total_channels);
+  channel_table->Resize(total_channels);
   for (size_t i = 0; i < total_channels; ++i) {
     ChannelInternalState& channel = (*channels)[i];
+    channel.AttachToTable(channel_table, i);
 
-    // Track real channels separately from virtual channels.
+    // Track real and stream channels separately from virtual channels.
     if (i < real_channels) {
-      channel.real_channel().Initialize(static_cast<int>(i));
+      channel.InitializeRealChannel(mixer, static_cast<int>(i));
       real_channel_free_list->push_front(channel);
+    } else if (i < real_channels + stream_channels) {
+      channel.InitializeStreamChannel(mixer,
+                                      static_cast<int>(i - real_channels));
+      stream_channel_free_list->push_front(channel);
     } else {
       virtual_channel_free_list->push_front(channel);
     }
@@ -124,29 +273,96 @@ static void InitializeListenerFreeList(
 }
 
 bool AudioEngine::Initialize(const char* config_file) {
-  std::string audio_config_source;
-  if (!LoadFile(config_file, &audio_config_source)) {
+  return Initialize(config_file, AssetStore());
+}
+
+bool AudioEngine::Initialize(const char* config_file,
+                             const AssetStore& asset_store) {
+  FileBuffer audio_config_source;
+  if (!audio_config_source.Load(config_file)) {
     CallLogFunc("Could not load audio config file.\n");
     return false;
   }
-  return Initialize(GetAudioConfig(audio_config_source.c_str()));
+  return Initialize(GetAudioConfig(audio_config_source.data()), asset_store);
 }
 
 bool AudioEngine::Initialize(const AudioConfig* config) {
+  return Initialize(config, AssetStore());
+}
+
+bool AudioEngine::Initialize(const AudioConfig* config,
+                             const AssetStore& asset_store) {
   // Construct internals.
   state_ = new AudioEngineInternalState();
+  state_->assets = asset_store.state();
   state_->version = &Version();
 
+  // Channels and buses are controlled through the command queue while the
+  // engine updates on its own thread.
+  if (config->update_frequency() > 0.0f && config->command_queue_size() == 0) {
+    CallLogFunc("An update_frequency requires a command_queue_size.\n");
+    return false;
+  }
+
   // Initialize audio engine.
   if (!state_->mixer.Initialize(config)) {
     return false;
   }
 
   // Initialize the channel internal data.
+  if (config->mixer_channels() + config->mixer_stream_channels() +
+          config->mixer_virtual_channels() >
+      kMaxChannelPoolSize) {
+    CallLogFunc("Too many channels; at most %u are supported.\n",
+                static_cast<unsigned int>(kMaxChannelPoolSize));
+    return false;
+  }
   InitializeChannelFreeLists(
-      &state_->real_channel_free_list, &state_->virtual_channel_free_list,
-      &state_->channel_state_memory, config->mixer_virtual_channels(),
-      config->mixer_channels());
+      &state_->mixer, &state_->real_channel_free_list,
+      &state_->stream_channel_free_list, &state_->virtual_channel_free_list,
+      &state_->channel_state_memory, &state_->channel_table,
+      config->mixer_virtual_channels(), config->mixer_channels(),
+      config->mixer_stream_channels());
+
+  state_->real_channel_count = config->mixer_channels();
+  state_->stream_channel_count = config->mixer_stream_channels();
+  state_->attenuation_lut_size = config->attenuation_lut_size();
+  state_->assets->loader.Initialize(config->loader_threads());
+  {
+    SampleCache& sample_cache = state_->assets->sample_cache;
+    std::lock_guard<std::mutex> assets_lock(state_->assets->mutex);
+    sample_cache.AddMixer(&state_->mixer);
+    if (config->sample_budget() > 0) {
+      sample_cache.set_budget(config->sample_budget());
+    }
+    state_->pin_sounds = sample_cache.budget() > 0;
+  }
+  state_->mixer_update_threshold = config->mixer_update_threshold();
+  state_->channel_table.grid.set_cell_size(config->culling_cell_size());
+  state_->lod_update_interval = config->lod_update_interval();
+  state_->lod_cutoff_ratio = config->lod_cutoff_ratio();
+  state_->steal_priority_margin = config->steal_priority_margin();
+  state_->min_real_channel_time = config->min_real_channel_time();
+  state_->steal_fade_milliseconds = static_cast<int>(
+      config->steal_fade_time() * kMillisecondsPerSecond + 0.5f);
+  state_->reranked_channels.reserve(state_->channel_state_memory.size());
+  uint32_t seed = config->random_seed();
+  if (seed == 0) {
+    seed = static_cast<uint32_t>(
+        std::chrono::steady_clock::now().time_since_epoch().count());
+  }
+  state_->random.Seed(seed);
+
+  // Set up the queue used to control the engine from other threads.
+  state_->next_ticket.store(kInvalidChannelTicket + 1);
+  if (config->command_queue_size() > 0) {
+    state_->command_queue.Initialize(config->command_queue_size());
+    size_t capacity = state_->command_queue.capacity();
+    state_->ticket_channels.resize(capacity * kTicketLaps);
+    state_->pending_plays.resize(capacity * kTicketLaps);
+    state_->queued_requests.reserve(capacity);
+    state_->queued_tickets.reserve(capacity);
+  }
 
   // Initialize the listener internal data.
   InitializeListenerFreeList(&state_->listener_state_free_list,
@@ -154,15 +370,20 @@ bool AudioEngine::Initialize(const AudioConfig* config) {
                              config->listeners());
 
   // Load the audio buses.
-  if (!LoadFile(config->bus_file()->c_str(), &state_->buses_source)) {
+  if (!state_->buses_source.Load(config->bus_file()->c_str())) {
     CallLogFunc("Could not load audio bus file.\n");
     return false;
   }
   const BusDefList* bus_def_list =
-      pindrop::GetBusDefList(state_->buses_source.c_str());
-  state_->buses.resize(bus_def_list->buses()->Length());
-  for (flatbuffers::uoffset_t i = 0; i < bus_def_list->buses()->Length(); ++i) {
-    state_->buses[i].Initialize(bus_def_list->buses()->Get(i));
+      pindrop::GetBusDefList(state_->buses_source.data());
+  std::vector<int> bus_order;
+  std::vector<int> bus_parents;
+  SortBusDefs(bus_def_list, &bus_order, &bus_parents);
+  state_->buses.resize(bus_order.size());
+  state_->bus_gains.resize(bus_order.size(), 0.0f);
+  for (size_t i = 0; i < bus_order.size(); ++i) {
+    state_->buses[i].Initialize(bus_def_list->buses()->Get(bus_order[i]), i,
+                                bus_parents[i], state_);
   }
 
   // Set up the children and ducking pointers.
@@ -188,27 +409,150 @@ bool AudioEngine::Initialize(const AudioConfig* config) {
   state_->paused = false;
   state_->mute = false;
   state_->master_gain = 1.0f;
+  state_->applied_master_gain = -1.0f;
+
+  // Optionally move the update onto a thread of its own. From here on the
+  // listeners only see changes made by the game once they are published.
+  state_->update_frequency = config->update_frequency();
+  state_->stop_update_thread = false;
+  if (state_->update_frequency > 0.0f) {
+    for (size_t i = 0; i < state_->listener_state_memory.size(); ++i) {
+      state_->listener_state_memory[i].set_buffered(true);
+    }
+    state_->published_channels.resize(state_->channel_state_memory.size());
+    PublishChannels(state_);
+    state_->update_thread = std::thread(RunUpdateThread, state_);
+  }
 
   return true;
 }
 
 bool AudioEngine::LoadSoundBank(const std::string& filename) {
+  return LoadSoundBank(filename, 0, nullptr, nullptr);
+}
+
+// Load a sound bank, or count another reference to it if it is already
+// loaded, and keep the callback to make once its sound files have loaded.
+// files holds the bank's files if they have been read already, and is null
+// otherwise. Called with the update lock and the asset store's mutex held.
+static bool LoadSoundBankLocked(AudioEngine* audio_engine,
+                                const std::string& filename,
+                                SoundBankFiles* files, int priority,
+                                SoundBankLoadedCallback callback,
+                                void* userdata) {
+  AudioEngineInternalState* state = audio_engine->state();
   bool success = true;
-  auto iter = state_->sound_bank_map.find(filename);
-  if (iter == state_->sound_bank_map.end()) {
-    auto& sound_bank = state_->sound_bank_map[filename];
+  std::unique_ptr<SoundBank>& sound_bank = state->sound_bank_map[filename];
+  if (!sound_bank) {
     sound_bank.reset(new SoundBank());
-    success = sound_bank->Initialize(filename, this);
+  }
+  if (sound_bank->ref_counter()->count() == 0) {
+    success = files ? sound_bank->Initialize(files, priority, audio_engine)
+                    : sound_bank->Initialize(filename, priority, audio_engine);
     if (success) {
       sound_bank->ref_counter()->Increment();
+    } else {
+      // Give back whatever was loaded, so that loading the bank again starts
+      // afresh.
+      sound_bank->Deinitialize(audio_engine);
     }
   } else {
-    iter->second->ref_counter()->Increment();
+    sound_bank->ref_counter()->Increment();
+    sound_bank->RaisePriority(priority, &state->assets->loader);
+  }
+  if (success && callback) {
+    PendingSoundBankCallback pending = {filename, callback, userdata};
+    state->sound_bank_callbacks.push_back(pending);
   }
   return success;
 }
 
+bool AudioEngine::LoadSoundBank(const std::string& filename, int priority,
+                                SoundBankLoadedCallback callback,
+                                void* userdata) {
+  UpdateLock lock(state_);
+  std::lock_guard<std::mutex> assets_lock(state_->assets->mutex);
+  return LoadSoundBankLocked(this, filename, nullptr, priority, callback,
+                             userdata);
+}
+
+// Load the sound banks queued by LoadSoundBanksAsync whose files have been
+// read, which queues their sound files for loading.
+static void LoadReadSoundBanks(AudioEngine* audio_engine) {
+  AudioEngineInternalState* state = audio_engine->state();
+  std::vector<PendingSoundBank>& pending = state->pending_sound_banks;
+  for (size_t i = 0; i < pending.size();) {
+    SoundBankFiles* files = pending[i].files.get();
+    if (!files->ready()) {
+      ++i;
+      continue;
+    }
+    if (!files->success ||
+        !LoadSoundBankLocked(audio_engine, pending[i].filename, files,
+                             pending[i].priority, pending[i].callback,
+                             pending[i].userdata)) {
+      CallLogFunc("Could not load sound bank %s.\n",
+                  pending[i].filename.c_str());
+    }
+    pending.erase(pending.begin() + i);
+  }
+}
+
+void AudioEngine::LoadSoundBanksAsync(const std::vector<std::string>& filenames,
+                                      SoundBankLoadedCallback callback,
+                                      void* userdata) {
+  LoadSoundBanksAsync(filenames, 0, callback, userdata);
+}
+
+void AudioEngine::LoadSoundBanksAsync(const std::vector<std::string>& filenames,
+                                      int priority,
+                                      SoundBankLoadedCallback callback,
+                                      void* userdata) {
+  UpdateLock lock(state_);
+  AssetStoreInternalState* assets = state_->assets.get();
+  std::lock_guard<std::mutex> assets_lock(assets->mutex);
+  // The banks' files are read ahead of any sound files, since those can only
+  // be queued once the banks have been read.
+  assets->loader.BeginGroup(kSoundBankFilesPriority);
+  for (size_t i = 0; i < filenames.size(); ++i) {
+    auto iter = state_->sound_bank_map.find(filenames[i]);
+    if (iter != state_->sound_bank_map.end() &&
+        iter->second->ref_counter()->count() > 0) {
+      // There is nothing to read for a bank that is already loaded.
+      LoadSoundBankLocked(this, filenames[i], nullptr, priority, callback,
+                          userdata);
+      continue;
+    }
+    PendingSoundBank pending;
+    pending.filename = filenames[i];
+    pending.priority = priority;
+    pending.callback = callback;
+    pending.userdata = userdata;
+    pending.files.reset(new SoundBankFiles());
+    SoundBankFiles* files = pending.files.get();
+    state_->pending_sound_banks.push_back(std::move(pending));
+    files->LoadFile(filenames[i].c_str(), &assets->loader);
+  }
+  assets->loader.EndGroup();
+  assets->loader.StartLoading();
+  // Files that were read straight away, as they are by the synchronous
+  // loader, need not wait for TryFinalize.
+  LoadReadSoundBanks(this);
+}
+
 void AudioEngine::UnloadSoundBank(const std::string& filename) {
+  UpdateLock lock(state_);
+  std::lock_guard<std::mutex> assets_lock(state_->assets->mutex);
+  // A bank whose files are still being read is simply forgotten, starting
+  // with the one queued last.
+  std::vector<PendingSoundBank>& pending = state_->pending_sound_banks;
+  for (size_t i = pending.size(); i > 0; --i) {
+    if (pending[i - 1].filename == filename) {
+      state_->assets->loader.CancelJob(pending[i - 1].files.get());
+      pending.erase(pending.begin() + (i - 1));
+      return;
+    }
+  }
   auto iter = state_->sound_bank_map.find(filename);
   if (iter == state_->sound_bank_map.end()) {
     CallLogFunc(
@@ -221,21 +565,81 @@ void AudioEngine::UnloadSoundBank(const std::string& filename) {
   }
 }
 
-void AudioEngine::StartLoadingSoundFiles() { state_->loader.StartLoading(); }
+void AudioEngine::StartLoadingSoundFiles() {
+  state_->assets->loader.StartLoading();
+}
 
-bool AudioEngine::TryFinalize() { return state_->loader.TryFinalize(); }
+bool AudioEngine::TryFinalize() {
+  {
+    UpdateLock lock(state_);
+    std::lock_guard<std::mutex> assets_lock(state_->assets->mutex);
+    LoadReadSoundBanks(this);
+  }
+  bool finalized = state_->assets->loader.TryFinalize();
+  std::vector<PendingSoundBankCallback> loaded;
+  {
+    UpdateLock lock(state_);
+    finalized = finalized && state_->pending_sound_banks.empty();
+    std::vector<PendingSoundBankCallback>& pending =
+        state_->sound_bank_callbacks;
+    for (size_t i = 0; i < pending.size();) {
+      auto iter = state_->sound_bank_map.find(pending[i].filename);
+      bool unloaded = iter == state_->sound_bank_map.end() ||
+                      iter->second->ref_counter()->count() == 0;
+      if (unloaded || iter->second->Loaded(state_->assets->loader)) {
+        if (!unloaded) {
+          loaded.push_back(pending[i]);
+        }
+        pending.erase(pending.begin() + i);
+      } else {
+        ++i;
+      }
+    }
+  }
+  // The callbacks are made without the lock held, so that they may load more
+  // sound banks.
+  for (size_t i = 0; i < loaded.size(); ++i) {
+    loaded[i].callback(loaded[i].filename, loaded[i].userdata);
+  }
+  return finalized;
+}
 
-bool BestListener(ListenerList::const_iterator* best_listener,
-                  float* distance_squared,
-                  mathfu::Vector<float, 3>* listener_space_location,
-                  const ListenerList& listener_list,
-                  const mathfu::Vector<float, 3>& location) {
-  if (listener_list.empty()) {
-    return false;
+bool AudioEngine::SoundBankLoaded(const std::string& filename) const {
+  UpdateLock lock(state_);
+  auto iter = state_->sound_bank_map.find(filename);
+  return iter != state_->sound_bank_map.end() &&
+         iter->second->ref_counter()->count() > 0 &&
+         iter->second->Loaded(state_->assets->loader);
+}
+
+float AudioEngine::LoadProgress() const {
+  return state_->assets->loader.Progress();
+}
+
+void AudioEngine::PrefetchSound(SoundHandle sound_handle) {
+  SoundCollection* collection = sound_handle;
+  if (!collection) {
+    CallLogFunc("Cannot prefetch sound: invalid sound handle\n");
+    return;
   }
+  UpdateLock lock(state_);
+  AssetStoreInternalState* assets = state_->assets.get();
+  std::lock_guard<std::mutex> assets_lock(assets->mutex);
+  const SoundList& sounds = collection->sounds();
+  for (size_t i = 0; i < sounds.size(); ++i) {
+    assets->sample_cache.Prefetch(sounds[i], &assets->loader);
+  }
+}
+
+// Find the listener the location is nearest to in its listener space, which
+// takes a transform for every listener.
+static void BestListenerInListenerSpace(
+    ListenerList::const_iterator* best_listener, float* distance_squared,
+    mathfu::Vector<float, 3>* listener_space_location,
+    const ListenerList& listener_list,
+    const mathfu::Vector<float, 3>& location) {
   ListenerList::const_iterator listener = listener_list.cbegin();
-  mathfu::Matrix<float, 4, 4> mat = listener->inverse_matrix();
-  *listener_space_location = mat * location;
+  *listener_space_location = listener->inverse_matrix() * location;
   *distance_squared = listener_space_location->LengthSquared();
   *best_listener = listener;
   for (++listener; listener != listener_list.cend(); ++listener) {
@@ -248,6 +652,43 @@ bool BestListener(ListenerList::const_iterator* best_listener,
       *listener_space_location = transformed_location;
     }
   }
+}
+
+// The nearest listener is found by world space distance, which is the same as
+// the distance in listener space for rigid transforms, so only the nearest
+// listener's inverse matrix is needed. If any listener's matrix scales, the
+// distances are compared in each listener's space instead.
+bool BestListener(ListenerList::const_iterator* best_listener,
+                  float* distance_squared,
+                  mathfu::Vector<float, 3>* listener_space_location,
+                  const ListenerList& listener_list,
+                  const mathfu::Vector<float, 3>& location) {
+  if (listener_list.empty()) {
+    return false;
+  }
+  ListenerList::const_iterator listener = listener_list.cbegin();
+  for (; listener != listener_list.cend(); ++listener) {
+    if (!listener->rigid()) {
+      BestListenerInListenerSpace(best_listener, distance_squared,
+                                  listener_space_location, listener_list,
+                                  location);
+      return true;
+    }
+  }
+  listener = listener_list.cbegin();
+  float best_distance_squared =
+      (listener->location() - location).LengthSquared();
+  *best_listener = listener;
+  for (++listener; listener != listener_list.cend(); ++listener) {
+    float magnitude_squared =
+        (listener->location() - location).LengthSquared();
+    if (magnitude_squared < best_distance_squared) {
+      *best_listener = listener;
+      best_distance_squared = magnitude_squared;
+    }
+  }
+  *listener_space_location = (*best_listener)->inverse_matrix() * location;
+  *distance_squared = listener_space_location->LengthSquared();
   return true;
 }
 
@@ -273,41 +714,62 @@ float AttenuationCurve(float point, float lower_bound, float upper_bound,
   return distance / ((range - distance) * (curve_factor - 1.0f) + range);
 }
 
-inline float Square(float f) { return f * f; }
-
 float CalculateDistanceAttenuation(float distance_squared,
-                                   const SoundCollectionDef* def) {
-  if (distance_squared < Square(def->min_audible_radius()) ||
-      distance_squared > Square(def->max_audible_radius())) {
+                                   const SoundCollectionParams& params) {
+  if (distance_squared < params.min_audible_radius_squared ||
+      distance_squared > params.max_audible_radius_squared) {
     return 0.0f;
   }
+  if (params.attenuation_table) {
+    // Interpolate between the two nearest table entries.
+    float position = (distance_squared - params.min_audible_radius_squared) *
+                     params.attenuation_table_scale;
+    size_t index = static_cast<size_t>(position);
+    if (index >= params.attenuation_table_size - 1) {
+      return params.attenuation_table[params.attenuation_table_size - 1];
+    }
+    float a = params.attenuation_table[index];
+    float b = params.attenuation_table[index + 1];
+    return a + (b - a) * (position - static_cast<float>(index));
+  }
+  // These are AttenuationCurve with the ranges precomputed.
   float distance = std::sqrt(distance_squared);
-  if (distance < def->roll_in_radius()) {
-    return AttenuationCurve(distance, def->min_audible_radius(),
-                            def->roll_in_radius(), def->roll_in_curve_factor());
-  } else if (distance > def->roll_out_radius()) {
-    return 1.0f - AttenuationCurve(distance, def->roll_out_radius(),
-                                   def->max_audible_radius(),
-                                   def->roll_out_curve_factor());
+  if (distance < params.roll_in_radius) {
+    float offset = distance - params.min_audible_radius;
+    return offset / ((params.roll_in_range - offset) *
+                         (params.roll_in_curve_factor - 1.0f) +
+                     params.roll_in_range);
+  } else if (distance > params.roll_out_radius) {
+    float offset = distance - params.roll_out_radius;
+    return 1.0f - offset / ((params.roll_out_range - offset) *
+                                (params.roll_out_curve_factor - 1.0f) +
+                            params.roll_out_range);
   } else {
     return 1.0f;
   }
 }
 
+float CalculateDistanceAttenuation(float distance_squared,
+                                   const SoundCollectionDef* def) {
+  SoundCollectionParams params;
+  params.Initialize(def);
+  return CalculateDistanceAttenuation(distance_squared, params);
+}
+
 static void CalculateGainAndPan(float* gain, mathfu::Vector<float, 2>* pan,
                                 SoundCollection* collection,
                                 const mathfu::Vector<float, 3>& location,
                                 const ListenerList& listener_list,
                                 float user_gain) {
-  const SoundCollectionDef* def = collection->GetSoundCollectionDef();
-  *gain = def->gain() * collection->bus()->gain() * user_gain;
-  if (def->mode() == Mode_Positional) {
+  const SoundCollectionParams& params = collection->params();
+  *gain = params.gain * collection->bus()->gain() * user_gain;
+  if (params.positional) {
     ListenerList::const_iterator listener;
     float distance_squared;
     mathfu::Vector<float, 3> listener_space_location;
     if (BestListener(&listener, &distance_squared, &listener_space_location,
                      listener_list, location)) {
-      *gain *= CalculateDistanceAttenuation(distance_squared, def);
+      *gain *= CalculateDistanceAttenuation(distance_squared, params);
       *pan = CalculatePan(listener_space_location);
     } else {
       *gain = 0.0f;
@@ -318,6 +780,241 @@ static void CalculateGainAndPan(float* gain, mathfu::Vector<float, 2>* pan,
   }
 }
 
+bool BestListenerBatch(float* distance_squared, float* listener_space_x,
+                       float* listener_space_y, float* listener_space_z,
+                       const ListenerList& listener_list, const float* x,
+                       const float* y, const float* z, size_t count) {
+  ListenerTable listeners;
+  listeners.Gather(listener_list.cbegin(), listener_list.cend());
+  return BestListenerBatch(distance_squared, listener_space_x,
+                           listener_space_y, listener_space_z, listeners, x, y,
+                           z, count, nullptr);
+}
+
+// Transform a point into the space of one listener in the table.
+static void ToListenerSpace(float* local, const ListenerTable& listeners,
+                            size_t l, float x, float y, float z) {
+  for (int row = 0; row < ListenerTable::kRowCount; ++row) {
+    local[row] = listeners.row_x[row][l] * x + listeners.row_y[row][l] * y +
+                 listeners.row_z[row][l] * z + listeners.row_w[row][l];
+  }
+}
+
+// The same search as BestListener, for a single location against a
+// ListenerTable.
+static void BestListenerInTable(float* distance_squared,
+                                float* listener_space_x,
+                                float* listener_space_y,
+                                float* listener_space_z,
+                                const ListenerTable& listeners, float x,
+                                float y, float z) {
+  float local[ListenerTable::kRowCount];
+  if (!listeners.rigid) {
+    for (size_t l = 0; l < listeners.size(); ++l) {
+      ToListenerSpace(local, listeners, l, x, y, z);
+      float magnitude_squared =
+          local[0] * local[0] + local[1] * local[1] + local[2] * local[2];
+      if (l == 0 || magnitude_squared < *distance_squared) {
+        *listener_space_x = local[0];
+        *listener_space_y = local[1];
+        *listener_space_z = local[2];
+        *distance_squared = magnitude_squared;
+      }
+    }
+    return;
+  }
+  size_t best = 0;
+  float best_distance_squared = 0.0f;
+  for (size_t l = 0; l < listeners.size(); ++l) {
+    float dx = x - listeners.location_x[l];
+    float dy = y - listeners.location_y[l];
+    float dz = z - listeners.location_z[l];
+    float magnitude_squared = dx * dx + dy * dy + dz * dz;
+    if (l == 0 || magnitude_squared < best_distance_squared) {
+      best = l;
+      best_distance_squared = magnitude_squared;
+    }
+  }
+  ToListenerSpace(local, listeners, best, x, y, z);
+  *listener_space_x = local[0];
+  *listener_space_y = local[1];
+  *listener_space_z = local[2];
+  *distance_squared =
+      local[0] * local[0] + local[1] * local[1] + local[2] * local[2];
+}
+
+bool BestListenerBatch(float* distance_squared, float* listener_space_x,
+                       float* listener_space_y, float* listener_space_z,
+                       const ListenerTable& listeners, const float* x,
+                       const float* y, const float* z, size_t count,
+                       const uint8_t* update) {
+  if (listeners.empty()) {
+    return false;
+  }
+  auto skip = [update](size_t i) { return update && !update[i]; };
+  typedef mathfu::Vector<float, 4> Lanes;
+  const size_t kLaneCount = 4;
+  const size_t listener_count = listeners.size();
+  // The lanes compare world space distances, so listeners that scale are
+  // searched one emitter at a time in listener space.
+  size_t batched_count = listeners.rigid ? count - count % kLaneCount : 0;
+  for (size_t i = 0; i < batched_count; i += kLaneCount) {
+    if (skip(i) && skip(i + 1) && skip(i + 2) && skip(i + 3)) {
+      continue;
+    }
+    Lanes emitter_x(x + i);
+    Lanes emitter_y(y + i);
+    Lanes emitter_z(z + i);
+
+    // Find the nearest listener to each of the four emitters in world space.
+    // Ties go to the earlier listener, as in BestListener.
+    Lanes best_distance_squared(0.0f);
+    size_t best[kLaneCount] = {0, 0, 0, 0};
+    for (size_t l = 0; l < listener_count; ++l) {
+      Lanes dx = emitter_x - Lanes(listeners.location_x[l]);
+      Lanes dy = emitter_y - Lanes(listeners.location_y[l]);
+      Lanes dz = emitter_z - Lanes(listeners.location_z[l]);
+      Lanes magnitude_squared = dx * dx + dy * dy + dz * dz;
+      if (l == 0) {
+        best_distance_squared = magnitude_squared;
+        continue;
+      }
+      for (size_t lane = 0; lane < kLaneCount; ++lane) {
+        if (magnitude_squared[lane] < best_distance_squared[lane]) {
+          best_distance_squared[lane] = magnitude_squared[lane];
+          best[lane] = l;
+        }
+      }
+    }
+
+    // Transform each emitter into the space of its nearest listener, with the
+    // rows of the listeners' inverse matrices gathered across the lanes.
+    Lanes local[ListenerTable::kRowCount];
+    for (int row = 0; row < ListenerTable::kRowCount; ++row) {
+      const std::vector<float>& rx = listeners.row_x[row];
+      const std::vector<float>& ry = listeners.row_y[row];
+      const std::vector<float>& rz = listeners.row_z[row];
+      const std::vector<float>& rw = listeners.row_w[row];
+      local[row] = Lanes(rx[best[0]], rx[best[1]], rx[best[2]], rx[best[3]]) *
+                       emitter_x +
+                   Lanes(ry[best[0]], ry[best[1]], ry[best[2]], ry[best[3]]) *
+                       emitter_y +
+                   Lanes(rz[best[0]], rz[best[1]], rz[best[2]], rz[best[3]]) *
+                       emitter_z +
+                   Lanes(rw[best[0]], rw[best[1]], rw[best[2]], rw[best[3]]);
+    }
+    Lanes magnitude_squared =
+        local[0] * local[0] + local[1] * local[1] + local[2] * local[2];
+    for (size_t lane = 0; lane < kLaneCount; ++lane) {
+      if (skip(i + lane)) {
+        continue;
+      }
+      distance_squared[i + lane] = magnitude_squared[lane];
+      listener_space_x[i + lane] = local[0][lane];
+      listener_space_y[i + lane] = local[1][lane];
+      listener_space_z[i + lane] = local[2][lane];
+    }
+  }
+  // Any emitters that do not fill a full set of lanes, or every emitter if a
+  // listener scales, are done one at a time.
+  for (size_t i = batched_count; i < count; ++i) {
+    if (skip(i)) {
+      continue;
+    }
+    BestListenerInTable(&distance_squared[i], &listener_space_x[i],
+                        &listener_space_y[i], &listener_space_z[i], listeners,
+                        x[i], y[i], z[i]);
+  }
+  return true;
+}
+
+// Given the squared distance to and listener space location of a sound as
+// found by BestListenerBatch, compute its gain and pan. This gives the same
+// results as CalculateGainAndPan, but reuses the squared distance to normalize
+// the pan.
+static void CalculateGainAndPanInListenerSpace(
+    float* gain, float* pan_x, float* pan_y, SoundCollection* collection,
+    float bus_gain, float user_gain, bool has_listener, float distance_squared,
+    float listener_space_x, float listener_space_z) {
+  const float kEpsilon = 0.0001f;
+  const SoundCollectionParams& params = collection->params();
+  *gain = params.gain * bus_gain * user_gain;
+  *pan_x = 0.0f;
+  *pan_y = 0.0f;
+  if (params.positional) {
+    if (has_listener) {
+      *gain *= CalculateDistanceAttenuation(distance_squared, params);
+      if (distance_squared > kEpsilon) {
+        float inverse_distance = 1.0f / std::sqrt(distance_squared);
+        *pan_x = listener_space_x * inverse_distance;
+        *pan_y = listener_space_z * inverse_distance;
+      }
+    } else {
+      *gain = 0.0f;
+    }
+  }
+}
+
+void CalculateGainAndPanBatch(ChannelTable* table,
+                              const ListenerTable& listeners,
+                              const float* bus_gains) {
+  bool has_listener = BestListenerBatch(
+      table->distance_squared.data(), table->listener_space_x.data(),
+      table->listener_space_y.data(), table->listener_space_z.data(),
+      listeners, table->location_x.data(), table->location_y.data(),
+      table->location_z.data(), table->size(), table->update.data());
+  SpatialGrid& grid = table->grid;
+  for (size_t i = 0; i < table->size(); ++i) {
+    if (!table->update[i]) {
+      continue;
+    }
+    CalculateGainAndPanInListenerSpace(
+        &table->gain[i], &table->pan_x[i], &table->pan_y[i],
+        table->collection[i], bus_gains[table->bus_index[i]],
+        table->user_gain[i], has_listener,
+        table->distance_squared[i], table->listener_space_x[i],
+        table->listener_space_z[i]);
+    // A positional sound out of range of its nearest listener is put to sleep
+    // if the grid can tell that it will stay out of range of all of them until
+    // something changes cells. Its gain is already zero, so it stays silent.
+    // The grid measures world distances, so nothing sleeps while a listener
+    // scales and the audible range differs in its space.
+    const SoundCollectionParams& params = table->collection[i]->params();
+    if (grid.enabled() && has_listener && listeners.rigid &&
+        params.positional &&
+        table->distance_squared[i] > params.max_audible_radius_squared) {
+      GridCell cell = grid.CellAt(table->location_x[i], table->location_y[i],
+                                  table->location_z[i]);
+      if (grid.OutOfRange(cell, params.max_audible_radius)) {
+        grid.Insert(i, cell, params.max_audible_radius);
+      }
+    }
+  }
+}
+
+// Find the cells the listeners are in, so that the grid can wake the sleeping
+// channels that a listener may have moved into range of. While a listener
+// scales the grid is given no listeners at all, which wakes every sleeping
+// channel, since world distances no longer tell whether they are in range.
+static void UpdateListenerCells(SpatialGrid* grid,
+                                const ListenerTable& listeners,
+                                std::vector<GridCell>* listener_cells) {
+  listener_cells->clear();
+  if (!grid->enabled()) {
+    return;
+  }
+  if (!listeners.rigid) {
+    grid->UpdateListenerCells(*listener_cells);
+    return;
+  }
+  for (size_t i = 0; i < listeners.size(); ++i) {
+    listener_cells->push_back(grid->CellAt(listeners.location_x[i],
+                                           listeners.location_y[i],
+                                           listeners.location_z[i]));
+  }
+  grid->UpdateListenerCells(*listener_cells);
+}
+
 // Given the priority of a node, and the list of ChannelInternalStates sorted by
 // priority, find the location in the list where the node would be inserted.
 // Note that the node should be inserted using InsertAfter. If the node you want
@@ -335,28 +1032,89 @@ PriorityList::iterator FindInsertionPoint(PriorityList* list, float priority) {
   return iter.base();
 }
 
+// Record an event for the channel in the trace, if one is being recorded.
+static void TraceChannel(TraceRecorder* trace, TraceEventType type,
+                         const ChannelInternalState* channel) {
+  if (!trace->recording()) {
+    return;
+  }
+  const SoundCollection* collection = channel->sound_collection();
+  const SoundCollectionDef* def =
+      collection ? collection->GetSoundCollectionDef() : nullptr;
+  trace->Record(type, channel->id(),
+                def && def->name() ? def->name()->c_str() : nullptr);
+}
+
+// Insert a channel into the priority list, using the priority index to find
+// where it belongs. The index is updated to match.
+static void InsertIntoPriorityList(PriorityList* list, PriorityIndex* index,
+                                   ChannelStateVector* channels,
+                                   ChannelInternalState* channel,
+                                   float priority) {
+  int successor = index->Insert(channel->index(), priority);
+  if (successor == PriorityIndex::kEnd) {
+    list->push_back(*channel);
+  } else {
+    PriorityList::insert_before((*channels)[successor], *channel,
+                                &ChannelInternalState::priority_node);
+  }
+}
+
+// Returns true if the channel has the kind of real channel that streamed
+// sounds play on when stream is true, or that buffered sounds play on
+// otherwise.
+static bool HasRealChannelOfKind(const ChannelInternalState& channel,
+                                 bool stream) {
+  return stream ? channel.stream_channel().Valid()
+                : channel.real_channel().Valid();
+}
+
+// Returns true if the channel is virtual or has the given kind of real
+// channel, so that a sound of that kind may take its place.
+static bool HasChannelForKind(const ChannelInternalState& channel,
+                              bool stream) {
+  return !channel.is_real() || HasRealChannelOfKind(channel, stream);
+}
+
+// Release the channel's pin on its sound, if it holds one, so that the sample
+// cache may unload the sound once nothing else is playing it.
+static void UnpinSound(AssetStoreInternalState* assets,
+                       ChannelInternalState* channel) {
+  if (channel->pinned()) {
+    std::lock_guard<std::mutex> assets_lock(assets->mutex);
+    assets->sample_cache.Unpin(channel->sound());
+    channel->set_pinned(false);
+  }
+}
+
 // Given a location to insert a node, take an InternalChannelState from the
 // appropritate list and insert it there. Return the new InternalChannelState.
 //
 // There are three places an InternalChannelState may be taken from. First, if
 // there are any real channels available in the real channel free list, use one
-// of those so that your channel can play.
+// of those so that your channel can play. Streamed sounds take theirs from the
+// stream channel free list instead, which is passed in its place.
 //
 // If there are no real channels, then use a free virtual channel instead so
 // that your channel can at least be tracked.
 //
 // If there are no real or virtual channels, use the node in the priority list,
 // remove it from the list, and insert it in the new insertion point. This
-// causes the lowest priority sound to stop being tracked.
+// causes the lowest priority sound to stop being tracked. That node must be
+// virtual, or have a real channel of the kind the new sound plays on, so that
+// neither pool can grow at the expense of the other.
 //
-// If the node you are trying to insert is the lowest priority, do nothing and
-// return a nullptr.
+// If the node you are trying to insert is the lowest priority, or the lowest
+// priority node has the other kind of real channel, do nothing and return a
+// nullptr.
 //
 // This function could use some unit tests b/20752976
 static ChannelInternalState* FindFreeChannelInternalState(
-    PriorityList::iterator insertion_point, PriorityList* list,
+    int insertion_point, float priority, PriorityList* list,
+    PriorityIndex* index, ChannelStateVector* channels,
     FreeList* real_channel_free_list, FreeList* virtual_channel_free_list,
-    bool paused) {
+    AssetStoreInternalState* assets, bool stream, bool paused,
+    TraceRecorder* trace) {
   ChannelInternalState* new_channel = nullptr;
   // Grab a free ChannelInternalState if there is one and the engine is not
   // paused. The engine is paused, grab a virtual channel for now, and it will
@@ -364,23 +1122,26 @@ static ChannelInternalState* FindFreeChannelInternalState(
   if (!paused && !real_channel_free_list->empty()) {
     new_channel = &real_channel_free_list->front();
     real_channel_free_list->pop_front();
-    PriorityList::insert_before(*insertion_point, *new_channel,
-                               &ChannelInternalState::priority_node);
+    InsertIntoPriorityList(list, index, channels, new_channel, priority);
   } else if (!virtual_channel_free_list->empty()) {
     new_channel = &virtual_channel_free_list->front();
     virtual_channel_free_list->pop_front();
-    PriorityList::insert_before(*insertion_point, *new_channel,
-                               &ChannelInternalState::priority_node);
-  } else if (&*insertion_point != &list->back()) {
+    InsertIntoPriorityList(list, index, channels, new_channel, priority);
+  } else if ((insertion_point == PriorityIndex::kEnd ||
+              &(*channels)[insertion_point] != &list->back()) &&
+             HasChannelForKind(list->back(), stream)) {
     // If there are no free sounds, and the new sound is not the lowest priority
     // sound, evict the lowest priority sound.
     new_channel = &list->back();
+    TraceChannel(trace, kTraceEvict, new_channel);
     new_channel->Halt();
+    UnpinSound(assets, new_channel);
 
     // Move it to a new spot in the list if it needs to be moved.
-    if (&*insertion_point != new_channel) {
+    if (insertion_point != static_cast<int>(new_channel->index())) {
       list->pop_back();
-      list->insert(insertion_point, *new_channel);
+      index->Remove(new_channel->index());
+      InsertIntoPriorityList(list, index, channels, new_channel, priority);
     }
   }
   return new_channel;
@@ -390,13 +1151,224 @@ static ChannelInternalState* FindFreeChannelInternalState(
 // backed by a real channel or not.
 static void InsertIntoFreeList(AudioEngineInternalState* state,
                                ChannelInternalState* channel) {
+  TraceChannel(&state->trace, kTraceStop, channel);
   channel->Remove();
-  FreeList* list = channel->is_real()
+  UnpinSound(state->assets.get(), channel);
+  FreeList* list = channel->real_channel().Valid()
                        ? &state->real_channel_free_list
-                       : &state->virtual_channel_free_list;
+                       : channel->stream_channel().Valid()
+                             ? &state->stream_channel_free_list
+                             : &state->virtual_channel_free_list;
   list->push_front(*channel);
 }
 
+// Returns the instance of the collection its instance limit policy says to stop
+// to make room for a new one, or nullptr if none should be.
+static ChannelInternalState* FindInstanceToSteal(SoundCollection* collection) {
+  InstanceList& instances = collection->instances();
+  if (instances.empty()) {
+    return nullptr;
+  }
+  switch (collection->params().instance_limit_policy) {
+    case InstanceLimitPolicy_StealOldest:
+      return &instances.front();
+    case InstanceLimitPolicy_StealQuietest: {
+      ChannelInternalState* quietest = nullptr;
+      for (auto iter = instances.begin(); iter != instances.end(); ++iter) {
+        if (!quietest || iter->gain() < quietest->gain()) {
+          quietest = &*iter;
+        }
+      }
+      return quietest;
+    }
+    default:
+      return nullptr;
+  }
+}
+
+// Decide whether a new instance of the collection may start, before any gain
+// or priority work is done for it. Plays that come too soon after the last one
+// are rejected. If the collection is already playing as many instances as it
+// may, either an instance is picked to make room or the play is rejected,
+// according to its instance limit policy. The picked instance is left in
+// victim, and keeps playing until StartChannel hands its channel over to the
+// new one.
+static bool AdmitInstance(AudioEngineInternalState* state,
+                          SoundCollection* collection,
+                          ChannelInternalState** victim) {
+  *victim = nullptr;
+  const SoundCollectionParams& params = collection->params();
+  if (state->time - collection->last_play_time() <
+      params.min_retrigger_interval) {
+    PINDROP_STATS_ONLY(++state->stats.rejected_plays);
+    return false;
+  }
+  if (params.max_instances == 0 ||
+      collection->instance_count() < params.max_instances) {
+    return true;
+  }
+  *victim = FindInstanceToSteal(collection);
+  if (!*victim) {
+    PINDROP_STATS_ONLY(++state->stats.rejected_plays);
+    return false;
+  }
+  return true;
+}
+
+// Stop the instance picked by AdmitInstance and move its channel to where a
+// sound with the given priority belongs in the priority list, so the new
+// instance can play on it. The victim keeps its real channel, if it has one.
+static ChannelInternalState* ReuseVictimChannel(AudioEngineInternalState* state,
+                                                ChannelInternalState* victim,
+                                                float priority) {
+  TraceChannel(&state->trace, kTraceEvict, victim);
+  PINDROP_STATS_ONLY(++state->stats.evictions);
+  victim->Halt();
+  UnpinSound(state->assets.get(), victim);
+  PriorityIndex* index = &state->channel_table.priority_index;
+  victim->priority_node.remove();
+  index->Remove(victim->index());
+  InsertIntoPriorityList(&state->playing_channel_list, index,
+                         &state->channel_state_memory, victim, priority);
+  return victim;
+}
+
+// Pin the sound a channel has just started playing, which loads it if it was
+// unloaded to stay within the sample budget. If the sound is not ready by the
+// time that returns, the channel waits in loading_channels for it to load.
+static void PinSound(AudioEngineInternalState* state,
+                     ChannelInternalState* channel) {
+  bool ready = channel->SoundReady();
+  if (state->pin_sounds && channel->sound()) {
+    AssetStoreInternalState* assets = state->assets.get();
+    std::lock_guard<std::mutex> assets_lock(assets->mutex);
+    assets->sample_cache.Pin(channel->sound(), &assets->loader);
+    channel->set_pinned(true);
+  }
+  if (!channel->SoundReady()) {
+    state->loading_channels.push_back(channel->id());
+  } else if (!ready) {
+    // The synchronous loader loads the sound as soon as it is pinned.
+    channel->PlayLoadedSound();
+  }
+}
+
+// Start the real channels of the channels whose sounds have finished loading
+// since they started.
+static void StartLoadedChannels(AudioEngineInternalState* state) {
+  std::vector<ChannelId>& waiting = state->loading_channels;
+  for (size_t i = 0; i < waiting.size();) {
+    ChannelInternalState* channel = FindChannelInternalState(state, waiting[i]);
+    if (channel && !channel->SoundReady()) {
+      ++i;
+      continue;
+    }
+    // A channel that has since been given to another sound has stopped
+    // waiting.
+    if (channel) {
+      channel->PlayLoadedSound();
+    }
+    waiting[i] = waiting.back();
+    waiting.pop_back();
+  }
+}
+
+// Unload the sounds played least recently until what is loaded fits within
+// the sample budget again.
+static void TrimSampleCache(AudioEngineInternalState* state) {
+  if (state->pin_sounds) {
+    AssetStoreInternalState* assets = state->assets.get();
+    std::lock_guard<std::mutex> assets_lock(assets->mutex);
+    assets->sample_cache.Trim(&assets->loader);
+  }
+}
+
+// Take a channel for a new sound with the given gain, pan and priority, put it
+// in its place in the priority list, and start it playing. If AdmitInstance
+// picked an instance of the collection to make room, the new sound takes that
+// instance's channel, so no other sound is stopped for it. Returns nullptr if
+// there was no channel available or the sound failed to play.
+static ChannelInternalState* StartChannel(
+    AudioEngineInternalState* state, SoundCollection* collection,
+    const mathfu::Vector<float, 3>& location, float user_gain, float gain,
+    const mathfu::Vector<float, 2>& pan, float priority,
+    ChannelInternalState* victim) {
+  ChannelInternalState* new_channel;
+  if (victim) {
+    new_channel = ReuseVictimChannel(state, victim, priority);
+  } else {
+    // Find where it belongs in the list.
+    PriorityIndex* index = &state->channel_table.priority_index;
+    int insertion_point = index->FindInsertionPoint(priority);
+
+    // Streamed sounds play on the stream channels, and the rest on the real
+    // channels.
+    bool stream = collection->params().stream;
+    FreeList* real_free_list = stream ? &state->stream_channel_free_list
+                                      : &state->real_channel_free_list;
+
+    // With no free channel to take, the new sound can only play by stopping
+    // another.
+    PINDROP_STATS_ONLY(bool evicting =
+                           (state->paused || real_free_list->empty()) &&
+                           state->virtual_channel_free_list.empty());
+
+    // Decide which ChannelInternalState object to use.
+    new_channel = FindFreeChannelInternalState(
+        insertion_point, priority, &state->playing_channel_list, index,
+        &state->channel_state_memory, real_free_list,
+        &state->virtual_channel_free_list, state->assets.get(), stream,
+        state->paused, &state->trace);
+
+    // The sound could not be added to the list; not high enough priority.
+    if (new_channel == nullptr) {
+      PINDROP_STATS_ONLY(++state->stats.rejected_plays);
+      return nullptr;
+    }
+    PINDROP_STATS_ONLY(if (evicting) ++state->stats.evictions);
+  }
+  new_channel->set_active(true);
+  new_channel->IncrementGeneration();
+
+  // Now that we have our new sound, set the data on it and update the next
+  // pointers.
+  new_channel->SetSoundCollection(collection);
+  new_channel->set_user_gain(user_gain);
+
+  // Attempt to play the sound if the engine is not paused.
+  if (!state->paused) {
+    if (!new_channel->Play(collection, &state->random)) {
+      // Error playing the sound, put it back in the free list.
+      InsertIntoFreeList(state, new_channel);
+      PINDROP_STATS_ONLY(++state->stats.rejected_plays);
+      return nullptr;
+    }
+    PinSound(state, new_channel);
+  }
+
+  collection->set_last_play_time(state->time);
+  new_channel->set_gain(gain);
+  new_channel->SetLocation(location);
+  if (new_channel->is_real()) {
+    // Set the gain and pan right away rather than with the rest of the frame's
+    // updates, so the sound does not start at the wrong gain.
+    new_channel->SetRealGain(gain);
+    new_channel->SetPan(pan);
+    ChannelTable& table = state->channel_table;
+    size_t index = new_channel->index();
+    table.real_time[index] = state->time;
+    table.applied_gain[index] = gain;
+    table.applied_pan_x[index] = pan.x;
+    table.applied_pan_y[index] = pan.y;
+    table.applied[index] = 1;
+    table.previous_gain[index] = gain;
+    table.previous_pan_x[index] = pan.x;
+    table.previous_pan_y[index] = pan.y;
+  }
+  TraceChannel(&state->trace, kTracePlay, new_channel);
+  return new_channel;
+}
+
 Channel AudioEngine::PlaySound(SoundHandle sound_handle) {
   return PlaySound(sound_handle, mathfu::kZeros3f, 1.0f);
 }
@@ -406,57 +1378,162 @@ Channel AudioEngine::PlaySound(SoundHandle sound_handle,
   return PlaySound(sound_handle, location, 1.0f);
 }
 
+// Queue a sound played from the game thread while the engine updates on its
+// own thread, and remember how it was played until the engine starts it.
+static Channel QueuePlayChannel(AudioEngine* audio_engine,
+                                SoundHandle sound_handle,
+                                const mathfu::Vector<float, 3>& location,
+                                float user_gain) {
+  AudioEngineInternalState* state = audio_engine->state();
+  ChannelTicket ticket =
+      audio_engine->QueuePlaySound(sound_handle, location, user_gain);
+  if (ticket == kInvalidChannelTicket) {
+    CallLogFunc("Cannot play sound: the command queue is full\n");
+    return Channel();
+  }
+  PendingPlay& pending =
+      state->pending_plays[ticket & (state->pending_plays.size() - 1)];
+  pending.ticket = ticket;
+  pending.channel.id = kNullChannelId;
+  pending.channel.playing = true;
+  pending.channel.location = location;
+  pending.channel.gain = user_gain;
+  return Channel(state, kNullChannelId, ticket);
+}
+
 Channel AudioEngine::PlaySound(SoundHandle sound_handle,
                                const mathfu::Vector<float, 3>& location,
                                float user_gain) {
   SoundCollection* collection = sound_handle;
   if (!collection) {
     CallLogFunc("Cannot play sound: invalid sound handle\n");
-    return Channel(nullptr);
+    return Channel();
+  }
+  // Rather than wait for an update in progress, the sound is started by the
+  // next one.
+  if (state_->update_thread.joinable()) {
+    return QueuePlayChannel(this, sound_handle, location, user_gain);
+  }
+  UpdateLock lock(state_);
+  ChannelInternalState* victim;
+  if (!AdmitInstance(state_, collection, &victim)) {
+    return Channel();
   }
 
-  // Find where it belongs in the list.
   float gain;
   mathfu::Vector<float, 2> pan;
   CalculateGainAndPan(&gain, &pan, collection, location, state_->listener_list,
                       user_gain);
-  float priority = gain * sound_handle->GetSoundCollectionDef()->priority();
-  PriorityList::iterator insertion_point =
-      FindInsertionPoint(&state_->playing_channel_list, priority);
-
-  // Decide which ChannelInternalState object to use.
-  ChannelInternalState* new_channel = FindFreeChannelInternalState(
-      insertion_point, &state_->playing_channel_list,
-      &state_->real_channel_free_list, &state_->virtual_channel_free_list,
-      state_->paused);
+  float priority = gain * collection->params().priority;
+  return MakeChannel(state_,
+                     StartChannel(state_, collection, location, user_gain,
+                                  gain, pan, priority, victim));
+}
 
-  // The sound could not be added to the list; not high enough priority.
-  if (new_channel == nullptr) {
-    return Channel(nullptr);
+// Play a batch of sounds, as described by AudioEngine::PlaySounds. The id of
+// the channel each request was played on is left in the batch's channels.
+static void PlaySoundBatch(AudioEngineInternalState* state,
+                           const PlayRequest* requests, size_t count) {
+  PlayBatch& batch = state->play_batch;
+  batch.Resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    const mathfu::Vector<float, 3>& location = requests[i].location;
+    batch.location_x[i] = location.x;
+    batch.location_y[i] = location.y;
+    batch.location_z[i] = location.z;
   }
 
-  // Now that we have our new sound, set the data on it and update the next
-  // pointers.
-  new_channel->SetSoundCollection(sound_handle);
-  new_channel->set_user_gain(user_gain);
+  // Work out the gain, pan and priority of the whole batch at once. Listeners
+  // that moved since the last frame are picked up by the next one.
+  if (state->listener_table.Gather(state->listener_list.cbegin(),
+                                   state->listener_list.cend())) {
+    state->listeners_changed_frame = state->current_frame + 1;
+  }
+  bool has_listener = BestListenerBatch(
+      batch.distance_squared.data(), batch.listener_space_x.data(),
+      batch.listener_space_y.data(), batch.listener_space_z.data(),
+      state->listener_table, batch.location_x.data(), batch.location_y.data(),
+      batch.location_z.data(), count, nullptr);
+  batch.order.clear();
+  for (size_t i = 0; i < count; ++i) {
+    SoundCollection* collection = requests[i].sound_handle;
+    batch.channels[i] = kNullChannelId;
+    if (!collection) {
+      CallLogFunc("Cannot play sound: invalid sound handle\n");
+      continue;
+    }
+    CalculateGainAndPanInListenerSpace(
+        &batch.gain[i], &batch.pan_x[i], &batch.pan_y[i], collection,
+        collection->bus()->gain(), requests[i].gain, has_listener,
+        batch.distance_squared[i], batch.listener_space_x[i],
+        batch.listener_space_z[i]);
+    batch.priority[i] = batch.gain[i] * collection->params().priority;
+    batch.order.push_back(i);
+  }
 
-  // Attempt to play the sound if the engine is not paused.
-  if (!state_->paused) {
-    if (!new_channel->Play(sound_handle)) {
-      // Error playing the sound, put it back in the free list.
-      InsertIntoFreeList(state_, new_channel);
-      return Channel(nullptr);
+  // Start the sounds from highest to lowest priority, so that the low priority
+  // sounds in the batch are the ones to lose out if channels run short or a
+  // collection reaches its instance limit.
+  std::stable_sort(batch.order.begin(), batch.order.end(),
+                   [&batch](size_t a, size_t b) {
+                     return batch.priority[a] > batch.priority[b];
+                   });
+  for (size_t i = 0; i < batch.order.size(); ++i) {
+    size_t request = batch.order[i];
+    ChannelInternalState* victim;
+    if (!AdmitInstance(state, requests[request].sound_handle, &victim)) {
+      continue;
+    }
+    ChannelInternalState* channel = StartChannel(
+        state, requests[request].sound_handle, requests[request].location,
+        requests[request].gain, batch.gain[request],
+        mathfu::Vector<float, 2>(batch.pan_x[request], batch.pan_y[request]),
+        batch.priority[request], victim);
+    if (channel) {
+      batch.channels[request] = channel->id();
     }
   }
+}
 
-  new_channel->set_gain(gain);
-  new_channel->SetLocation(location);
-  if (new_channel->is_real()) {
-    new_channel->real_channel().SetGain(gain);
-    new_channel->real_channel().SetPan(pan);
+void AudioEngine::PlaySounds(const PlayRequest* requests, size_t count,
+                             Channel* channels) {
+  if (state_->update_thread.joinable()) {
+    for (size_t i = 0; i < count; ++i) {
+      channels[i] = requests[i].sound_handle
+                        ? QueuePlayChannel(this, requests[i].sound_handle,
+                                           requests[i].location,
+                                           requests[i].gain)
+                        : Channel();
+    }
+    return;
+  }
+  UpdateLock lock(state_);
+  PlaySoundBatch(state_, requests, count);
+  for (size_t i = 0; i < count; ++i) {
+    ChannelId id = state_->play_batch.channels[i];
+    channels[i] = id != kNullChannelId ? Channel(state_, id) : Channel();
   }
+}
+
+Channel AudioEngine::PlaySound(SoundId sound_id) {
+  return PlaySound(sound_id, mathfu::kZeros3f, 1.0f);
+}
+
+Channel AudioEngine::PlaySound(SoundId sound_id,
+                               const mathfu::Vector<float, 3>& location) {
+  return PlaySound(sound_id, location, 1.0f);
+}
 
-  return Channel(new_channel);
+Channel AudioEngine::PlaySound(SoundId sound_id,
+                               const mathfu::Vector<float, 3>& location,
+                               float user_gain) {
+  SoundHandle handle = GetSoundHandle(sound_id);
+  if (handle) {
+    return PlaySound(handle, location, user_gain);
+  } else {
+    CallLogFunc("Cannot play sound: invalid id (%u)\n", sound_id);
+    return Channel();
+  }
 }
 
 Channel AudioEngine::PlaySound(const std::string& sound_name) {
@@ -476,28 +1553,109 @@ Channel AudioEngine::PlaySound(const std::string& sound_name,
     return PlaySound(handle, location, user_gain);
   } else {
     CallLogFunc("Cannot play sound: invalid name (%s)\n", sound_name.c_str());
-    return Channel(nullptr);
+    return Channel();
   }
 }
 
+bool AudioEngine::ReloadSoundCollectionDef(const std::string& filename) {
+  FileBuffer source;
+  if (!source.Load(filename.c_str())) {
+    CallLogFunc("Could not load sound collection file %s.\n",
+                filename.c_str());
+    return false;
+  }
+  UpdateLock lock(state_);
+  SoundCollection* collection = GetSoundHandleFromFile(filename);
+  if (!collection) {
+    CallLogFunc("Sound collection %s is not loaded.\n", filename.c_str());
+    return false;
+  }
+  return collection->ReloadSoundCollectionDef(&source, state_);
+}
+
+bool AudioEngine::ReloadBusFile(const std::string& filename) {
+  FileBuffer source;
+  if (!source.Load(filename.c_str())) {
+    CallLogFunc("Could not load audio bus file %s.\n", filename.c_str());
+    return false;
+  }
+  const BusDefList* bus_def_list = pindrop::GetBusDefList(source.data());
+  std::vector<int> bus_order;
+  std::vector<int> bus_parents;
+  SortBusDefs(bus_def_list, &bus_order, &bus_parents);
+
+  UpdateLock lock(state_);
+  // Channels and collections refer to the buses by pointer and by index, so
+  // the buses themselves must stay as they are. Only their settings and what
+  // they duck may change.
+  std::vector<BusInternalState>& buses = state_->buses;
+  bool same_buses = bus_order.size() == buses.size();
+  for (size_t i = 0; same_buses && i < buses.size(); ++i) {
+    const BusDef* def = bus_def_list->buses()->Get(bus_order[i]);
+    same_buses = bus_parents[i] == buses[i].parent_index() &&
+                 buses[i].name() == def->name()->c_str();
+  }
+  if (!same_buses) {
+    CallLogFunc("Audio bus file %s cannot change the buses or their parents "
+                "when it is reloaded.\n",
+                filename.c_str());
+    return false;
+  }
+  // The names are unchanged, so the new lists can be looked up among the
+  // buses before their definitions are replaced.
+  std::vector<std::vector<BusInternalState*>> child_buses(buses.size());
+  std::vector<std::vector<BusInternalState*>> duck_buses(buses.size());
+  for (size_t i = 0; i < buses.size(); ++i) {
+    const BusDef* def = bus_def_list->buses()->Get(bus_order[i]);
+    if (!PopulateBuses(state_, "child_buses", def->child_buses(),
+                       &child_buses[i]) ||
+        !PopulateBuses(state_, "duck_buses", def->duck_buses(),
+                       &duck_buses[i])) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < buses.size(); ++i) {
+    buses[i].Reload(bus_def_list->buses()->Get(bus_order[i]));
+    buses[i].child_buses().swap(child_buses[i]);
+    buses[i].duck_buses().swap(duck_buses[i]);
+  }
+  state_->buses_source.Swap(&source);
+  return true;
+}
+
 SoundHandle AudioEngine::GetSoundHandle(const std::string& sound_name) const {
-  auto iter = state_->sound_collection_map.find(sound_name);
-  if (iter == state_->sound_collection_map.end()) {
+  UpdateLock lock(state_);
+  SoundCollection* collection =
+      state_->sound_collection_table.Find(HashSoundName(sound_name.c_str()));
+  // Make sure this is not a different sound whose name has the same hash.
+  if (!collection ||
+      strcmp(collection->GetSoundCollectionDef()->name()->c_str(),
+             sound_name.c_str()) != 0) {
     return nullptr;
   }
-  return iter->second.get();
+  return collection;
+}
+
+SoundHandle AudioEngine::GetSoundHandle(SoundId id) const {
+  UpdateLock lock(state_);
+  return state_->sound_collection_table.Find(id);
 }
 
 SoundHandle AudioEngine::GetSoundHandleFromFile(
     const std::string& filename) const {
-  auto iter = state_->sound_id_map.find(filename);
-  if (iter == state_->sound_id_map.end()) {
-    return nullptr;
+  UpdateLock lock(state_);
+  for (auto iter = state_->sound_bank_map.begin();
+       iter != state_->sound_bank_map.end(); ++iter) {
+    SoundHandle handle = iter->second->FindSoundCollection(filename.c_str());
+    if (handle) {
+      return handle;
+    }
   }
-  return GetSoundHandle(iter->second);
+  return nullptr;
 }
 
 Listener AudioEngine::AddListener() {
+  UpdateLock lock(state_);
   if (state_->listener_state_free_list.empty()) {
     return Listener(nullptr);
   }
@@ -508,16 +1666,19 @@ Listener AudioEngine::AddListener() {
 }
 
 void AudioEngine::RemoveListener(Listener* listener) {
+  UpdateLock lock(state_);
   assert(listener->Valid());
   listener->state()->node.remove();
   state_->listener_state_free_list.push_back(listener->state());
 }
 
 Bus AudioEngine::FindBus(const char* bus_name) {
+  UpdateLock lock(state_);
   return Bus(FindBusInternalState(state_, bus_name));
 }
 
 void AudioEngine::Pause(bool pause) {
+  UpdateLock lock(state_);
   state_->paused = pause;
 
   PriorityList& list = state_->playing_channel_list;
@@ -528,19 +1689,25 @@ void AudioEngine::Pause(bool pause) {
         // playback of the channel without marking it as paused from the audio
         // engine's point of view, so that we know to restart it when the audio
         // engine is unpaused.
-        iter->real_channel().Pause();
+        iter->PauseReal();
       } else {
         // Unpause all channels that were not explicitly paused.
-        iter->real_channel().Resume();
+        iter->ResumeReal();
       }
     }
   }
 }
 
-static void EraseFinishedSounds(AudioEngineInternalState* state) {
+// Stop the channels whose sounds have finished, including virtual one shot
+// sounds that would have reached their end by now, and free them.
+static void EraseFinishedSounds(AudioEngineInternalState* state,
+                                float delta_time) {
   PriorityList& list = state->playing_channel_list;
   for (auto iter = list.begin(); iter != list.end();) {
     auto current = iter++;
+    if (!state->paused) {
+      current->AdvancePlayhead(delta_time);
+    }
     current->UpdateState();
     if (current->Stopped()) {
       InsertIntoFreeList(state, &*current);
@@ -548,88 +1715,890 @@ static void EraseFinishedSounds(AudioEngineInternalState* state) {
   }
 }
 
-static void UpdateChannel(ChannelInternalState* channel,
-                          AudioEngineInternalState* state) {
-  float gain;
-  mathfu::Vector<float, 2> pan;
-  CalculateGainAndPan(&gain, &pan, channel->sound_collection(),
-                      channel->Location(), state->listener_list,
-                      channel->user_gain());
-  channel->set_gain(gain);
-  if (channel->is_real()) {
-    channel->real_channel().SetGain(gain);
-    channel->real_channel().SetPan(pan);
-  }
-}
-
-// If there are any free real channels, assign those to virtual channels that
-// need them. If the priority list has gaps (i.e. if there are real channels
-// that are lower priority than virtual channels) then move the lower priority
-// real channels to the higher priority virtual channels.
-// TODO(amablue): Write unit tests for this function. b/20696606
-static void UpdateRealChannels(PriorityList* priority_list,
-                               FreeList* real_free_list,
-                               FreeList* virtual_free_list) {
+// Returns the priority of the lowest priority buffered channel that can be
+// real, or zero if there are no more playing buffered channels than real
+// channels. Streamed channels have their own, usually much smaller, pool, so
+// they are not counted.
+static float LowestRealPriority(AudioEngineInternalState* state) {
+  PriorityList& list = state->playing_channel_list;
+  const ChannelTable& table = state->channel_table;
+  unsigned int count = 0;
+  float priority = 0.0f;
+  for (auto iter = list.begin();
+       iter != list.end() && count < state->real_channel_count; ++iter) {
+    if (!table.collection[iter->index()]->params().stream) {
+      priority = iter->Priority();
+      ++count;
+    }
+  }
+  return count < state->real_channel_count ? 0.0f : priority;
+}
+
+// Return true if nothing a channel's gain and pan depend on has changed since
+// they were last computed.
+static bool ChannelUnchanged(const AudioEngineInternalState* state,
+                             const ChannelTable& table, size_t i) {
+  uint32_t last_frame = table.lod_frame[i];
+  return !table.dirty[i] && last_frame != 0 &&
+         last_frame >= state->listeners_changed_frame &&
+         last_frame >= state->bus_gain_frames[table.bus_index[i]];
+}
+
+// Decide which channels are updated this frame. Channels that have not changed
+// since their last update, and whose bus and listeners have not either, keep
+// their gain and pan. Of the rest, real channels, and virtual channels whose
+// priority was near enough to the lowest real channel's on the last frame, are
+// updated every frame. The far virtual channels take turns, each being updated
+// once every lod_update_interval frames. The turns are staggered by channel
+// index so the work is spread evenly over the frames.
+static void ScheduleChannelUpdates(AudioEngineInternalState* state) {
+  ChannelTable& table = state->channel_table;
+  ChannelUpdateStats& stats = state->channel_update_stats;
+  const unsigned int interval = state->lod_update_interval;
+  const float cutoff =
+      interval > 1 ? LowestRealPriority(state) * state->lod_cutoff_ratio
+                   : 0.0f;
+  stats = ChannelUpdateStats();
+  for (size_t i = 0; i < table.size(); ++i) {
+    if (!table.active[i] || table.asleep[i]) {
+      table.update[i] = 0;
+    } else if (ChannelUnchanged(state, table, i)) {
+      // Holding the gain still stops it being extrapolated.
+      table.update[i] = 0;
+      table.lod_gain_rate[i] = 0.0f;
+      ++stats.unchanged;
+    } else if (interval <= 1 || table.real[i] || table.lod_frame[i] == 0 ||
+               table.priority[i] >= cutoff) {
+      table.update[i] = 1;
+      ++stats.every_frame;
+    } else if ((i + state->current_frame) % interval == 0) {
+      table.update[i] = 1;
+      ++stats.scheduled;
+    } else {
+      table.update[i] = 0;
+      ++stats.extrapolated;
+    }
+  }
+}
+
+// Update the gain, pan and priority of every playing channel, and take the
+// channels whose priority changed out of the list to be re-ranked.
+//
+// Channels not scheduled for an update this frame have their gain carried on
+// at the rate it changed between their last two updates.
+//
+// The gain, pan and priority are computed in a single linear pass over the
+// ChannelTable. Rather than sorting the whole list afterwards, only the
+// channels whose priority actually changed are pulled out of the list. The
+// channels that remain are still in the order they were in last frame, so they
+// are still sorted.
+static void UpdateChannels(AudioEngineInternalState* state) {
+  ChannelTable& table = state->channel_table;
+  ChannelStateVector& channels = state->channel_state_memory;
+  std::vector<ChannelInternalState*>& reranked = state->reranked_channels;
+  reranked.clear();
+  if (state->listener_table.Gather(state->listener_list.cbegin(),
+                                   state->listener_list.cend())) {
+    state->listeners_changed_frame = state->current_frame;
+  }
+  UpdateListenerCells(&table.grid, state->listener_table,
+                      &state->listener_cells);
+  ScheduleChannelUpdates(state);
+  CalculateGainAndPanBatch(&table, state->listener_table,
+                           state->bus_gains.data());
+  state->channel_update_stats.sleeping = table.grid.size();
+  const uint32_t frame = state->current_frame;
+  for (size_t i = 0; i < table.size(); ++i) {
+    if (!table.active[i]) {
+      continue;
+    }
+    if (table.asleep[i]) {
+      // The gain of a sleeping channel is already zero. Once it wakes it is
+      // updated straight away rather than waiting for its turn.
+      table.lod_frame[i] = 0;
+    } else if (table.update[i]) {
+      uint32_t last_frame = table.lod_frame[i];
+      table.lod_gain_rate[i] =
+          last_frame != 0 && last_frame != frame
+              ? (table.gain[i] - table.lod_gain[i]) /
+                    static_cast<float>(frame - last_frame)
+              : 0.0f;
+      table.lod_gain[i] = table.gain[i];
+      table.lod_frame[i] = frame;
+      table.dirty[i] = 0;
+    } else {
+      float frames = static_cast<float>(frame - table.lod_frame[i]);
+      table.gain[i] = std::max(
+          0.0f, table.lod_gain[i] + table.lod_gain_rate[i] * frames);
+    }
+    float priority = table.gain[i] * table.collection[i]->params().priority;
+    if (priority != table.priority[i]) {
+      table.priority[i] = priority;
+      ChannelInternalState* channel = &channels[i];
+      channel->priority_node.remove();
+      reranked.push_back(channel);
+    }
+  }
+}
+
+// Restore the priority ordering of the list. The channels re-ranked by
+// UpdateChannels are sorted on their own and then merged back into the list in
+// a single pass. When nothing moves (static emitters and a static listener)
+// there is nothing to do.
+static void RerankChannels(AudioEngineInternalState* state) {
+  std::vector<ChannelInternalState*>& reranked = state->reranked_channels;
+  if (reranked.empty()) {
+    return;
+  }
+  PriorityList& list = state->playing_channel_list;
+  std::sort(reranked.begin(), reranked.end(),
+            [](const ChannelInternalState* a, const ChannelInternalState* b) {
+              return a->Priority() > b->Priority();
+            });
+  auto iter = list.begin();
+  for (size_t i = 0; i < reranked.size(); ++i) {
+    ChannelInternalState* channel = reranked[i];
+    float priority = channel->Priority();
+    while (iter != list.end() && iter->Priority() >= priority) {
+      ++iter;
+    }
+    list.insert(iter, *channel);
+  }
+  // The re-ranked channels were taken out of the list without updating the
+  // index, so rebuild it from the list now that it is back in order.
+  state->channel_table.priority_index.Rebuild(list.begin(), list.end());
+}
+
+// Returns true if a change from the value last sent to the mixer should be
+// sent now. Changes smaller than the threshold are held back while the value is
+// still moving, but the final value is sent once it stops, so that the mixer
+// does not stay short of it. Reaching or crossing zero is always sent, so that
+// a fade to silence ends silent and a pan does not stay on the wrong side.
+static bool ShouldCommit(float value, float applied, float previous,
+                         float threshold) {
+  if (value == applied) {
+    return false;
+  }
+  return std::fabs(value - applied) > threshold || value == previous ||
+         value == 0.0f || (value < 0.0f) != (applied < 0.0f);
+}
+
+// Pass the gain and pan of the channels being mixed along to the mixer. Small
+// changes are held back as ShouldCommit describes, and the rest are sent in one
+// batch with the mixer locked, so the audio thread is not locked and unlocked
+// again for every call.
+static void CommitRealChannelUpdates(AudioEngineInternalState* state) {
+  ChannelTable& table = state->channel_table;
+  ChannelStateVector& channels = state->channel_state_memory;
+  std::vector<RealChannelUpdate>& updates = state->real_channel_updates;
+  const float threshold = state->mixer_update_threshold;
+  updates.clear();
+  for (size_t i = 0; i < table.size(); ++i) {
+    if (!table.active[i] || !table.real[i] || table.stealing[i]) {
+      continue;
+    }
+    RealChannelUpdate update;
+    update.channel = &channels[i];
+    if (table.applied[i]) {
+      update.gain = ShouldCommit(table.gain[i], table.applied_gain[i],
+                                 table.previous_gain[i], threshold);
+      update.pan = ShouldCommit(table.pan_x[i], table.applied_pan_x[i],
+                                table.previous_pan_x[i], threshold) ||
+                   ShouldCommit(table.pan_y[i], table.applied_pan_y[i],
+                                table.previous_pan_y[i], threshold);
+      if (!update.gain && table.gain[i] != table.applied_gain[i]) {
+        ++state->skipped_mixer_updates;
+      }
+      if (!update.pan && (table.pan_x[i] != table.applied_pan_x[i] ||
+                          table.pan_y[i] != table.applied_pan_y[i])) {
+        ++state->skipped_mixer_updates;
+      }
+    } else {
+      update.gain = true;
+      update.pan = true;
+    }
+    table.previous_gain[i] = table.gain[i];
+    table.previous_pan_x[i] = table.pan_x[i];
+    table.previous_pan_y[i] = table.pan_y[i];
+    if (update.gain || update.pan) {
+      updates.push_back(update);
+    }
+  }
+  if (updates.empty()) {
+    return;
+  }
+  state->mixer.Lock();
+  for (size_t i = 0; i < updates.size(); ++i) {
+    const RealChannelUpdate& update = updates[i];
+    size_t index = update.channel->index();
+    ChannelInternalState* channel = update.channel;
+    if (update.gain) {
+      channel->SetRealGain(table.gain[index]);
+      table.applied_gain[index] = table.gain[index];
+    }
+    if (update.pan) {
+      channel->SetPan(
+          mathfu::Vector<float, 2>(table.pan_x[index], table.pan_y[index]));
+      table.applied_pan_x[index] = table.pan_x[index];
+      table.applied_pan_y[index] = table.pan_y[index];
+    }
+    table.applied[index] = 1;
+  }
+  state->mixer.Unlock();
+}
+
+// Returns true if the channel at the given index plays a streamed sound
+// collection, and so may only be given a stream channel.
+static bool PlaysStream(const ChannelTable& table, size_t index) {
+  return table.collection[index]->params().stream;
+}
+
+// Count the stream channels that are playing.
+static unsigned int CountRealStreams(const AudioEngineInternalState* state) {
+  const ChannelTable& table = state->channel_table;
+  unsigned int streams = 0;
+  for (size_t i = 0; i < table.size(); ++i) {
+    if (table.active[i] && table.real[i] &&
+        state->channel_state_memory[i].stream_channel().Valid()) {
+      ++streams;
+    }
+  }
+  return streams;
+}
+
+// Make sure the highest priority channels of one kind, buffered or streamed,
+// are the ones backed by that kind's real channels. Only the first
+// channel_count channels of that kind in the priority list can ever have one
+// after this runs, so only those are examined, and the channels of the other
+// kind are passed over. Any of them that are virtual are given a free real
+// channel from free_list if there is one, or otherwise take the real channel
+// from the lowest priority channel of the same kind below the cutoff. Returns
+// the number of real channels handed from one channel to another.
+//
+// A virtual channel only takes the real channel of a lower priority channel if
+// its priority is higher by more than the steal margin, and only once that
+// channel has been real for the minimum time, so that channels hovering around
+// the cutoff do not swap back and forth every frame. The real channel is faded
+// out rather than cut off, and handed over once the fade has finished. A
+// waiting channel does not steal another real channel while one is already
+// fading out for it.
+static unsigned int AssignRealChannels(AudioEngineInternalState* state,
+                                       bool stream, FreeList* free_list,
+                                       unsigned int channel_count) {
+  PriorityList* priority_list = &state->playing_channel_list;
+  FreeList* virtual_free_list = &state->virtual_channel_free_list;
+  ChannelTable& table = state->channel_table;
+  std::vector<ChannelInternalState*>& stealing = state->stealing_channels;
+  const float margin = 1.0f + state->steal_priority_margin;
+  const int fade_milliseconds = state->steal_fade_milliseconds;
+
+  size_t fading = 0;
+  for (size_t i = 0; i < stealing.size(); ++i) {
+    if (HasRealChannelOfKind(*stealing[i], stream) &&
+        !stealing[i]->StealFinished()) {
+      ++fading;
+    }
+  }
+
+  unsigned int swaps = 0;
   PriorityList::reverse_iterator reverse_iter = priority_list->rbegin();
-  for (auto iter = priority_list->begin(); iter != priority_list->end();
-       ++iter) {
-    if (!iter->is_real()) {
-      // First check if there are any free real channels.
-      if (!real_free_list->empty()) {
-        // We have a free real channel. Assign this channel id to the channel
-        // that is trying to resume, clear the free channel, and push it into
-        // the virtual free list.
-        ChannelInternalState* free_channel = &real_free_list->front();
-        iter->Devirtualize(free_channel);
-        virtual_free_list->push_front(*free_channel);
-        iter->Resume();
-      } else {
-        // If there aren't any free channels, then scan from the back of the
-        // list for low priority real channels.
-        reverse_iter =
-            std::find_if(reverse_iter, PriorityList::reverse_iterator(iter),
-                         [](const ChannelInternalState& channel) {
-                           return channel.real_channel().Valid();
-                         });
-        if (reverse_iter == priority_list->rend()) {
-          // There is no more swapping that can be done. Return.
+  unsigned int rank = 0;
+  for (auto iter = priority_list->begin();
+       iter != priority_list->end() && rank < channel_count; ++iter) {
+    if (PlaysStream(table, iter->index()) != stream) {
+      continue;
+    }
+    ++rank;
+    if (iter->is_real()) {
+      continue;
+    }
+    // First check if there are any free real channels.
+    if (!free_list->empty()) {
+      // We have a free real channel. Assign this channel id to the channel
+      // that is trying to resume, clear the free channel, and push it into
+      // the virtual free list.
+      ChannelInternalState* free_channel = &free_list->front();
+      iter->Devirtualize(free_channel);
+      TraceChannel(&state->trace, kTraceDevirtualize, &*iter);
+      PINDROP_STATS_ONLY(++state->stats.devirtualizations);
+      virtual_free_list->push_front(*free_channel);
+      iter->Resume();
+      table.real_time[iter->index()] = state->time;
+      continue;
+    }
+
+    // Next, take a real channel that has finished fading out.
+    auto finished = std::find_if(
+        stealing.begin(), stealing.end(),
+        [stream](const ChannelInternalState* channel) {
+          return HasRealChannelOfKind(*channel, stream) &&
+                 channel->StealFinished();
+        });
+    if (finished != stealing.end()) {
+      TraceChannel(&state->trace, kTraceVirtualize, *finished);
+      iter->Devirtualize(*finished);
+      TraceChannel(&state->trace, kTraceDevirtualize, &*iter);
+      PINDROP_STATS_ONLY(++state->stats.devirtualizations);
+      stealing.erase(finished);
+      table.real_time[iter->index()] = state->time;
+      ++swaps;
+      continue;
+    }
+
+    // Wait for one that is still fading out.
+    if (fading > 0) {
+      --fading;
+      continue;
+    }
+
+    // Otherwise, scan from the back of the list for a low priority channel
+    // with the same kind of real channel that has had it for long enough.
+    PriorityList::reverse_iterator cutoff(iter);
+    while (reverse_iter != cutoff &&
+           (!HasRealChannelOfKind(*reverse_iter, stream) ||
+            reverse_iter->stealing() ||
+            state->time - table.real_time[reverse_iter->index()] <
+                state->min_real_channel_time)) {
+      ++reverse_iter;
+    }
+    if (reverse_iter == cutoff ||
+        iter->Priority() <= reverse_iter->Priority() * margin) {
+      // There is no more swapping that can be done.
+      break;
+    }
+    ChannelInternalState* victim = &*reverse_iter;
+    if (fade_milliseconds > 0 && victim->Playing()) {
+      victim->BeginSteal(fade_milliseconds);
+      stealing.push_back(victim);
+      ++reverse_iter;
+    } else {
+      TraceChannel(&state->trace, kTraceVirtualize, victim);
+      iter->Devirtualize(victim);
+      TraceChannel(&state->trace, kTraceDevirtualize, &*iter);
+      PINDROP_STATS_ONLY(++state->stats.devirtualizations);
+      table.real_time[iter->index()] = state->time;
+      ++swaps;
+    }
+  }
+  return swaps;
+}
+
+// Give the highest priority buffered and streamed channels the real and stream
+// channels. The two pools are assigned separately, so a stream never takes a
+// real channel from a buffered sound, nor the other way around.
+static void UpdateRealChannels(AudioEngineInternalState* state) {
+  std::vector<ChannelInternalState*>& stealing = state->stealing_channels;
+
+  // Forget the channels that were stopped or reused while fading out.
+  stealing.erase(std::remove_if(stealing.begin(), stealing.end(),
+                                [](const ChannelInternalState* channel) {
+                                  return !channel->stealing();
+                                }),
+                 stealing.end());
+
+  unsigned int swaps =
+      AssignRealChannels(state, false, &state->real_channel_free_list,
+                         state->real_channel_count) +
+      AssignRealChannels(state, true, &state->stream_channel_free_list,
+                         state->stream_channel_count);
+
+  // Any channel that finished fading out without being needed after all keeps
+  // its real channel, and fades back in from where it has got to.
+  for (auto iter = stealing.begin(); iter != stealing.end();) {
+    if ((*iter)->StealFinished()) {
+      (*iter)->CancelSteal(state->steal_fade_milliseconds);
+      iter = stealing.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+  state->channel_update_stats.swaps = swaps;
+  state->channel_update_stats.stealing = stealing.size();
+  state->channel_update_stats.streams = CountRealStreams(state);
+}
+
+// Update the final gain of every bus. The buses are stored parents first, so
+// this is a single pass over the array, and a bus only recomputes its gain if
+// it or one of its ancestors changed this frame.
+static void UpdateBusGains(AudioEngineInternalState* state, float delta_time) {
+  float master_gain = state->mute ? 0.0f : state->master_gain;
+  bool master_changed = master_gain != state->applied_master_gain;
+  state->applied_master_gain = master_gain;
+  std::vector<BusInternalState>& buses = state->buses;
+  std::vector<uint8_t>& changed = state->bus_gain_changed;
+  changed.resize(buses.size());
+  state->bus_gain_frames.resize(buses.size(), 0);
+  for (size_t i = 0; i < buses.size(); ++i) {
+    BusInternalState& bus = buses[i];
+    int parent = bus.parent_index();
+    bool parent_changed;
+    float parent_gain;
+    if (parent == BusInternalState::kNoParent) {
+      parent_changed = master_changed;
+      parent_gain = master_gain;
+    } else {
+      parent_changed = changed[parent] != 0;
+      parent_gain = state->bus_gains[parent];
+    }
+    changed[i] = bus.AdvanceFrame(delta_time, parent_gain, parent_changed);
+    if (changed[i]) {
+      state->bus_gain_frames[i] = state->current_frame;
+    }
+    state->bus_gains[i] = bus.gain();
+  }
+}
+
+ChannelTicket AudioEngine::QueuePlaySound(
+    SoundHandle sound_handle, const mathfu::Vector<float, 3>& location,
+    float gain) {
+  ChannelTicket ticket =
+      state_->next_ticket.fetch_add(1, std::memory_order_relaxed);
+  if (ticket == kInvalidChannelTicket) {
+    // The counter wrapped around.
+    ticket = state_->next_ticket.fetch_add(1, std::memory_order_relaxed);
+  }
+  Command command;
+  command.type = Command::kPlay;
+  command.ticket = ticket;
+  command.sound_collection = sound_handle;
+  command.location[0] = location.x;
+  command.location[1] = location.y;
+  command.location[2] = location.z;
+  command.gain = gain;
+  return state_->command_queue.Push(command) ? ticket : kInvalidChannelTicket;
+}
+
+bool AudioEngine::QueueStop(ChannelTicket ticket) {
+  Command command;
+  command.type = Command::kStop;
+  command.ticket = ticket;
+  return state_->command_queue.Push(command);
+}
+
+// Point a command at the given channel. A Channel played while the engine
+// updates on its own thread may not have an id yet, in which case the command
+// finds its channel by ticket.
+static void SetCommandChannel(Command* command, const Channel& channel) {
+  if (channel.ticket() != kInvalidChannelTicket) {
+    command->ticket = channel.ticket();
+  } else {
+    command->channel_id = channel.id();
+  }
+}
+
+bool AudioEngine::QueueStop(const Channel& channel) {
+  Command command;
+  command.type = Command::kStop;
+  SetCommandChannel(&command, channel);
+  return state_->command_queue.Push(command);
+}
+
+bool AudioEngine::QueueSetLocation(ChannelTicket ticket,
+                                   const mathfu::Vector<float, 3>& location) {
+  Command command;
+  command.type = Command::kSetLocation;
+  command.ticket = ticket;
+  command.location[0] = location.x;
+  command.location[1] = location.y;
+  command.location[2] = location.z;
+  return state_->command_queue.Push(command);
+}
+
+bool AudioEngine::QueueSetLocation(const Channel& channel,
+                                   const mathfu::Vector<float, 3>& location) {
+  Command command;
+  command.type = Command::kSetLocation;
+  SetCommandChannel(&command, channel);
+  command.location[0] = location.x;
+  command.location[1] = location.y;
+  command.location[2] = location.z;
+  return state_->command_queue.Push(command);
+}
+
+bool AudioEngine::QueueSetGain(ChannelTicket ticket, float gain) {
+  Command command;
+  command.type = Command::kSetGain;
+  command.ticket = ticket;
+  command.gain = gain;
+  return state_->command_queue.Push(command);
+}
+
+bool AudioEngine::QueueSetGain(const Channel& channel, float gain) {
+  Command command;
+  command.type = Command::kSetGain;
+  SetCommandChannel(&command, channel);
+  command.gain = gain;
+  return state_->command_queue.Push(command);
+}
+
+// Find the id of the channel the sound with the given ticket was played on.
+static ChannelId FindTicketChannel(const AudioEngineInternalState* state,
+                                   ChannelTicket ticket) {
+  const std::vector<QueuedChannel>& channels = state->ticket_channels;
+  if (ticket == kInvalidChannelTicket || channels.empty()) {
+    return kNullChannelId;
+  }
+  const QueuedChannel& entry = channels[ticket & (channels.size() - 1)];
+  return entry.ticket == ticket ? entry.channel_id : kNullChannelId;
+}
+
+Channel AudioEngine::FindQueuedChannel(ChannelTicket ticket) const {
+  UpdateLock lock(state_);
+  ChannelId id = FindTicketChannel(state_, ticket);
+  return FindChannelInternalState(state_, id) ? Channel(state_, id)
+                                               : Channel();
+}
+
+Channel AudioEngine::FindChannel(ChannelId id) const {
+  UpdateLock lock(state_);
+  return FindChannelInternalState(state_, id) ? Channel(state_, id)
+                                               : Channel();
+}
+
+// Start the queued sounds gathered so far as one batch, and record which
+// channel each ticket was played on.
+static void PlayQueuedSounds(AudioEngineInternalState* state) {
+  size_t count = state->queued_requests.size();
+  if (count == 0) {
+    return;
+  }
+  PlaySoundBatch(state, state->queued_requests.data(), count);
+  // Sounds that could not be played are recorded too, so that the game thread
+  // can tell them from sounds that have not been started yet. The new
+  // channels are published along with their tickets, so that a Channel never
+  // finds its id before its state.
+  std::lock_guard<std::mutex> lock(state->publish_mutex);
+  size_t mask = state->ticket_channels.size() - 1;
+  for (size_t i = 0; i < count; ++i) {
+    ChannelTicket ticket = state->queued_tickets[i];
+    ChannelId id = state->play_batch.channels[i];
+    QueuedChannel& entry = state->ticket_channels[ticket & mask];
+    entry.ticket = ticket;
+    entry.channel_id = id;
+    ChannelInternalState* channel = FindChannelInternalState(state, id);
+    if (channel && !state->published_channels.empty()) {
+      PublishChannel(*channel,
+                     &state->published_channels[ChannelIdIndex(id)]);
+    }
+  }
+  state->queued_requests.clear();
+  state->queued_tickets.clear();
+}
+
+// Carry out the commands queued from other threads, in order.
+static void ExecuteQueuedCommands(AudioEngineInternalState* state) {
+  // Take at most one queue's worth of commands, so that producers that keep
+  // queueing cannot hold up the frame indefinitely.
+  size_t limit = state->command_queue.capacity();
+  Command command;
+  for (size_t i = 0; i < limit && state->command_queue.Pop(&command); ++i) {
+    if (command.type == Command::kPlay) {
+      state->queued_requests.push_back(PlayRequest(
+          command.sound_collection,
+          mathfu::Vector<float, 3>(command.location), command.gain));
+      state->queued_tickets.push_back(command.ticket);
+      continue;
+    }
+
+    // The command may refer to a sound in the pending batch, so start it
+    // first.
+    PlayQueuedSounds(state);
+    ChannelId id = command.channel_id != kNullChannelId
+                       ? command.channel_id
+                       : FindTicketChannel(state, command.ticket);
+    ChannelInternalState* channel_state = FindChannelInternalState(state, id);
+    if (!channel_state) {
+      continue;
+    }
+    switch (command.type) {
+      case Command::kStop:
+        if (!channel_state->Stopped()) {
+          channel_state->Stop();
+        }
+        break;
+      case Command::kPause:
+        channel_state->Pause();
+        break;
+      case Command::kResume:
+        channel_state->Resume();
+        break;
+      case Command::kSetLocation:
+        channel_state->SetLocation(
+            mathfu::Vector<float, 3>(command.location));
+        break;
+      case Command::kSetGain:
+        channel_state->set_user_gain(command.gain);
+        break;
+      default:
+        break;
+    }
+  }
+  PlayQueuedSounds(state);
+}
+
+// Update the engine by one frame.
+static void UpdateFrame(AudioEngineInternalState* state, float delta_time) {
+  PINDROP_STATS_TIMER(&state->stats.frame_nanoseconds);
+  ++state->current_frame;
+  state->trace.set_frame(state->current_frame);
+  state->time += delta_time;
+  state->mixer.AdvanceFrame(delta_time);
+  ExecuteQueuedCommands(state);
+  {
+    PINDROP_STATS_TIMER(&state->stats.erase_finished_sounds_nanoseconds);
+    EraseFinishedSounds(state, delta_time);
+  }
+  TrimSampleCache(state);
+  {
+    PINDROP_STATS_TIMER(&state->stats.bus_update_nanoseconds);
+    for (size_t i = 0; i < state->buses.size(); ++i) {
+      state->buses[i].ResetDuckGain();
+    }
+    for (size_t i = 0; i < state->buses.size(); ++i) {
+      state->buses[i].UpdateDuckGain(delta_time, &state->trace);
+    }
+    UpdateBusGains(state, delta_time);
+  }
+  {
+    PINDROP_STATS_TIMER(&state->stats.channel_update_nanoseconds);
+    UpdateChannels(state);
+  }
+  {
+    PINDROP_STATS_TIMER(&state->stats.sort_nanoseconds);
+    RerankChannels(state);
+  }
+  {
+    PINDROP_STATS_TIMER(&state->stats.real_channel_update_nanoseconds);
+    // No point in updating which channels are real and virtual when paused.
+    if (!state->paused) {
+      UpdateRealChannels(state);
+      StartLoadedChannels(state);
+    }
+  }
+  CommitRealChannelUpdates(state);
+}
+
+// Hand the listeners as last set by the game over to the update thread.
+static void PublishListeners(AudioEngineInternalState* state) {
+  std::lock_guard<std::mutex> lock(state->publish_mutex);
+  for (auto iter = state->listener_list.begin();
+       iter != state->listener_list.end(); ++iter) {
+    iter->Publish();
+  }
+}
+
+// Hand the state of the channels over to the game thread, for Channel to
+// report while the engine updates on its own thread.
+static void PublishChannel(const ChannelInternalState& channel,
+                           PublishedChannel* published) {
+  published->id = channel.id();
+  published->playing = channel.Playing();
+  published->location = channel.Location();
+  published->gain = channel.user_gain();
+}
+
+static void PublishChannels(AudioEngineInternalState* state) {
+  std::lock_guard<std::mutex> lock(state->publish_mutex);
+  for (size_t i = 0; i < state->channel_state_memory.size(); ++i) {
+    PublishChannel(state->channel_state_memory[i],
+                   &state->published_channels[i]);
+  }
+}
+
+bool FindPublishedChannel(AudioEngineInternalState* state, ChannelId id,
+                          ChannelTicket ticket, PublishedChannel* channel) {
+  std::lock_guard<std::mutex> lock(state->publish_mutex);
+  if (id == kNullChannelId) {
+    if (ticket == kInvalidChannelTicket) {
+      return false;
+    }
+    size_t index = ticket & (state->ticket_channels.size() - 1);
+    const QueuedChannel& entry = state->ticket_channels[index];
+    if (entry.ticket != ticket) {
+      // The engine has not started the sound yet if the entry still holds an
+      // earlier ticket. A later one means the ticket is too old to look up.
+      const PendingPlay& pending = state->pending_plays[index];
+      if (static_cast<int32_t>(entry.ticket - ticket) >= 0 ||
+          pending.ticket != ticket) {
+        return false;
+      }
+      *channel = pending.channel;
+      return true;
+    }
+    id = entry.channel_id;
+  }
+  size_t index = ChannelIdIndex(id);
+  if (index >= state->published_channels.size() ||
+      state->published_channels[index].id != id) {
+    return false;
+  }
+  *channel = state->published_channels[index];
+  return true;
+}
+
+bool QueueChannelCommand(AudioEngineInternalState* state,
+                         const Command& command) {
+  if (command.channel_id == kNullChannelId &&
+      command.ticket != kInvalidChannelTicket) {
+    PendingPlay& pending =
+        state->pending_plays[command.ticket &
+                             (state->pending_plays.size() - 1)];
+    if (pending.ticket == command.ticket) {
+      switch (command.type) {
+        case Command::kStop:
+          pending.channel.playing = false;
+          break;
+        case Command::kSetLocation:
+          pending.channel.location =
+              mathfu::Vector<float, 3>(command.location);
+          break;
+        case Command::kSetGain:
+          pending.channel.gain = command.gain;
+          break;
+        default:
+          break;
+      }
+    }
+  }
+  if (!state->command_queue.Push(command)) {
+    CallLogFunc("Could not control channel: the command queue is full\n");
+    return false;
+  }
+  return true;
+}
+
+// Update the engine at a fixed rate until asked to stop.
+static void RunUpdateThread(AudioEngineInternalState* state) {
+  typedef std::chrono::steady_clock Clock;
+  const float delta_time = 1.0f / state->update_frequency;
+  const Clock::duration period = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<float>(delta_time));
+  Clock::time_point next_update = Clock::now();
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> update_lock(state->update_mutex);
+      {
+        std::lock_guard<std::mutex> publish_lock(state->publish_mutex);
+        if (state->stop_update_thread) {
           return;
         }
-        // Found a real channel that we can give to the higher priority
-        // channel.
-        iter->Devirtualize(&*reverse_iter);
+        for (auto iter = state->listener_list.begin();
+             iter != state->listener_list.end(); ++iter) {
+          iter->Consume();
+        }
       }
+      UpdateFrame(state, delta_time);
+      PublishChannels(state);
+    }
+
+    // Do not try to catch up on updates missed while stalled.
+    next_update += period;
+    Clock::time_point now = Clock::now();
+    if (next_update < now) {
+      next_update = now;
     }
+    std::unique_lock<std::mutex> publish_lock(state->publish_mutex);
+    state->update_condition.wait_until(publish_lock, next_update, [state]() {
+      return state->stop_update_thread;
+    });
   }
 }
 
 void AudioEngine::AdvanceFrame(float delta_time) {
-  ++state_->current_frame;
-  EraseFinishedSounds(state_);
-  for (size_t i = 0; i < state_->buses.size(); ++i) {
-    state_->buses[i].ResetDuckGain();
-  }
-  for (size_t i = 0; i < state_->buses.size(); ++i) {
-    state_->buses[i].UpdateDuckGain(delta_time);
+  if (state_->update_thread.joinable()) {
+    PublishListeners(state_);
+  } else {
+    UpdateFrame(state_, delta_time);
   }
-  if (state_->master_bus) {
-    float master_gain = state_->mute ? 0.0f : state_->master_gain;
-    state_->master_bus->AdvanceFrame(delta_time, master_gain);
+}
+
+void AudioEngine::GetSoundMemoryStats(SoundMemoryStats* stats) const {
+  UpdateLock lock(state_);
+  *stats = SoundMemoryStats();
+  {
+    std::lock_guard<std::mutex> assets_lock(state_->assets->mutex);
+    state_->assets->sample_cache.AddMemoryStats(stats);
   }
+  state_->mixer.AddMemoryStats(stats);
+}
+
+uint64_t AudioEngine::skipped_mixer_updates() const {
+  UpdateLock lock(state_);
+  return state_->skipped_mixer_updates;
+}
+
+void AudioEngine::GetChannelUpdateStats(ChannelUpdateStats* stats) const {
+  UpdateLock lock(state_);
+  *stats = state_->channel_update_stats;
+}
+
+size_t AudioEngine::sleeping_channel_count() const {
+  UpdateLock lock(state_);
+  return state_->channel_table.grid.size();
+}
+
+void AudioEngine::GetStats(EngineStats* stats) const {
+  *stats = EngineStats();
+#ifdef PINDROP_STATS
+  UpdateLock lock(state_);
+  *stats = state_->stats;
+  stats->enabled = true;
   PriorityList& list = state_->playing_channel_list;
   for (auto iter = list.begin(); iter != list.end(); ++iter) {
-    UpdateChannel(&*iter, state_);
-  }
-  list.sort(
-      [](const ChannelInternalState& a, const ChannelInternalState& b) -> bool {
-        return a.Priority() < b.Priority();
-      });
-  // No point in updating which channels are real and virtual when paused.
-  if (!state_->paused) {
-    UpdateRealChannels(&state_->playing_channel_list,
-                       &state_->real_channel_free_list,
-                       &state_->virtual_channel_free_list);
+    if (iter->is_real()) {
+      ++stats->real_channels;
+    } else {
+      ++stats->virtual_channels;
+    }
+  }
+  stats->loader_queue_depth = state_->assets->loader.queue_depth();
+  const SoundBankMap& banks = state_->sound_bank_map;
+  for (auto iter = banks.begin(); iter != banks.end(); ++iter) {
+    if (iter->second->ref_counter()->count() == 0) {
+      continue;
+    }
+    SoundBankStats bank;
+    bank.filename = iter->first;
+    bank.sample_bytes = iter->second->SampleBytes();
+    stats->sound_banks.push_back(bank);
+  }
+#endif  // PINDROP_STATS
+}
+
+void AudioEngine::StartTrace(size_t event_count) {
+  UpdateLock lock(state_);
+  state_->trace.Start(event_count);
+}
+
+void AudioEngine::StopTrace() {
+  UpdateLock lock(state_);
+  state_->trace.Stop();
+}
+
+void AudioEngine::GetTrace(std::string* json) const {
+  UpdateLock lock(state_);
+  state_->trace.WriteJson(json);
+}
+
+bool AudioEngine::WriteTrace(const std::string& filename) const {
+  std::string json;
+  GetTrace(&json);
+  FILE* file = fopen(filename.c_str(), "wb");
+  if (!file) {
+    CallLogFunc("Could not open %s to write the trace.\n", filename.c_str());
+    return false;
+  }
+  bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+  written &= fclose(file) == 0;
+  if (!written) {
+    CallLogFunc("Could not write the trace to %s.\n", filename.c_str());
   }
+  return written;
+}
+
+void AudioEngine::SeedRandom(uint32_t seed) {
+  UpdateLock lock(state_);
+  state_->random.Seed(seed);
 }
 
 const PindropVersion* AudioEngine::version() const { return state_->version; }
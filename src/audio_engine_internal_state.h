@@ -17,21 +17,36 @@
 
 #include "pindrop/audio_engine.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
+#include "asset_store_internal_state.h"
 #include "bus_internal_state.h"
 #include "channel_internal_state.h"
+#include "channel_table.h"
+#include "command_queue.h"
+#include "engine_stats.h"
+#include "file_buffer.h"
 #include "file_loader.h"
 #include "fplutil/intrusive_list.h"
 #include "listener_internal_state.h"
+#include "listener_table.h"
 #include "mathfu/utilities.h"
 #include "mathfu/vector.h"
 #include "mixer.h"
+#include "random.h"
+#include "sample_cache.h"
 #include "sound.h"
 #include "sound_bank.h"
 #include "sound_collection.h"
 #include "sound_collection_def_generated.h"
+#include "sound_id_table.h"
+#include "trace_recorder.h"
 
 namespace pindrop {
 
@@ -39,15 +54,27 @@ struct AudioConfig;
 struct BusDefList;
 struct SoundBankDef;
 
-typedef std::map<std::string, std::unique_ptr<SoundCollection>>
-    SoundCollectionMap;
-
-typedef std::map<std::string, std::string> SoundIdMap;
-
 typedef std::map<std::string, std::unique_ptr<SoundBank>> SoundBankMap;
 
 typedef std::vector<ChannelInternalState> ChannelStateVector;
 
+// A callback waiting for a sound bank to finish loading.
+struct PendingSoundBankCallback {
+  std::string filename;
+  SoundBankLoadedCallback callback;
+  void* userdata;
+};
+
+// A sound bank queued with AudioEngine::LoadSoundBanksAsync whose files are
+// still being read. It is loaded by TryFinalize once they have been.
+struct PendingSoundBank {
+  std::string filename;
+  int priority;
+  SoundBankLoadedCallback callback;
+  void* userdata;
+  std::unique_ptr<SoundBankFiles> files;
+};
+
 typedef std::vector<ListenerInternalState,
                     mathfu::simd_allocator<ListenerInternalState>>
     ListenerStateVector;
@@ -58,38 +85,154 @@ typedef fplutil::intrusive_list<ChannelInternalState> FreeList;
 
 typedef fplutil::intrusive_list<ListenerInternalState> ListenerList;
 
+// Scratch space used by AudioEngine::PlaySounds to work out the gain, pan and
+// priority of a batch of sounds at once. Indexed by request.
+struct PlayBatch {
+  void Resize(size_t size) {
+    location_x.resize(size);
+    location_y.resize(size);
+    location_z.resize(size);
+    listener_space_x.resize(size);
+    listener_space_y.resize(size);
+    listener_space_z.resize(size);
+    distance_squared.resize(size);
+    gain.resize(size);
+    pan_x.resize(size);
+    pan_y.resize(size);
+    priority.resize(size);
+    channels.resize(size);
+  }
+
+  std::vector<float> location_x;
+  std::vector<float> location_y;
+  std::vector<float> location_z;
+  std::vector<float> listener_space_x;
+  std::vector<float> listener_space_y;
+  std::vector<float> listener_space_z;
+  std::vector<float> distance_squared;
+  std::vector<float> gain;
+  std::vector<float> pan_x;
+  std::vector<float> pan_y;
+  std::vector<float> priority;
+
+  // The valid requests, sorted by priority before they are played.
+  std::vector<size_t> order;
+
+  // The id of the channel each request was played on, or kNullChannelId if it
+  // was not played. Ids are taken as each request starts, since a later
+  // request in the batch may stop and reuse an earlier one's channel.
+  std::vector<ChannelId> channels;
+};
+
+// A change to the gain or pan of a real channel to send to the mixer.
+struct RealChannelUpdate {
+  ChannelInternalState* channel;
+  bool gain;
+  bool pan;
+};
+
+// The channel a queued sound was played on.
+struct QueuedChannel {
+  QueuedChannel() : ticket(0), channel_id(kNullChannelId) {}
+
+  uint32_t ticket;
+  ChannelId channel_id;
+};
+
+// What a Channel reports about its channel while the engine updates on its
+// own thread.
+struct PublishedChannel {
+  PublishedChannel()
+      : id(kNullChannelId),
+        playing(false),
+        location(mathfu::kZeros3f),
+        gain(0.0f) {}
+
+  ChannelId id;
+  bool playing;
+  mathfu::Vector<float, 3> location;
+  float gain;
+};
+
+// A sound played from the game thread while the engine updates on its own
+// thread, as the game last saw it before the engine started it.
+struct PendingPlay {
+  PendingPlay() : ticket(kInvalidChannelTicket) {}
+
+  ChannelTicket ticket;
+  PublishedChannel channel;
+};
+
 struct AudioEngineInternalState {
   AudioEngineInternalState()
-      : playing_channel_list(&ChannelInternalState::priority_node),
+      : pin_sounds(false),
+        playing_channel_list(&ChannelInternalState::priority_node),
         real_channel_free_list(&ChannelInternalState::free_node),
+        stream_channel_free_list(&ChannelInternalState::free_node),
         virtual_channel_free_list(&ChannelInternalState::free_node),
-        listener_list(&ListenerInternalState::node) {}
+        real_channel_count(0),
+        stream_channel_count(0),
+        attenuation_lut_size(0),
+        lod_update_interval(1),
+        lod_cutoff_ratio(0.0f),
+        steal_priority_margin(0.0f),
+        min_real_channel_time(0.0f),
+        steal_fade_milliseconds(0),
+        mixer_update_threshold(0.0f),
+        skipped_mixer_updates(0),
+        listener_list(&ListenerInternalState::node),
+        current_frame(0),
+        listeners_changed_frame(0),
+        time(0.0) {}
 
   Mixer mixer;
 
   // Hold the audio bus list.
-  std::string buses_source;
+  FileBuffer buses_source;
 
   // The state of the buses.
   std::vector<BusInternalState> buses;
 
+  // The final gain of each bus, indexed the same way as buses.
+  std::vector<float> bus_gains;
+
+  // Scratch space used each frame to track which buses changed gain.
+  std::vector<uint8_t> bus_gain_changed;
+
+  // The frame on which each bus last changed gain.
+  std::vector<unsigned int> bus_gain_frames;
+
   // The master bus, cached to prevent needless lookups.
   BusInternalState* master_bus;
 
   // The gain applied to all buses.
   float master_gain;
 
+  // The master gain as it was last applied to the buses, taking mute into
+  // account. Negative before the first frame so that every bus gets updated.
+  float applied_master_gain;
+
   // If true, the master gain is ignored and all channels have a gain of 0.
   bool mute;
 
   // If true, the entire audio engine has paused all playback.
   bool paused;
 
-  // A map of sound names to SoundCollections.
-  SoundCollectionMap sound_collection_map;
+  // The Sounds of the loaded SoundCollections and the loader that loads them,
+  // shared with every other engine using the same AssetStore.
+  std::shared_ptr<AssetStoreInternalState> assets;
+
+  // True if the asset store has a sample budget, in which case channels pin
+  // the sounds they play so that those are not unloaded.
+  bool pin_sounds;
 
-  // A map of file names to sound ids to determine if a file needs to be loaded.
-  SoundIdMap sound_id_map;
+  // The channels that started before their sound had loaded. Their real
+  // channels start playing once it has.
+  std::vector<ChannelId> loading_channels;
+
+  // The loaded SoundCollections, indexed by id. The collections are owned by
+  // the sound banks that loaded them, which also index them by file name.
+  SoundIdTable sound_collection_table;
 
   // Hold the sounds banks.
   SoundBankMap sound_bank_map;
@@ -97,25 +240,188 @@ struct AudioEngineInternalState {
   // The preallocated pool of all ChannelInternalState objects
   ChannelStateVector channel_state_memory;
 
-  // The lists that track currently playing channels and free channels.
+  // The per-frame data of every ChannelInternalState, indexed by the
+  // channel's position in channel_state_memory.
+  ChannelTable channel_table;
+
+  // The lists that track currently playing channels and free channels. Free
+  // channels with a real channel for buffered sounds, with a stream channel
+  // for streamed sounds, and with neither are kept in separate lists.
   PriorityList playing_channel_list;
   FreeList real_channel_free_list;
+  FreeList stream_channel_free_list;
   FreeList virtual_channel_free_list;
 
+  // The number of real channels, which play buffered sounds, and stream
+  // channels, which play streamed sounds. Only this many of the highest
+  // priority channels of each kind are considered when assigning them.
+  unsigned int real_channel_count;
+  unsigned int stream_channel_count;
+
+  // The size of the attenuation lookup table to build for each positional
+  // sound collection, or zero for none.
+  unsigned int attenuation_lut_size;
+
+  // Scratch space used each frame to hold the channels whose priority changed
+  // and need to be moved in the priority list.
+  std::vector<ChannelInternalState*> reranked_channels;
+
+  // Scratch space used each frame to hold the grid cells the listeners are in.
+  std::vector<GridCell> listener_cells;
+
+  // Virtual channels whose priority is below lod_cutoff_ratio times the
+  // priority of the lowest real channel are only updated once every
+  // lod_update_interval frames.
+  unsigned int lod_update_interval;
+  float lod_cutoff_ratio;
+
+  // How the channels were updated on the last frame.
+  ChannelUpdateStats channel_update_stats;
+
+#ifdef PINDROP_STATS
+  // The counters and timings reported by AudioEngine::GetStats. The channel
+  // counts, loader queue depth and sound bank sizes are filled in when asked
+  // for rather than kept up to date.
+  EngineStats stats;
+#endif  // PINDROP_STATS
+
+  // Records channel and bus events between AudioEngine::StartTrace and
+  // AudioEngine::StopTrace.
+  TraceRecorder trace;
+
+  // A virtual channel only takes a real channel from a channel whose priority
+  // is lower by more than steal_priority_margin times its own, and that has
+  // been real for at least min_real_channel_time seconds. The real channel is
+  // faded out over steal_fade_milliseconds before it is handed over.
+  float steal_priority_margin;
+  float min_real_channel_time;
+  int steal_fade_milliseconds;
+
+  // The channels whose real channels are fading out to be given away.
+  std::vector<ChannelInternalState*> stealing_channels;
+
+  // Changes to gain and pan smaller than this are not sent to the mixer.
+  float mixer_update_threshold;
+
+  // The number of gain and pan changes that were too small to send to the
+  // mixer.
+  uint64_t skipped_mixer_updates;
+
+  // Scratch space used each frame to gather the changes that are sent to the
+  // mixer.
+  std::vector<RealChannelUpdate> real_channel_updates;
+
+  // Scratch space for AudioEngine::PlaySounds.
+  PlayBatch play_batch;
+
+  // Commands queued from other threads, carried out at the start of each
+  // frame.
+  CommandQueue command_queue;
+
+  // The next ticket to hand out for a queued sound.
+  std::atomic<uint32_t> next_ticket;
+
+  // The channels that recently queued sounds were played on, indexed by
+  // ticket modulo the size, which is a power of two. Each entry also holds its
+  // ticket, since later tickets reuse the entry.
+  std::vector<QueuedChannel> ticket_channels;
+
+  // The sounds played from the game thread that the engine may not have
+  // started yet, indexed like ticket_channels. Only used by the game thread.
+  std::vector<PendingPlay> pending_plays;
+
+  // Scratch space used to gather consecutive queued sounds into one batch.
+  std::vector<PlayRequest> queued_requests;
+  std::vector<uint32_t> queued_tickets;
+
   // The list of listeners.
   ListenerList listener_list;
+
+  // The engine side transforms of the listeners in listener_list, gathered
+  // before the listeners are searched.
+  ListenerTable listener_table;
   ListenerStateVector listener_state_memory;
   std::vector<ListenerInternalState*> listener_state_free_list;
 
-  // Loads the sound files.
-  FileLoader loader;
+  // The callbacks of sound banks that have not been reported as loaded yet.
+  std::vector<PendingSoundBankCallback> sound_bank_callbacks;
+
+  // The sound banks whose files are being read, in the order they were
+  // queued.
+  std::vector<PendingSoundBank> pending_sound_banks;
 
   // The current frame, i.e. the number of times AdvanceFrame has been called.
   unsigned int current_frame;
 
+  // The first frame whose channel updates saw the listeners as they are now.
+  unsigned int listeners_changed_frame;
+
+  // The total time, in seconds, the engine has been updated for.
+  double time;
+
+  // Chooses which sound of a collection each new channel plays.
+  Random random;
+
+  // The number of times per second the engine updates itself on its own
+  // thread, or zero if AdvanceFrame updates it directly.
+  float update_frequency;
+
+  // The state of each channel as of the last update on the engine's own
+  // thread, indexed like channel_state_memory.
+  std::vector<PublishedChannel> published_channels;
+
+  // The thread the engine updates itself on, when it has one. The thread holds
+  // update_mutex while it updates. publish_mutex guards the hand over of the
+  // listeners, published_channels, ticket_channels and stop_update_thread, and
+  // update_condition wakes the thread when it needs to stop.
+  std::thread update_thread;
+  std::mutex update_mutex;
+  std::mutex publish_mutex;
+  std::condition_variable update_condition;
+  bool stop_update_thread;
+
   const PindropVersion* version;
 };
 
+// Holds the update mutex while the engine updates itself on its own thread,
+// so that calls made from the game thread do not race with the update. The
+// engine and Bus functions the game calls take one of these, so nothing they
+// call may take another. Channel and PlaySound queue commands instead, so
+// they never wait for an update. Does nothing if the state is null.
+class UpdateLock {
+ public:
+  explicit UpdateLock(AudioEngineInternalState* state)
+      : mutex_(state && state->update_thread.joinable() ? &state->update_mutex
+                                                        : nullptr) {
+    if (mutex_) mutex_->lock();
+  }
+
+  ~UpdateLock() {
+    if (mutex_) mutex_->unlock();
+  }
+
+ private:
+  std::mutex* mutex_;
+};
+
+// Find the channel the given id refers to. Returns null if the id is no longer
+// valid.
+ChannelInternalState* FindChannelInternalState(AudioEngineInternalState* state,
+                                               ChannelId id);
+
+// Find what a Channel reports about the channel with the given id, or the
+// sound with the given ticket if the id is null, while the engine updates on
+// its own thread. Returns false if the Channel is no longer valid. Must be
+// called from the game thread.
+bool FindPublishedChannel(AudioEngineInternalState* state, ChannelId id,
+                          ChannelTicket ticket, PublishedChannel* channel);
+
+// Queue a command for a Channel while the engine updates on its own thread,
+// updating the sound it refers to if the engine has not started it yet. Must
+// be called from the game thread. Returns false if the queue is full.
+bool QueueChannelCommand(AudioEngineInternalState* state,
+                         const Command& command);
+
 // Find a bus with the given name.
 BusInternalState* FindBusInternalState(AudioEngineInternalState* state,
                                        const char* name);
@@ -154,6 +460,11 @@ float AttenuationCurve(float point, float lower_bound, float upper_bound,
 float CalculateDistanceAttenuation(float distance_squared,
                                    const SoundCollectionDef* def);
 
+// The same as above, using the parameters decoded from the def when the
+// collection was loaded.
+float CalculateDistanceAttenuation(float distance_squared,
+                                   const SoundCollectionParams& params);
+
 // Given a vector in listener space, return a vector inside a unit circle
 // representing the direction from the listener to the sound. A value of (-1, 0)
 // means the sound is directly to the listener's left, while a value of (1, 0)
@@ -163,7 +474,41 @@ float CalculateDistanceAttenuation(float distance_squared,
 mathfu::Vector<float, 2> CalculatePan(
     const mathfu::Vector<float, 3>& listener_space_location);
 
-bool LoadFile(const char* filename, std::string* dest);
+// The batched form of BestListener. For each of the count locations given by
+// x, y and z, find the closest listener and write the squared distance to it
+// and the location in its space to the output arrays. Locations are processed
+// four at a time using mathfu's SIMD vector types. The nearest listener is
+// found by distance in world space, and only it is used to transform the
+// location into listener space. If any listener's matrix scales or shears,
+// the locations are instead compared in every listener's space one at a time,
+// as BestListener does. Returns true on success, or false if the list was
+// empty.
+bool BestListenerBatch(float* distance_squared, float* listener_space_x,
+                       float* listener_space_y, float* listener_space_z,
+                       const ListenerList& listener_list, const float* x,
+                       const float* y, const float* z, size_t count);
+
+// The same as above, searching a ListenerTable, and only for the locations
+// whose entry in update is non-zero. If update is null every location is
+// searched. The outputs of the others are left unchanged, and a set of four
+// locations that are all skipped is not searched at all.
+bool BestListenerBatch(float* distance_squared, float* listener_space_x,
+                       float* listener_space_y, float* listener_space_z,
+                       const ListenerTable& listeners, const float* x,
+                       const float* y, const float* z, size_t count,
+                       const uint8_t* update);
+
+// Compute the gain and pan of every active channel in the table against the
+// given listeners, producing the same results as calling CalculateGainAndPan on
+// each channel in turn. The gain of each channel's bus is read from bus_gains
+// using the channel's cached bus index.
+//
+// Only the channels marked in the table's update column are computed.
+// Positional channels found to be out of range of every listener are put to
+// sleep in the table's grid.
+void CalculateGainAndPanBatch(ChannelTable* table,
+                              const ListenerTable& listeners,
+                              const float* bus_gains);
 
 }  // namespace pindrop
 
@@ -14,6 +14,7 @@
 
 #include "pindrop/bus.h"
 
+#include "audio_engine_internal_state.h"
 #include "bus_internal_state.h"
 
 namespace pindrop {
@@ -22,14 +23,24 @@ void Bus::Clear() { state_ = nullptr; }
 
 bool Bus::Valid() const { return state_ != nullptr; }
 
-void Bus::SetGain(float gain) { return state_->set_user_gain(gain); }
+void Bus::SetGain(float gain) {
+  UpdateLock lock(state_->engine_state());
+  state_->set_user_gain(gain);
+}
 
-float Bus::Gain() const { return state_->user_gain(); }
+float Bus::Gain() const {
+  UpdateLock lock(state_->engine_state());
+  return state_->user_gain();
+}
 
 void Bus::FadeTo(float gain, float duration) {
+  UpdateLock lock(state_->engine_state());
   state_->FadeTo(gain, duration);
 }
 
-float Bus::FinalGain() const { return state_->gain(); }
+float Bus::FinalGain() const {
+  UpdateLock lock(state_->engine_state());
+  return state_->gain();
+}
 
 }  // pindrop
@@ -19,19 +19,39 @@
 
 namespace pindrop {
 
+const int BusInternalState::kNoParent;
+
 void BusInternalState::FadeTo(float gain, float duration) {
   target_user_gain_ = gain;
   target_user_gain_step_ = (target_user_gain_ - user_gain_) / duration;
+  dirty_ = true;
 }
 
-void BusInternalState::Initialize(const BusDef* bus_def) {
+void BusInternalState::Initialize(const BusDef* bus_def, size_t index,
+                                  int parent_index,
+                                  AudioEngineInternalState* engine_state) {
   // Make sure we only initiliaze once.
   assert(bus_def_ == nullptr);
   bus_def_ = bus_def;
+  name_ = bus_def->name()->c_str();
+  engine_state_ = engine_state;
+  index_ = index;
+  parent_index_ = parent_index;
+}
+
+void BusInternalState::Reload(const BusDef* bus_def) {
+  bus_def_ = bus_def;
+  dirty_ = true;
 }
 
-void BusInternalState::UpdateDuckGain(float delta_time) {
+void BusInternalState::UpdateDuckGain(float delta_time,
+                                      TraceRecorder* trace) {
   bool playing = !playing_sound_list_.empty();
+  if (playing != ducking_ && !duck_buses_.empty()) {
+    trace->Record(playing ? kTraceDuckStart : kTraceDuckEnd,
+                  static_cast<uint32_t>(index_), bus_def_->name()->c_str());
+  }
+  ducking_ = playing;
   if (playing && transition_percentage_ <= 1.0f) {
     // Fading to duck gain.
     float fade_in_time = bus_def_->duck_fade_in_time();
@@ -59,25 +79,30 @@ void BusInternalState::UpdateDuckGain(float delta_time) {
   }
 }
 
-void BusInternalState::AdvanceFrame(float delta_time, float parent_gain) {
+bool BusInternalState::AdvanceFrame(float delta_time, float parent_gain,
+                                    bool parent_changed) {
+  bool changed = parent_changed || dirty_ || duck_gain_ != previous_duck_gain_;
+
   // Update fading.
-  user_gain_ += delta_time * target_user_gain_step_;
-  bool fading_complete =
-      (target_user_gain_step_ < 0 && user_gain_ < target_user_gain_) ||
-      (target_user_gain_step_ > 0 && user_gain_ > target_user_gain_);
-  if (fading_complete) {
-    user_gain_ = target_user_gain_;
-    target_user_gain_step_ = 0;
+  if (target_user_gain_step_ != 0.0f) {
+    user_gain_ += delta_time * target_user_gain_step_;
+    bool fading_complete =
+        (target_user_gain_step_ < 0 && user_gain_ < target_user_gain_) ||
+        (target_user_gain_step_ > 0 && user_gain_ > target_user_gain_);
+    if (fading_complete) {
+      user_gain_ = target_user_gain_;
+      target_user_gain_step_ = 0;
+    }
+    changed = true;
   }
+  dirty_ = false;
+  previous_duck_gain_ = duck_gain_;
 
   // Update final gain.
-  gain_ = bus_def_->gain() * parent_gain * duck_gain_ * user_gain_;
-  for (size_t i = 0; i < child_buses_.size(); ++i) {
-    BusInternalState* child_bus = child_buses_[i];
-    if (child_bus) {
-      child_bus->AdvanceFrame(delta_time, gain_);
-    }
+  if (changed) {
+    gain_ = bus_def_->gain() * parent_gain * duck_gain_ * user_gain_;
   }
+  return changed;
 }
 
 }  // namespace pindrop
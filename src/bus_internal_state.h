@@ -15,13 +15,16 @@
 #ifndef PINDROP_BUS_INTERNAL_STATE_H_
 #define PINDROP_BUS_INTERNAL_STATE_H_
 
+#include <string>
 #include <vector>
 
 #include "channel_internal_state.h"
 #include "fplutil/intrusive_list.h"
+#include "trace_recorder.h"
 
 namespace pindrop {
 
+struct AudioEngineInternalState;
 struct BusDef;
 
 typedef fplutil::intrusive_list<ChannelInternalState> BusList;
@@ -30,18 +33,51 @@ class BusInternalState {
  public:
   BusInternalState()
       : bus_def_(nullptr),
+        engine_state_(nullptr),
+        index_(0),
+        parent_index_(kNoParent),
         user_gain_(1.0f),
         target_user_gain_(1.0f),
         target_user_gain_step_(0.0f),
         duck_gain_(1.0f),
+        previous_duck_gain_(1.0f),
+        gain_(0.0f),
+        dirty_(true),
         playing_sound_list_(&ChannelInternalState::bus_node),
-        transition_percentage_(0.0f) {}
+        transition_percentage_(0.0f),
+        ducking_(false) {}
 
-  void Initialize(const BusDef* bus_def);
+  // The parent index of buses that are not the child of any other bus.
+  static const int kNoParent = -1;
+
+  // Initialize the bus with its definition, its index in the engine's bus
+  // array, the index of its parent bus and the engine it belongs to. Parents
+  // always come before their children in the array.
+  void Initialize(const BusDef* bus_def, size_t index, int parent_index,
+                  AudioEngineInternalState* engine_state);
+
+  // Replace the bus definition with a new one for the same bus, keeping the
+  // bus's fades, ducking and playing sounds. The final gain is recomputed on
+  // the next update.
+  void Reload(const BusDef* bus_def);
 
   // Return the bus definition.
   const BusDef* bus_def() const { return bus_def_; }
 
+  // Return the name of the bus, as decoded when it was initialized. Reloads
+  // compare against it rather than the old definition, whose file may have
+  // been rewritten in place.
+  const std::string& name() const { return name_; }
+
+  // Return the engine this bus belongs to.
+  AudioEngineInternalState* engine_state() const { return engine_state_; }
+
+  // Return the index of this bus in the engine's bus array.
+  size_t index() const { return index_; }
+
+  // Return the index of the parent bus, or kNoParent.
+  int parent_index() const { return parent_index_; }
+
   // Return the final gain after all modifiers have been applied (parent gain,
   // duck gain, bus gain, user gain).
   float gain() const { return gain_; }
@@ -51,6 +87,7 @@ class BusInternalState {
     user_gain_ = user_gain;
     target_user_gain_ = user_gain;
     target_user_gain_step_ = 0.0f;
+    dirty_ = true;
   }
 
   // Return the user gain.
@@ -76,14 +113,26 @@ class BusInternalState {
   BusList& playing_sound_list() { return playing_sound_list_; }
   const BusList& playing_sound_list() const { return playing_sound_list_; }
 
-  // Apply appropriate duck gain to all ducked buses.
-  void UpdateDuckGain(float delta_time);
+  // Apply appropriate duck gain to all ducked buses, recording when the bus
+  // starts and stops ducking them in the trace.
+  void UpdateDuckGain(float delta_time, TraceRecorder* trace);
 
-  // Recursively update the final gain of the bus.
-  void AdvanceFrame(float delta_time, float parent_gain);
+  // Update the fade and final gain of the bus. The final gain is only
+  // recomputed if the parent's gain changed this frame or if this bus's own
+  // fade, user gain or duck gain changed. Returns true if the final gain was
+  // recomputed, which the children use as their parent_changed value.
+  bool AdvanceFrame(float delta_time, float parent_gain, bool parent_changed);
 
  private:
   const BusDef* bus_def_;
+  std::string name_;
+
+  // The engine whose update lock guards this bus.
+  AudioEngineInternalState* engine_state_;
+
+  // The location of this bus and its parent in the engine's bus array.
+  size_t index_;
+  int parent_index_;
 
   // Children of a given bus have their gain multiplied against their parent's
   // gain.
@@ -106,15 +155,24 @@ class BusInternalState {
   // duck_buses_.
   float duck_gain_;
 
+  // The duck gain used to compute the current final gain.
+  float previous_duck_gain_;
+
   // The final gain to be applied to all sounds on this bus.
   float gain_;
 
+  // True if the user gain changed since the final gain was last computed.
+  bool dirty_;
+
   // Keeps track of how many sounds are being played on this bus.
   BusList playing_sound_list_;
 
   // If a sound is playing on this bus, all duck_buses_ should lower in volume
   // over time. This tracks how far we are into that transition.
   float transition_percentage_;
+
+  // True if a sound was playing on this bus on the last update.
+  bool ducking_;
 };
 
 }  // namespace pindrop
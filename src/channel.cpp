@@ -14,55 +14,151 @@
 
 #include "pindrop/channel.h"
 
+#include "audio_engine_internal_state.h"
 #include "channel_internal_state.h"
+#include "mathfu/constants.h"
 
 namespace pindrop {
 
-const int kFadeOutDurationMs = 10;
+ChannelInternalState* Channel::state() const {
+  return engine_state_ ? FindChannelInternalState(engine_state_, id_)
+                       : nullptr;
+}
+
+bool Channel::Queued() const {
+  return engine_state_ && engine_state_->update_thread.joinable();
+}
+
+// Queue a command for the channel, without any arguments.
+static void QueueCommand(AudioEngineInternalState* state, ChannelId id,
+                         ChannelTicket ticket, Command::Type type) {
+  Command command;
+  command.type = type;
+  command.channel_id = id;
+  command.ticket = ticket;
+  QueueChannelCommand(state, command);
+}
 
-void Channel::Clear() { state_ = nullptr; }
+void Channel::Clear() {
+  engine_state_ = nullptr;
+  id_ = kNullChannelId;
+  ticket_ = kInvalidChannelTicket;
+}
 
-bool Channel::Valid() const { return state_ != nullptr; }
+bool Channel::Valid() const {
+  if (Queued()) {
+    PublishedChannel channel;
+    return FindPublishedChannel(engine_state_, id_, ticket_, &channel);
+  }
+  UpdateLock lock(engine_state_);
+  return state() != nullptr;
+}
+
+ChannelId Channel::id() const {
+  if (id_ != kNullChannelId || ticket_ == kInvalidChannelTicket) {
+    return id_;
+  }
+  PublishedChannel channel;
+  return FindPublishedChannel(engine_state_, id_, ticket_, &channel)
+             ? channel.id
+             : kNullChannelId;
+}
 
 bool Channel::Playing() const {
-  assert(Valid());
-  return state_->Playing();
+  if (Queued()) {
+    PublishedChannel channel;
+    return FindPublishedChannel(engine_state_, id_, ticket_, &channel) &&
+           channel.playing;
+  }
+  UpdateLock lock(engine_state_);
+  ChannelInternalState* state = this->state();
+  return state && state->Playing();
 }
 
 void Channel::Stop() {
-  assert(Valid());
-  // Fade out rather than halting to avoid clicks.  However, SDL_Mixer will
-  // not fade out channels with a volume of 0.  Manually halt channels in this
-  // case.
-  if (!state_->is_real() || state_->real_channel().Gain() == 0.0f) {
-    state_->Halt();
-  } else {
-    state_->FadeOut(kFadeOutDurationMs);
+  if (Queued()) {
+    QueueCommand(engine_state_, id_, ticket_, Command::kStop);
+    return;
   }
+  UpdateLock lock(engine_state_);
+  ChannelInternalState* state = this->state();
+  if (state) state->Stop();
 }
 
 void Channel::Pause() {
-  assert(Valid());
-  state_->Pause();
+  if (Queued()) {
+    QueueCommand(engine_state_, id_, ticket_, Command::kPause);
+    return;
+  }
+  UpdateLock lock(engine_state_);
+  ChannelInternalState* state = this->state();
+  if (state) state->Pause();
 }
 
 void Channel::Resume() {
-  assert(Valid());
-  state_->Resume();
+  if (Queued()) {
+    QueueCommand(engine_state_, id_, ticket_, Command::kResume);
+    return;
+  }
+  UpdateLock lock(engine_state_);
+  ChannelInternalState* state = this->state();
+  if (state) state->Resume();
 }
 
 const mathfu::Vector<float, 3> Channel::Location() const {
-  assert(Valid());
-  return state_->Location();
+  if (Queued()) {
+    PublishedChannel channel;
+    return FindPublishedChannel(engine_state_, id_, ticket_, &channel)
+               ? channel.location
+               : mathfu::kZeros3f;
+  }
+  UpdateLock lock(engine_state_);
+  ChannelInternalState* state = this->state();
+  return state ? state->Location() : mathfu::kZeros3f;
 }
 
 void Channel::SetLocation(const mathfu::Vector<float, 3>& location) {
-  assert(Valid());
-  state_->SetLocation(location);
+  if (Queued()) {
+    Command command;
+    command.type = Command::kSetLocation;
+    command.channel_id = id_;
+    command.ticket = ticket_;
+    command.location[0] = location.x;
+    command.location[1] = location.y;
+    command.location[2] = location.z;
+    QueueChannelCommand(engine_state_, command);
+    return;
+  }
+  UpdateLock lock(engine_state_);
+  ChannelInternalState* state = this->state();
+  if (state) state->SetLocation(location);
 }
 
-void Channel::SetGain(float gain) { return state_->set_user_gain(gain); }
+void Channel::SetGain(float gain) {
+  if (Queued()) {
+    Command command;
+    command.type = Command::kSetGain;
+    command.channel_id = id_;
+    command.ticket = ticket_;
+    command.gain = gain;
+    QueueChannelCommand(engine_state_, command);
+    return;
+  }
+  UpdateLock lock(engine_state_);
+  ChannelInternalState* state = this->state();
+  if (state) state->set_user_gain(gain);
+}
 
-float Channel::Gain() const { return state_->user_gain(); }
+float Channel::Gain() const {
+  if (Queued()) {
+    PublishedChannel channel;
+    return FindPublishedChannel(engine_state_, id_, ticket_, &channel)
+               ? channel.gain
+               : 0.0f;
+  }
+  UpdateLock lock(engine_state_);
+  ChannelInternalState* state = this->state();
+  return state ? state->user_gain() : 0.0f;
+}
 
 }  // namespace pindrop
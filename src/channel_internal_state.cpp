@@ -31,32 +31,154 @@
 
 namespace pindrop {
 
+// How long Stop fades a channel out for.
+static const int kFadeOutDurationMs = 10;
+
 bool ChannelInternalState::IsStream() const {
-  return collection_->GetSoundCollectionDef()->stream() != 0;
+  return sound_collection()->params().stream;
 }
 
 // Removes this channel state from all lists.
 void ChannelInternalState::Remove() {
   free_node.remove();
   priority_node.remove();
+  table_->priority_index.Remove(index_);
   bus_node.remove();
+  if (instance_node.in_list()) {
+    sound_collection()->RemoveInstance(this);
+  }
+  set_active(false);
 }
 
 void ChannelInternalState::SetSoundCollection(SoundCollection* collection) {
-  if (collection_ && collection_->bus()) {
+  SoundCollection* previous = sound_collection();
+  if (previous && previous->bus()) {
     bus_node.remove();
   }
-  collection_ = collection;
-  if (collection_ && collection_->bus()) {
-    collection_->bus()->playing_sound_list().push_front(*this);
+  if (previous && instance_node.in_list()) {
+    previous->RemoveInstance(this);
+  }
+  table_->collection[index_] = collection;
+  table_->dirty[index_] = 1;
+  if (collection) {
+    collection->AddInstance(this);
+  }
+  if (collection && collection->bus()) {
+    collection->bus()->playing_sound_list().push_front(*this);
+    table_->bus_index[index_] = collection->bus()->index();
+  }
+  if (collection) {
+    set_gain(gain());
   }
 }
 
-bool ChannelInternalState::Play(SoundCollection* collection) {
-  collection_ = collection;
-  sound_ = collection->Select();
+void ChannelInternalState::UpdateBus() {
+  BusInternalState* bus = sound_collection()->bus();
+  bus_node.remove();
+  bus->playing_sound_list().push_front(*this);
+  table_->bus_index[index_] = bus->index();
+}
+
+void ChannelInternalState::set_gain(const float gain) {
+  table_->gain[index_] = gain;
+  table_->priority[index_] =
+      gain * sound_collection()->params().priority;
+}
+
+bool ChannelInternalState::Play(SoundCollection* collection,
+                                Random* random) {
+  table_->collection[index_] = collection;
+  sound_ = collection->Select(random);
   channel_state_ = kChannelStatePlaying;
-  return real_channel_.Valid() ? real_channel_.Play(collection_, sound_) : true;
+  resume_position_ = 0.0f;
+  table_->applied[index_] = 0;
+  table_->lod_frame[index_] = 0;
+  return is_real() && SoundReady() ? PlayReal(0.0f) : true;
+}
+
+bool ChannelInternalState::PlayReal(float position) {
+  return real_channel_.Valid()
+             ? real_channel_.Play(sound_collection(), sound_, position)
+             : stream_channel_.Play(sound_collection(), sound_, position);
+}
+
+bool ChannelInternalState::RealPlaying() const {
+  return real_channel_.Valid() ? real_channel_.Playing()
+                               : stream_channel_.Playing();
+}
+
+float ChannelInternalState::RealPosition() const {
+  return real_channel_.Valid() ? real_channel_.Position()
+                               : stream_channel_.Position();
+}
+
+float ChannelInternalState::RealGain() const {
+  return real_channel_.Valid() ? real_channel_.Gain() : stream_channel_.Gain();
+}
+
+void ChannelInternalState::FadeOutReal(int milliseconds) {
+  if (real_channel_.Valid()) {
+    real_channel_.FadeOut(milliseconds);
+  } else if (stream_channel_.Valid()) {
+    stream_channel_.FadeOut(milliseconds);
+  }
+}
+
+void ChannelInternalState::FadeInReal(int milliseconds) {
+  if (real_channel_.Valid()) {
+    real_channel_.FadeIn(milliseconds);
+  } else if (stream_channel_.Valid()) {
+    stream_channel_.FadeIn(milliseconds);
+  }
+}
+
+void ChannelInternalState::SetRealGain(float gain) {
+  if (real_channel_.Valid()) {
+    real_channel_.SetGain(gain);
+  } else if (stream_channel_.Valid()) {
+    stream_channel_.SetGain(gain);
+  }
+}
+
+void ChannelInternalState::PauseReal() {
+  if (real_channel_.Valid()) {
+    real_channel_.Pause();
+  } else if (stream_channel_.Valid()) {
+    stream_channel_.Pause();
+  }
+}
+
+void ChannelInternalState::ResumeReal() {
+  if (real_channel_.Valid()) {
+    real_channel_.Resume();
+  } else if (stream_channel_.Valid()) {
+    stream_channel_.Resume();
+  }
+}
+
+bool ChannelInternalState::SoundReady() const {
+  return !sound_ || sound_->ready();
+}
+
+void ChannelInternalState::PlayRealChannel() {
+  if (!SoundReady()) {
+    return;
+  }
+  if (Playing()) {
+    // Resume playing the audio.
+    PlayReal(resume_position_);
+  } else if (Paused()) {
+    // The audio needs to be playing to pause it.
+    PlayReal(resume_position_);
+    PauseReal();
+  }
+}
+
+void ChannelInternalState::PlayLoadedSound() {
+  if (is_real() && !stealing()) {
+    table_->applied[index_] = 0;
+    PlayRealChannel();
+  }
 }
 
 bool ChannelInternalState::Playing() const {
@@ -72,68 +194,102 @@ bool ChannelInternalState::Paused() const {
 }
 
 void ChannelInternalState::Halt() {
-  // If this channel loops, we may want to resume it later. If this is a one
-  // shot sound that does not loop, just halt it now.
-  // TODO(amablue): What we really want is for one shot sounds to change to the
-  // stopped state when the sound would have finished. However, SDL mixer does
-  // not give good visibility into the length of loaded audio, which makes this
-  // difficult. b/20697050
-  if (!collection_->GetSoundCollectionDef()->loop()) {
-    channel_state_ = kChannelStateStopped;
-  }
+  // Halting always stops the channel, whether or not its sound loops. Virtual
+  // one shot sounds that are left to play are only retired by
+  // AdvancePlayhead, once it reaches the end of the sound.
   if (real_channel_.Valid()) {
     real_channel_.Halt();
+  } else if (stream_channel_.Valid()) {
+    stream_channel_.Halt();
   }
   channel_state_ = kChannelStateStopped;
 }
 
-void ChannelInternalState::Pause() {
-  if (real_channel_.Valid()) {
-    real_channel_.Pause();
+void ChannelInternalState::Stop() {
+  // Fade out rather than halting to avoid clicks.  However, SDL_Mixer will
+  // not fade out channels with a volume of 0.  Manually halt channels in this
+  // case.
+  if (!is_real() || RealGain() == 0.0f) {
+    Halt();
+  } else {
+    FadeOut(kFadeOutDurationMs);
   }
+}
+
+void ChannelInternalState::Pause() {
+  PauseReal();
   channel_state_ = kChannelStatePaused;
 }
 
 void ChannelInternalState::Resume() {
-  if (real_channel_.Valid()) {
-    real_channel_.Resume();
-  }
+  ResumeReal();
   channel_state_ = kChannelStatePlaying;
 }
 
 void ChannelInternalState::FadeOut(int milliseconds) {
-  if (real_channel_.Valid()) {
-    real_channel_.FadeOut(milliseconds);
-  }
+  FadeOutReal(milliseconds);
   channel_state_ = kChannelStateFadingOut;
 }
 
 void ChannelInternalState::SetPan(const mathfu::Vector<float, 2>& pan) {
   if (real_channel_.Valid()) {
     real_channel_.SetPan(pan);
+  } else if (stream_channel_.Valid()) {
+    stream_channel_.SetPan(pan);
   }
 }
 
 void ChannelInternalState::Devirtualize(ChannelInternalState* other) {
-  assert(!real_channel_.Valid());
-  assert(other->real_channel_.Valid());
+  assert(!is_real());
+  assert(other->is_real());
+
+  // Remember where the other channel got to, so that it can pick up from
+  // there if it gets a real channel back. A channel that was faded out to be
+  // given away has kept track of that itself.
+  if (!other->Stopped() && !other->stealing()) {
+    other->resume_position_ = other->RealPosition();
+  }
 
-  // Transfer the real channel id to this channel.
+  // Transfer the real or stream channel to this channel. This channel has
+  // neither, so swapping both hands over whichever the other one had.
   std::swap(real_channel_, other->real_channel_);
+  std::swap(stream_channel_, other->stream_channel_);
+  std::swap(table_->real[index_], table_->real[other->index_]);
+  table_->applied[index_] = 0;
+  table_->stealing[index_] = 0;
+  table_->stealing[other->index_] = 0;
+  PlayRealChannel();
+}
 
-  if (Playing()) {
-    // Resume playing the audio.
-    real_channel_.Play(collection_, sound_);
-  } else if (Paused()) {
-    // The audio needs to be playing to pause it.
-    real_channel_.Play(collection_, sound_);
-    real_channel_.Pause();
+void ChannelInternalState::BeginSteal(int milliseconds) {
+  assert(is_real());
+  resume_position_ = RealPosition();
+  FadeOutReal(milliseconds);
+  table_->stealing[index_] = 1;
+}
+
+void ChannelInternalState::CancelSteal(int milliseconds) {
+  table_->stealing[index_] = 0;
+  table_->applied[index_] = 0;
+  if (Playing() && SoundReady() && PlayReal(resume_position_)) {
+    FadeInReal(milliseconds);
   }
 }
 
-float ChannelInternalState::Priority() const {
-  assert(collection_);
-  return gain() * collection_->GetSoundCollectionDef()->priority();
+void ChannelInternalState::AdvancePlayhead(float delta_time) {
+  if ((is_real() && !stealing()) || !Playing() || !sound_) {
+    return;
+  }
+  resume_position_ += delta_time;
+  float duration = sound_->duration();
+  if (duration <= 0.0f || resume_position_ < duration) {
+    return;
+  }
+  if (sound_collection()->params().loop) {
+    resume_position_ = std::fmod(resume_position_, duration);
+  } else {
+    channel_state_ = kChannelStateStopped;
+  }
 }
 
 void ChannelInternalState::UpdateState() {
@@ -143,12 +299,15 @@ void ChannelInternalState::UpdateState() {
       break;
     }
     case kChannelStatePlaying:
-      if (real_channel_.Valid() && !real_channel_.Playing()) {
+      // A real channel that stopped because it was faded out to be given away
+      // does not mean the sound has finished, and one waiting for its sound to
+      // load has not started yet.
+      if (is_real() && !RealPlaying() && !stealing() && SoundReady()) {
         channel_state_ = kChannelStateStopped;
       }
       break;
     case kChannelStateFadingOut: {
-      if (!real_channel_.Valid() || !real_channel_.Playing()) {
+      if (!is_real() || !RealPlaying()) {
         channel_state_ = kChannelStateStopped;
       }
       break;
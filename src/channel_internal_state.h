@@ -15,9 +15,11 @@
 #ifndef PINDROP_CHANNEL_INTERNAL_STATE_H_
 #define PINDROP_CHANNEL_INTERNAL_STATE_H_
 
+#include "channel_table.h"
 #include "fplutil/intrusive_list.h"
 #include "mathfu/vector.h"
 #include "pindrop/channel.h"
+#include "random.h"
 #include "real_channel.h"
 #include "sound.h"
 
@@ -35,15 +37,52 @@ class ChannelInternalState {
  public:
   ChannelInternalState()
       : real_channel_(),
+        stream_channel_(),
         channel_state_(kChannelStateStopped),
-        collection_(nullptr),
         sound_(nullptr),
-        location_() {}
+        pinned_(false),
+        resume_position_(0.0f),
+        table_(nullptr),
+        index_(0) {}
+
+  // Assign this channel its slot in the ChannelTable. The table holds the
+  // location, gains, priority and collection of the channel, and must outlive
+  // it.
+  void AttachToTable(ChannelTable* table, size_t index) {
+    table_ = table;
+    index_ = index;
+  }
+
+  // Return the index of this channel's slot in the ChannelTable.
+  size_t index() const { return index_; }
+
+  // Return the id that currently refers to this channel.
+  uint32_t id() const {
+    return MakeChannelId(index_, table_->generation[index_]);
+  }
+
+  // Move this channel on to its next generation, so that ids referring to the
+  // last sound played on it are no longer valid.
+  void IncrementGeneration() {
+    uint32_t& generation = table_->generation[index_];
+    generation = (generation + 1) & kChannelIdGenerationMask;
+    if (generation == 0) {
+      generation = 1;
+    }
+  }
 
   // Updates the state enum based on whether this channel is stopped, playing,
   // etc.
   void UpdateState();
 
+  // Move a virtual channel's playhead on by the given number of seconds, so
+  // that it picks up from the right place when it is devirtualized. A one shot
+  // sound whose playhead passes the end of its sound is stopped, and a looping
+  // one wraps around. Does nothing for real channels, which track their own
+  // position, unless they are fading out to be given away, or for sounds of
+  // unknown length, which never finish.
+  void AdvancePlayhead(float delta_time);
+
   // Returns true if this channel holds streaming data.
   bool IsStream() const;
 
@@ -52,25 +91,74 @@ class ChannelInternalState {
 
   // Get or set the sound collection playing on this channel. Note that when you set
   // the sound collection, you also add this channel to the bus list that
-  // corresponds to that sound collection.
+  // corresponds to that sound collection, and count it as one of the
+  // collection's instances.
   void SetSoundCollection(SoundCollection* collection);
-  SoundCollection* sound_collection() const { return collection_; }
+
+  // Move the channel to the bus its sound collection plays on, after the
+  // collection's definition was reloaded with a different bus.
+  void UpdateBus();
+
+  // Make the next update recompute the channel's gain and pan, after
+  // something they depend on has changed.
+  void MarkDirty() { table_->dirty[index_] = 1; }
+
+  SoundCollection* sound_collection() const {
+    return table_->collection[index_];
+  }
 
   // Get the current state of this channel (playing, stopped, paused, etc). This
   // is tracked manually because not all ChannelInternalStates are backed by
   // real channels.
   ChannelState channel_state() const { return channel_state_; }
 
-  // Get or set the location of this channel
+  // Get or set the location of this channel. A sleeping channel that moves to
+  // another cell is woken so that the next update checks it again.
   void SetLocation(const mathfu::Vector<float, 3>& location) {
-    location_ = location;
+    table_->location_x[index_] = location.x;
+    table_->location_y[index_] = location.y;
+    table_->location_z[index_] = location.z;
+    table_->dirty[index_] = 1;
+    SpatialGrid& grid = table_->grid;
+    if (grid.Contains(index_) &&
+        grid.CellAt(location.x, location.y, location.z) != grid.cell(index_)) {
+      grid.Remove(index_);
+    }
   }
   mathfu::Vector<float, 3> Location() const {
-    return mathfu::Vector<float, 3>(location_);
+    return mathfu::Vector<float, 3>(table_->location_x[index_],
+                                    table_->location_y[index_],
+                                    table_->location_z[index_]);
+  }
+
+  // Mark whether this channel is in the priority list and should be updated
+  // each frame. Either way the channel starts out awake, and is not giving up
+  // its real channel.
+  void set_active(bool active) {
+    table_->active[index_] = active ? 1 : 0;
+    table_->stealing[index_] = 0;
+    table_->grid.Remove(index_);
   }
+  bool active() const { return table_->active[index_] != 0; }
+
+  // Play a sound on this channel, chosen from the collection using the given
+  // random number generator. If the sound has not loaded yet, the real channel
+  // is left silent until PlayLoadedSound is called.
+  bool Play(SoundCollection* collection, Random* random);
+
+  // Return the sound chosen by Play.
+  Sound* sound() const { return sound_; }
 
-  // Play a sound on this channel.
-  bool Play(SoundCollection* collection);
+  // Returns true unless the sound chosen by Play is still loading.
+  bool SoundReady() const;
+
+  // Start the real channel of a channel whose sound had not loaded when Play
+  // was called, picking up from where a virtual channel would have got to.
+  void PlayLoadedSound();
+
+  // Mark whether the channel holds a pin on its sound in the sample cache.
+  void set_pinned(bool pinned) { pinned_ = pinned; }
+  bool pinned() const { return pinned_; }
 
   // Check if this channel is currently playing on a real or virtual channel.
   bool Playing() const;
@@ -82,16 +170,24 @@ class ChannelInternalState {
   bool Paused() const;
 
   // Set and query the user gain of this channel.
-  void set_user_gain(const float user_gain) { user_gain_ = user_gain; }
-  float user_gain() const { return user_gain_; }
+  void set_user_gain(const float user_gain) {
+    table_->user_gain[index_] = user_gain;
+    table_->dirty[index_] = 1;
+  }
+  float user_gain() const { return table_->user_gain[index_]; }
 
-  // Set and query the current gain of this channel.
-  void set_gain(const float gain) { gain_ = gain; }
-  float gain() const { return gain_; }
+  // Set and query the current gain of this channel. Setting the gain also
+  // updates the cached priority of the channel.
+  void set_gain(const float gain);
+  float gain() const { return table_->gain[index_]; }
 
   // Immediately stop the audio. May cause clicking.
   void Halt();
 
+  // Stop the audio with a short fade out to avoid clicks, or halt it if it
+  // can not fade.
+  void Stop();
+
   // Pauses this channel.
   void Pause();
 
@@ -104,20 +200,65 @@ class ChannelInternalState {
   // Sets the pan based on a position in a unit circle.
   void SetPan(const mathfu::Vector<float, 2>& pan);
 
+  // Set the gain of the real or stream channel, if this channel has one.
+  void SetRealGain(float gain);
+
+  // Pause or resume the real or stream channel, if this channel has one,
+  // without changing whether this channel is considered paused.
+  void PauseReal();
+  void ResumeReal();
+
   // Devirtualizes a virtual channel. This transfers ownership of the given
-  // channel's channel_id to this channel.
+  // channel's real or stream channel to this channel.
   void Devirtualize(ChannelInternalState* other);
 
+  // Start fading out the real channel so that it can be given to a higher
+  // priority channel without a click. The channel keeps its real channel, and
+  // carries on playing as far as its state is concerned, until it is handed
+  // over with Devirtualize once the fade has finished. Its playhead keeps
+  // moving in the meantime, as if it were virtual.
+  void BeginSteal(int milliseconds);
+
+  // Returns true if the real channel is fading out to be given away.
+  bool stealing() const { return table_->stealing[index_] != 0; }
+
+  // Returns true if the real channel has finished fading out to be given away.
+  bool StealFinished() const { return !RealPlaying(); }
+
+  // Keep the real channel after all, playing the sound again from where it has
+  // got to by now, and fading it back in over the given number of
+  // milliseconds.
+  void CancelSteal(int milliseconds);
+
   // Returns the priority of this channel based on its gain and priority
-  // multiplier on the sound collection definition.
-  float Priority() const;
+  // multiplier on the sound collection definition. This is cached in the
+  // ChannelTable whenever the gain or sound collection changes.
+  float Priority() const { return table_->priority[index_]; }
 
-  // Returns the real channel.
+  // Returns the real channel, which plays buffered sounds.
   RealChannel& real_channel() { return real_channel_; }
   const RealChannel& real_channel() const { return real_channel_; }
 
-  // Returns true if the real channel is valid.
-  bool is_real() { return real_channel_.Valid(); }
+  // Returns the stream channel, which plays streamed sounds.
+  StreamChannel& stream_channel() { return stream_channel_; }
+  const StreamChannel& stream_channel() const { return stream_channel_; }
+
+  // Returns true if this channel has a real or stream channel to play on.
+  bool is_real() const {
+    return real_channel_.Valid() || stream_channel_.Valid();
+  }
+
+  // Give this channel the given mixer's real channel with the given index.
+  void InitializeRealChannel(Mixer* mixer, int index) {
+    real_channel_.Initialize(mixer, index);
+    table_->real[index_] = 1;
+  }
+
+  // Give this channel the given mixer's stream channel with the given index.
+  void InitializeStreamChannel(Mixer* mixer, int index) {
+    stream_channel_.Initialize(mixer, index);
+    table_->real[index_] = 1;
+  }
 
   // The node that tracks the location in the priority list.
   fplutil::intrusive_list_node priority_node;
@@ -128,26 +269,55 @@ class ChannelInternalState {
   // The node that tracks the list of sounds playing on a given bus.
   fplutil::intrusive_list_node bus_node;
 
+  // The node that tracks the list of channels playing a given collection.
+  fplutil::intrusive_list_node instance_node;
+
  private:
+  // Play the sound on the real channel from the resume position, in the state
+  // the channel is in. Does nothing until the sound has loaded.
+  void PlayRealChannel();
+
+  // Play the sound from the given number of seconds in on the real or stream
+  // channel, whichever this channel has.
+  bool PlayReal(float position);
+
+  // Query the real or stream channel, whichever this channel has.
+  bool RealPlaying() const;
+  float RealPosition() const;
+  float RealGain() const;
+
+  // Fade out the real or stream channel, whichever this channel has, without
+  // changing the state of this channel.
+  void FadeOutReal(int milliseconds);
+
+  // Fade in the sound just played on the real or stream channel, whichever
+  // this channel has.
+  void FadeInReal(int milliseconds);
+
+  // A channel has at most one of these at a time: a real channel if it plays a
+  // buffered sound, or a stream channel if it plays a streamed one.
   RealChannel real_channel_;
+  StreamChannel stream_channel_;
 
   // Whether this channel is currently playing, stopped, fading out, etc.
   ChannelState channel_state_;
 
-  // The collection of the sound being played on this channel.
-  SoundCollection* collection_;
-
   // The sound source that was chosen from the sound collection.
   Sound* sound_;
 
-  // The gain set by the user.
-  float user_gain_;
+  // True if the channel holds a pin on sound_.
+  bool pinned_;
 
-  // The gain of this channel.
-  float gain_;
+  // How far into the sound, in seconds, the channel has played while virtual
+  // or while its real channel fades out to be given away, starting from where
+  // the real channel had got to when it was taken away. The sound picks up
+  // from here when it is devirtualized, or when a steal is cancelled.
+  float resume_position_;
 
-  // The location of this channel's sound.
-  mathfu::VectorPacked<float, 3> location_;
+  // The table holding the location, gains, priority and collection of this
+  // channel, and the index of this channel's slot in it.
+  ChannelTable* table_;
+  size_t index_;
 };
 
 }  // namespace pindrop
@@ -0,0 +1,192 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_CHANNEL_TABLE_H_
+#define PINDROP_CHANNEL_TABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "priority_index.h"
+#include "spatial_grid.h"
+
+namespace pindrop {
+
+class SoundCollection;
+
+// A ChannelId packs the index of a channel in the pool into its low bits and
+// the channel's generation into the rest. Generation zero is never used, so
+// kNullChannelId never refers to a channel.
+static const uint32_t kChannelIdIndexBits = 20;
+static const uint32_t kChannelIdIndexMask = (1u << kChannelIdIndexBits) - 1;
+static const uint32_t kChannelIdGenerationMask =
+    (1u << (32 - kChannelIdIndexBits)) - 1;
+
+// The largest channel pool that ChannelIds can address.
+static const size_t kMaxChannelPoolSize = kChannelIdIndexMask + 1;
+
+inline uint32_t MakeChannelId(size_t index, uint32_t generation) {
+  return (generation << kChannelIdIndexBits) |
+         static_cast<uint32_t>(index & kChannelIdIndexMask);
+}
+
+inline size_t ChannelIdIndex(uint32_t id) { return id & kChannelIdIndexMask; }
+
+inline uint32_t ChannelIdGeneration(uint32_t id) {
+  return id >> kChannelIdIndexBits;
+}
+
+// The per-channel data that is read and written every frame, stored as a
+// structure of arrays. Each ChannelInternalState owns one slot in the table,
+// identified by its index in the channel pool, so the per-frame gain, pan and
+// priority pass can be done as a linear scan over contiguous arrays rather
+// than by walking the priority list.
+struct ChannelTable {
+  ChannelTable() {}
+
+  void Resize(size_t size) {
+    location_x.resize(size, 0.0f);
+    location_y.resize(size, 0.0f);
+    location_z.resize(size, 0.0f);
+    listener_space_x.resize(size, 0.0f);
+    listener_space_y.resize(size, 0.0f);
+    listener_space_z.resize(size, 0.0f);
+    distance_squared.resize(size, 0.0f);
+    pan_x.resize(size, 0.0f);
+    pan_y.resize(size, 0.0f);
+    applied_gain.resize(size, 0.0f);
+    applied_pan_x.resize(size, 0.0f);
+    applied_pan_y.resize(size, 0.0f);
+    applied.resize(size, 0);
+    previous_gain.resize(size, 0.0f);
+    previous_pan_x.resize(size, 0.0f);
+    previous_pan_y.resize(size, 0.0f);
+    update.resize(size, 0);
+    dirty.resize(size, 1);
+    lod_gain.resize(size, 0.0f);
+    lod_gain_rate.resize(size, 0.0f);
+    lod_frame.resize(size, 0);
+    user_gain.resize(size, 1.0f);
+    gain.resize(size, 0.0f);
+    priority.resize(size, 0.0f);
+    collection.resize(size, nullptr);
+    bus_index.resize(size, 0);
+    active.resize(size, 0);
+    real.resize(size, 0);
+    stealing.resize(size, 0);
+    real_time.resize(size, 0.0);
+    generation.resize(size, 1);
+    priority_index.Initialize(&priority, size);
+    grid.Initialize(&asleep, size);
+  }
+
+  size_t size() const { return active.size(); }
+
+  // The location of the channel's sound.
+  std::vector<float> location_x;
+  std::vector<float> location_y;
+  std::vector<float> location_z;
+
+  // The location of the channel's sound in the space of its nearest listener,
+  // and the squared distance to that listener, computed on the last update.
+  std::vector<float> listener_space_x;
+  std::vector<float> listener_space_y;
+  std::vector<float> listener_space_z;
+  std::vector<float> distance_squared;
+
+  // The pan computed for the channel on the last update.
+  std::vector<float> pan_x;
+  std::vector<float> pan_y;
+
+  // The gain and pan last sent to the channel's real channel. They are only
+  // meaningful when applied is non-zero; it is cleared whenever the real
+  // channel starts a sound, so that the next update sends both.
+  std::vector<float> applied_gain;
+  std::vector<float> applied_pan_x;
+  std::vector<float> applied_pan_y;
+  std::vector<uint8_t> applied;
+
+  // The gain and pan of the channel when its updates were last committed, used
+  // to tell when a change too small to send right away has stopped moving.
+  std::vector<float> previous_gain;
+  std::vector<float> previous_pan_x;
+  std::vector<float> previous_pan_y;
+
+  // Non-zero if the channel's gain, pan and priority are computed on this
+  // frame. Channels far below the real channels are only computed every few
+  // frames, and their gain is extrapolated in between.
+  std::vector<uint8_t> update;
+
+  // Non-zero if the channel's location, user gain or collection changed since
+  // its gain and pan were last computed. Channels that are not dirty, and
+  // whose listeners and bus have not changed either, keep their gain and pan.
+  std::vector<uint8_t> dirty;
+
+  // The gain computed on the channel's last update, how much it changed per
+  // frame since the update before, and the frame it was computed on. A frame
+  // of zero means the channel has not been updated since it started playing.
+  std::vector<float> lod_gain;
+  std::vector<float> lod_gain_rate;
+  std::vector<uint32_t> lod_frame;
+
+  // The gain set by the user.
+  std::vector<float> user_gain;
+
+  // The final gain of the channel, and the priority derived from it.
+  std::vector<float> gain;
+  std::vector<float> priority;
+
+  // The collection playing on the channel. Collections do not have a stable
+  // index of their own, so the collection pointer is stored directly.
+  std::vector<SoundCollection*> collection;
+
+  // The index of the bus the collection plays on, in the engine's bus array.
+  std::vector<size_t> bus_index;
+
+  // Non-zero if the channel is in the priority list and should be updated.
+  std::vector<uint8_t> active;
+
+  // Non-zero if the channel is currently backed by a real channel. This
+  // mirrors RealChannel::Valid() so the update pass does not need to touch the
+  // ChannelInternalState to find out.
+  std::vector<uint8_t> real;
+
+  // Non-zero if the channel's real channel is fading out so that it can be
+  // given to a higher priority channel.
+  std::vector<uint8_t> stealing;
+
+  // The engine time, in seconds, at which the channel was last given a real
+  // channel.
+  std::vector<double> real_time;
+
+  // Non-zero if the channel is too far from every listener to be heard and is
+  // skipped by the update pass until the grid wakes it. Written by the grid.
+  std::vector<uint8_t> asleep;
+
+  // The generation of each channel, which changes every time the channel is
+  // given to a new sound. A ChannelId is only valid while its generation
+  // matches.
+  std::vector<uint32_t> generation;
+
+  // An index over the playing channels, ordered by priority.
+  PriorityIndex priority_index;
+
+  // A grid over the locations of the sleeping channels.
+  SpatialGrid grid;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_CHANNEL_TABLE_H_
@@ -0,0 +1,80 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "command_queue.h"
+
+namespace pindrop {
+
+CommandQueue::CommandQueue()
+    : mask_(0), enqueue_position_(0), dequeue_position_(0) {}
+
+void CommandQueue::Initialize(size_t capacity) {
+  size_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  slots_.reset(new Slot[size]);
+  for (size_t i = 0; i < size; ++i) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  mask_ = size - 1;
+  enqueue_position_.store(0, std::memory_order_relaxed);
+  dequeue_position_.store(0, std::memory_order_relaxed);
+}
+
+bool CommandQueue::Push(const Command& command) {
+  if (!slots_) return false;
+  size_t position = enqueue_position_.load(std::memory_order_relaxed);
+  Slot* slot;
+  for (;;) {
+    slot = &slots_[position & mask_];
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    intptr_t difference =
+        static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+    if (difference == 0) {
+      // The slot is free. Claim it, unless another producer got there first.
+      if (enqueue_position_.compare_exchange_weak(
+              position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      // The consumer has not yet emptied this slot, so the queue is full.
+      return false;
+    } else {
+      position = enqueue_position_.load(std::memory_order_relaxed);
+    }
+  }
+  slot->command = command;
+  slot->sequence.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+bool CommandQueue::Pop(Command* command) {
+  if (!slots_) return false;
+  size_t position = dequeue_position_.load(std::memory_order_relaxed);
+  Slot* slot = &slots_[position & mask_];
+  size_t sequence = slot->sequence.load(std::memory_order_acquire);
+  if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1) <
+      0) {
+    // No producer has finished writing this slot yet.
+    return false;
+  }
+  *command = slot->command;
+  // Hand the slot back to the producers for the next lap around the ring.
+  slot->sequence.store(position + mask_ + 1, std::memory_order_release);
+  dequeue_position_.store(position + 1, std::memory_order_relaxed);
+  return true;
+}
+
+}  // namespace pindrop
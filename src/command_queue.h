@@ -0,0 +1,105 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_COMMAND_QUEUE_H_
+#define PINDROP_COMMAND_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace pindrop {
+
+class SoundCollection;
+
+// A request queued from another thread, to be carried out by the engine the
+// next time it advances a frame.
+struct Command {
+  enum Type { kPlay, kStop, kPause, kResume, kSetLocation, kSetGain };
+
+  Command()
+      : type(kPlay),
+        ticket(0),
+        channel_id(0),
+        sound_collection(nullptr),
+        gain(1.0f) {
+    location[0] = location[1] = location[2] = 0.0f;
+  }
+
+  Type type;
+
+  // The ticket of the sound the command applies to. For kPlay, the ticket the
+  // new channel is given.
+  uint32_t ticket;
+
+  // The id of the channel the command applies to. If non-zero, this is used
+  // instead of the ticket.
+  uint32_t channel_id;
+
+  // The collection to play. Only used by kPlay.
+  SoundCollection* sound_collection;
+
+  // The location of the sound. Used by kPlay and kSetLocation.
+  float location[3];
+
+  // The gain of the sound. Used by kPlay and kSetGain.
+  float gain;
+};
+
+// A bounded, lock free queue that any number of threads may push commands to
+// and a single thread pops them from. Each slot carries a sequence number
+// that tells producers and the consumer whose turn it is, so neither side
+// ever waits on a lock. Pushing to a full queue fails rather than blocking.
+class CommandQueue {
+ public:
+  CommandQueue();
+
+  // Allocate space for at least capacity commands, rounded up to a power of
+  // two. Must be called before the queue is shared with other threads.
+  void Initialize(size_t capacity);
+
+  // Add a command to the queue. Safe to call from any thread. Returns false if
+  // the queue is full.
+  bool Push(const Command& command);
+
+  // Remove the oldest command from the queue. Must only be called from one
+  // thread at a time. Returns false if the queue is empty.
+  bool Pop(Command* command);
+
+  size_t capacity() const { return mask_ + 1; }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    Command command;
+  };
+
+  // The size of a cache line, used to keep the producer and consumer
+  // positions from sharing one.
+  static const size_t kCacheLineSize = 64;
+
+  std::unique_ptr<Slot[]> slots_;
+  size_t mask_;
+
+  char padding0_[kCacheLineSize];
+  std::atomic<size_t> enqueue_position_;
+  char padding1_[kCacheLineSize];
+  std::atomic<size_t> dequeue_position_;
+  char padding2_[kCacheLineSize];
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_COMMAND_QUEUE_H_
@@ -0,0 +1,71 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_ENGINE_STATS_H_
+#define PINDROP_ENGINE_STATS_H_
+
+#ifdef PINDROP_STATS
+#include <chrono>
+#include <cstdint>
+#endif  // PINDROP_STATS
+
+namespace pindrop {
+
+// The engine statistics are only gathered when PINDROP_STATS is defined. The
+// macros below wrap every statement that gathers them, so that without it they
+// compile to nothing and the engine pays nothing for them.
+#ifdef PINDROP_STATS
+
+// Records how long the enclosing scope took, in nanoseconds.
+class PhaseTimer {
+ public:
+  explicit PhaseTimer(uint64_t* nanoseconds)
+      : nanoseconds_(nanoseconds), start_(std::chrono::steady_clock::now()) {}
+
+  ~PhaseTimer() {
+    *nanoseconds_ = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_)
+            .count());
+  }
+
+ private:
+  PhaseTimer(const PhaseTimer&);
+  PhaseTimer& operator=(const PhaseTimer&);
+
+  uint64_t* nanoseconds_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+#define PINDROP_STATS_CONCATENATE_INNER(a, b) a##b
+#define PINDROP_STATS_CONCATENATE(a, b) PINDROP_STATS_CONCATENATE_INNER(a, b)
+
+// Time the rest of the enclosing scope into the given uint64_t.
+#define PINDROP_STATS_TIMER(nanoseconds)                                  \
+  ::pindrop::PhaseTimer PINDROP_STATS_CONCATENATE(pindrop_phase_timer_, \
+                                                  __LINE__)(nanoseconds)
+
+// Run the given statement only when gathering statistics.
+#define PINDROP_STATS_ONLY(statement) statement
+
+#else
+
+#define PINDROP_STATS_TIMER(nanoseconds)
+#define PINDROP_STATS_ONLY(statement)
+
+#endif  // PINDROP_STATS
+
+}  // namespace pindrop
+
+#endif  // PINDROP_ENGINE_STATS_H_
@@ -0,0 +1,205 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "file_buffer.h"
+
+#include <utility>
+
+#include "SDL.h"
+#include "pindrop/log.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PINDROP_FILE_BUFFER_MMAP 1
+#endif
+
+#ifdef __ANDROID__
+#include <android/asset_manager.h>
+#include <android/asset_manager_jni.h>
+#include <jni.h>
+#endif  // __ANDROID__
+
+namespace pindrop {
+
+FileBuffer::FileBuffer()
+    : data_(nullptr),
+      size_(0),
+      mapping_(nullptr),
+#ifdef __ANDROID__
+      asset_(nullptr),
+#endif  // __ANDROID__
+      heap_() {
+}
+
+FileBuffer::~FileBuffer() { Release(); }
+
+bool FileBuffer::Load(const char* filename) {
+  Release();
+  if (MapAsset(filename) || MapFile(filename) || ReadFile(filename)) {
+    return true;
+  }
+  CallLogFunc("Could not load %s\n", filename);
+  Release();
+  return false;
+}
+
+void FileBuffer::Assign(const std::string& source) {
+  Release();
+  heap_ = source;
+  data_ = heap_.data();
+  size_ = heap_.size();
+}
+
+void FileBuffer::Release() {
+#ifdef PINDROP_FILE_BUFFER_MMAP
+  if (mapping_) {
+    munmap(mapping_, size_);
+  }
+#endif  // PINDROP_FILE_BUFFER_MMAP
+#ifdef __ANDROID__
+  if (asset_) {
+    AAsset_close(asset_);
+    asset_ = nullptr;
+  }
+#endif  // __ANDROID__
+  mapping_ = nullptr;
+  std::string().swap(heap_);
+  data_ = nullptr;
+  size_ = 0;
+}
+
+void FileBuffer::Swap(FileBuffer* other) {
+  std::swap(data_, other->data_);
+  std::swap(size_, other->size_);
+  std::swap(mapping_, other->mapping_);
+#ifdef __ANDROID__
+  std::swap(asset_, other->asset_);
+#endif  // __ANDROID__
+  heap_.swap(other->heap_);
+  // Short strings are stored inside the string itself, so the copies on the
+  // heap have to be found again.
+  if (!heap_.empty()) {
+    data_ = heap_.data();
+  }
+  if (!other->heap_.empty()) {
+    other->data_ = other->heap_.data();
+  }
+}
+
+#ifdef __ANDROID__
+// SDL looks up relative paths in the application's assets, so do the same.
+// The asset manager is fetched from the activity once and kept for the life of
+// the process.
+static AAssetManager* GetAssetManager() {
+  static AAssetManager* asset_manager = nullptr;
+  if (!asset_manager) {
+    JNIEnv* env = static_cast<JNIEnv*>(SDL_AndroidGetJNIEnv());
+    jobject activity = static_cast<jobject>(SDL_AndroidGetActivity());
+    if (!env || !activity) {
+      return nullptr;
+    }
+    jclass activity_class = env->GetObjectClass(activity);
+    jmethodID get_assets = env->GetMethodID(
+        activity_class, "getAssets", "()Landroid/content/res/AssetManager;");
+    jobject assets = env->CallObjectMethod(activity, get_assets);
+    if (assets) {
+      // Hold a global reference so the manager outlives this call.
+      asset_manager = AAssetManager_fromJava(env, env->NewGlobalRef(assets));
+      env->DeleteLocalRef(assets);
+    }
+    env->DeleteLocalRef(activity_class);
+    env->DeleteLocalRef(activity);
+  }
+  return asset_manager;
+}
+#endif  // __ANDROID__
+
+bool FileBuffer::MapAsset(const char* filename) {
+#ifdef __ANDROID__
+  if (filename[0] == '/') {
+    return false;
+  }
+  AAssetManager* asset_manager = GetAssetManager();
+  if (!asset_manager) {
+    return false;
+  }
+  asset_ = AAssetManager_open(asset_manager, filename, AASSET_MODE_BUFFER);
+  if (!asset_) {
+    return false;
+  }
+  // Compressed assets are inflated into a buffer owned by the asset, so this
+  // still avoids a second copy.
+  data_ = static_cast<const char*>(AAsset_getBuffer(asset_));
+  size_ = static_cast<size_t>(AAsset_getLength(asset_));
+  if (!data_ || size_ == 0) {
+    // Let the caller fall back to reading the file without an asset held open.
+    AAsset_close(asset_);
+    asset_ = nullptr;
+    data_ = nullptr;
+    size_ = 0;
+    return false;
+  }
+  return true;
+#else
+  (void)filename;
+  return false;
+#endif  // __ANDROID__
+}
+
+bool FileBuffer::MapFile(const char* filename) {
+#ifdef PINDROP_FILE_BUFFER_MMAP
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+    close(fd);
+    return false;
+  }
+  size_t size = static_cast<size_t>(file_stat.st_size);
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the descriptor is closed.
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  mapping_ = mapping;
+  data_ = static_cast<const char*>(mapping);
+  size_ = size;
+  return true;
+#else
+  (void)filename;
+  return false;
+#endif  // PINDROP_FILE_BUFFER_MMAP
+}
+
+bool FileBuffer::ReadFile(const char* filename) {
+  SDL_RWops* handle = SDL_RWFromFile(filename, "rb");
+  if (!handle) {
+    return false;
+  }
+  size_t len = static_cast<size_t>(SDL_RWsize(handle));
+  heap_.assign(len, 0);
+  size_t rlen = len > 0 ? SDL_RWread(handle, &heap_[0], 1, len) : 0;
+  SDL_RWclose(handle);
+  data_ = heap_.data();
+  size_ = len;
+  return len == rlen && len > 0;
+}
+
+}  // namespace pindrop
@@ -0,0 +1,78 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_FILE_BUFFER_H_
+#define PINDROP_FILE_BUFFER_H_
+
+#include <cstddef>
+#include <string>
+
+#ifdef __ANDROID__
+struct AAsset;
+#endif  // __ANDROID__
+
+namespace pindrop {
+
+// The contents of a file, held so that flatbuffers can be read from them in
+// place. Where the platform allows it the file is mapped into memory rather
+// than copied: Android assets are opened through the asset manager, which can
+// hand out a pointer to an uncompressed asset directly, and files on disk are
+// mapped with mmap. Anything else is read into a heap buffer.
+class FileBuffer {
+ public:
+  FileBuffer();
+  ~FileBuffer();
+
+  // Load the given file, releasing whatever the buffer held before. Returns
+  // false if the file could not be read or is empty.
+  bool Load(const char* filename);
+
+  // Hold a copy of the given data rather than the contents of a file.
+  void Assign(const std::string& source);
+
+  // Release the contents of the buffer.
+  void Release();
+
+  // Exchange the contents of this buffer with those of another.
+  void Swap(FileBuffer* other);
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  FileBuffer(const FileBuffer&);
+  FileBuffer& operator=(const FileBuffer&);
+
+  bool MapAsset(const char* filename);
+  bool MapFile(const char* filename);
+  bool ReadFile(const char* filename);
+
+  const char* data_;
+  size_t size_;
+
+  // The region mapped by MapFile, or null if the file is not mapped.
+  void* mapping_;
+
+#ifdef __ANDROID__
+  // The asset opened by MapAsset, or null if the file is not an asset.
+  AAsset* asset_;
+#endif  // __ANDROID__
+
+  // The copy of the data when it could not be mapped.
+  std::string heap_;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_FILE_BUFFER_H_
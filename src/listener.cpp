@@ -32,7 +32,7 @@ void Listener::SetOrientation(const mathfu::Vector<float, 3>& location,
 }
 
 mathfu::Vector<float, 3> Listener::Location() const {
-  return state_->inverse_matrix().TranslationVector3D();
+  return state_->game_location();
 }
 
 void Listener::SetLocation(const mathfu::Vector<float, 3>& location) {
@@ -42,11 +42,11 @@ void Listener::SetLocation(const mathfu::Vector<float, 3>& location) {
 
 void Listener::SetMatrix(const mathfu::Matrix<float, 4>& matrix) {
   assert(Valid());
-  state_->set_inverse_matrix(matrix.Inverse());
+  state_->set_matrix(matrix);
 }
 
 const mathfu::Matrix<float, 4> Listener::Matrix() const {
-  return state_->inverse_matrix().Inverse();
+  return state_->game_matrix();
 }
 
 }  // namespace pindrop
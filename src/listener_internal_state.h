@@ -15,6 +15,8 @@
 #ifndef PINDROP_LISTENER_INTERNAL_STATE_H_
 #define PINDROP_LISTENER_INTERNAL_STATE_H_
 
+#include <cmath>
+
 #include "fplutil/intrusive_list.h"
 #include "mathfu/constants.h"
 #include "mathfu/matrix_4x4.h"
@@ -22,27 +24,121 @@
 
 namespace pindrop {
 
+// Return true if the affine matrix only rotates, reflects and translates, so
+// that distances are the same before and after it is applied. Allows for the
+// rounding error in matrices built from rotations.
+inline bool IsRigidTransform(const mathfu::Matrix<float, 4>& m) {
+  static const float kTolerance = 0.001f;
+  for (int a = 0; a < 3; ++a) {
+    for (int b = a; b < 3; ++b) {
+      float dot = m(a, 0) * m(b, 0) + m(a, 1) * m(b, 1) + m(a, 2) * m(b, 2);
+      float expected = a == b ? 1.0f : 0.0f;
+      if (std::fabs(dot - expected) > kTolerance) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// The matrices of a listener, along with its location in world space. The
+// matrix and inverse are both kept so that neither the game nor the engine
+// has to invert one to get the other.
+struct ListenerTransform {
+  ListenerTransform()
+      : inverse_matrix(mathfu::Matrix<float, 4>::Identity()),
+        matrix(mathfu::Matrix<float, 4>::Identity()),
+        location(mathfu::kZeros3f),
+        rigid(true) {}
+  ListenerTransform(const mathfu::Matrix<float, 4>& inverse_matrix,
+                    const mathfu::Matrix<float, 4>& matrix)
+      : inverse_matrix(inverse_matrix),
+        matrix(matrix),
+        location(matrix.TranslationVector3D()),
+        rigid(IsRigidTransform(inverse_matrix)) {}
+
+  mathfu::Matrix<float, 4> inverse_matrix;
+  mathfu::Matrix<float, 4> matrix;
+  mathfu::Vector<float, 3> location;
+
+  // True if the matrix does not scale or shear, in which case the nearest
+  // listener can be found by world space distance.
+  bool rigid;
+};
+
 class ListenerInternalState {
  public:
-  ListenerInternalState()
-      : inverse_matrix_(mathfu::Matrix<float, 4>::Identity()) {}
+  ListenerInternalState() : buffered_(false) {}
 
+  // Set the matrix from the game side, given either the matrix or its
+  // inverse. When the listener is buffered the engine does not see the change
+  // until it has been published.
+  void set_matrix(const mathfu::Matrix<float, 4>& matrix) {
+    set_transform(ListenerTransform(matrix.Inverse(), matrix));
+  }
   void set_inverse_matrix(const mathfu::Matrix<float, 4>& inverse_matrix) {
-    inverse_matrix_ = inverse_matrix;
+    set_transform(ListenerTransform(inverse_matrix, inverse_matrix.Inverse()));
+  }
+
+  // The matrix, inverse matrix and location as last set by the game.
+  const mathfu::Matrix<float, 4>& game_matrix() const {
+    return game_transform().matrix;
+  }
+  const mathfu::Matrix<float, 4>& game_inverse_matrix() const {
+    return game_transform().inverse_matrix;
+  }
+  const mathfu::Vector<float, 3>& game_location() const {
+    return game_transform().location;
   }
 
-  mathfu::Matrix<float, 4>& inverse_matrix() { return inverse_matrix_; }
+  // The inverse matrix and location the engine uses.
   const mathfu::Matrix<float, 4>& inverse_matrix() const {
-    return inverse_matrix_;
+    return transform_.inverse_matrix;
+  }
+  const mathfu::Vector<float, 3>& location() const {
+    return transform_.location;
+  }
+  bool rigid() const { return transform_.rigid; }
+
+  // Buffer changes made by the game so that the engine can be updated on
+  // another thread.
+  void set_buffered(bool buffered) {
+    game_transform_ = transform_;
+    published_transform_ = transform_;
+    buffered_ = buffered;
   }
 
+  // Hand the game side matrix over to the engine. Publish is called from the
+  // game thread and Consume from the engine's thread, with a lock held
+  // around both.
+  void Publish() { published_transform_ = game_transform_; }
+  void Consume() { transform_ = published_transform_; }
+
   fplutil::intrusive_list_node node;
 
  private:
-  // We use an inverse matrix here rather than a regular matrix because the
-  // inverse matrix is used to translate sounds into listener space, and
-  // calculating the matrix every time would be wasteful.
-  mathfu::Matrix<float, 4> inverse_matrix_;
+  void set_transform(const ListenerTransform& transform) {
+    if (buffered_) {
+      game_transform_ = transform;
+    } else {
+      transform_ = transform;
+    }
+  }
+
+  const ListenerTransform& game_transform() const {
+    return buffered_ ? game_transform_ : transform_;
+  }
+
+  // We keep the inverse matrix because it is used to translate sounds into
+  // listener space, and calculating it every time would be wasteful.
+  ListenerTransform transform_;
+
+  // When buffered, the transform set by the game, and the transform most
+  // recently published for the engine.
+  ListenerTransform game_transform_;
+  ListenerTransform published_transform_;
+
+  bool buffered_;
 };
 
 }  // namespace pindrop
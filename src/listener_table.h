@@ -0,0 +1,118 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_LISTENER_TABLE_H_
+#define PINDROP_LISTENER_TABLE_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "listener_internal_state.h"
+#include "mathfu/matrix.h"
+
+namespace pindrop {
+
+// The engine side transforms of the active listeners, stored as a structure of
+// arrays so the nearest listener search can scan them linearly.
+//
+// Each listener is stored as its location in world space and as the top three
+// rows of its inverse matrix. Listener matrices are affine, so the bottom row
+// is always (0, 0, 0, 1) and the transform into listener space needs no divide.
+// For row r, the listener space coordinate r of the world space point (x, y, z)
+// is row_x[r] * x + row_y[r] * y + row_z[r] * z + row_w[r].
+struct ListenerTable {
+  static const int kRowCount = 3;
+
+  ListenerTable() : rigid(true) {}
+
+  // Refill the table from a sequence of ListenerInternalStates, keeping their
+  // order. Ties between equally near listeners go to the earliest one. Returns
+  // true if any listener was added, removed or moved since the table was last
+  // filled.
+  template <typename Iterator>
+  bool Gather(Iterator begin, Iterator end);
+
+  size_t size() const { return location_x.size(); }
+  bool empty() const { return location_x.empty(); }
+
+  // The location of each listener in world space.
+  std::vector<float> location_x;
+  std::vector<float> location_y;
+  std::vector<float> location_z;
+
+  // The top three rows of each listener's inverse matrix.
+  std::vector<float> row_x[kRowCount];
+  std::vector<float> row_y[kRowCount];
+  std::vector<float> row_z[kRowCount];
+  std::vector<float> row_w[kRowCount];
+
+  // True if no listener's matrix scales or shears, so that the nearest
+  // listener to a point is the nearest in world space.
+  bool rigid;
+};
+
+// Store a value at the given index, which is either in the vector or one past
+// its end. Returns true if the value stored there changed.
+inline bool StoreListenerValue(std::vector<float>* values, size_t index,
+                               float value) {
+  if (index == values->size()) {
+    values->push_back(value);
+    return true;
+  }
+  if ((*values)[index] == value) {
+    return false;
+  }
+  (*values)[index] = value;
+  return true;
+}
+
+template <typename Iterator>
+bool ListenerTable::Gather(Iterator begin, Iterator end) {
+  // The listeners are written over their old values, rather than the table
+  // being cleared first, so that the engine can tell when none have moved.
+  bool changed = false;
+  size_t count = 0;
+  rigid = true;
+  for (Iterator iter = begin; iter != end; ++iter, ++count) {
+    rigid &= iter->rigid();
+    const mathfu::Vector<float, 3>& location = iter->location();
+    changed |= StoreListenerValue(&location_x, count, location.x);
+    changed |= StoreListenerValue(&location_y, count, location.y);
+    changed |= StoreListenerValue(&location_z, count, location.z);
+    const mathfu::Matrix<float, 4>& m = iter->inverse_matrix();
+    for (int row = 0; row < kRowCount; ++row) {
+      changed |= StoreListenerValue(&row_x[row], count, m(row, 0));
+      changed |= StoreListenerValue(&row_y[row], count, m(row, 1));
+      changed |= StoreListenerValue(&row_z[row], count, m(row, 2));
+      changed |= StoreListenerValue(&row_w[row], count, m(row, 3));
+    }
+  }
+  if (count != location_x.size()) {
+    changed = true;
+    location_x.resize(count);
+    location_y.resize(count);
+    location_z.resize(count);
+    for (int row = 0; row < kRowCount; ++row) {
+      row_x[row].resize(count);
+      row_y[row].resize(count);
+      row_z[row].resize(count);
+      row_w[row].resize(count);
+    }
+  }
+  return changed;
+}
+
+}  // namespace pindrop
+
+#endif  // PINDROP_LISTENER_TABLE_H_
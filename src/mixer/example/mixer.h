@@ -18,6 +18,8 @@
 namespace pindrop {
 
 struct AudioConfig;
+class Sound;
+struct SoundMemoryStats;
 
 // This class represents the audio mixer backend that does the actual audio
 // mixing.
@@ -28,6 +30,28 @@ class Mixer {
  public:
   // Initalize the audio Mixer.
   bool Initialize(const AudioConfig* config);
+
+  // Lock and unlock the mixer's audio thread. The engine locks the mixer
+  // around each frame's batch of gain and pan changes, so that the audio
+  // thread is not locked and unlocked for each one. The lock must allow the
+  // RealChannel calls made while it is held to lock it again.
+  void Lock();
+  void Unlock();
+
+  // Called at the start of each engine update with the number of seconds that
+  // have passed since the last one. Mixers that play in time with an audio
+  // device can ignore it; a mixer with no device can use it as its clock.
+  void AdvanceFrame(float delta_time);
+
+  // Stop every voice that is playing the given sound, which is about to be
+  // unloaded or destroyed. A Sound may be shared by several engines, so the
+  // engine's SampleCache calls this on the mixer of every engine using it.
+  void HaltVoicesPlaying(const Sound* sound);
+
+  // Add any memory held by the mixer itself, such as a cache of decoded
+  // audio, to the given stats. This is called after every Sound has added its
+  // own memory.
+  void AddMemoryStats(SoundMemoryStats* stats) const;
 };
 
 }  // namespace pindrop
@@ -19,6 +19,7 @@
 
 namespace pindrop {
 
+class Mixer;
 class SoundCollection;
 class Sound;
 
@@ -34,11 +35,14 @@ class Sound;
 // mixer backend being used.
 class RealChannel {
  public:
-  // Initialize this channel.
-  void Initialize(int index);
+  // Initialize this channel as a handle to the given mixer's channel with the
+  // given index. Several engines may run at once, each with a mixer of its
+  // own, so the channel must keep to the mixer it is given.
+  void Initialize(Mixer* mixer, int index);
 
-  // Play the audio on the real channel.
-  bool Play(SoundCollection* handle, Sound* sound);
+  // Play the audio on the real channel, starting the given number of seconds
+  // into the sound.
+  bool Play(SoundCollection* handle, Sound* sound, float position);
 
   // Halt the real channel so it may be re-used. However this virtual channel
   // may still be considered playing.
@@ -56,6 +60,9 @@ class RealChannel {
   // Check if this channel is currently paused on a real channel.
   bool Paused() const;
 
+  // Return how far into the sound the real channel has played, in seconds.
+  float Position() const;
+
   // Set the current gain of the real channel.
   void SetGain(float gain);
 
@@ -68,10 +75,70 @@ class RealChannel {
   // Fade this channel out over the given number of milliseconds.
   void FadeOut(int milliseconds);
 
+  // Ramp the gain of a sound that has just been played up from silence over
+  // the given number of milliseconds. Backends that can not fade in a sound
+  // once it is playing may play it at full gain.
+  void FadeIn(int milliseconds);
+
   // Return true if this is a valid real channel.
   bool Valid() const;
 };
 
+// A StreamChannel represents a channel of the mixer that plays streamed
+// sounds. Streamed and buffered sounds are given channels from separate pools,
+// sized by AudioConfig's mixer_stream_channels and mixer_channels, so a
+// backend that streams differently from how it plays buffered sounds can keep
+// the two apart. It has the same interface as RealChannel, and a backend that
+// plays both kinds alike may derive it from RealChannel.
+class StreamChannel {
+ public:
+  // Initialize this channel with its index among the given mixer's stream
+  // channels.
+  void Initialize(Mixer* mixer, int index);
+
+  // Play the audio on the channel, starting the given number of seconds into
+  // the sound.
+  bool Play(SoundCollection* handle, Sound* sound, float position);
+
+  // Halt the channel so it may be re-used.
+  void Halt();
+
+  // Pause the channel.
+  void Pause();
+
+  // Resume the paused channel.
+  void Resume();
+
+  // Check if this channel is currently playing.
+  bool Playing() const;
+
+  // Check if this channel is currently paused.
+  bool Paused() const;
+
+  // Return how far into the sound the channel has played, in seconds.
+  float Position() const;
+
+  // Set the current gain of the channel.
+  void SetGain(float gain);
+
+  // Get the current gain of the channel.
+  float Gain() const;
+
+  // Set the pan for the sound. This should be a unit vector.
+  void SetPan(const mathfu::Vector<float, 2>& pan);
+
+  // Fade this channel out over the given number of milliseconds.
+  void FadeOut(int milliseconds);
+
+  // Ramp the gain of a sound that has just been played up from silence over
+  // the given number of milliseconds. Backends that can not fade in a sound
+  // once it is playing may play it at full gain.
+  void FadeIn(int milliseconds);
+
+  // Return true if this is a valid stream channel.
+  bool Valid() const;
+};
+
 }  // namespace pindrop
 
 #endif  // PINDROP_MIXER_EXAMPLE_REAL_CHANNEL_H_
@@ -20,6 +20,7 @@
 namespace pindrop {
 
 class SoundCollection;
+struct SoundMemoryStats;
 
 // A sound represents either buffered or streaming audio file.
 //
@@ -32,8 +33,27 @@ class Sound : public Resource {
   // or not the sound should be streaming, which may impact how you load it.
   void Initialize(const SoundCollection* sound_collection);
 
-  // Load the audio file.
+  // Load the audio file. If data() is not null the file's contents are already
+  // in memory, for example because they came from a sound bank archive, and
+  // should be read from there rather than from filename().
   virtual void Load();
+
+  // Free the audio loaded by Load, called when the engine unloads the sound to
+  // stay within its sample budget. The sound may be loaded again later. If
+  // the backend does not support unloading, it can leave this out and keep
+  // the audio loaded.
+  virtual void Free();
+
+  // Add the memory held by this sound to the given stats. Backends that
+  // support collections stored compressed count those sounds'
+  // compressed_bytes here, and the rest as decoded_bytes.
+  void AddMemoryStats(SoundMemoryStats* stats) const;
+
+  // Return the length of the sound in seconds, or zero if it is not known.
+  // The engine uses this to tell when a one shot sound playing on a virtual
+  // channel would have finished. Sounds of unknown length play on virtual
+  // channels until they are stopped.
+  float duration() const;
 };
 
 }  // namespace pindrop
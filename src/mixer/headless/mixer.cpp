@@ -0,0 +1,72 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mixer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "audio_config_generated.h"
+#include "sound.h"
+
+namespace pindrop {
+
+Mixer::Mixer() : first_stream_voice_(0) {}
+
+Mixer::~Mixer() {}
+
+bool Mixer::Initialize(const AudioConfig* config) {
+  voices_.assign(config->mixer_channels() + config->mixer_stream_channels(),
+                 Voice());
+  first_stream_voice_ = static_cast<int>(config->mixer_channels());
+  return true;
+}
+
+void Mixer::AdvanceFrame(float delta_time) {
+  for (size_t i = 0; i < voices_.size(); ++i) {
+    Voice& voice = voices_[i];
+    if (!voice.playing || voice.paused) {
+      continue;
+    }
+    if (voice.fading) {
+      voice.fade_time -= delta_time;
+      if (voice.fade_time <= 0.0f) {
+        voice.playing = false;
+        continue;
+      }
+    }
+    voice.fade_in_time = std::max(voice.fade_in_time - delta_time, 0.0f);
+    voice.position += delta_time;
+    float duration = voice.sound->duration();
+    if (voice.position >= duration) {
+      if (voice.loop && duration > 0.0f) {
+        voice.position = std::fmod(voice.position, duration);
+      } else {
+        voice.playing = false;
+      }
+    }
+  }
+}
+
+void Mixer::HaltVoicesPlaying(const Sound* sound) {
+  for (size_t i = 0; i < voices_.size(); ++i) {
+    Voice& voice = voices_[i];
+    if (voice.sound == sound) {
+      voice.playing = false;
+      voice.sound = nullptr;
+    }
+  }
+}
+
+}  // namespace pindrop
@@ -0,0 +1,106 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_MIXER_HEADLESS_MIXER_H_
+#define PINDROP_MIXER_HEADLESS_MIXER_H_
+
+#include <vector>
+
+namespace pindrop {
+
+struct AudioConfig;
+class Sound;
+struct SoundMemoryStats;
+
+// The simulated playback state of one real channel.
+struct Voice {
+  Voice()
+      : sound(nullptr),
+        position(0.0f),
+        gain(0.0f),
+        pan_x(0.0f),
+        pan_y(0.0f),
+        fade_time(0.0f),
+        fade_in_time(0.0f),
+        loop(false),
+        playing(false),
+        paused(false),
+        fading(false) {}
+
+  // The sound being played.
+  const Sound* sound;
+
+  // How far into the sound the voice has played, in seconds.
+  float position;
+
+  float gain;
+  float pan_x;
+  float pan_y;
+
+  // The time, in seconds, left until a fading voice stops.
+  float fade_time;
+
+  // The time, in seconds, left until a voice fading in reaches its full gain.
+  float fade_in_time;
+
+  bool loop;
+  bool playing;
+  bool paused;
+  bool fading;
+};
+
+// The headless mixer has no audio device. Its voices play on a clock that only
+// moves when the engine updates, by the time the engine was updated for, so
+// sounds finish exactly when their lengths say they should however fast or
+// slowly the engine is run. Nothing is decoded or mixed, which makes it suited
+// to servers that need the engine's priority and audibility logic, and to
+// reproducible performance runs.
+class Mixer {
+ public:
+  Mixer();
+
+  ~Mixer();
+
+  bool Initialize(const AudioConfig* config);
+
+  // There is no audio thread to lock out.
+  void Lock() {}
+  void Unlock() {}
+
+  // Move every playing voice on by the given number of seconds, stopping the
+  // ones that reach the end of their sound or finish fading out.
+  void AdvanceFrame(float delta_time);
+
+  // Return the voice for the given real channel.
+  Voice* voice(int channel_id) { return &voices_[channel_id]; }
+
+  // Return the channel id of the voice for the given stream channel. The
+  // stream channels' voices come after those of the real channels.
+  int stream_voice_id(int index) const { return first_stream_voice_ + index; }
+
+  // Stop every voice that is playing the given sound, which is about to be
+  // unloaded or destroyed.
+  void HaltVoicesPlaying(const Sound* sound);
+
+  // The headless mixer holds no audio of its own, so this adds nothing.
+  void AddMemoryStats(SoundMemoryStats* /*stats*/) const {}
+
+ private:
+  std::vector<Voice> voices_;
+  int first_stream_voice_;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_MIXER_HEADLESS_MIXER_H_
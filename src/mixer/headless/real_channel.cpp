@@ -0,0 +1,135 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "real_channel.h"
+
+#include <cassert>
+#include <cmath>
+
+#include "mixer.h"
+#include "pindrop/log.h"
+#include "sound_collection.h"
+
+namespace pindrop {
+
+static const int kInvalidChannelId = -1;
+
+static const float kMillisecondsPerSecond = 1000.0f;
+
+RealChannel::RealChannel() : mixer_(nullptr), channel_id_(kInvalidChannelId) {}
+
+void RealChannel::Initialize(Mixer* mixer, int i) {
+  mixer_ = mixer;
+  channel_id_ = i;
+}
+
+void StreamChannel::Initialize(Mixer* mixer, int i) {
+  RealChannel::Initialize(mixer, mixer->stream_voice_id(i));
+}
+
+bool RealChannel::Valid() const { return channel_id_ != kInvalidChannelId; }
+
+bool RealChannel::Play(SoundCollection* collection, Sound* sound,
+                       float position) {
+  assert(Valid());
+  if (!sound->loaded()) {
+    CallLogFunc("Could not play sound %s\n", sound->filename().c_str());
+    return false;
+  }
+  const bool loop = collection->params().loop;
+  const float duration = sound->duration();
+  if (loop && duration > 0.0f) {
+    position = std::fmod(position, duration);
+  }
+  Voice* voice = mixer_->voice(channel_id_);
+  voice->sound = sound;
+  voice->position = position > 0.0f ? position : 0.0f;
+  voice->gain = 0.0f;
+  voice->fade_time = 0.0f;
+  voice->fade_in_time = 0.0f;
+  voice->loop = loop;
+  // A one shot sound resumed past its end has already finished.
+  voice->playing = loop || voice->position < duration;
+  voice->paused = false;
+  voice->fading = false;
+  return true;
+}
+
+bool RealChannel::Playing() const {
+  assert(Valid());
+  return mixer_->voice(channel_id_)->playing;
+}
+
+bool RealChannel::Paused() const {
+  assert(Valid());
+  return mixer_->voice(channel_id_)->paused;
+}
+
+float RealChannel::Position() const {
+  assert(Valid());
+  return mixer_->voice(channel_id_)->position;
+}
+
+void RealChannel::SetGain(const float gain) {
+  assert(Valid());
+  mixer_->voice(channel_id_)->gain = gain;
+}
+
+float RealChannel::Gain() const {
+  assert(Valid());
+  return mixer_->voice(channel_id_)->gain;
+}
+
+void RealChannel::Halt() {
+  assert(Valid());
+  mixer_->voice(channel_id_)->playing = false;
+}
+
+void RealChannel::Pause() {
+  assert(Valid());
+  mixer_->voice(channel_id_)->paused = true;
+}
+
+void RealChannel::Resume() {
+  assert(Valid());
+  mixer_->voice(channel_id_)->paused = false;
+}
+
+void RealChannel::FadeOut(int milliseconds) {
+  assert(Valid());
+  Voice* voice = mixer_->voice(channel_id_);
+  if (milliseconds <= 0) {
+    voice->playing = false;
+  } else if (!voice->fading ||
+             voice->fade_time > milliseconds / kMillisecondsPerSecond) {
+    voice->fade_time = milliseconds / kMillisecondsPerSecond;
+    voice->fading = true;
+  }
+}
+
+void RealChannel::FadeIn(int milliseconds) {
+  assert(Valid());
+  Voice* voice = mixer_->voice(channel_id_);
+  voice->fade_in_time =
+      milliseconds > 0 ? milliseconds / kMillisecondsPerSecond : 0.0f;
+}
+
+void RealChannel::SetPan(const mathfu::Vector<float, 2>& pan) {
+  assert(Valid());
+  Voice* voice = mixer_->voice(channel_id_);
+  voice->pan_x = pan.x;
+  voice->pan_y = pan.y;
+}
+
+}  // namespace pindrop
@@ -0,0 +1,71 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sound.h"
+
+#include "SDL.h"
+#include "file_buffer.h"
+#include "pcm_file.h"
+#include "pindrop/log.h"
+#include "sound_file_duration.h"
+
+namespace pindrop {
+
+// Read the length of a prebuilt PCM file from its header.
+static bool PcmDuration(const char* data, size_t size, float* duration) {
+  PcmFile pcm;
+  if (!ParsePcmFile(data, size, &pcm) || pcm.frequency == 0) {
+    return false;
+  }
+  size_t frame_size = SDL_AUDIO_BITSIZE(pcm.format) / 8 * pcm.channels;
+  if (frame_size == 0) {
+    return false;
+  }
+  *duration = static_cast<float>(pcm.size / frame_size) / pcm.frequency;
+  return true;
+}
+
+Sound::~Sound() {}
+
+// The SampleCache has every engine's mixer halt the voices playing the sound
+// before it is freed.
+void Sound::Free() {
+  duration_ = 0.0f;
+  loaded_ = false;
+}
+
+void Sound::Initialize(const SoundCollection* /*sound_collection*/) {}
+
+void Sound::Load() {
+  FileBuffer source;
+  const char* bytes = data();
+  size_t byte_count = size();
+  if (!bytes) {
+    if (source.Load(filename().c_str())) {
+      bytes = source.data();
+      byte_count = source.size();
+    }
+  }
+  loaded_ = false;
+  if (bytes) {
+    loaded_ = PcmDuration(bytes, byte_count, &duration_) ||
+              ReadSoundFileDuration(bytes, byte_count, &duration_);
+  }
+  if (!loaded_) {
+    duration_ = 0.0f;
+    CallLogFunc("Could not load sound file: %s.", filename().c_str());
+  }
+}
+
+}  // namespace pindrop
@@ -0,0 +1,60 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_MIXER_HEADLESS_SOUND_H_
+#define PINDROP_MIXER_HEADLESS_SOUND_H_
+
+#include <cstddef>
+#include <string>
+
+#include "file_loader.h"
+
+namespace pindrop {
+
+class SoundCollection;
+struct SoundMemoryStats;
+
+// A sound that is never decoded. Loading it only reads the headers of its Ogg
+// Vorbis, wave or prebuilt PCM file to find out how long it is, which is all
+// the headless mixer needs to play it.
+class Sound : public Resource {
+ public:
+  Sound() : duration_(0.0f), loaded_(false) {}
+
+  virtual ~Sound();
+
+  void Initialize(const SoundCollection* sound_collection);
+
+  virtual void Load();
+
+  // Return true if the length of the sound could be read.
+  bool loaded() const { return loaded_; }
+
+  // Return the length of the sound in seconds, or zero if it did not load.
+  float duration() const { return duration_; }
+
+  // The headless mixer holds no audio, so this adds nothing.
+  void AddMemoryStats(SoundMemoryStats* /*stats*/) const {}
+
+ private:
+  // Forget the length of the sound.
+  virtual void Free();
+
+  float duration_;
+  bool loaded_;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_MIXER_HEADLESS_SOUND_H_
@@ -0,0 +1,118 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decode_cache.h"
+
+#include <iterator>
+
+namespace pindrop {
+
+// Returns true if the channel is playing the given chunk, or a chunk over part
+// of its samples made to play it from part way through.
+static bool IsPlaying(int channel, const Mix_Chunk* chunk) {
+  const Mix_Chunk* playing = Mix_GetChunk(channel);
+  return Mix_Playing(channel) && playing && playing->abuf >= chunk->abuf &&
+         playing->abuf < chunk->abuf + chunk->alen;
+}
+
+// Returns true if any channel is playing the given chunk.
+static bool IsPlaying(const Mix_Chunk* chunk) {
+  int channel_count = Mix_AllocateChannels(-1);
+  for (int channel = 0; channel < channel_count; ++channel) {
+    if (IsPlaying(channel, chunk)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+DecodeCache::~DecodeCache() { Clear(); }
+
+size_t DecodeCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_;
+}
+
+Mix_Chunk* DecodeCache::Find(const Sound* sound) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto iter = index_.find(sound);
+  if (iter == index_.end()) {
+    return nullptr;
+  }
+  entries_.splice(entries_.begin(), entries_, iter->second);
+  return iter->second->chunk;
+}
+
+void DecodeCache::Insert(const Sound* sound, Mix_Chunk* chunk) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  RemoveLocked(sound);
+  Entry entry = {sound, chunk};
+  entries_.push_front(entry);
+  index_[sound] = entries_.begin();
+  size_ += chunk->alen;
+  Evict();
+}
+
+void DecodeCache::Remove(const Sound* sound) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  RemoveLocked(sound);
+}
+
+void DecodeCache::RemoveLocked(const Sound* sound) {
+  auto iter = index_.find(sound);
+  if (iter == index_.end()) {
+    return;
+  }
+  // Freeing a chunk halts any channel playing it, but not the channels
+  // playing part of it, which are halted here.
+  Mix_Chunk* chunk = iter->second->chunk;
+  int channel_count = Mix_AllocateChannels(-1);
+  for (int channel = 0; channel < channel_count; ++channel) {
+    if (IsPlaying(channel, chunk)) {
+      Mix_HaltChannel(channel);
+    }
+  }
+  size_ -= chunk->alen;
+  entries_.erase(iter->second);
+  index_.erase(iter);
+  Mix_FreeChunk(chunk);
+}
+
+void DecodeCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto iter = entries_.begin(); iter != entries_.end(); ++iter) {
+    Mix_FreeChunk(iter->chunk);
+  }
+  entries_.clear();
+  index_.clear();
+  size_ = 0;
+}
+
+void DecodeCache::Evict() {
+  // Never evict the most recently played chunk, which is about to play.
+  auto iter = entries_.end();
+  while (size_ > capacity_ && iter != entries_.begin() &&
+         std::prev(iter) != entries_.begin()) {
+    --iter;
+    if (IsPlaying(iter->chunk)) {
+      continue;
+    }
+    size_ -= iter->chunk->alen;
+    Mix_FreeChunk(iter->chunk);
+    index_.erase(iter->sound);
+    iter = entries_.erase(iter);
+  }
+}
+
+}  // namespace pindrop
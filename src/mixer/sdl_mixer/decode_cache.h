@@ -0,0 +1,88 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_MIXER_SDL_MIXER_DECODE_CACHE_H_
+#define PINDROP_MIXER_SDL_MIXER_DECODE_CACHE_H_
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "SDL_mixer.h"
+
+namespace pindrop {
+
+class Sound;
+
+// The chunks decoded for sounds that are stored compressed. When the chunks
+// add up to more than the capacity, the least recently played ones are freed,
+// skipping any that a channel is still playing. A chunk is kept even if that
+// leaves the cache over capacity, since the sound is about to play.
+//
+// Sounds are shared between engines, so a sound may be removed by the engine
+// unloading it while this cache's engine decodes another one. The cache locks
+// itself.
+class DecodeCache {
+ public:
+  DecodeCache() : capacity_(0), size_(0) {}
+  ~DecodeCache();
+
+  void set_capacity(size_t capacity) { capacity_ = capacity; }
+  size_t capacity() const { return capacity_; }
+
+  // The total size of the decoded audio in the cache.
+  size_t size() const;
+
+  // Return the chunk decoded for the given sound and mark it as the most
+  // recently played, or null if the sound is not in the cache.
+  Mix_Chunk* Find(const Sound* sound);
+
+  // Add the chunk decoded for the given sound, taking ownership of it, and
+  // free older chunks to make room for it.
+  void Insert(const Sound* sound, Mix_Chunk* chunk);
+
+  // Free the chunk decoded for the given sound, if there is one.
+  void Remove(const Sound* sound);
+
+  // Free every chunk.
+  void Clear();
+
+ private:
+  struct Entry {
+    const Sound* sound;
+    Mix_Chunk* chunk;
+  };
+  typedef std::list<Entry> EntryList;
+
+  // Free the chunk decoded for the given sound with the mutex held.
+  void RemoveLocked(const Sound* sound);
+
+  // Free the least recently played chunks that are not playing until the
+  // cache is within its capacity.
+  void Evict();
+
+  // The cached chunks, most recently played first.
+  EntryList entries_;
+  std::unordered_map<const Sound*, EntryList::iterator> index_;
+
+  size_t capacity_;
+  size_t size_;
+
+  mutable std::mutex mutex_;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_MIXER_SDL_MIXER_DECODE_CACHE_H_
@@ -14,10 +14,12 @@
 
 #include "mixer.h"
 
+#include <algorithm>
+
 #include "SDL_mixer.h"
 #include "audio_config_generated.h"
+#include "pindrop/audio_engine.h"
 #include "pindrop/log.h"
-#include "real_channel.h"
 
 namespace pindrop {
 
@@ -25,6 +27,7 @@ Mixer::Mixer() : initialized_(false) {}
 
 Mixer::~Mixer() {
   if (initialized_) {
+    decode_cache_.Clear();
     Mix_CloseAudio();
   }
 }
@@ -35,10 +38,12 @@ bool Mixer::Initialize(const AudioConfig* config) {
     return false;
   }
 
-#ifdef PINDROP_MULTISTREAM
-  Mix_HookMusicFinishedCh(nullptr, FreeFinishedMusicMultistream);
-#else
-  Mix_HookMusicFinished(FreeFinishedMusic);
+#ifndef PINDROP_MULTISTREAM
+  if (config->mixer_stream_channels() > 1) {
+    CallLogFunc("SDL_Mixer can only stream one sound at a time without "
+                "PINDROP_MULTISTREAM.\n");
+    return false;
+  }
 #endif  // PINDROP_MULTISTREAM
 
   if (Mix_OpenAudio(config->output_frequency(), AUDIO_S16LSB,
@@ -48,6 +53,7 @@ bool Mixer::Initialize(const AudioConfig* config) {
     return false;
   }
   initialized_ = true;
+  decode_cache_.set_capacity(config->decode_cache_size());
 
   // Initialize the channels.
   Mix_AllocateChannels(config->mixer_channels());
@@ -63,4 +69,23 @@ bool Mixer::Initialize(const AudioConfig* config) {
   return true;
 }
 
+void Mixer::Lock() {
+  if (initialized_) {
+    SDL_LockAudio();
+  }
+}
+
+void Mixer::Unlock() {
+  if (initialized_) {
+    SDL_UnlockAudio();
+  }
+}
+
+void Mixer::AddMemoryStats(SoundMemoryStats* stats) const {
+  stats->decode_cache_bytes += decode_cache_.size();
+  stats->decode_cache_capacity += decode_cache_.capacity();
+  // What the cache holds is not saved.
+  stats->saved_bytes -= std::min(stats->saved_bytes, decode_cache_.size());
+}
+
 }  // namespace pindrop
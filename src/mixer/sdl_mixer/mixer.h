@@ -15,9 +15,13 @@
 #ifndef PINDROP_MIXER_SDL_MIXER_MIXER_H_
 #define PINDROP_MIXER_SDL_MIXER_MIXER_H_
 
+#include "decode_cache.h"
+
 namespace pindrop {
 
 struct AudioConfig;
+class Sound;
+struct SoundMemoryStats;
 
 class Mixer {
  public:
@@ -26,8 +30,28 @@ class Mixer {
 
   bool Initialize(const AudioConfig* config);
 
+  // The chunks decoded for sounds that are stored compressed.
+  DecodeCache* decode_cache() { return &decode_cache_; }
+
+  // Free the chunk decoded for the given sound, which is about to be unloaded
+  // or destroyed. Freeing a chunk halts the channels playing it.
+  void HaltVoicesPlaying(const Sound* sound) { decode_cache_.Remove(sound); }
+
+  // Lock and unlock the audio thread, so that several changes can be made to
+  // the channels without it being locked and unlocked for each one.
+  void Lock();
+  void Unlock();
+
+  // SDL_Mixer plays in time with the audio device, so the engine's frame time
+  // is not needed.
+  void AdvanceFrame(float /*delta_time*/) {}
+
+  // Add the memory held by the mixer to the given stats.
+  void AddMemoryStats(SoundMemoryStats* stats) const;
+
  private:
   bool initialized_;
+  DecodeCache decode_cache_;
 };
 
 }  // namespace pindrop
@@ -14,6 +14,7 @@
 
 #include "SDL_mixer.h"
 #include "file_loader.h"
+#include "mixer.h"
 #include "pindrop/log.h"
 #include "real_channel.h"
 #include "sound_collection.h"
@@ -25,178 +26,321 @@ static const int kLoopForever = -1;
 static const int kPlayOnce = 0;
 static const int kInvalidChannelId = -1;
 
-#ifdef PINDROP_MULTISTREAM
-void FreeFinishedMusicMultistream(void* /*userdata*/, Mix_Music* music,
-                                  int /*channel*/) {
-  Mix_FreeMusic(music);
+static const float kMillisecondsPerSecond = 1000.0f;
+
+// Special value to query volume rather than set volume.
+static const int kQueryVolume = -1;
+
+// Return the SDL ticks a sound would have started at to be the given number of
+// seconds in now.
+static Uint32 StartTicks(float position) {
+  return SDL_GetTicks() -
+         static_cast<Uint32>(position * kMillisecondsPerSecond);
+}
+
+RealChannel::RealChannel()
+    : mixer_(nullptr),
+      channel_id_(kInvalidChannelId),
+      start_ticks_(0),
+      pause_ticks_(0),
+      offset_chunk_(nullptr) {}
+
+void RealChannel::Initialize(Mixer* mixer, int i) {
+  mixer_ = mixer;
+  channel_id_ = i;
+}
+
+bool RealChannel::Valid() const { return channel_id_ != kInvalidChannelId; }
+
+void RealChannel::FreeOffsetChunk() {
+  if (offset_chunk_) {
+    // Freeing a chunk halts any channel playing it.
+    Mix_FreeChunk(offset_chunk_);
+    offset_chunk_ = nullptr;
+  }
+}
+
+// Make a chunk that plays the given chunk from the given number of seconds in,
+// without copying its samples. Returns null if the position is past the end.
+static Mix_Chunk* MakeOffsetChunk(Mix_Chunk* chunk, float position) {
+  int frequency;
+  Uint16 format;
+  int channels;
+  if (!chunk || !Mix_QuerySpec(&frequency, &format, &channels)) {
+    return nullptr;
+  }
+  Uint32 frame_size = SDL_AUDIO_BITSIZE(format) / 8 * channels;
+  Uint32 offset =
+      static_cast<Uint32>(position * static_cast<float>(frequency)) *
+      frame_size;
+  if (offset >= chunk->alen) {
+    return nullptr;
+  }
+  return Mix_QuickLoad_RAW(chunk->abuf + offset, chunk->alen - offset);
+}
+
+bool RealChannel::Play(SoundCollection* collection, Sound* sound,
+                       float position) {
+  assert(Valid());
+  int loops = collection->params().loop ? kLoopForever : kPlayOnce;
+  FreeOffsetChunk();
+  Mix_Chunk* chunk = sound->chunk(mixer_->decode_cache());
+  if (position > 0.0f && loops == kPlayOnce) {
+    // SDL_mixer can not seek a chunk, so play a chunk over the rest of the
+    // sound's samples instead.
+    offset_chunk_ = MakeOffsetChunk(chunk, position);
+  }
+  if (offset_chunk_) {
+    chunk = offset_chunk_;
+  } else {
+    position = 0.0f;
+  }
+
+  // Check if playing the sound was successful, and display the error if it was
+  // not.
+  if (Mix_PlayChannel(channel_id_, chunk, loops) == kInvalidChannelId) {
+    CallLogFunc("Could not play sound %s\n", Mix_GetError());
+    return false;
+  }
+  start_ticks_ = StartTicks(position);
+  pause_ticks_ = start_ticks_;
+  return true;
+}
+
+bool RealChannel::Playing() const {
+  assert(Valid());
+  return Mix_Playing(channel_id_) != 0;
+}
+
+bool RealChannel::Paused() const {
+  assert(Valid());
+  return Mix_Paused(channel_id_) != 0;
+}
+
+float RealChannel::Position() const {
+  assert(Valid());
+  Uint32 now = Paused() ? pause_ticks_ : SDL_GetTicks();
+  return (now - start_ticks_) / kMillisecondsPerSecond;
+}
+
+void RealChannel::SetGain(const float gain) {
+  assert(Valid());
+  Mix_Volume(channel_id_, static_cast<int>(gain * MIX_MAX_VOLUME));
+}
+
+float RealChannel::Gain() const {
+  assert(Valid());
+  int volume = Mix_Volume(channel_id_, kQueryVolume);
+  return volume / static_cast<float>(MIX_MAX_VOLUME);
+}
+
+void RealChannel::Halt() {
+  assert(Valid());
+  Mix_HaltChannel(channel_id_);
+  FreeOffsetChunk();
+}
+
+void RealChannel::Pause() {
+  assert(Valid());
+  pause_ticks_ = SDL_GetTicks();
+  Mix_Pause(channel_id_);
+}
+
+void RealChannel::Resume() {
+  assert(Valid());
+  if (Paused()) {
+    start_ticks_ += SDL_GetTicks() - pause_ticks_;
+  }
+  Mix_Resume(channel_id_);
+}
+
+void RealChannel::FadeOut(int milliseconds) {
+  assert(Valid());
+  Mix_FadeOutChannel(channel_id_, milliseconds);
 }
-#else
-static int s_music_channel_id;
 
-static Mix_Music* s_playing_music;
+void RealChannel::FadeIn(int /*milliseconds*/) { assert(Valid()); }
 
-void FreeFinishedMusic() {
-  Mix_FreeMusic(s_playing_music);
-  s_playing_music = nullptr;
+void RealChannel::SetPan(const mathfu::Vector<float, 2>& pan) {
+  assert(Valid());
+  static const unsigned char kMaxPanValue = 255;
+  // This formula is explained in the following paper:
+  // http://www.rs-met.com/documents/tutorials/PanRules.pdf
+  float p = static_cast<float>(M_PI) * (pan.x + 1.0f) / 4.0f;
+  unsigned char left = static_cast<unsigned char>(cos(p) * kMaxPanValue);
+  unsigned char right = static_cast<unsigned char>(sin(p) * kMaxPanValue);
+  Mix_SetPanning(channel_id_, left, right);
 }
+
+#ifndef PINDROP_MULTISTREAM
+// SDL_mixer plays a single music stream, so this remembers which stream
+// channel last started it. Any other stream channel is no longer playing.
+static int s_music_channel_id = kInvalidChannelId;
 #endif  // PINDROP_MULTISTREAM
 
-RealChannel::RealChannel() : channel_id_(kInvalidChannelId) {}
+StreamChannel::StreamChannel()
+    : channel_id_(kInvalidChannelId),
+      start_ticks_(0),
+      pause_ticks_(0),
+      owned_music_(nullptr) {}
 
-void RealChannel::Initialize(int i) { channel_id_ = i; }
+void StreamChannel::Initialize(Mixer* /*mixer*/, int i) { channel_id_ = i; }
 
-bool RealChannel::Valid() const { return channel_id_ != kInvalidChannelId; }
+bool StreamChannel::Valid() const { return channel_id_ != kInvalidChannelId; }
 
-bool RealChannel::Play(SoundCollection* collection, Sound* sound) {
+#ifdef PINDROP_MULTISTREAM
+void StreamChannel::FreeOwnedMusic() {
+  if (owned_music_) {
+    Mix_HaltMusicCh(channel_id_);
+    Mix_FreeMusic(owned_music_);
+    owned_music_ = nullptr;
+  }
+}
+#endif  // PINDROP_MULTISTREAM
+
+bool StreamChannel::Play(SoundCollection* collection, Sound* sound,
+                         float position) {
   assert(Valid());
-  const SoundCollectionDef* def = collection->GetSoundCollectionDef();
-  int loops = def->loop() ? kLoopForever : kPlayOnce;
-  stream_ = def->stream();
+  int loops = collection->params().loop ? kLoopForever : kPlayOnce;
 
-  // Play the audio using the appropriate Mix_Play* function.
-  int result;
-  if (stream_) {
+  // Streamed sounds keep their music open between plays, so this does not
+  // touch the file.
+  bool owned = false;
 #ifdef PINDROP_MULTISTREAM
-    result = Mix_PlayMusicCh(Mix_LoadMUS(sound->filename().c_str()), loops,
-                             channel_id);
+  FreeOwnedMusic();
+  Mix_Music* music = sound->StreamMusic(channel_id_, &owned);
+  if (owned) {
+    owned_music_ = music;
+  }
+  bool success =
+      music && Mix_PlayMusicCh(music, loops, channel_id_) != kInvalidChannelId;
+  // SDL_mixer can not seek music playing on a particular channel.
+  position = 0.0f;
 #else
+  Mix_Music* music = sound->StreamMusic(channel_id_, &owned);
+  bool success = music && Mix_PlayMusic(music, loops) != kInvalidChannelId;
+  if (success) {
+    // Only claim the music once it is playing, so that a failed play does not
+    // make the channel that was streaming look stopped.
     s_music_channel_id = channel_id_;
-    FreeFinishedMusic();
-    result = Mix_PlayMusic(Mix_LoadMUS(sound->filename().c_str()), loops);
-#endif
-  } else {
-    result = Mix_PlayChannel(channel_id_, sound->chunk(), loops);
+    // Not every music format can seek, in which case it plays from the
+    // beginning.
+    if (position > 0.0f && Mix_SetMusicPosition(position) != 0) {
+      position = 0.0f;
+    }
   }
+#endif  // PINDROP_MULTISTREAM
 
   // Check if playing the sound was successful, and display the error if it was
   // not.
-  bool success = result != kInvalidChannelId;
   if (!success) {
     CallLogFunc("Could not play sound %s\n", Mix_GetError());
+    return false;
   }
-  return success;
+  start_ticks_ = StartTicks(position);
+  pause_ticks_ = start_ticks_;
+  return true;
 }
 
-bool RealChannel::Playing() const {
+bool StreamChannel::Playing() const {
   assert(Valid());
-  if (stream_) {
 #ifdef PINDROP_MULTISTREAM
-    return Mix_PlayingMusicCh(channel_id_) != 0;
+  return Mix_PlayingMusicCh(channel_id_) != 0;
 #else
-    return Mix_PlayingMusic() != 0 && channel_id_ == s_music_channel_id;
+  return Mix_PlayingMusic() != 0 && channel_id_ == s_music_channel_id;
 #endif  // PINDROP_MULTISTREAM
-  } else {
-    return Mix_Playing(channel_id_) != 0;
-  }
 }
 
-bool RealChannel::Paused() const {
+bool StreamChannel::Paused() const {
   assert(Valid());
-  if (stream_) {
 #ifdef PINDROP_MULTISTREAM
-    return Mix_PausedMusicCh(channel_id_) != 0;
+  return Mix_PausedMusicCh(channel_id_) != 0;
 #else
-    return Mix_PausedMusic() != 0;
+  return Mix_PausedMusic() != 0 && channel_id_ == s_music_channel_id;
 #endif  // PINDROP_MULTISTREAM
-  } else {
-    return Mix_Paused(channel_id_) != 0;
-  }
 }
 
-void RealChannel::SetGain(const float gain) {
+float StreamChannel::Position() const {
+  assert(Valid());
+  Uint32 now = Paused() ? pause_ticks_ : SDL_GetTicks();
+  return (now - start_ticks_) / kMillisecondsPerSecond;
+}
+
+void StreamChannel::SetGain(const float gain) {
   assert(Valid());
   int mix_volume = static_cast<int>(gain * MIX_MAX_VOLUME);
-  if (stream_) {
 #ifdef PINDROP_MULTISTREAM
-    Mix_VolumeMusicCh(channel_id_, mix_volume);
+  Mix_VolumeMusicCh(channel_id_, mix_volume);
 #else
+  if (channel_id_ == s_music_channel_id) {
     Mix_VolumeMusic(mix_volume);
-#endif  // PINDROP_MULTISTREAM
-  } else {
-    Mix_Volume(channel_id_, mix_volume);
   }
+#endif  // PINDROP_MULTISTREAM
 }
 
-float RealChannel::Gain() const {
+float StreamChannel::Gain() const {
   assert(Valid());
-  // Special value to query volume rather than set volume.
-  static const int kQueryVolume = -1;
-  int volume;
-  if (stream_) {
 #ifdef PINDROP_MULTISTREAM
-    volume = Mix_VolumeMusicCh(channel_id_, kQueryVolume);
+  int volume = Mix_VolumeMusicCh(channel_id_, kQueryVolume);
 #else
-    volume = Mix_VolumeMusic(kQueryVolume);
+  int volume = Mix_VolumeMusic(kQueryVolume);
 #endif  // PINDROP_MULTISTREAM
-  } else {
-    volume = Mix_Volume(channel_id_, kQueryVolume);
-  }
   return volume / static_cast<float>(MIX_MAX_VOLUME);
 }
 
-void RealChannel::Halt() {
+void StreamChannel::Halt() {
   assert(Valid());
-  if (stream_) {
 #ifdef PINDROP_MULTISTREAM
-    Mix_HaltMusicCh(channel_id_);
+  Mix_HaltMusicCh(channel_id_);
+  FreeOwnedMusic();
 #else
+  if (channel_id_ == s_music_channel_id) {
     Mix_HaltMusic();
-#endif  // PINDROP_MULTISTREAM
-  } else {
-    Mix_HaltChannel(channel_id_);
   }
+#endif  // PINDROP_MULTISTREAM
 }
 
-void RealChannel::Pause() {
+void StreamChannel::Pause() {
   assert(Valid());
-  if (stream_) {
+  pause_ticks_ = SDL_GetTicks();
 #ifdef PINDROP_MULTISTREAM
-    Mix_PauseMusicCh(channel_id_);
+  Mix_PauseMusicCh(channel_id_);
 #else
+  if (channel_id_ == s_music_channel_id) {
     Mix_PauseMusic();
-#endif  // PINDROP_MULTISTREAM
-  } else {
-    Mix_Pause(channel_id_);
   }
+#endif  // PINDROP_MULTISTREAM
 }
 
-void RealChannel::Resume() {
+void StreamChannel::Resume() {
   assert(Valid());
-  if (stream_) {
+  if (Paused()) {
+    start_ticks_ += SDL_GetTicks() - pause_ticks_;
+  }
 #ifdef PINDROP_MULTISTREAM
-    Mix_ResumeMusicCh(channel_id_);
+  Mix_ResumeMusicCh(channel_id_);
 #else
+  if (channel_id_ == s_music_channel_id) {
     Mix_ResumeMusic();
-#endif  // PINDROP_MULTISTREAM
-  } else {
-    Mix_Resume(channel_id_);
   }
+#endif  // PINDROP_MULTISTREAM
 }
 
-void RealChannel::FadeOut(int milliseconds) {
+void StreamChannel::FadeOut(int milliseconds) {
   assert(Valid());
-  if (stream_) {
 #ifdef PINDROP_MULTISTREAM
-    Mix_FadeOutMusicCh(channel_id_, milliseconds);
+  Mix_FadeOutMusicCh(channel_id_, milliseconds);
 #else
+  if (channel_id_ == s_music_channel_id) {
     Mix_FadeOutMusic(milliseconds);
-#endif  // PINDROP_MULTISTREAM
-  } else {
-    Mix_FadeOutChannel(channel_id_, milliseconds);
   }
+#endif  // PINDROP_MULTISTREAM
 }
 
-void RealChannel::SetPan(const mathfu::Vector<float, 2>& pan) {
+void StreamChannel::FadeIn(int /*milliseconds*/) { assert(Valid()); }
+
+void StreamChannel::SetPan(const mathfu::Vector<float, 2>&) {
   assert(Valid());
-  static const unsigned char kMaxPanValue = 255;
-  if (!stream_) {
-    // This formula is explained in the following paper:
-    // http://www.rs-met.com/documents/tutorials/PanRules.pdf
-    float p = static_cast<float>(M_PI) * (pan.x + 1.0f) / 4.0f;
-    unsigned char left = static_cast<unsigned char>(cos(p) * kMaxPanValue);
-    unsigned char right = static_cast<unsigned char>(sin(p) * kMaxPanValue);
-    Mix_SetPanning(channel_id_, left, right);
-  }
 }
 
 }  // namespace pindrop
@@ -21,17 +21,23 @@
 
 namespace pindrop {
 
+class Mixer;
 class SoundCollection;
 
+// A RealChannel is one of SDL_mixer's channels, which play buffered sounds
+// from their chunks.
 class RealChannel {
  public:
   RealChannel();
 
-  // Initialize this channel.
-  void Initialize(int index);
+  // Initialize this channel as the given mixer's channel with the given
+  // index.
+  void Initialize(Mixer* mixer, int index);
 
-  // Play the audio on the real channel.
-  bool Play(SoundCollection* handle, Sound* sound);
+  // Play the audio on the real channel, starting the given number of seconds
+  // into the sound. SDL_mixer can not seek a looping chunk, so looping sounds
+  // always start from the beginning.
+  bool Play(SoundCollection* handle, Sound* sound, float position);
 
   // Halt the real channel so it may be re-used. However this virtual channel
   // may still be considered playing.
@@ -49,6 +55,9 @@ class RealChannel {
   // Check if this channel is currently paused on a real channel.
   bool Paused() const;
 
+  // Return how far into the sound the real channel has played, in seconds.
+  float Position() const;
+
   // Set and query the current gain of the real channel.
   void SetGain(float gain);
 
@@ -61,21 +70,102 @@ class RealChannel {
   // Fade this channel out over the given number of milliseconds.
   void FadeOut(int milliseconds);
 
+  // SDL_mixer can only fade in a channel as it starts, so this does nothing
+  // and the sound plays at full gain.
+  void FadeIn(int milliseconds);
+
   // Return true if this is a valid real channel.
   bool Valid() const;
 
  private:
+  // Halt and free the chunk this channel made to play part of a sound, if
+  // any.
+  void FreeOffsetChunk();
+
+  // The mixer whose decode cache holds the chunks of compressed sounds.
+  Mixer* mixer_;
   int channel_id_;
-  bool stream_;
+
+  // The time, in SDL ticks, that the sound would have started at had it been
+  // played from the beginning, and the time it was paused at.
+  Uint32 start_ticks_;
+  Uint32 pause_ticks_;
+
+  // A chunk over the end of a sound's samples, made to play a one shot sound
+  // from part way through. It points into the sound's own chunk.
+  Mix_Chunk* offset_chunk_;
 };
 
+// A StreamChannel plays streamed sounds as SDL_mixer music. With
+// PINDROP_MULTISTREAM each stream channel is one of the mixer's music
+// channels. Otherwise SDL_mixer plays a single music stream, so there should
+// only be one stream channel; starting music on another stops the first.
+class StreamChannel {
+ public:
+  StreamChannel();
+
+  // Initialize this channel with its index among the given mixer's stream
+  // channels.
+  void Initialize(Mixer* mixer, int index);
+
+  // Play the audio on the channel, starting the given number of seconds into
+  // the sound where the music can seek.
+  bool Play(SoundCollection* handle, Sound* sound, float position);
+
+  // Halt the channel so it may be re-used.
+  void Halt();
+
+  // Pause the channel.
+  void Pause();
+
+  // Resume the paused channel.
+  void Resume();
+
+  // Check if this channel is currently playing.
+  bool Playing() const;
+
+  // Check if this channel is currently paused.
+  bool Paused() const;
+
+  // Return how far into the sound the channel has played, in seconds.
+  float Position() const;
+
+  // Set the current gain of the channel.
+  void SetGain(float gain);
+
+  // Get the current gain of the channel.
+  float Gain() const;
+
+  // SDL_mixer can not pan music, so this does nothing.
+  void SetPan(const mathfu::Vector<float, 2>& pan);
+
+  // Fade this channel out over the given number of milliseconds.
+  void FadeOut(int milliseconds);
+
+  // SDL_mixer can only fade in music as it starts, so this does nothing.
+  void FadeIn(int milliseconds);
+
+  // Return true if this is a valid stream channel.
+  bool Valid() const;
+
+ private:
 #ifdef PINDROP_MULTISTREAM
-void FreeFinishedMusicMultistream(void* userdata, Mix_Music* music,
-                                  int channel);
-#else
-void FreeFinishedMusic();
+  // Halt and free the music this channel opened for itself, if any.
+  void FreeOwnedMusic();
 #endif  // PINDROP_MULTISTREAM
 
+  int channel_id_;
+
+  // The time, in SDL ticks, that the sound would have started at had it been
+  // played from the beginning, and the time it was paused at.
+  Uint32 start_ticks_;
+  Uint32 pause_ticks_;
+
+  // Music opened for this channel because the sound's own music was already
+  // streaming on another channel. Only used with PINDROP_MULTISTREAM.
+  Mix_Music* owned_music_;
+};
+
 }  // namespace pindrop
 
 #endif  // PINDROP_MIXER_SDL_MIXER_REAL_CHANNEL_H_
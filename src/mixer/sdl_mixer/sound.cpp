@@ -12,25 +12,210 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstring>
+
+#include "pindrop/audio_engine.h"
 #include "pindrop/log.h"
 #include "file_loader.h"
+#include "decode_cache.h"
+#include "pcm_file.h"
 #include "sound.h"
 #include "sound_collection.h"
 #include "sound_collection_def_generated.h"
+#include "sound_file_duration.h"
 
 namespace pindrop {
 
+Sound::~Sound() { Free(); }
+
+// The SampleCache has every engine's mixer free the chunk decoded for a sound
+// stored compressed before the sound is freed.
+void Sound::Free() {
+  if (music_) {
+    Mix_FreeMusic(music_);
+    music_ = nullptr;
+  }
+  music_channel_ = -1;
+  if (chunk_) {
+    Mix_FreeChunk(chunk_);
+    chunk_ = nullptr;
+  }
+  source_.reset();
+  std::vector<Uint8>().swap(converted_);
+  compressed_data_ = nullptr;
+  compressed_size_ = 0;
+  duration_ = 0.0f;
+}
+
+// Returns the length in seconds of a chunk in the mixer's output format, or
+// zero if the mixer is not open.
+static float ChunkDuration(const Mix_Chunk* chunk) {
+  int frequency;
+  Uint16 format;
+  int channels;
+  if (!chunk || !Mix_QuerySpec(&frequency, &format, &channels)) {
+    return 0.0f;
+  }
+  int frame_size = SDL_AUDIO_BITSIZE(format) / 8 * channels;
+  return static_cast<float>(chunk->alen) /
+         (static_cast<float>(frame_size) * static_cast<float>(frequency));
+}
+
 void Sound::Initialize(const SoundCollection* sound_collection) {
-  stream_ = sound_collection->GetSoundCollectionDef()->stream();
+  stream_ = sound_collection->params().stream;
+  keep_compressed_ = sound_collection->params().compressed;
+  compressed_ = keep_compressed_;
 }
 
 void Sound::Load() {
-  if (!stream_) {
-    chunk_ = Mix_LoadWAV(filename().c_str());
+  compressed_ = keep_compressed_;
+  if (stream_) {
+    // Open the music now so that playing it does not have to open and parse
+    // the file.
+    music_ = OpenMusic();
+    if (music_ == nullptr) {
+      CallLogFunc("Could not load sound file: %s.", filename().c_str());
+    }
+  } else {
+    const char* source = data();
+    size_t source_size = size();
+    if (!source && (compressed_ || HasPcmFileExtension(filename()))) {
+      source_.reset(new FileBuffer());
+      if (source_->Load(filename().c_str())) {
+        source = source_->data();
+        source_size = source_->size();
+      }
+    }
+    PcmFile pcm;
+    if (source && ParsePcmFile(source, source_size, &pcm)) {
+      // Prebuilt PCM costs as much memory compressed as decoded.
+      compressed_ = false;
+      chunk_ = LoadPcm(pcm);
+    } else if (compressed_) {
+      // Keep the compressed audio, and decode it when the sound plays. Its
+      // length is read from its headers, so that it is known before then.
+      compressed_data_ = source;
+      compressed_size_ = source ? source_size : 0;
+      float duration = 0.0f;
+      if (!source) {
+        CallLogFunc("Could not load sound file: %s.", filename().c_str());
+      } else {
+        ReadSoundFileDuration(source, source_size, &duration);
+      }
+      duration_ = duration;
+      return;
+    } else if (source) {
+      chunk_ = Mix_LoadWAV_RW(
+          SDL_RWFromConstMem(source, static_cast<int>(source_size)), 1);
+    } else {
+      chunk_ = Mix_LoadWAV(filename().c_str());
+    }
     if (chunk_ == nullptr) {
       CallLogFunc("Could not load sound file: %s.", filename().c_str());
     }
+    duration_ = ChunkDuration(chunk_);
+  }
+}
+
+Mix_Chunk* Sound::LoadPcm(const PcmFile& pcm) {
+  int frequency;
+  Uint16 format;
+  int channels;
+  if (!Mix_QuerySpec(&frequency, &format, &channels)) {
+    return nullptr;
+  }
+  // SDL_Mixer only reads from the chunk, so it can point straight at the
+  // file's contents.
+  Uint8* samples = reinterpret_cast<Uint8*>(const_cast<char*>(pcm.samples));
+  Uint32 length = static_cast<Uint32>(pcm.size);
+  if (static_cast<int>(pcm.frequency) != frequency || pcm.format != format ||
+      pcm.channels != channels) {
+    CallLogFunc("%s was prebuilt for a different output format.\n",
+                filename().c_str());
+    SDL_AudioCVT cvt;
+    if (SDL_BuildAudioCVT(&cvt, pcm.format, static_cast<Uint8>(pcm.channels),
+                          static_cast<int>(pcm.frequency), format,
+                          static_cast<Uint8>(channels), frequency) < 0) {
+      return nullptr;
+    }
+    converted_.resize(pcm.size * cvt.len_mult);
+    memcpy(converted_.data(), pcm.samples, pcm.size);
+    cvt.buf = converted_.data();
+    cvt.len = static_cast<int>(pcm.size);
+    if (SDL_ConvertAudio(&cvt) != 0) {
+      return nullptr;
+    }
+    converted_.resize(cvt.len_cvt);
+    samples = converted_.data();
+    length = static_cast<Uint32>(converted_.size());
+    source_.reset();
+  }
+  return Mix_QuickLoad_RAW(samples, length);
+}
+
+Mix_Chunk* Sound::chunk(DecodeCache* decode_cache) {
+  if (!compressed_) {
+    return chunk_;
+  }
+  if (!compressed_data_) {
+    return nullptr;
+  }
+  Mix_Chunk* chunk = decode_cache->Find(this);
+  if (!chunk) {
+    chunk = Mix_LoadWAV_RW(
+        SDL_RWFromConstMem(compressed_data_,
+                           static_cast<int>(compressed_size_)),
+        1);
+    if (!chunk) {
+      CallLogFunc("Could not decode sound file: %s.", filename().c_str());
+      return nullptr;
+    }
+    decoded_size_ = chunk->alen;
+    decode_cache->Insert(this, chunk);
+  }
+  return chunk;
+}
+
+void Sound::AddMemoryStats(SoundMemoryStats* stats) const {
+  if (compressed_) {
+    stats->compressed_bytes += compressed_size_;
+    size_t decoded_size = decoded_size_;
+    if (decoded_size > compressed_size_) {
+      stats->saved_bytes += decoded_size - compressed_size_;
+    }
+  } else if (chunk_) {
+    stats->decoded_bytes += chunk_->alen;
+  }
+}
+
+Mix_Music* Sound::StreamMusic(int channel, bool* owned) {
+  *owned = false;
+  if (music_ == nullptr) {
+    music_ = OpenMusic();
+    if (music_ == nullptr) {
+      return nullptr;
+    }
+  }
+#ifdef PINDROP_MULTISTREAM
+  // The same music can not stream on two channels at once. If the channel it
+  // last played on has since moved on to other music this opens a new stream
+  // needlessly, which costs no more than opening it on every play did.
+  if (music_channel_ >= 0 && music_channel_ != channel &&
+      Mix_PlayingMusicCh(music_channel_)) {
+    *owned = true;
+    return OpenMusic();
+  }
+#endif  // PINDROP_MULTISTREAM
+  music_channel_ = channel;
+  return music_;
+}
+
+Mix_Music* Sound::OpenMusic() {
+  if (data()) {
+    return Mix_LoadMUS_RW(
+        SDL_RWFromConstMem(data(), static_cast<int>(size())), 1);
   }
+  return Mix_LoadMUS(filename().c_str());
 }
 
 }  // namespace pindrop
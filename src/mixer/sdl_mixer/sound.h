@@ -15,26 +15,109 @@
 #ifndef PINDROP_MIXER_SDL_MIXER_SOUND_H_
 #define PINDROP_MIXER_SDL_MIXER_SOUND_H_
 
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "SDL_mixer.h"
+#include "file_buffer.h"
 #include "file_loader.h"
 
 namespace pindrop {
 
+class DecodeCache;
 class SoundCollection;
+struct PcmFile;
+struct SoundMemoryStats;
 
 class Sound : public Resource {
  public:
+  Sound()
+      : chunk_(nullptr),
+        music_(nullptr),
+        music_channel_(-1),
+        stream_(false),
+        keep_compressed_(false),
+        compressed_(false),
+        compressed_data_(nullptr),
+        compressed_size_(0),
+        decoded_size_(0),
+        duration_(0.0f) {}
+
+  virtual ~Sound();
+
   void Initialize(const SoundCollection* sound_collection);
 
   virtual void Load();
 
-  Mix_Chunk* chunk() { return chunk_; }
+  // Return the decoded chunk. If the sound is stored compressed, this decodes
+  // it into the given decode cache, which belongs to the mixer about to play
+  // it, unless it is already there. Returns null if the sound could not be
+  // decoded.
+  Mix_Chunk* chunk(DecodeCache* decode_cache);
+
+  // Add the memory held by this sound to the given stats.
+  void AddMemoryStats(SoundMemoryStats* stats) const;
+
+  // Return the length of the sound in seconds, or zero if it is not known.
+  // The length of streamed music is never known. The length of a sound stored
+  // compressed is read from its headers when it loads, which only Ogg Vorbis
+  // and wave files have.
+  float duration() const { return duration_; }
+
+  // Return the music to stream this sound on the given channel. Streamed music
+  // is opened when the sound is loaded and kept open between plays, so the
+  // sound owns the result. If that music is already streaming on another
+  // channel, new music is opened instead and *owned is set to true, in which
+  // case the caller must free it. Returns null if the music could not be
+  // opened.
+  Mix_Music* StreamMusic(int channel, bool* owned);
 
  private:
+  // Free the chunk, music and files loaded by Load.
+  virtual void Free();
+
+  // Open the sound as music to be streamed. The caller owns the result.
+  Mix_Music* OpenMusic();
+
+  // Wrap prebuilt PCM in a chunk without copying it, unless it has to be
+  // converted to the output format first.
+  Mix_Chunk* LoadPcm(const PcmFile& pcm);
+
   Mix_Chunk* chunk_;
+
+  // The sound's music, if it is streamed, and the channel it was last streamed
+  // on.
+  Mix_Music* music_;
+  int music_channel_;
+
   bool stream_;
+
+  // Whether the collection asked for the sound to be stored compressed, and
+  // whether it is. Prebuilt PCM is never stored compressed.
+  bool keep_compressed_;
+  bool compressed_;
+
+  // The file holding the sound's audio, if it is needed after loading. That
+  // is the case for prebuilt PCM files, which the chunk points into, and for
+  // sounds stored compressed.
+  std::shared_ptr<FileBuffer> source_;
+
+  // The compressed audio of a sound stored compressed, either in source_ or
+  // in memory given by the loader.
+  const char* compressed_data_;
+  size_t compressed_size_;
+
+  // The size of the decoded audio of a sound stored compressed, once it has
+  // been decoded. Sounds are shared between engines, so it may be decoded on
+  // one engine's thread while another reads the memory stats.
+  std::atomic<size_t> decoded_size_;
+
+  // The chunk's samples, if prebuilt PCM had to be converted.
+  std::vector<Uint8> converted_;
+
+  float duration_;
 };
 
 }  // namespace pindrop
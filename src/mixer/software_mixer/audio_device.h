@@ -0,0 +1,73 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef PINDROP_MIXER_SOFTWARE_MIXER_AUDIO_DEVICE_H_
+#define PINDROP_MIXER_SOFTWARE_MIXER_AUDIO_DEVICE_H_
+
+#include <cstddef>
+#include <memory>
+
+namespace pindrop {
+
+struct AudioDeviceState;
+
+// The audio output the software mixer renders into. Which output is used is
+// chosen when Pindrop is built, by compiling one of the audio_device_*.cpp
+// files: SDL's audio device everywhere, or on Android an AAudio stream, or an
+// OpenSL ES buffer queue on devices without AAudio.
+class AudioDevice {
+ public:
+  // Fill frame_count frames of interleaved float output. Called on the audio
+  // thread with the device locked.
+  typedef void (*RenderFunc)(void* userdata, float* output,
+                             size_t frame_count);
+
+  AudioDevice();
+
+  ~AudioDevice();
+
+  // Open the output with the given frequency, channel count and buffer size
+  // in frames, without starting it. A frequency or buffer size of zero asks
+  // for the device's native one, where the output can find out what that is.
+  // Returns false if no output could be opened.
+  bool Open(int frequency, int channels, int buffer_frames, RenderFunc render,
+            void* userdata);
+
+  // Start calling the render function.
+  void Start();
+
+  // Stop and close the output.
+  void Close();
+
+  // Lock and unlock the render function. The lock may be taken again while it
+  // is held. The native Android output never waits for the lock: a buffer due
+  // while it is held is played as silence.
+  void Lock();
+  void Unlock();
+
+  // The frequency and channel count the output was opened with.
+  int frequency() const { return frequency_; }
+  int channels() const { return channels_; }
+
+ private:
+  AudioDevice(const AudioDevice&);
+  AudioDevice& operator=(const AudioDevice&);
+
+  std::unique_ptr<AudioDeviceState> state_;
+  int frequency_;
+  int channels_;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_MIXER_SOFTWARE_MIXER_AUDIO_DEVICE_H_
@@ -0,0 +1,515 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "audio_device.h"
+
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+#include <aaudio/AAudio.h>
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "pindrop/log.h"
+
+namespace pindrop {
+
+// How many bursts an AAudio stream buffers when the configuration leaves the
+// buffer size to the device. Two is the fewest that does not glitch.
+static const int32_t kAAudioBurstsPerBuffer = 2;
+
+// OpenSL ES cannot report the device's native frequency or burst size without
+// going through Java, so typical values are used when the configuration leaves
+// them to the device.
+static const int kOpenSLDefaultFrequency = 48000;
+static const int kOpenSLDefaultBufferFrames = 256;
+
+// The number of buffers queued with OpenSL ES at a time.
+static const int kOpenSLBufferCount = 2;
+
+static const float kInt16Scale = 32767.0f;
+
+// AAudio is only present on Android 8.0 and later, so it is looked up when the
+// device is opened rather than linked against, and OpenSL ES is used where it
+// is missing.
+struct AAudioLibrary {
+  typedef aaudio_result_t (*CreateStreamBuilderFunc)(AAudioStreamBuilder**);
+  typedef void (*SetInt32Func)(AAudioStreamBuilder*, int32_t);
+  typedef void (*SetDataCallbackFunc)(AAudioStreamBuilder*,
+                                      AAudioStream_dataCallback, void*);
+  typedef void (*SetErrorCallbackFunc)(AAudioStreamBuilder*,
+                                       AAudioStream_errorCallback, void*);
+  typedef aaudio_result_t (*OpenStreamFunc)(AAudioStreamBuilder*,
+                                            AAudioStream**);
+  typedef aaudio_result_t (*BuilderFunc)(AAudioStreamBuilder*);
+  typedef aaudio_result_t (*StreamFunc)(AAudioStream*);
+  typedef int32_t (*StreamGetFunc)(AAudioStream*);
+  typedef aaudio_result_t (*StreamSetFunc)(AAudioStream*, int32_t);
+  typedef const char* (*ResultTextFunc)(aaudio_result_t);
+
+  AAudioLibrary()
+      : library(nullptr),
+        create_stream_builder(nullptr),
+        set_sample_rate(nullptr),
+        set_channel_count(nullptr),
+        set_format(nullptr),
+        set_sharing_mode(nullptr),
+        set_performance_mode(nullptr),
+        set_data_callback(nullptr),
+        set_error_callback(nullptr),
+        open_stream(nullptr),
+        delete_builder(nullptr),
+        request_start(nullptr),
+        request_stop(nullptr),
+        close(nullptr),
+        get_sample_rate(nullptr),
+        get_frames_per_burst(nullptr),
+        set_buffer_size(nullptr),
+        result_text(nullptr) {}
+
+  ~AAudioLibrary() {
+    if (library) {
+      dlclose(library);
+    }
+  }
+
+  // Load the library, returning false if this device does not have it.
+  bool Load();
+
+  void* library;
+  CreateStreamBuilderFunc create_stream_builder;
+  SetInt32Func set_sample_rate;
+  SetInt32Func set_channel_count;
+  SetInt32Func set_format;
+  SetInt32Func set_sharing_mode;
+  SetInt32Func set_performance_mode;
+  SetDataCallbackFunc set_data_callback;
+  SetErrorCallbackFunc set_error_callback;
+  OpenStreamFunc open_stream;
+  BuilderFunc delete_builder;
+  StreamFunc request_start;
+  StreamFunc request_stop;
+  StreamFunc close;
+  StreamGetFunc get_sample_rate;
+  StreamGetFunc get_frames_per_burst;
+  StreamSetFunc set_buffer_size;
+  ResultTextFunc result_text;
+};
+
+template <typename Func>
+static bool LoadSymbol(void* library, const char* name, Func* func) {
+  *func = reinterpret_cast<Func>(dlsym(library, name));
+  return *func != nullptr;
+}
+
+bool AAudioLibrary::Load() {
+  library = dlopen("libaaudio.so", RTLD_NOW);
+  if (!library) {
+    return false;
+  }
+  bool loaded =
+      LoadSymbol(library, "AAudio_createStreamBuilder",
+                 &create_stream_builder) &&
+      LoadSymbol(library, "AAudioStreamBuilder_setSampleRate",
+                 &set_sample_rate) &&
+      LoadSymbol(library, "AAudioStreamBuilder_setChannelCount",
+                 &set_channel_count) &&
+      LoadSymbol(library, "AAudioStreamBuilder_setFormat", &set_format) &&
+      LoadSymbol(library, "AAudioStreamBuilder_setSharingMode",
+                 &set_sharing_mode) &&
+      LoadSymbol(library, "AAudioStreamBuilder_setPerformanceMode",
+                 &set_performance_mode) &&
+      LoadSymbol(library, "AAudioStreamBuilder_setDataCallback",
+                 &set_data_callback) &&
+      LoadSymbol(library, "AAudioStreamBuilder_setErrorCallback",
+                 &set_error_callback) &&
+      LoadSymbol(library, "AAudioStreamBuilder_openStream", &open_stream) &&
+      LoadSymbol(library, "AAudioStreamBuilder_delete", &delete_builder) &&
+      LoadSymbol(library, "AAudioStream_requestStart", &request_start) &&
+      LoadSymbol(library, "AAudioStream_requestStop", &request_stop) &&
+      LoadSymbol(library, "AAudioStream_close", &close) &&
+      LoadSymbol(library, "AAudioStream_getSampleRate", &get_sample_rate) &&
+      LoadSymbol(library, "AAudioStream_getFramesPerBurst",
+                 &get_frames_per_burst) &&
+      LoadSymbol(library, "AAudioStream_setBufferSizeInFrames",
+                 &set_buffer_size) &&
+      LoadSymbol(library, "AAudio_convertResultToText", &result_text);
+  if (!loaded) {
+    dlclose(library);
+    library = nullptr;
+  }
+  return loaded;
+}
+
+struct AudioDeviceState {
+  AudioDeviceState()
+      : render(nullptr),
+        userdata(nullptr),
+        frequency(0),
+        channels(0),
+        buffer_frames(0),
+        stream(nullptr),
+        closing(false),
+        reopening(false),
+        engine_object(nullptr),
+        engine(nullptr),
+        output_mix(nullptr),
+        player_object(nullptr),
+        player(nullptr),
+        queue(nullptr),
+        next_buffer(0) {}
+
+  AudioDevice::RenderFunc render;
+  void* userdata;
+
+  // Held while rendering, and by the mixer while it changes its voices. The
+  // render callback only ever tries to take it.
+  std::recursive_mutex render_mutex;
+
+  // The frequency asked for, or once the output is open the one it has. The
+  // channel count and buffer size are as asked for, with zero leaving the
+  // buffer size to the device.
+  int frequency;
+  int channels;
+  int buffer_frames;
+
+  // The AAudio stream, if AAudio is in use. If the stream is disconnected, for
+  // example by headphones being unplugged, it is reopened on its own thread.
+  // The stream mutex is held while the stream is opened or closed.
+  AAudioLibrary aaudio;
+  AAudioStream* stream;
+  std::mutex stream_mutex;
+  std::mutex reopen_mutex;
+  std::thread reopen_thread;
+  std::atomic<bool> closing;
+  bool reopening;
+
+  // The OpenSL ES objects, if OpenSL ES is in use, and the buffers it is
+  // queued with. The mix is rendered as floats and converted to 16 bit
+  // samples, which every version of OpenSL ES on Android plays.
+  SLObjectItf engine_object;
+  SLEngineItf engine;
+  SLObjectItf output_mix;
+  SLObjectItf player_object;
+  SLPlayItf player;
+  SLAndroidSimpleBufferQueueItf queue;
+  std::vector<float> float_buffer;
+  std::vector<int16_t> pcm_buffers;
+  int next_buffer;
+};
+
+// The callbacks run on the device's real time thread, which must never wait
+// for the game thread. If the mixer holds the lock while it changes its voices,
+// the buffer is filled with silence instead, and the voices carry on from where
+// they were with the next one.
+static void Render(AudioDeviceState* state, float* output,
+                   size_t frame_count) {
+  std::unique_lock<std::recursive_mutex> lock(state->render_mutex,
+                                              std::try_to_lock);
+  if (!lock.owns_lock()) {
+    std::fill(output, output + frame_count * state->channels, 0.0f);
+    return;
+  }
+  state->render(state->userdata, output, frame_count);
+}
+
+static aaudio_data_callback_result_t AAudioDataCallback(
+    AAudioStream* /*stream*/, void* userdata, void* audio_data,
+    int32_t frame_count) {
+  Render(static_cast<AudioDeviceState*>(userdata),
+         static_cast<float*>(audio_data), static_cast<size_t>(frame_count));
+  return AAUDIO_CALLBACK_RESULT_CONTINUE;
+}
+
+static void ReopenAAudioStream(AudioDeviceState* state);
+
+// Streams may not be closed from their own callbacks, so a disconnected stream
+// is reopened on a thread of its own.
+static void AAudioErrorCallback(AAudioStream* /*stream*/, void* userdata,
+                                aaudio_result_t error) {
+  AudioDeviceState* state = static_cast<AudioDeviceState*>(userdata);
+  if (error != AAUDIO_ERROR_DISCONNECTED) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(state->reopen_mutex);
+  if (state->closing || state->reopening) {
+    return;
+  }
+  state->reopening = true;
+  if (state->reopen_thread.joinable()) {
+    // The last reopen has finished, but its thread has not been joined yet.
+    state->reopen_thread.join();
+  }
+  state->reopen_thread = std::thread(ReopenAAudioStream, state);
+}
+
+// Open an exclusive, low latency AAudio stream. A frequency of zero gets the
+// device's native frequency, so that nothing needs resampling. AAudio falls
+// back to a shared stream by itself when it cannot have an exclusive one.
+// Expects the stream mutex to be held.
+static bool OpenAAudioStream(AudioDeviceState* state) {
+  AAudioLibrary& aaudio = state->aaudio;
+  AAudioStreamBuilder* builder;
+  aaudio_result_t result = aaudio.create_stream_builder(&builder);
+  if (result != AAUDIO_OK) {
+    CallLogFunc("Could not create AAudio stream builder: %s\n",
+                aaudio.result_text(result));
+    return false;
+  }
+  aaudio.set_performance_mode(builder, AAUDIO_PERFORMANCE_MODE_LOW_LATENCY);
+  aaudio.set_sharing_mode(builder, AAUDIO_SHARING_MODE_EXCLUSIVE);
+  aaudio.set_format(builder, AAUDIO_FORMAT_PCM_FLOAT);
+  aaudio.set_channel_count(builder, state->channels);
+  if (state->frequency > 0) {
+    aaudio.set_sample_rate(builder, state->frequency);
+  }
+  aaudio.set_data_callback(builder, AAudioDataCallback, state);
+  aaudio.set_error_callback(builder, AAudioErrorCallback, state);
+  result = aaudio.open_stream(builder, &state->stream);
+  aaudio.delete_builder(builder);
+  if (result != AAUDIO_OK) {
+    CallLogFunc("Could not open AAudio stream: %s\n",
+                aaudio.result_text(result));
+    state->stream = nullptr;
+    return false;
+  }
+  int32_t burst = aaudio.get_frames_per_burst(state->stream);
+  int32_t buffer_frames =
+      state->buffer_frames > 0
+          ? std::max(burst, static_cast<int32_t>(state->buffer_frames))
+          : burst * kAAudioBurstsPerBuffer;
+  aaudio.set_buffer_size(state->stream, buffer_frames);
+  state->frequency = aaudio.get_sample_rate(state->stream);
+  return true;
+}
+
+// Expects the stream mutex to be held.
+static void CloseAAudioStream(AudioDeviceState* state) {
+  if (state->stream) {
+    state->aaudio.request_stop(state->stream);
+    state->aaudio.close(state->stream);
+    state->stream = nullptr;
+  }
+}
+
+// Replace a disconnected stream with one on whatever the output device is now.
+// The new stream keeps the old one's frequency, which the mixer was set up for,
+// even if the new device's native frequency is different.
+static void ReopenAAudioStream(AudioDeviceState* state) {
+  {
+    std::lock_guard<std::mutex> lock(state->stream_mutex);
+    if (!state->closing) {
+      CloseAAudioStream(state);
+      if (OpenAAudioStream(state)) {
+        state->aaudio.request_start(state->stream);
+      }
+    }
+  }
+  std::lock_guard<std::mutex> lock(state->reopen_mutex);
+  state->reopening = false;
+}
+
+// Render the next buffer and queue it with OpenSL ES.
+static void EnqueueOpenSLBuffer(AudioDeviceState* state) {
+  const size_t sample_count =
+      static_cast<size_t>(state->buffer_frames) * state->channels;
+  Render(state, state->float_buffer.data(),
+         static_cast<size_t>(state->buffer_frames));
+  // The mixer has already clamped its output, so it only needs scaling.
+  int16_t* pcm = &state->pcm_buffers[state->next_buffer * sample_count];
+  for (size_t i = 0; i < sample_count; ++i) {
+    pcm[i] = static_cast<int16_t>(state->float_buffer[i] * kInt16Scale);
+  }
+  (*state->queue)
+      ->Enqueue(state->queue, pcm,
+                static_cast<SLuint32>(sample_count * sizeof(int16_t)));
+  state->next_buffer = (state->next_buffer + 1) % kOpenSLBufferCount;
+}
+
+static void OpenSLBufferCallback(SLAndroidSimpleBufferQueueItf /*queue*/,
+                                 void* context) {
+  EnqueueOpenSLBuffer(static_cast<AudioDeviceState*>(context));
+}
+
+static void CloseOpenSL(AudioDeviceState* state) {
+  if (state->player_object) {
+    (*state->player_object)->Destroy(state->player_object);
+    state->player_object = nullptr;
+    state->player = nullptr;
+    state->queue = nullptr;
+  }
+  if (state->output_mix) {
+    (*state->output_mix)->Destroy(state->output_mix);
+    state->output_mix = nullptr;
+  }
+  if (state->engine_object) {
+    (*state->engine_object)->Destroy(state->engine_object);
+    state->engine_object = nullptr;
+    state->engine = nullptr;
+  }
+}
+
+static bool OpenOpenSL(AudioDeviceState* state) {
+  if (state->frequency <= 0) {
+    state->frequency = kOpenSLDefaultFrequency;
+  }
+  if (state->buffer_frames <= 0) {
+    state->buffer_frames = kOpenSLDefaultBufferFrames;
+  }
+  SLDataLocator_AndroidSimpleBufferQueue queue_locator = {
+      SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, kOpenSLBufferCount};
+  SLDataFormat_PCM format = {
+      SL_DATAFORMAT_PCM,
+      static_cast<SLuint32>(state->channels),
+      static_cast<SLuint32>(state->frequency) * 1000,
+      SL_PCMSAMPLEFORMAT_FIXED_16,
+      SL_PCMSAMPLEFORMAT_FIXED_16,
+      state->channels == 1
+          ? SL_SPEAKER_FRONT_CENTER
+          : static_cast<SLuint32>(SL_SPEAKER_FRONT_LEFT |
+                                  SL_SPEAKER_FRONT_RIGHT),
+      SL_BYTEORDER_LITTLEENDIAN};
+  SLDataSource source = {&queue_locator, &format};
+  SLDataLocator_OutputMix output_mix_locator = {SL_DATALOCATOR_OUTPUTMIX,
+                                                nullptr};
+  SLDataSink sink = {&output_mix_locator, nullptr};
+  const SLInterfaceID interfaces[] = {SL_IID_ANDROIDSIMPLEBUFFERQUEUE};
+  const SLboolean required[] = {SL_BOOLEAN_TRUE};
+
+  bool opened =
+      slCreateEngine(&state->engine_object, 0, nullptr, 0, nullptr,
+                     nullptr) == SL_RESULT_SUCCESS &&
+      (*state->engine_object)->Realize(state->engine_object,
+                                       SL_BOOLEAN_FALSE) ==
+          SL_RESULT_SUCCESS &&
+      (*state->engine_object)->GetInterface(state->engine_object,
+                                            SL_IID_ENGINE, &state->engine) ==
+          SL_RESULT_SUCCESS &&
+      (*state->engine)->CreateOutputMix(state->engine, &state->output_mix, 0,
+                                        nullptr,
+                                        nullptr) == SL_RESULT_SUCCESS &&
+      (*state->output_mix)->Realize(state->output_mix, SL_BOOLEAN_FALSE) ==
+          SL_RESULT_SUCCESS;
+  if (opened) {
+    output_mix_locator.outputMix = state->output_mix;
+    opened =
+        (*state->engine)->CreateAudioPlayer(
+            state->engine, &state->player_object, &source, &sink, 1,
+            interfaces, required) == SL_RESULT_SUCCESS &&
+        (*state->player_object)->Realize(state->player_object,
+                                         SL_BOOLEAN_FALSE) ==
+            SL_RESULT_SUCCESS &&
+        (*state->player_object)->GetInterface(state->player_object,
+                                              SL_IID_PLAY, &state->player) ==
+            SL_RESULT_SUCCESS &&
+        (*state->player_object)->GetInterface(
+            state->player_object, SL_IID_ANDROIDSIMPLEBUFFERQUEUE,
+            &state->queue) == SL_RESULT_SUCCESS &&
+        (*state->queue)->RegisterCallback(state->queue, OpenSLBufferCallback,
+                                          state) == SL_RESULT_SUCCESS;
+  }
+  if (!opened) {
+    CallLogFunc("Could not open OpenSL ES audio output.\n");
+    CloseOpenSL(state);
+    return false;
+  }
+  const size_t sample_count =
+      static_cast<size_t>(state->buffer_frames) * state->channels;
+  state->float_buffer.resize(sample_count);
+  state->pcm_buffers.resize(sample_count * kOpenSLBufferCount);
+  return true;
+}
+
+AudioDevice::AudioDevice() : state_(), frequency_(0), channels_(0) {}
+
+AudioDevice::~AudioDevice() { Close(); }
+
+bool AudioDevice::Open(int frequency, int channels, int buffer_frames,
+                       RenderFunc render, void* userdata) {
+  state_.reset(new AudioDeviceState());
+  state_->render = render;
+  state_->userdata = userdata;
+  state_->frequency = frequency;
+  state_->channels = channels;
+  state_->buffer_frames = buffer_frames;
+  bool opened;
+  {
+    std::lock_guard<std::mutex> lock(state_->stream_mutex);
+    opened = state_->aaudio.Load() && OpenAAudioStream(state_.get());
+  }
+  if (!opened) {
+    opened = OpenOpenSL(state_.get());
+  }
+  if (!opened) {
+    state_.reset();
+    return false;
+  }
+  frequency_ = state_->frequency;
+  channels_ = channels;
+  return true;
+}
+
+void AudioDevice::Start() {
+  if (!state_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(state_->stream_mutex);
+  if (state_->stream) {
+    state_->aaudio.request_start(state_->stream);
+  } else if (state_->player) {
+    for (int i = 0; i < kOpenSLBufferCount; ++i) {
+      EnqueueOpenSLBuffer(state_.get());
+    }
+    (*state_->player)->SetPlayState(state_->player, SL_PLAYSTATE_PLAYING);
+  }
+}
+
+void AudioDevice::Close() {
+  if (!state_) {
+    return;
+  }
+  state_->closing = true;
+  std::thread reopen_thread;
+  {
+    std::lock_guard<std::mutex> lock(state_->reopen_mutex);
+    reopen_thread.swap(state_->reopen_thread);
+  }
+  if (reopen_thread.joinable()) {
+    reopen_thread.join();
+  }
+  {
+    std::lock_guard<std::mutex> lock(state_->stream_mutex);
+    CloseAAudioStream(state_.get());
+  }
+  CloseOpenSL(state_.get());
+  state_.reset();
+}
+
+void AudioDevice::Lock() {
+  if (state_) {
+    state_->render_mutex.lock();
+  }
+}
+
+void AudioDevice::Unlock() {
+  if (state_) {
+    state_->render_mutex.unlock();
+  }
+}
+
+}  // namespace pindrop
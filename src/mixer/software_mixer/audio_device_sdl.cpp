@@ -0,0 +1,104 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "audio_device.h"
+
+#include <cstring>
+
+#include "SDL.h"
+#include "pindrop/log.h"
+
+namespace pindrop {
+
+struct AudioDeviceState {
+  AudioDeviceState()
+      : device(0), render(nullptr), userdata(nullptr), channels(0) {}
+
+  SDL_AudioDeviceID device;
+  AudioDevice::RenderFunc render;
+  void* userdata;
+  int channels;
+};
+
+static void AudioCallback(void* userdata, Uint8* stream, int length) {
+  AudioDeviceState* state = static_cast<AudioDeviceState*>(userdata);
+  size_t frame_count = length / (sizeof(float) * state->channels);
+  state->render(state->userdata, reinterpret_cast<float*>(stream),
+                frame_count);
+}
+
+AudioDevice::AudioDevice() : state_(), frequency_(0), channels_(0) {}
+
+AudioDevice::~AudioDevice() { Close(); }
+
+bool AudioDevice::Open(int frequency, int channels, int buffer_frames,
+                       RenderFunc render, void* userdata) {
+  if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+    CallLogFunc("Could not initialize SDL audio: %s\n", SDL_GetError());
+    return false;
+  }
+  state_.reset(new AudioDeviceState());
+  state_->render = render;
+  state_->userdata = userdata;
+
+  // SDL picks its own default for a frequency or buffer size of zero.
+  SDL_AudioSpec desired;
+  memset(&desired, 0, sizeof(desired));
+  desired.freq = frequency;
+  desired.format = AUDIO_F32SYS;
+  desired.channels = static_cast<Uint8>(channels);
+  desired.samples = static_cast<Uint16>(buffer_frames);
+  desired.callback = AudioCallback;
+  desired.userdata = state_.get();
+  SDL_AudioSpec obtained;
+  state_->device = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained,
+                                       SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+  if (state_->device == 0) {
+    CallLogFunc("Could not open audio stream: %s\n", SDL_GetError());
+    state_.reset();
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    return false;
+  }
+  state_->channels = obtained.channels;
+  frequency_ = obtained.freq;
+  channels_ = obtained.channels;
+  return true;
+}
+
+void AudioDevice::Start() {
+  if (state_) {
+    SDL_PauseAudioDevice(state_->device, 0);
+  }
+}
+
+void AudioDevice::Close() {
+  if (state_) {
+    SDL_CloseAudioDevice(state_->device);
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    state_.reset();
+  }
+}
+
+void AudioDevice::Lock() {
+  if (state_) {
+    SDL_LockAudioDevice(state_->device);
+  }
+}
+
+void AudioDevice::Unlock() {
+  if (state_) {
+    SDL_UnlockAudioDevice(state_->device);
+  }
+}
+
+}  // namespace pindrop
@@ -0,0 +1,172 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mix_kernels.h"
+
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define PINDROP_MIX_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define PINDROP_MIX_NEON
+#include <arm_neon.h>
+#endif
+
+namespace pindrop {
+
+void MixMonoToStereo(float* output, const float* input, size_t frame_count,
+                     float left_start, float right_start, float left_end,
+                     float right_end) {
+  if (frame_count == 0) return;
+  const float left_delta = (left_end - left_start) / frame_count;
+  const float right_delta = (right_end - right_start) / frame_count;
+  size_t i = 0;
+#if defined(PINDROP_MIX_SSE)
+  __m128 left = _mm_setr_ps(left_start, left_start + left_delta,
+                            left_start + 2.0f * left_delta,
+                            left_start + 3.0f * left_delta);
+  __m128 right = _mm_setr_ps(right_start, right_start + right_delta,
+                             right_start + 2.0f * right_delta,
+                             right_start + 3.0f * right_delta);
+  const __m128 left_step = _mm_set1_ps(4.0f * left_delta);
+  const __m128 right_step = _mm_set1_ps(4.0f * right_delta);
+  for (; i + 4 <= frame_count; i += 4) {
+    __m128 samples = _mm_loadu_ps(input + i);
+    __m128 l = _mm_mul_ps(samples, left);
+    __m128 r = _mm_mul_ps(samples, right);
+    float* out = output + 2 * i;
+    _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), _mm_unpacklo_ps(l, r)));
+    _mm_storeu_ps(out + 4,
+                  _mm_add_ps(_mm_loadu_ps(out + 4), _mm_unpackhi_ps(l, r)));
+    left = _mm_add_ps(left, left_step);
+    right = _mm_add_ps(right, right_step);
+  }
+#elif defined(PINDROP_MIX_NEON)
+  const float left_init[4] = {left_start, left_start + left_delta,
+                              left_start + 2.0f * left_delta,
+                              left_start + 3.0f * left_delta};
+  const float right_init[4] = {right_start, right_start + right_delta,
+                               right_start + 2.0f * right_delta,
+                               right_start + 3.0f * right_delta};
+  float32x4_t left = vld1q_f32(left_init);
+  float32x4_t right = vld1q_f32(right_init);
+  const float32x4_t left_step = vdupq_n_f32(4.0f * left_delta);
+  const float32x4_t right_step = vdupq_n_f32(4.0f * right_delta);
+  for (; i + 4 <= frame_count; i += 4) {
+    float32x4_t samples = vld1q_f32(input + i);
+    float32x4x2_t lr =
+        vzipq_f32(vmulq_f32(samples, left), vmulq_f32(samples, right));
+    float* out = output + 2 * i;
+    vst1q_f32(out, vaddq_f32(vld1q_f32(out), lr.val[0]));
+    vst1q_f32(out + 4, vaddq_f32(vld1q_f32(out + 4), lr.val[1]));
+    left = vaddq_f32(left, left_step);
+    right = vaddq_f32(right, right_step);
+  }
+#endif
+  for (; i < frame_count; ++i) {
+    const float left = left_start + left_delta * i;
+    const float right = right_start + right_delta * i;
+    output[2 * i] += input[i] * left;
+    output[2 * i + 1] += input[i] * right;
+  }
+}
+
+void MixStereoToStereo(float* output, const float* input, size_t frame_count,
+                       float left_start, float right_start, float left_end,
+                       float right_end) {
+  if (frame_count == 0) return;
+  const float left_delta = (left_end - left_start) / frame_count;
+  const float right_delta = (right_end - right_start) / frame_count;
+  size_t i = 0;
+#if defined(PINDROP_MIX_SSE)
+  // Each vector holds two interleaved stereo frames.
+  __m128 gain = _mm_setr_ps(left_start, right_start, left_start + left_delta,
+                            right_start + right_delta);
+  const __m128 gain_step = _mm_setr_ps(2.0f * left_delta, 2.0f * right_delta,
+                                       2.0f * left_delta, 2.0f * right_delta);
+  for (; i + 2 <= frame_count; i += 2) {
+    float* out = output + 2 * i;
+    __m128 samples = _mm_loadu_ps(input + 2 * i);
+    _mm_storeu_ps(out,
+                  _mm_add_ps(_mm_loadu_ps(out), _mm_mul_ps(samples, gain)));
+    gain = _mm_add_ps(gain, gain_step);
+  }
+#elif defined(PINDROP_MIX_NEON)
+  const float gain_init[4] = {left_start, right_start, left_start + left_delta,
+                              right_start + right_delta};
+  const float gain_step_init[4] = {2.0f * left_delta, 2.0f * right_delta,
+                                   2.0f * left_delta, 2.0f * right_delta};
+  float32x4_t gain = vld1q_f32(gain_init);
+  const float32x4_t gain_step = vld1q_f32(gain_step_init);
+  for (; i + 2 <= frame_count; i += 2) {
+    float* out = output + 2 * i;
+    float32x4_t samples = vld1q_f32(input + 2 * i);
+    vst1q_f32(out, vmlaq_f32(vld1q_f32(out), samples, gain));
+    gain = vaddq_f32(gain, gain_step);
+  }
+#endif
+  for (; i < frame_count; ++i) {
+    const float left = left_start + left_delta * i;
+    const float right = right_start + right_delta * i;
+    output[2 * i] += input[2 * i] * left;
+    output[2 * i + 1] += input[2 * i + 1] * right;
+  }
+}
+
+uint64_t Resample(float* output, const float* input, size_t input_frame_count,
+                  int channel_count, uint64_t position, uint64_t step,
+                  size_t frame_count) {
+  static const float kFractionScale = 1.0f / kFixedPointOne;
+  static const uint64_t kFractionMask = kFixedPointOne - 1;
+  const size_t last_frame = input_frame_count - 1;
+  for (size_t i = 0; i < frame_count; ++i) {
+    const size_t frame = std::min(
+        static_cast<size_t>(position >> kFixedPointShift), last_frame);
+    const size_t next_frame = std::min(frame + 1, last_frame);
+    const float fraction = (position & kFractionMask) * kFractionScale;
+    const float* a = input + frame * channel_count;
+    const float* b = input + next_frame * channel_count;
+    for (int channel = 0; channel < channel_count; ++channel) {
+      *output++ = a[channel] + (b[channel] - a[channel]) * fraction;
+    }
+    position += step;
+  }
+  return position;
+}
+
+void ClampSamples(float* samples, size_t sample_count) {
+  size_t i = 0;
+#if defined(PINDROP_MIX_SSE)
+  const __m128 lower = _mm_set1_ps(-1.0f);
+  const __m128 upper = _mm_set1_ps(1.0f);
+  for (; i + 4 <= sample_count; i += 4) {
+    __m128 value = _mm_loadu_ps(samples + i);
+    _mm_storeu_ps(samples + i, _mm_min_ps(_mm_max_ps(value, lower), upper));
+  }
+#elif defined(PINDROP_MIX_NEON)
+  const float32x4_t lower = vdupq_n_f32(-1.0f);
+  const float32x4_t upper = vdupq_n_f32(1.0f);
+  for (; i + 4 <= sample_count; i += 4) {
+    float32x4_t value = vld1q_f32(samples + i);
+    vst1q_f32(samples + i, vminq_f32(vmaxq_f32(value, lower), upper));
+  }
+#endif
+  for (; i < sample_count; ++i) {
+    samples[i] = std::min(std::max(samples[i], -1.0f), 1.0f);
+  }
+}
+
+}  // namespace pindrop
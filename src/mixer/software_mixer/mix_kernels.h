@@ -0,0 +1,59 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_MIXER_SOFTWARE_MIXER_MIX_KERNELS_H_
+#define PINDROP_MIXER_SOFTWARE_MIXER_MIX_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pindrop {
+
+// The inner loops of the software mixer. Each kernel has an SSE and a NEON
+// implementation, selected at compile time, with a scalar fallback for other
+// targets. The output buffers are always interleaved stereo.
+
+// Positions into a source buffer are stored as 32.32 fixed point frames.
+static const int kFixedPointShift = 32;
+static const uint64_t kFixedPointOne = static_cast<uint64_t>(1)
+                                       << kFixedPointShift;
+
+// Scale frame_count frames of mono input by a left and right gain and add the
+// result to the stereo output. The gains ramp linearly from their start to
+// their end values over the span of the frames to avoid zipper noise.
+void MixMonoToStereo(float* output, const float* input, size_t frame_count,
+                     float left_start, float right_start, float left_end,
+                     float right_end);
+
+// Scale frame_count frames of stereo input by a left and right gain and add
+// the result to the stereo output, ramping the gains as above.
+void MixStereoToStereo(float* output, const float* input, size_t frame_count,
+                       float left_start, float right_start, float left_end,
+                       float right_end);
+
+// Resample frame_count frames from the input, which has input_frame_count
+// frames of channel_count interleaved channels, into the output using linear
+// interpolation. Reading starts at the fixed point frame position and advances
+// by step per output frame. Reads past the last input frame are clamped to it.
+// Returns the position after the last frame written.
+uint64_t Resample(float* output, const float* input, size_t input_frame_count,
+                  int channel_count, uint64_t position, uint64_t step,
+                  size_t frame_count);
+
+// Clamp each sample to the range [-1, 1].
+void ClampSamples(float* samples, size_t sample_count);
+
+}  // namespace pindrop
+
+#endif  // PINDROP_MIXER_SOFTWARE_MIXER_MIX_KERNELS_H_
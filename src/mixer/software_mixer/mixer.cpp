@@ -0,0 +1,203 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mixer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "audio_config_generated.h"
+#include "mix_kernels.h"
+#include "pindrop/log.h"
+#include "sound.h"
+
+namespace pindrop {
+
+// The number of frames mixed at a time. Gain changes are ramped over a block.
+static const size_t kBlockFrames = 256;
+
+static const int kStereo = 2;
+
+const float Voice::kCenterPan = 0.70710678f;
+
+Mixer::Mixer()
+    : device_(),
+      output_frequency_(0),
+      output_channels_(0),
+      first_stream_voice_(0),
+      initialized_(false) {}
+
+Mixer::~Mixer() {
+  if (initialized_) {
+    device_.Close();
+  }
+}
+
+bool Mixer::Initialize(const AudioConfig* config) {
+  if (initialized_) {
+    CallLogFunc("The software mixer has already been initialized.\n");
+    return false;
+  }
+
+  // The mix loop always produces stereo, which is folded down to mono if that
+  // is what the configuration asks for. A frequency or buffer size of zero
+  // leaves it to the device.
+  if (!device_.Open(static_cast<int>(config->output_frequency()),
+                    config->output_channels() == 1 ? 1 : kStereo,
+                    static_cast<int>(config->output_buffer_size()), Render,
+                    this)) {
+    return false;
+  }
+  output_frequency_ = device_.frequency();
+  output_channels_ = device_.channels();
+
+  // Unlike SDL_Mixer there is no per channel overhead beyond the Voice itself,
+  // so large numbers of real channels are cheap when they are not playing.
+  voices_.resize(config->mixer_channels() + config->mixer_stream_channels());
+  first_stream_voice_ = static_cast<int>(config->mixer_channels());
+  mix_buffer_.resize(kBlockFrames * kStereo);
+  resample_buffer_.resize(kBlockFrames * kStereo);
+
+  initialized_ = true;
+  device_.Start();
+  return true;
+}
+
+void Mixer::Lock() {
+  if (initialized_) {
+    device_.Lock();
+  }
+}
+
+void Mixer::Unlock() {
+  if (initialized_) {
+    device_.Unlock();
+  }
+}
+
+void Mixer::HaltVoicesPlaying(const Sound* sound) {
+  MixerLock lock(this);
+  for (size_t i = 0; i < voices_.size(); ++i) {
+    Voice& voice = voices_[i];
+    if (voice.sound == sound) {
+      voice.playing = false;
+      voice.sound = nullptr;
+    }
+  }
+}
+
+void Mixer::Render(void* userdata, float* output, size_t frame_count) {
+  static_cast<Mixer*>(userdata)->Mix(output, frame_count);
+}
+
+void Mixer::Mix(float* output, size_t frame_count) {
+  float* mix = mix_buffer_.data();
+  while (frame_count > 0) {
+    const size_t block_frames = std::min(frame_count, kBlockFrames);
+    std::fill(mix, mix + block_frames * kStereo, 0.0f);
+    for (size_t i = 0; i < voices_.size(); ++i) {
+      Voice& voice = voices_[i];
+      if (voice.playing && !voice.paused) {
+        MixVoice(&voice, block_frames);
+      }
+    }
+    ClampSamples(mix, block_frames * kStereo);
+    if (output_channels_ == kStereo) {
+      memcpy(output, mix, block_frames * kStereo * sizeof(float));
+      output += block_frames * kStereo;
+    } else {
+      for (size_t i = 0; i < block_frames; ++i) {
+        *output++ = 0.5f * (mix[2 * i] + mix[2 * i + 1]);
+      }
+    }
+    frame_count -= block_frames;
+  }
+}
+
+void Mixer::MixVoice(Voice* voice, size_t frame_count) {
+  const Sound* sound = voice->sound;
+  const float* samples = sound->samples();
+  const size_t sound_frames = sound->frame_count();
+  const int channel_count = sound->channel_count();
+  const uint64_t end = static_cast<uint64_t>(sound_frames) << kFixedPointShift;
+  const uint64_t step = voice->step;
+
+  // Work out the gains at the end of this block, taking any fade into account.
+  // The gains ramp from where the last block left them to these values.
+  float fade_end = voice->fade_gain + voice->fade_delta * frame_count;
+  bool faded_out = false;
+  if (fade_end <= 0.0f) {
+    fade_end = 0.0f;
+    faded_out = true;
+  } else if (fade_end >= 1.0f && voice->fade_delta > 0.0f) {
+    fade_end = 1.0f;
+    voice->fade_delta = 0.0f;
+  }
+  const float gain = voice->gain * fade_end;
+  const float left_start = voice->applied_left;
+  const float right_start = voice->applied_right;
+  const float left_end = gain * voice->pan_left;
+  const float right_end = gain * voice->pan_right;
+  const float left_delta = (left_end - left_start) / frame_count;
+  const float right_delta = (right_end - right_start) / frame_count;
+
+  size_t written = 0;
+  while (written < frame_count) {
+    if (voice->position >= end) {
+      if (voice->loop && end > 0) {
+        voice->position %= end;
+      } else {
+        voice->playing = false;
+        break;
+      }
+    }
+
+    // Mix up to the end of the sound or the end of the block, whichever comes
+    // first.
+    const size_t frames_left =
+        static_cast<size_t>((end - voice->position + step - 1) / step);
+    const size_t frames = std::min(frame_count - written, frames_left);
+    const float* input;
+    if (step == kFixedPointOne) {
+      input = samples +
+              (voice->position >> kFixedPointShift) * channel_count;
+    } else {
+      Resample(resample_buffer_.data(), samples, sound_frames, channel_count,
+               voice->position, step, frames);
+      input = resample_buffer_.data();
+    }
+
+    float* out = mix_buffer_.data() + written * kStereo;
+    const float left_a = left_start + left_delta * written;
+    const float right_a = right_start + right_delta * written;
+    const float left_b = left_start + left_delta * (written + frames);
+    const float right_b = right_start + right_delta * (written + frames);
+    if (channel_count == 1) {
+      MixMonoToStereo(out, input, frames, left_a, right_a, left_b, right_b);
+    } else {
+      MixStereoToStereo(out, input, frames, left_a, right_a, left_b, right_b);
+    }
+    voice->position += frames * step;
+    written += frames;
+  }
+
+  voice->applied_left = left_end;
+  voice->applied_right = right_end;
+  voice->fade_gain = fade_end;
+  if (faded_out) {
+    voice->playing = false;
+  }
+}
+
+}  // namespace pindrop
@@ -0,0 +1,152 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_MIXER_SOFTWARE_MIXER_MIXER_H_
+#define PINDROP_MIXER_SOFTWARE_MIXER_MIXER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "audio_device.h"
+
+namespace pindrop {
+
+struct AudioConfig;
+class Sound;
+struct SoundMemoryStats;
+
+// The playback state of one real channel. Voices are owned by the Mixer and
+// read by the audio callback, so they must only be touched while the mixer is
+// locked.
+struct Voice {
+  // The pan coefficient of both sides when a sound is centered, cos(pi / 4).
+  static const float kCenterPan;
+
+  Voice()
+      : sound(nullptr),
+        position(0),
+        step(0),
+        gain(0.0f),
+        pan_left(kCenterPan),
+        pan_right(kCenterPan),
+        applied_left(0.0f),
+        applied_right(0.0f),
+        fade_gain(1.0f),
+        fade_delta(0.0f),
+        loop(false),
+        playing(false),
+        paused(false) {}
+
+  // The sound being played.
+  const Sound* sound;
+
+  // The playback position in the sound, and the amount it advances per output
+  // frame, both as 32.32 fixed point frames.
+  uint64_t position;
+  uint64_t step;
+
+  // The gain and the constant power pan coefficients requested for the voice.
+  float gain;
+  float pan_left;
+  float pan_right;
+
+  // The left and right gains the voice was mixed at by the end of the last
+  // block. Gain changes are ramped from these over the next block.
+  float applied_left;
+  float applied_right;
+
+  // The fade gain, and how much it changes per output frame. It falls while
+  // the voice fades out, and rises while it fades in.
+  float fade_gain;
+  float fade_delta;
+
+  bool loop;
+  bool playing;
+  bool paused;
+};
+
+// The software mixer mixes every voice itself using pindrop's own float mix
+// loop and hands the result to an AudioDevice: SDL's raw audio callback, or
+// the native low latency output on Android.
+class Mixer {
+ public:
+  Mixer();
+
+  ~Mixer();
+
+  bool Initialize(const AudioConfig* config);
+
+  // Lock and unlock the audio callback. Voices may only be modified while the
+  // mixer is locked. The lock may be taken again while it is held.
+  void Lock();
+  void Unlock();
+
+  // The mix loop runs in time with the audio device, so the engine's frame
+  // time is not needed.
+  void AdvanceFrame(float /*delta_time*/) {}
+
+  // Return the voice for the given real channel.
+  Voice* voice(int channel_id) { return &voices_[channel_id]; }
+
+  // Return the channel id of the voice for the given stream channel. The
+  // stream channels' voices come after those of the real channels.
+  int stream_voice_id(int index) const { return first_stream_voice_ + index; }
+
+  int output_frequency() const { return output_frequency_; }
+
+  // Stop every voice that is playing the given sound, which is about to be
+  // unloaded or destroyed. The audio callback is locked out while the voices
+  // are stopped, so it is done reading the sound's samples once this returns.
+  void HaltVoicesPlaying(const Sound* sound);
+
+  // The software mixer holds no audio of its own, so this adds nothing.
+  void AddMemoryStats(SoundMemoryStats* /*stats*/) const {}
+
+ private:
+  static void Render(void* userdata, float* output, size_t frame_count);
+
+  // Mix frame_count frames of every playing voice into the output.
+  void Mix(float* output, size_t frame_count);
+
+  // Mix frame_count frames of the voice into the stereo mix buffer.
+  void MixVoice(Voice* voice, size_t frame_count);
+
+  AudioDevice device_;
+  int output_frequency_;
+  int output_channels_;
+
+  std::vector<Voice> voices_;
+  int first_stream_voice_;
+
+  // Scratch space for one block of stereo output, and for resampled input.
+  std::vector<float> mix_buffer_;
+  std::vector<float> resample_buffer_;
+
+  bool initialized_;
+};
+
+// Locks the mixer for the lifetime of the object.
+class MixerLock {
+ public:
+  explicit MixerLock(Mixer* mixer) : mixer_(mixer) { mixer_->Lock(); }
+  ~MixerLock() { mixer_->Unlock(); }
+
+ private:
+  Mixer* mixer_;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_MIXER_SOFTWARE_MIXER_MIXER_H_
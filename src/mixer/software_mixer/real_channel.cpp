@@ -0,0 +1,169 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "real_channel.h"
+
+#include <cassert>
+#include <cmath>
+
+#include "mix_kernels.h"
+#include "mixer.h"
+#include "pindrop/log.h"
+#include "sound_collection.h"
+
+namespace pindrop {
+
+static const int kInvalidChannelId = -1;
+
+static const int kMillisecondsPerSecond = 1000;
+
+RealChannel::RealChannel() : mixer_(nullptr), channel_id_(kInvalidChannelId) {}
+
+void RealChannel::Initialize(Mixer* mixer, int i) {
+  mixer_ = mixer;
+  channel_id_ = i;
+}
+
+void StreamChannel::Initialize(Mixer* mixer, int i) {
+  RealChannel::Initialize(mixer, mixer->stream_voice_id(i));
+}
+
+bool RealChannel::Valid() const { return channel_id_ != kInvalidChannelId; }
+
+bool RealChannel::Play(SoundCollection* collection, Sound* sound,
+                       float position) {
+  assert(Valid());
+  if (sound->frame_count() == 0) {
+    CallLogFunc("Could not play sound %s\n", sound->filename().c_str());
+    return false;
+  }
+  const bool loop = collection->params().loop;
+  uint64_t start_frame =
+      position > 0.0f
+          ? static_cast<uint64_t>(position * sound->frequency())
+          : 0;
+  if (loop) {
+    start_frame %= sound->frame_count();
+  }
+  MixerLock lock(mixer_);
+  Voice* voice = mixer_->voice(channel_id_);
+  voice->sound = sound;
+  voice->position = start_frame << kFixedPointShift;
+  voice->step =
+      (static_cast<uint64_t>(sound->frequency()) << kFixedPointShift) /
+      mixer_->output_frequency();
+  // The gain is set right after the sound starts, and ramps up from silence
+  // over the first block.
+  voice->gain = 0.0f;
+  voice->applied_left = 0.0f;
+  voice->applied_right = 0.0f;
+  voice->fade_gain = 1.0f;
+  voice->fade_delta = 0.0f;
+  voice->loop = loop;
+  // A one shot sound resumed past its end has already finished.
+  voice->playing = start_frame < sound->frame_count();
+  voice->paused = false;
+  return true;
+}
+
+bool RealChannel::Playing() const {
+  assert(Valid());
+  MixerLock lock(mixer_);
+  return mixer_->voice(channel_id_)->playing;
+}
+
+bool RealChannel::Paused() const {
+  assert(Valid());
+  MixerLock lock(mixer_);
+  return mixer_->voice(channel_id_)->paused;
+}
+
+float RealChannel::Position() const {
+  assert(Valid());
+  MixerLock lock(mixer_);
+  const Voice* voice = mixer_->voice(channel_id_);
+  if (!voice->sound || voice->sound->frequency() == 0) {
+    return 0.0f;
+  }
+  return static_cast<float>(voice->position >> kFixedPointShift) /
+         voice->sound->frequency();
+}
+
+void RealChannel::SetGain(const float gain) {
+  assert(Valid());
+  MixerLock lock(mixer_);
+  mixer_->voice(channel_id_)->gain = gain;
+}
+
+float RealChannel::Gain() const {
+  assert(Valid());
+  MixerLock lock(mixer_);
+  return mixer_->voice(channel_id_)->gain;
+}
+
+void RealChannel::Halt() {
+  assert(Valid());
+  MixerLock lock(mixer_);
+  mixer_->voice(channel_id_)->playing = false;
+}
+
+void RealChannel::Pause() {
+  assert(Valid());
+  MixerLock lock(mixer_);
+  mixer_->voice(channel_id_)->paused = true;
+}
+
+void RealChannel::Resume() {
+  assert(Valid());
+  MixerLock lock(mixer_);
+  mixer_->voice(channel_id_)->paused = false;
+}
+
+void RealChannel::FadeOut(int milliseconds) {
+  assert(Valid());
+  MixerLock lock(mixer_);
+  Voice* voice = mixer_->voice(channel_id_);
+  const float frames = static_cast<float>(milliseconds) *
+                       mixer_->output_frequency() / kMillisecondsPerSecond;
+  if (frames < 1.0f) {
+    voice->playing = false;
+  } else {
+    voice->fade_delta = -voice->fade_gain / frames;
+  }
+}
+
+void RealChannel::FadeIn(int milliseconds) {
+  assert(Valid());
+  MixerLock lock(mixer_);
+  Voice* voice = mixer_->voice(channel_id_);
+  const float frames = static_cast<float>(milliseconds) *
+                       mixer_->output_frequency() / kMillisecondsPerSecond;
+  if (frames >= 1.0f) {
+    voice->fade_gain = 0.0f;
+    voice->fade_delta = 1.0f / frames;
+  }
+}
+
+void RealChannel::SetPan(const mathfu::Vector<float, 2>& pan) {
+  assert(Valid());
+  // This formula is explained in the following paper:
+  // http://www.rs-met.com/documents/tutorials/PanRules.pdf
+  float p = static_cast<float>(M_PI) * (pan.x + 1.0f) / 4.0f;
+  MixerLock lock(mixer_);
+  Voice* voice = mixer_->voice(channel_id_);
+  voice->pan_left = cos(p);
+  voice->pan_right = sin(p);
+}
+
+}  // namespace pindrop
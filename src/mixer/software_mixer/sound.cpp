@@ -0,0 +1,226 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sound.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "file_buffer.h"
+#include "pcm_file.h"
+#include "pindrop/audio_engine.h"
+#include "pindrop/log.h"
+#ifdef PINDROP_USE_TREMOR
+#include "ivorbisfile.h"
+#else
+#include "vorbis/vorbisfile.h"
+#endif  // PINDROP_USE_TREMOR
+
+namespace pindrop {
+
+static const int kMaxChannels = 2;
+
+// The number of frames requested from the Ogg decoder at a time.
+static const int kOggReadFrames = 4096;
+
+#ifdef PINDROP_USE_TREMOR
+// Tremor only decodes to 16 bit integers, which are scaled by this.
+static const float kInt16Scale = 1.0f / 32768.0f;
+#endif  // PINDROP_USE_TREMOR
+
+// The first four bytes of every Ogg file.
+static const char kOggMagic[] = {'O', 'g', 'g', 'S'};
+
+// Callbacks that let the Ogg decoder read through SDL_RWops, so that sounds
+// are found in the same places SDL_Mixer would find them.
+static size_t ReadRWops(void* buffer, size_t size, size_t count,
+                        void* source) {
+  return SDL_RWread(static_cast<SDL_RWops*>(source), buffer, size, count);
+}
+
+static int SeekRWops(void* source, ogg_int64_t offset, int whence) {
+  return SDL_RWseek(static_cast<SDL_RWops*>(source), offset, whence) < 0 ? -1
+                                                                         : 0;
+}
+
+static int CloseRWops(void* source) {
+  return SDL_RWclose(static_cast<SDL_RWops*>(source));
+}
+
+static long TellRWops(void* source) {
+  return static_cast<long>(SDL_RWtell(static_cast<SDL_RWops*>(source)));
+}
+
+Sound::~Sound() {}
+
+// The SampleCache has every engine's mixer halt the voices playing the sound,
+// so that no audio callback is still reading its samples, before it is freed.
+void Sound::Free() {
+  std::vector<float>().swap(samples_);
+  channel_count_ = 0;
+  frequency_ = 0;
+}
+
+void Sound::Initialize(const SoundCollection* /*sound_collection*/) {}
+
+void Sound::Load() {
+  // Prebuilt PCM only needs converting to float, not decoding.
+  bool success = false;
+  PcmFile pcm;
+  if (data() && ParsePcmFile(data(), size(), &pcm)) {
+    success = LoadPcm(pcm);
+  } else if (!data() && HasPcmFileExtension(filename())) {
+    FileBuffer source;
+    success = source.Load(filename().c_str()) &&
+              ParsePcmFile(source.data(), source.size(), &pcm) && LoadPcm(pcm);
+  } else {
+    SDL_RWops* rw =
+        data() ? SDL_RWFromConstMem(data(), static_cast<int>(size()))
+               : SDL_RWFromFile(filename().c_str(), "rb");
+    if (rw != nullptr) {
+      char magic[sizeof(kOggMagic)];
+      bool is_ogg =
+          SDL_RWread(rw, magic, 1, sizeof(magic)) == sizeof(magic) &&
+          memcmp(magic, kOggMagic, sizeof(magic)) == 0;
+      SDL_RWseek(rw, 0, RW_SEEK_SET);
+      success = is_ogg ? LoadOgg(rw) : LoadWav(rw);
+    }
+  }
+  if (!success) {
+    samples_.clear();
+    channel_count_ = 0;
+    CallLogFunc("Could not load sound file: %s.", filename().c_str());
+  }
+}
+
+void Sound::AddMemoryStats(SoundMemoryStats* stats) const {
+  stats->decoded_bytes += samples_.size() * sizeof(float);
+}
+
+bool Sound::LoadOgg(SDL_RWops* rw) {
+  ov_callbacks callbacks = {ReadRWops, SeekRWops, CloseRWops, TellRWops};
+  OggVorbis_File file;
+  if (ov_open_callbacks(rw, &file, nullptr, 0, callbacks) != 0) {
+    SDL_RWclose(rw);
+    return false;
+  }
+  const vorbis_info* info = ov_info(&file, -1);
+  const int source_channels = info->channels;
+  channel_count_ = std::min(source_channels, kMaxChannels);
+  frequency_ = static_cast<int>(info->rate);
+
+  ogg_int64_t total_frames = ov_pcm_total(&file, -1);
+  if (total_frames > 0) {
+    samples_.reserve(static_cast<size_t>(total_frames) * channel_count_);
+  }
+
+  // Decode the whole file, keeping only the first two channels.
+  bool success = true;
+  int bitstream = 0;
+#ifdef PINDROP_USE_TREMOR
+  // Tremor has no float output, so its interleaved 16 bit output is converted.
+  std::vector<int16_t> buffer(kOggReadFrames * source_channels);
+  const int buffer_bytes = static_cast<int>(buffer.size() * sizeof(int16_t));
+  for (;;) {
+    long bytes = ov_read(&file, reinterpret_cast<char*>(buffer.data()),
+                         buffer_bytes, &bitstream);
+    if (bytes == OV_HOLE) {
+      continue;
+    } else if (bytes <= 0) {
+      success = bytes == 0;
+      break;
+    }
+    const long frames =
+        bytes / static_cast<long>(sizeof(int16_t) * source_channels);
+    for (long i = 0; i < frames; ++i) {
+      const int16_t* frame = &buffer[i * source_channels];
+      for (int channel = 0; channel < channel_count_; ++channel) {
+        samples_.push_back(frame[channel] * kInt16Scale);
+      }
+    }
+  }
+#else
+  for (;;) {
+    float** pcm;
+    long frames = ov_read_float(&file, &pcm, kOggReadFrames, &bitstream);
+    if (frames == OV_HOLE) {
+      continue;
+    } else if (frames <= 0) {
+      success = frames == 0;
+      break;
+    }
+    for (long i = 0; i < frames; ++i) {
+      for (int channel = 0; channel < channel_count_; ++channel) {
+        samples_.push_back(pcm[channel][i]);
+      }
+    }
+  }
+#endif  // PINDROP_USE_TREMOR
+  // This also closes the SDL_RWops.
+  ov_clear(&file);
+  return success;
+}
+
+bool Sound::LoadWav(SDL_RWops* rw) {
+  SDL_AudioSpec spec;
+  Uint8* buffer;
+  Uint32 length;
+  if (SDL_LoadWAV_RW(rw, 1, &spec, &buffer, &length) == nullptr) {
+    return false;
+  }
+  bool success = ConvertSamples(buffer, length, spec.format, spec.channels,
+                                spec.freq);
+  SDL_FreeWAV(buffer);
+  return success;
+}
+
+bool Sound::LoadPcm(const PcmFile& pcm) {
+  return ConvertSamples(reinterpret_cast<const Uint8*>(pcm.samples),
+                        static_cast<Uint32>(pcm.size), pcm.format,
+                        static_cast<Uint8>(pcm.channels),
+                        static_cast<int>(pcm.frequency));
+}
+
+bool Sound::ConvertSamples(const Uint8* buffer, Uint32 length,
+                           SDL_AudioFormat format, Uint8 channels,
+                           int frequency) {
+  channel_count_ = channels == 1 ? 1 : kMaxChannels;
+  frequency_ = frequency;
+
+  // Convert to float in place in the sample buffer. The sample rate is left
+  // alone; the mix loop resamples as it goes.
+  SDL_AudioCVT cvt;
+  if (SDL_BuildAudioCVT(&cvt, format, channels, frequency, AUDIO_F32SYS,
+                        static_cast<Uint8>(channel_count_), frequency) < 0) {
+    return false;
+  }
+  const size_t buffer_size = static_cast<size_t>(length) * cvt.len_mult;
+  samples_.resize((buffer_size + sizeof(float) - 1) / sizeof(float));
+  memcpy(samples_.data(), buffer, length);
+  size_t converted_size = length;
+  if (cvt.needed) {
+    cvt.buf = reinterpret_cast<Uint8*>(samples_.data());
+    cvt.len = static_cast<int>(length);
+    if (SDL_ConvertAudio(&cvt) != 0) {
+      return false;
+    }
+    converted_size = cvt.len_cvt;
+  }
+  samples_.resize(converted_size / sizeof(float));
+  samples_.shrink_to_fit();
+  return true;
+}
+
+}  // namespace pindrop
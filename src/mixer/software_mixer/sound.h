@@ -0,0 +1,86 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_MIXER_SOFTWARE_MIXER_SOUND_H_
+#define PINDROP_MIXER_SOFTWARE_MIXER_SOUND_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "SDL.h"
+#include "file_loader.h"
+
+namespace pindrop {
+
+class SoundCollection;
+struct PcmFile;
+struct SoundMemoryStats;
+
+// A sound decoded to interleaved 32 bit float samples. Ogg Vorbis, wave and
+// prebuilt PCM files are decoded in full when they are loaded, including
+// streamed collections and collections stored compressed, so that the mix
+// loop never has to decode.
+class Sound : public Resource {
+ public:
+  Sound() : channel_count_(0), frequency_(0) {}
+
+  virtual ~Sound();
+
+  void Initialize(const SoundCollection* sound_collection);
+
+  virtual void Load();
+
+  const float* samples() const { return samples_.data(); }
+
+  size_t frame_count() const {
+    return channel_count_ ? samples_.size() / channel_count_ : 0;
+  }
+
+  // The number of interleaved channels, which is either 1 or 2.
+  int channel_count() const { return channel_count_; }
+
+  // The sample rate of the sound in frames per second.
+  int frequency() const { return frequency_; }
+
+  // The length of the sound in seconds, or zero if it did not load.
+  float duration() const {
+    return frequency_ ? static_cast<float>(frame_count()) /
+                            static_cast<float>(frequency_)
+                      : 0.0f;
+  }
+
+  // Add the memory held by this sound to the given stats.
+  void AddMemoryStats(SoundMemoryStats* stats) const;
+
+ private:
+  // Free the samples, once no voice is playing them.
+  virtual void Free();
+
+  bool LoadOgg(SDL_RWops* rw);
+  bool LoadWav(SDL_RWops* rw);
+  bool LoadPcm(const PcmFile& pcm);
+
+  // Convert the given samples to float, keeping at most two channels.
+  bool ConvertSamples(const Uint8* buffer, Uint32 length,
+                      SDL_AudioFormat format, Uint8 channels, int frequency);
+
+  std::vector<float> samples_;
+  int channel_count_;
+  int frequency_;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_MIXER_SOFTWARE_MIXER_SOUND_H_
@@ -0,0 +1,53 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pcm_file.h"
+
+#include <cstring>
+
+namespace pindrop {
+
+static const char kPcmFileExtension[] = ".pcm";
+static const char kPcmFileMagic[] = {'P', 'P', 'C', 'M'};
+
+static uint32_t ReadLittleEndian(const char* data, size_t size) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  uint32_t value = 0;
+  for (size_t i = size; i > 0; --i) {
+    value = (value << 8) | bytes[i - 1];
+  }
+  return value;
+}
+
+bool HasPcmFileExtension(const std::string& filename) {
+  const size_t length = sizeof(kPcmFileExtension) - 1;
+  return filename.size() >= length &&
+         filename.compare(filename.size() - length, length,
+                          kPcmFileExtension) == 0;
+}
+
+bool ParsePcmFile(const char* data, size_t size, PcmFile* pcm) {
+  if (size < kPcmFileHeaderSize ||
+      memcmp(data, kPcmFileMagic, sizeof(kPcmFileMagic)) != 0) {
+    return false;
+  }
+  pcm->frequency = ReadLittleEndian(data + 4, 4);
+  pcm->format = static_cast<uint16_t>(ReadLittleEndian(data + 8, 2));
+  pcm->channels = static_cast<uint16_t>(ReadLittleEndian(data + 10, 2));
+  pcm->size = ReadLittleEndian(data + 12, 4);
+  pcm->samples = data + kPcmFileHeaderSize;
+  return pcm->size <= size - kPcmFileHeaderSize && pcm->channels > 0;
+}
+
+}  // namespace pindrop
@@ -0,0 +1,58 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_PCM_FILE_H_
+#define PINDROP_PCM_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace pindrop {
+
+// The size of the header at the start of a prebuilt PCM file. The samples
+// that follow it are aligned to 16 bytes.
+static const size_t kPcmFileHeaderSize = 16;
+
+// Audio that scripts/build_assets.py --pcm has already decoded to the engine's
+// output format, so that it can be handed to the mixer without being decoded
+// or converted. A .pcm file starts with a header of:
+//
+//   char     magic[4];   // "PPCM"
+//   uint32_t frequency;  // Frames per second.
+//   uint16_t format;     // An SDL_AudioFormat.
+//   uint16_t channels;
+//   uint32_t size;       // The size of the samples in bytes.
+//
+// all little endian, followed by the interleaved samples.
+struct PcmFile {
+  PcmFile() : frequency(0), format(0), channels(0), samples(nullptr), size(0) {}
+
+  uint32_t frequency;
+  uint16_t format;
+  uint16_t channels;
+  const char* samples;
+  size_t size;
+};
+
+// Returns true if the filename has the extension of a prebuilt PCM file.
+bool HasPcmFileExtension(const std::string& filename);
+
+// Read the header of a prebuilt PCM file. Returns false if the data does not
+// hold one.
+bool ParsePcmFile(const char* data, size_t size, PcmFile* pcm);
+
+}  // namespace pindrop
+
+#endif  // PINDROP_PCM_FILE_H_
@@ -0,0 +1,114 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "priority_index.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace pindrop {
+
+const int PriorityIndex::kEnd;
+const int PriorityIndex::kMaxLevels;
+
+PriorityIndex::PriorityIndex()
+    : priorities_(nullptr), head_(0), random_state_(0x9e3779b9u) {}
+
+void PriorityIndex::Initialize(const std::vector<float>* priorities,
+                               size_t size) {
+  priorities_ = priorities;
+  head_ = size;
+  levels_.assign(size, 0);
+  next_.assign((size + 1) * kMaxLevels, kEnd);
+  prev_.assign((size + 1) * kMaxLevels, kEnd);
+}
+
+void PriorityIndex::Clear() {
+  std::fill(levels_.begin(), levels_.end(), 0);
+  for (int level = 0; level < kMaxLevels; ++level) {
+    next(head_, level) = kEnd;
+  }
+}
+
+int PriorityIndex::FindInsertionPoint(float priority) const {
+  int node = static_cast<int>(head_);
+  for (int level = kMaxLevels - 1; level >= 0; --level) {
+    for (int n = next(node, level); n != kEnd && this->priority(n) > priority;
+         n = next(node, level)) {
+      node = n;
+    }
+  }
+  return next(node, 0);
+}
+
+int PriorityIndex::Insert(size_t channel, float priority) {
+  assert(!Contains(channel));
+  int predecessors[kMaxLevels];
+  int node = static_cast<int>(head_);
+  for (int level = kMaxLevels - 1; level >= 0; --level) {
+    for (int n = next(node, level); n != kEnd && this->priority(n) > priority;
+         n = next(node, level)) {
+      node = n;
+    }
+    predecessors[level] = node;
+  }
+  int successor = next(node, 0);
+  Link(channel, RandomLevel(), predecessors);
+  return successor;
+}
+
+void PriorityIndex::Link(size_t channel, int level_count,
+                         const int* predecessors) {
+  int node = static_cast<int>(channel);
+  levels_[channel] = static_cast<uint8_t>(level_count);
+  for (int level = 0; level < level_count; ++level) {
+    int predecessor = predecessors[level];
+    int successor = next(predecessor, level);
+    next(node, level) = successor;
+    prev(node, level) = predecessor;
+    next(predecessor, level) = node;
+    if (successor != kEnd) {
+      prev(successor, level) = node;
+    }
+  }
+}
+
+void PriorityIndex::Remove(size_t channel) {
+  int level_count = levels_[channel];
+  for (int level = 0; level < level_count; ++level) {
+    int predecessor = prev(channel, level);
+    int successor = next(channel, level);
+    next(predecessor, level) = successor;
+    if (successor != kEnd) {
+      prev(successor, level) = predecessor;
+    }
+  }
+  levels_[channel] = 0;
+}
+
+int PriorityIndex::RandomLevel() {
+  // xorshift32. Each level is kept with probability 1/4, matching the spacing
+  // used by Rebuild.
+  random_state_ ^= random_state_ << 13;
+  random_state_ ^= random_state_ >> 17;
+  random_state_ ^= random_state_ << 5;
+  int level_count = 1;
+  for (uint32_t bits = random_state_;
+       (bits & 3) == 0 && level_count < kMaxLevels; bits >>= 2) {
+    ++level_count;
+  }
+  return level_count;
+}
+
+}  // namespace pindrop
@@ -0,0 +1,125 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_PRIORITY_INDEX_H_
+#define PINDROP_PRIORITY_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pindrop {
+
+// A skip list over the channels in the playing channel list, keyed on their
+// priority. It mirrors the order of the priority list so that finding where a
+// new sound belongs takes O(log n) instead of a linear walk of the list.
+//
+// Channels are referred to by their index in the channel pool, and their
+// priorities are read from the array given to Initialize. The index does not
+// modify the priority list itself; callers keep the two in step.
+class PriorityIndex {
+ public:
+  // Returned by FindInsertionPoint and Insert when the new channel belongs at
+  // the end of the list.
+  static const int kEnd = -1;
+
+  PriorityIndex();
+
+  // Prepare the index to hold up to size channels, whose priorities are
+  // stored in priorities.
+  void Initialize(const std::vector<float>* priorities, size_t size);
+
+  // Returns the first channel in the index whose priority is at or below the
+  // given priority, or kEnd if there is none. A new channel with this priority
+  // should be placed immediately before the returned channel. This matches
+  // the FindInsertionPoint function that works on the priority list.
+  int FindInsertionPoint(float priority) const;
+
+  // Add a channel with the given priority to the index. Returns the channel it
+  // was placed before, or kEnd if it was placed at the end.
+  int Insert(size_t channel, float priority);
+
+  // Remove a channel from the index. Does nothing if it is not in the index.
+  void Remove(size_t channel);
+
+  // Returns true if the channel is in the index.
+  bool Contains(size_t channel) const { return levels_[channel] != 0; }
+
+  // Clear the index and rebuild it from an ordered sequence of channels. The
+  // levels are assigned evenly rather than randomly, so the rebuilt index is
+  // perfectly balanced.
+  template <typename Iterator>
+  void Rebuild(Iterator begin, Iterator end);
+
+ private:
+  static const int kMaxLevels = 8;
+
+  int& next(size_t node, int level) { return next_[node * kMaxLevels + level]; }
+  int next(size_t node, int level) const {
+    return next_[node * kMaxLevels + level];
+  }
+  int& prev(size_t node, int level) { return prev_[node * kMaxLevels + level]; }
+
+  float priority(int node) const { return (*priorities_)[node]; }
+
+  void Clear();
+  void Link(size_t channel, int level_count, const int* predecessors);
+  int RandomLevel();
+
+  const std::vector<float>* priorities_;
+
+  // The number of levels each channel occupies, or zero if it is not in the
+  // index.
+  std::vector<uint8_t> levels_;
+
+  // The forward and backward links of every level, kMaxLevels per node. The
+  // last node is the head of the list.
+  std::vector<int> next_;
+  std::vector<int> prev_;
+  size_t head_;
+
+  uint32_t random_state_;
+};
+
+template <typename Iterator>
+void PriorityIndex::Rebuild(Iterator begin, Iterator end) {
+  Clear();
+  int last[kMaxLevels];
+  for (int level = 0; level < kMaxLevels; ++level) {
+    last[level] = static_cast<int>(head_);
+  }
+  unsigned int position = 0;
+  for (Iterator iter = begin; iter != end; ++iter) {
+    // Every fourth node is promoted to level 1, every sixteenth to level 2,
+    // and so on.
+    ++position;
+    int level_count = 1;
+    for (unsigned int p = position; p % 4 == 0 && level_count < kMaxLevels;
+         p /= 4) {
+      ++level_count;
+    }
+    int channel = static_cast<int>(iter->index());
+    levels_[channel] = static_cast<uint8_t>(level_count);
+    for (int level = 0; level < level_count; ++level) {
+      next(last[level], level) = channel;
+      prev(channel, level) = last[level];
+      next(channel, level) = kEnd;
+      last[level] = channel;
+    }
+  }
+}
+
+}  // namespace pindrop
+
+#endif  // PINDROP_PRIORITY_INDEX_H_
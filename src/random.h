@@ -0,0 +1,70 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_RANDOM_H_
+#define PINDROP_RANDOM_H_
+
+#include <cstdint>
+
+namespace pindrop {
+
+// A small, fast pseudorandom number generator (PCG32) owned by the engine, so
+// that choosing samples does not share the state of the C library's rand()
+// with game code. The same seed always produces the same sequence.
+class Random {
+ public:
+  Random() : state_(0), increment_(0) { Seed(0); }
+  explicit Random(uint32_t seed) : state_(0), increment_(0) { Seed(seed); }
+
+  // Restart the sequence from the given seed.
+  void Seed(uint32_t seed) {
+    state_ = 0;
+    increment_ = (static_cast<uint64_t>(seed) << 1) | 1u;
+    Next();
+    state_ += kDefaultState;
+    Next();
+  }
+
+  // Returns a uniformly distributed 32 bit value.
+  uint32_t Next() {
+    uint64_t state = state_;
+    state_ = state * kMultiplier + increment_;
+    uint32_t xorshifted =
+        static_cast<uint32_t>(((state >> 18u) ^ state) >> 27u);
+    uint32_t rotation = static_cast<uint32_t>(state >> 59u);
+    return (xorshifted >> rotation) | (xorshifted << ((-rotation) & 31u));
+  }
+
+  // Returns a uniformly distributed value in [0, 1).
+  float NextFloat() {
+    return static_cast<float>(Next() >> 8) * (1.0f / 16777216.0f);
+  }
+
+  // Returns a value in [0, bound). The bound must be greater than zero.
+  uint32_t Below(uint32_t bound) {
+    return static_cast<uint32_t>(
+        (static_cast<uint64_t>(Next()) * bound) >> 32);
+  }
+
+ private:
+  static const uint64_t kMultiplier = 6364136223846793005ull;
+  static const uint64_t kDefaultState = 0x853c49e6748fea9bull;
+
+  uint64_t state_;
+  uint64_t increment_;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_RANDOM_H_
@@ -0,0 +1,217 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sample_cache.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#include "mixer.h"
+#include "pindrop/audio_engine.h"
+#include "sound_collection.h"
+
+namespace pindrop {
+
+// The collection parameters that change how a Sound is loaded.
+static const unsigned int kStreamFlag = 1 << 0;
+static const unsigned int kCompressedFlag = 1 << 1;
+
+// Sounds loaded because they are about to play are loaded before anything
+// else, since the channel playing them is silent until they are.
+static const int kOnDemandLoadPriority = std::numeric_limits<int>::max();
+
+static unsigned int LoadFlags(const SoundCollection* collection) {
+  const SoundCollectionParams& params = collection->params();
+  return (params.stream ? kStreamFlag : 0) |
+         (params.compressed ? kCompressedFlag : 0);
+}
+
+Sound* SampleCache::Acquire(const char* filename,
+                            const SoundCollection* collection,
+                            const std::shared_ptr<SoundBankArchive>& archive,
+                            FileLoader* loader, LoadGroupId* load_group) {
+  Key key(filename, LoadFlags(collection));
+  auto iter = entries_.find(key);
+  if (iter == entries_.end()) {
+    iter = entries_.insert(std::make_pair(key, Entry())).first;
+    Entry& entry = iter->second;
+    entry.sound.reset(new Sound());
+    entry.load_group = loader->current_group();
+    index_[entry.sound.get()] = iter;
+
+    entry.sound->Initialize(collection);
+    const char* data;
+    size_t size;
+    if (archive && archive->Find(filename, &data, &size)) {
+      entry.archive = archive;
+    }
+    entry.on_demand = budget_ > 0;
+    if (!entry.on_demand) {
+      Load(iter, loader);
+    }
+  }
+  Entry& entry = iter->second;
+  entry.ref_counter.Increment();
+  *load_group = entry.load_group;
+  return entry.sound.get();
+}
+
+void SampleCache::Load(EntryMap::iterator iter, FileLoader* loader) {
+  const char* filename = iter->first.first.c_str();
+  Entry& entry = iter->second;
+  const char* data;
+  size_t size;
+  if (entry.archive && entry.archive->Find(filename, &data, &size)) {
+    entry.sound->LoadMemory(filename, data, size, loader);
+  } else {
+    entry.sound->LoadFile(filename, loader);
+  }
+}
+
+void SampleCache::Release(Sound* sound, FileLoader* loader) {
+  auto index_iter = index_.find(sound);
+  assert(index_iter != index_.end());
+  EntryMap::iterator iter = index_iter->second;
+  if (iter->second.ref_counter.Decrement() == 0) {
+    // The Sound can not be destroyed while it is being loaded or played.
+    loader->CancelJob(sound);
+    HaltVoicesPlaying(sound);
+    Entry* entry = &iter->second;
+    if (entry->load_state == kLoading) {
+      loading_.erase(std::find(loading_.begin(), loading_.end(), entry));
+    } else if (entry->load_state == kLoaded) {
+      loaded_bytes_ -= entry->bytes;
+    }
+    index_.erase(index_iter);
+    entries_.erase(iter);
+  }
+}
+
+bool SampleCache::FindEntry(const Sound* sound, EntryMap::iterator* iter) {
+  auto index_iter = index_.find(sound);
+  if (index_iter == index_.end()) {
+    return false;
+  }
+  *iter = index_iter->second;
+  return true;
+}
+
+void SampleCache::RemoveMixer(Mixer* mixer) {
+  auto iter = std::find(mixers_.begin(), mixers_.end(), mixer);
+  if (iter != mixers_.end()) {
+    mixers_.erase(iter);
+  }
+}
+
+void SampleCache::HaltVoicesPlaying(const Sound* sound) {
+  for (size_t i = 0; i < mixers_.size(); ++i) {
+    mixers_[i]->HaltVoicesPlaying(sound);
+  }
+}
+
+void SampleCache::LoadOnDemand(EntryMap::iterator iter, FileLoader* loader) {
+  Entry& entry = iter->second;
+  entry.last_played = ++play_count_;
+  if (!entry.on_demand || entry.load_state != kUnloaded) {
+    return;
+  }
+  entry.load_state = kLoading;
+  loading_.push_back(&entry);
+  loader->BeginGroup(kOnDemandLoadPriority);
+  Load(iter, loader);
+  loader->EndGroup();
+}
+
+void SampleCache::Pin(Sound* sound, FileLoader* loader) {
+  EntryMap::iterator iter;
+  if (FindEntry(sound, &iter)) {
+    ++iter->second.pin_count;
+    LoadOnDemand(iter, loader);
+  }
+}
+
+void SampleCache::Unpin(Sound* sound) {
+  // The sound may have been released while it was still playing.
+  EntryMap::iterator iter;
+  if (FindEntry(sound, &iter) && iter->second.pin_count > 0) {
+    --iter->second.pin_count;
+  }
+}
+
+void SampleCache::Prefetch(Sound* sound, FileLoader* loader) {
+  EntryMap::iterator iter;
+  if (FindEntry(sound, &iter)) {
+    LoadOnDemand(iter, loader);
+  }
+}
+
+void SampleCache::CountLoadedEntries() {
+  for (size_t i = 0; i < loading_.size();) {
+    Entry* entry = loading_[i];
+    if (!entry->sound->ready()) {
+      ++i;
+      continue;
+    }
+    SoundMemoryStats stats;
+    entry->sound->AddMemoryStats(&stats);
+    entry->bytes = stats.decoded_bytes + stats.compressed_bytes;
+    entry->load_state = kLoaded;
+    loaded_bytes_ += entry->bytes;
+    loading_[i] = loading_.back();
+    loading_.pop_back();
+  }
+}
+
+void SampleCache::Trim(FileLoader* loader) {
+  if (budget_ == 0) {
+    return;
+  }
+  CountLoadedEntries();
+  if (loaded_bytes_ <= budget_) {
+    return;
+  }
+  unpinned_.clear();
+  for (auto iter = entries_.begin(); iter != entries_.end(); ++iter) {
+    Entry* entry = &iter->second;
+    if (entry->load_state == kLoaded && entry->pin_count == 0) {
+      unpinned_.push_back(entry);
+    }
+  }
+  std::sort(unpinned_.begin(), unpinned_.end(),
+            [](const Entry* a, const Entry* b) {
+              return a->last_played < b->last_played;
+            });
+  for (size_t i = 0; i < unpinned_.size() && loaded_bytes_ > budget_; ++i) {
+    Entry* entry = unpinned_[i];
+    // The Sound has finished loading, so this only waits for the loader to
+    // let go of it.
+    loader->CancelJob(entry->sound.get());
+    HaltVoicesPlaying(entry->sound.get());
+    entry->sound->Unload();
+    entry->load_state = kUnloaded;
+    loaded_bytes_ -= entry->bytes;
+    entry->bytes = 0;
+  }
+}
+
+void SampleCache::AddMemoryStats(SoundMemoryStats* stats) const {
+  for (auto iter = entries_.begin(); iter != entries_.end(); ++iter) {
+    iter->second.sound->AddMemoryStats(stats);
+  }
+  stats->sample_budget = budget_;
+  stats->budgeted_bytes = loaded_bytes_;
+}
+
+}  // namespace pindrop
@@ -0,0 +1,188 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_SAMPLE_CACHE_H_
+#define PINDROP_SAMPLE_CACHE_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "file_loader.h"
+#include "ref_counter.h"
+#include "sound.h"
+#include "sound_bank_archive.h"
+
+namespace pindrop {
+
+class Mixer;
+class SoundCollection;
+struct SoundMemoryStats;
+
+// The Sounds of every loaded sound collection, keyed by the file they are
+// loaded from. Collections that play the same file share one Sound, so each
+// file is loaded and held only once. Files that are played in different ways,
+// such as streamed by one collection and not by another, are loaded once for
+// each way.
+class SampleCache {
+ public:
+  SampleCache()
+      : entries_(), index_(), budget_(0), loaded_bytes_(0), play_count_(0) {}
+
+  // Set the number of bytes of audio to keep loaded. If zero, every Sound is
+  // loaded when it is first acquired and stays loaded until it is released.
+  // Otherwise Sounds acquired from then on are only loaded when they are
+  // played or prefetched, and are unloaded again by Trim, least recently
+  // played first, once the loaded audio goes over the budget.
+  void set_budget(size_t budget) { budget_ = budget; }
+  size_t budget() const { return budget_; }
+
+  // Return the Sound for the given file as played by the given collection,
+  // queueing it for loading if there is no budget and it is not loaded
+  // already. The file is read from the archive if it is in it. load_group is
+  // set to the group the Sound was queued for loading in. Every call must be
+  // balanced by a call to Release.
+  Sound* Acquire(const char* filename, const SoundCollection* collection,
+                 const std::shared_ptr<SoundBankArchive>& archive,
+                 FileLoader* loader, LoadGroupId* load_group);
+
+  // Release a Sound returned by Acquire. The Sound is destroyed once every
+  // collection that acquired it has released it.
+  void Release(Sound* sound, FileLoader* loader);
+
+  // Mark a Sound as playing on a channel, and as played just now. It is
+  // queued for loading ahead of everything else if it is not loaded, and is
+  // not unloaded until every Pin has been balanced by a call to Unpin.
+  void Pin(Sound* sound, FileLoader* loader);
+  void Unpin(Sound* sound);
+
+  // Queue a Sound for loading if it is not loaded, and mark it as played just
+  // now so that it is the last to be unloaded.
+  void Prefetch(Sound* sound, FileLoader* loader);
+
+  // Unload the Sounds played least recently that are not pinned until the
+  // loaded audio fits within the budget. Does nothing if there is no budget.
+  void Trim(FileLoader* loader);
+
+  // Return the number of bytes held by the Sounds loaded on demand.
+  size_t loaded_bytes() const { return loaded_bytes_; }
+
+  // Add the memory held by every loaded Sound to the given stats.
+  void AddMemoryStats(SoundMemoryStats* stats) const;
+
+  // Return the number of distinct Sounds held.
+  size_t size() const { return entries_.size(); }
+
+  // Add or remove the mixer of an engine using the cache. Sounds are shared
+  // between engines, so before a Sound is unloaded or destroyed every mixer
+  // halts the voices playing it.
+  void AddMixer(Mixer* mixer) { mixers_.push_back(mixer); }
+  void RemoveMixer(Mixer* mixer);
+
+ private:
+  SampleCache(const SampleCache&);
+  SampleCache& operator=(const SampleCache&);
+
+  // A filename and the way the file is played, as flags built from the
+  // collection's parameters.
+  typedef std::pair<std::string, unsigned int> Key;
+
+  // Where a Sound acquired while there was a budget is in being loaded.
+  enum LoadState { kUnloaded, kLoading, kLoaded };
+
+  struct Entry {
+    Entry()
+        : sound(),
+          archive(),
+          load_group(0),
+          ref_counter(),
+          on_demand(false),
+          load_state(kUnloaded),
+          bytes(0),
+          pin_count(0),
+          last_played(0) {}
+
+    std::unique_ptr<Sound> sound;
+
+    // The archive the Sound was loaded from, if any, which the Sound may keep
+    // pointing into for as long as it is loaded.
+    std::shared_ptr<SoundBankArchive> archive;
+
+    LoadGroupId load_group;
+    RefCounter ref_counter;
+
+    // True if the Sound is loaded on demand and may be unloaded, because it
+    // was acquired while there was a budget.
+    bool on_demand;
+    LoadState load_state;
+
+    // The bytes the Sound held once it had loaded.
+    size_t bytes;
+
+    // The number of channels playing the Sound.
+    unsigned int pin_count;
+
+    // The value of play_count_ when the Sound was last played or prefetched.
+    uint64_t last_played;
+  };
+
+  typedef std::map<Key, Entry> EntryMap;
+
+  // Queue the entry's Sound for loading from its archive or its file.
+  static void Load(EntryMap::iterator iter, FileLoader* loader);
+
+  // Mark the entry as played just now. If it is loaded on demand and is not
+  // loaded or being loaded, queue it on a load group of its own ahead of
+  // everything else.
+  void LoadOnDemand(EntryMap::iterator iter, FileLoader* loader);
+
+  // Start counting what the entries that finished loading since the last
+  // call hold against the budget.
+  void CountLoadedEntries();
+
+  // Find the entry holding the Sound. Returns false if there is none.
+  bool FindEntry(const Sound* sound, EntryMap::iterator* iter);
+
+  // Halt the voices playing the Sound in every mixer.
+  void HaltVoicesPlaying(const Sound* sound);
+
+  EntryMap entries_;
+
+  // Finds the entry holding each Sound when it is released.
+  std::unordered_map<const Sound*, EntryMap::iterator> index_;
+
+  size_t budget_;
+  size_t loaded_bytes_;
+
+  // Counts calls to Pin and Prefetch, to order the entries by when they were
+  // last played.
+  uint64_t play_count_;
+
+  // The entries loaded on demand that are being loaded.
+  std::vector<Entry*> loading_;
+
+  // Scratch space holding the entries that may be unloaded by Trim.
+  std::vector<Entry*> unpinned_;
+
+  // The mixers of the engines using the cache.
+  std::vector<Mixer*> mixers_;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_SAMPLE_CACHE_H_
@@ -14,81 +14,263 @@
 
 #include "sound_bank.h"
 
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <set>
+
 #include "audio_engine_internal_state.h"
 #include "pindrop/log.h"
 #include "sound_bank_def_generated.h"
 
 namespace pindrop {
 
-static bool InitializeSoundCollection(const std::string& filename,
-                                      AudioEngine* audio_engine) {
+// Destroy a collection created by a sound bank. The collection keeps its arena
+// alive, so a reference is held until the collection is gone.
+static void DestroySoundCollection(SoundCollection* collection) {
+  std::shared_ptr<Arena> arena = collection->arena();
+  collection->~SoundCollection();
+}
+
+// Load the collection with the given filename, or count another reference to
+// it if it is already loaded. Its SoundCollectionDef is read from the archive
+// if there is one, and otherwise from source if that has already been read,
+// or else from the file.
+static SoundCollection* InitializeSoundCollection(
+    const std::string& filename,
+    const std::shared_ptr<SoundBankArchive>& archive, FileBuffer* source,
+    int priority, const std::shared_ptr<Arena>& arena,
+    AudioEngine* audio_engine, std::vector<LoadGroupId>* load_groups) {
+  AudioEngineInternalState* state = audio_engine->state();
   // Find the ID.
   SoundHandle handle = audio_engine->GetSoundHandleFromFile(filename);
+  // The audio queued by this collection already has the bank's priority.
+  LoadGroupId new_group = 0;
+  bool is_new = !handle;
   if (handle) {
     // We've seen this ID before, update it.
     handle->ref_counter()->Increment();
   } else {
     // This is a new sound collection, load it and update it.
-    std::unique_ptr<SoundCollection> collection(new SoundCollection());
-    if (!collection->LoadSoundCollectionDefFromFile(filename,
-                                                    audio_engine->state())) {
-      return false;
+    SoundCollection* collection = new (arena->Allocate<SoundCollection>(1))
+        SoundCollection(arena);
+    new_group = state->assets->loader.BeginGroup(priority);
+    bool loaded;
+    if (archive) {
+      loaded = collection->LoadSoundCollectionDefFromArchive(filename, archive,
+                                                             state);
+    } else if (source) {
+      loaded = source->data() &&
+               collection->LoadSoundCollectionDefFromBuffer(source, state);
+    } else {
+      loaded = collection->LoadSoundCollectionDefFromFile(filename, state);
+    }
+    state->assets->loader.EndGroup();
+    if (!loaded) {
+      collection->ReleaseSounds(state);
+      DestroySoundCollection(collection);
+      return nullptr;
+    }
+    const char* name = collection->GetSoundCollectionDef()->name()->c_str();
+    SoundHandle existing = state->sound_collection_table.Find(collection->id());
+    if (existing &&
+        strcmp(existing->GetSoundCollectionDef()->name()->c_str(), name) != 0) {
+      CallLogFunc("Sound collection %s has the same id as %s\n", name,
+                  existing->GetSoundCollectionDef()->name()->c_str());
+      collection->ReleaseSounds(state);
+      DestroySoundCollection(collection);
+      return nullptr;
     }
     collection->ref_counter()->Increment();
+    state->sound_collection_table.Insert(collection->id(), collection);
+    handle = collection;
+  }
+  const LoadGroupList& groups = handle->load_groups();
+  for (size_t i = 0; i < groups.size(); ++i) {
+    if (!is_new || groups[i] != new_group) {
+      state->assets->loader.RaiseGroupPriority(groups[i], priority);
+    }
+  }
+  load_groups->insert(load_groups->end(), groups.begin(), groups.end());
+  return handle;
+}
+
+static void DeinitializeSoundCollection(SoundCollection* collection,
+                                        AudioEngineInternalState* state) {
+  if (collection->ref_counter()->Decrement() == 0) {
+    collection->ReleaseSounds(state);
+    // Another file may have replaced this collection under the same id.
+    if (state->sound_collection_table.Find(collection->id()) == collection) {
+      state->sound_collection_table.Erase(collection->id());
+    }
+    DestroySoundCollection(collection);
+  }
+}
+
+SoundBank::SoundBank()
+    : ref_counter_(),
+      load_groups_(),
+      sound_bank_def_source_(),
+      archive_(),
+      sound_bank_def_(nullptr),
+      arena_(),
+      collections_(nullptr),
+      collection_count_(0) {}
+
+void SoundBankFiles::Load() { success = Read(filename()); }
 
-    std::string name = collection->GetSoundCollectionDef()->name()->c_str();
-    audio_engine->state()->sound_collection_map[name] = std::move(collection);
+bool SoundBankFiles::Read(const std::string& filename) {
+  collection_sources.clear();
+  bank_source.reset(new FileBuffer());
+  if (!bank_source->Load(filename.c_str())) {
+    bank_source.reset();
+    return false;
+  }
+  if (SoundBankArchive::IsArchive(*bank_source)) {
+    return true;
+  }
+  const SoundBankDef* def = GetSoundBankDef(bank_source->data());
+  flatbuffers::uoffset_t count = def->filenames()->size();
+  collection_sources.resize(count);
+  for (flatbuffers::uoffset_t i = 0; i < count; ++i) {
+    collection_sources[i].reset(new FileBuffer());
+    collection_sources[i]->Load(def->filenames()->Get(i)->c_str());
   }
   return true;
 }
 
-bool SoundBank::Initialize(const std::string& filename,
+bool SoundBank::Initialize(const std::string& filename, int priority,
+                           AudioEngine* audio_engine) {
+  // The SoundCollectionDef files are read as they are needed, so that those
+  // of collections other banks have already loaded are not read again.
+  SoundBankFiles files;
+  files.set_filename(filename);
+  files.bank_source.reset(new FileBuffer());
+  if (!files.bank_source->Load(filename.c_str())) {
+    return false;
+  }
+  return Initialize(&files, priority, audio_engine);
+}
+
+bool SoundBank::Initialize(SoundBankFiles* files, int priority,
                            AudioEngine* audio_engine) {
   bool success = true;
-  if (!LoadFile(filename.c_str(), &sound_bank_def_source_)) {
+  if (!files->bank_source) {
     return false;
   }
-  sound_bank_def_ = GetSoundBankDef(sound_bank_def_source_.c_str());
+  sound_bank_def_source_ = files->bank_source;
+  const char* sound_bank_def_data = sound_bank_def_source_->data();
+  if (SoundBankArchive::IsArchive(*sound_bank_def_source_)) {
+    // The SoundBankDef, its collections and their audio are all in the one
+    // file.
+    archive_.reset(new SoundBankArchive(sound_bank_def_source_));
+    size_t sound_bank_def_size;
+    if (!archive_->FindSoundBank(&sound_bank_def_data, &sound_bank_def_size)) {
+      CallLogFunc("Sound bank archive %s is malformed.\n",
+                  files->filename().c_str());
+      return false;
+    }
+  }
+  sound_bank_def_ = GetSoundBankDef(sound_bank_def_data);
 
   // Load each SoundCollection named in the sound bank.
-  for (flatbuffers::uoffset_t i = 0; i < sound_bank_def_->filenames()->size();
-       ++i) {
+  flatbuffers::uoffset_t count = sound_bank_def_->filenames()->size();
+  arena_.reset(new Arena());
+  collections_ = arena_->Allocate<CollectionEntry>(count);
+  collection_count_ = 0;
+  for (flatbuffers::uoffset_t i = 0; i < count; ++i) {
     const char* sound_filename = sound_bank_def_->filenames()->Get(i)->c_str();
-    success &= InitializeSoundCollection(sound_filename, audio_engine);
+    FileBuffer* source = i < files->collection_sources.size()
+                             ? files->collection_sources[i].get()
+                             : nullptr;
+    SoundCollection* collection = InitializeSoundCollection(
+        sound_filename, archive_, source, priority, arena_, audio_engine,
+        &load_groups_);
+    if (collection) {
+      AddCollection(sound_filename, collection);
+    } else {
+      success = false;
+    }
   }
   return success;
 }
 
-static bool DeinitializeSoundCollection(const char* filename,
-                                        AudioEngineInternalState* state) {
-  auto id_iter = state->sound_id_map.find(filename);
-  if (id_iter == state->sound_id_map.end()) {
-    return false;
+void SoundBank::AddCollection(const char* filename,
+                              SoundCollection* collection) {
+  CollectionEntry* end = collections_ + collection_count_;
+  CollectionEntry* position = std::upper_bound(
+      collections_, end, filename,
+      [](const char* name, const CollectionEntry& entry) {
+        return strcmp(name, entry.filename) < 0;
+      });
+  std::copy_backward(position, end, end + 1);
+  size_t length = strlen(filename) + 1;
+  char* filename_copy = arena_->Allocate<char>(length);
+  memcpy(filename_copy, filename, length);
+  position->filename = filename_copy;
+  position->collection = collection;
+  ++collection_count_;
+}
+
+SoundCollection* SoundBank::FindSoundCollection(const char* filename) const {
+  const CollectionEntry* begin = collections_;
+  const CollectionEntry* end = begin + collection_count_;
+  const CollectionEntry* position = std::lower_bound(
+      begin, end, filename,
+      [](const CollectionEntry& entry, const char* name) {
+        return strcmp(entry.filename, name) < 0;
+      });
+  if (position == end || strcmp(position->filename, filename) != 0) {
+    return nullptr;
   }
+  return position->collection;
+}
 
-  std::string id = id_iter->second;
-  auto collection_iter = state->sound_collection_map.find(id);
-  if (collection_iter == state->sound_collection_map.end()) {
-    return false;
+void SoundBank::Deinitialize(AudioEngine* audio_engine) {
+  for (size_t i = 0; i < collection_count_; ++i) {
+    DeinitializeSoundCollection(collections_[i].collection,
+                                audio_engine->state());
+  }
+  collections_ = nullptr;
+  collection_count_ = 0;
+  load_groups_.clear();
+  // Release the arena in one go, unless collections still used by other banks
+  // are keeping it alive.
+  arena_.reset();
+  archive_.reset();
+  sound_bank_def_ = nullptr;
+  sound_bank_def_source_.reset();
+}
+
+void SoundBank::RaisePriority(int priority, FileLoader* loader) {
+  for (size_t i = 0; i < load_groups_.size(); ++i) {
+    loader->RaiseGroupPriority(load_groups_[i], priority);
   }
+}
 
-  if (collection_iter->second->ref_counter()->Decrement() == 0) {
-    state->sound_collection_map.erase(collection_iter);
+bool SoundBank::Loaded(const FileLoader& loader) const {
+  for (size_t i = 0; i < load_groups_.size(); ++i) {
+    if (!loader.GroupLoaded(load_groups_[i])) {
+      return false;
+    }
   }
   return true;
 }
 
-void SoundBank::Deinitialize(AudioEngine* audio_engine) {
-  for (flatbuffers::uoffset_t i = 0; i < sound_bank_def_->filenames()->size();
-       ++i) {
-    const char* filename = sound_bank_def_->filenames()->Get(i)->c_str();
-    if (!DeinitializeSoundCollection(filename, audio_engine->state())) {
-      CallLogFunc(
-          "Error while deinitializing SoundCollection %s in SoundBank.\n",
-          filename);
-      assert(0);
+size_t SoundBank::SampleBytes() const {
+  // A sound may appear in more than one of the bank's collections, but its
+  // audio is only held once.
+  std::set<const Sound*> counted;
+  SoundMemoryStats stats;
+  for (size_t i = 0; i < collection_count_; ++i) {
+    const SoundList& sounds = collections_[i].collection->sounds();
+    for (size_t j = 0; j < sounds.size(); ++j) {
+      if (counted.insert(sounds[j]).second) {
+        sounds[j]->AddMemoryStats(&stats);
+      }
     }
   }
+  return stats.decoded_bytes + stats.compressed_bytes;
 }
 
 }  // namespace pindrop
@@ -20,28 +20,121 @@
 #include <string>
 #include <vector>
 
+#include "arena.h"
+#include "file_buffer.h"
+#include "file_loader.h"
 #include "ref_counter.h"
+#include "sound_bank_archive.h"
 
 namespace pindrop {
 
 struct SoundBankDef;
 
-typedef int SoundId;
-
 class AudioEngine;
+class SoundCollection;
+
+// The files a sound bank is loaded from: the SoundBankDef or archive, and the
+// SoundCollectionDef files it names unless it is an archive. They are read as
+// a Resource so that many banks can be read at once on the loader's threads,
+// with nothing but the reading done off the calling thread.
+class SoundBankFiles : public Resource {
+ public:
+  SoundBankFiles() : bank_source(), collection_sources(), success(false) {}
+
+  // Read the files of the sound bank with the given filename. Returns false
+  // if the bank itself could not be read. Collections whose files could not be
+  // read are left with empty buffers, and fail to load with the bank.
+  bool Read(const std::string& filename);
+
+  std::shared_ptr<FileBuffer> bank_source;
+
+  // The file of each SoundCollectionDef, in the order the SoundBankDef names
+  // them. Empty for an archive, which holds the collections itself.
+  std::vector<std::unique_ptr<FileBuffer>> collection_sources;
+
+  // The result of the last call to Read.
+  bool success;
 
+ private:
+  // Called on one of the loader's threads.
+  virtual void Load();
+};
+
+// A sound bank and the sound collections it loaded. Each bank owns an arena
+// that holds the collections it was first to load, their tables, and the
+// bank's index of its collections, so unloading a bank releases them in one go
+// rather than piece by piece.
 class SoundBank {
  public:
-  bool Initialize(const std::string& filename, AudioEngine* audio_engine);
+  SoundBank();
+
+  // Load the sound bank, and queue the audio of its sound collections for
+  // loading with the given priority.
+  bool Initialize(const std::string& filename, int priority,
+                  AudioEngine* audio_engine);
+
+  // Load the sound bank from files that have already been read, taking their
+  // contents, and queue the audio of its sound collections for loading with
+  // the given priority.
+  bool Initialize(SoundBankFiles* files, int priority,
+                  AudioEngine* audio_engine);
 
   void Deinitialize(AudioEngine* audio_engine);
 
+  // Raise the loading priority of the bank's audio that is still queued.
+  void RaisePriority(int priority, FileLoader* loader);
+
+  // Return true if all of the bank's audio has been loaded.
+  bool Loaded(const FileLoader& loader) const;
+
+  // Return the sound collection the bank loaded from the given file, or
+  // nullptr if it has none.
+  SoundCollection* FindSoundCollection(const char* filename) const;
+
+  // Return the decoded and compressed audio held by the sounds of the bank's
+  // sound collections, in bytes.
+  size_t SampleBytes() const;
+
   RefCounter* ref_counter() { return &ref_counter_; }
 
  private:
+  SoundBank(const SoundBank&);
+  SoundBank& operator=(const SoundBank&);
+
+  // A sound collection of the bank, and the file named in the SoundBankDef it
+  // was loaded from. The filename is copied into the arena, so that finding a
+  // collection to reload never reads a SoundBankDef that may have been
+  // rewritten in place.
+  struct CollectionEntry {
+    const char* filename;
+    SoundCollection* collection;
+  };
+
+  // Add a collection to the bank's index, which is kept sorted by filename.
+  void AddCollection(const char* filename, SoundCollection* collection);
+
   RefCounter ref_counter_;
-  std::string sound_bank_def_source_;
+
+  // The groups the audio of the bank's sound collections was queued in. Audio
+  // shared with other banks may have been queued by those banks.
+  std::vector<LoadGroupId> load_groups_;
+
+  std::shared_ptr<FileBuffer> sound_bank_def_source_;
+
+  // The archive the bank was loaded from, or null if the bank was loaded from
+  // a SoundBankDef.
+  std::shared_ptr<SoundBankArchive> archive_;
+
   const SoundBankDef* sound_bank_def_;
+
+  // The arena the bank's index and the collections it loaded first are
+  // allocated from. Collections still used by other banks when this one is
+  // unloaded keep it alive until they are unloaded too.
+  std::shared_ptr<Arena> arena_;
+
+  // The bank's collections, sorted by filename.
+  CollectionEntry* collections_;
+  size_t collection_count_;
 };
 
 }  // namespace pindrop
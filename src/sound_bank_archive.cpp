@@ -0,0 +1,77 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sound_bank_archive.h"
+
+#include <cstring>
+
+#include "sound_bank_archive_generated.h"
+
+namespace pindrop {
+
+// The size of the root offset and file identifier that start a flatbuffer.
+static const size_t kIdentifiedBufferHeaderSize =
+    sizeof(flatbuffers::uoffset_t) + 4;
+
+// Point data and size at the contents of the given file, if the file lies
+// within the buffer.
+static bool GetContents(const FileBuffer& buffer, const ArchiveFileDef* file,
+                        const char** data, size_t* size) {
+  if (!file || file->offset() > buffer.size() ||
+      file->size() > buffer.size() - file->offset()) {
+    return false;
+  }
+  *data = buffer.data() + file->offset();
+  *size = static_cast<size_t>(file->size());
+  return true;
+}
+
+bool SoundBankArchive::IsArchive(const FileBuffer& buffer) {
+  return buffer.size() >= kIdentifiedBufferHeaderSize &&
+         SoundBankArchiveDefBufferHasIdentifier(buffer.data());
+}
+
+SoundBankArchive::SoundBankArchive(const std::shared_ptr<FileBuffer>& buffer)
+    : buffer_(buffer), def_(GetSoundBankArchiveDef(buffer->data())) {}
+
+bool SoundBankArchive::FindSoundBank(const char** data, size_t* size) const {
+  return GetContents(*buffer_, def_->sound_bank(), data, size);
+}
+
+bool SoundBankArchive::Find(const char* filename, const char** data,
+                            size_t* size) const {
+  const flatbuffers::Vector<flatbuffers::Offset<ArchiveFileDef>>* files =
+      def_->files();
+  if (!files) {
+    return false;
+  }
+  // The files are sorted by filename, so binary search for the name.
+  flatbuffers::uoffset_t begin = 0;
+  flatbuffers::uoffset_t end = files->size();
+  while (begin < end) {
+    flatbuffers::uoffset_t middle = begin + (end - begin) / 2;
+    const ArchiveFileDef* file = files->Get(middle);
+    int order = strcmp(file->filename()->c_str(), filename);
+    if (order == 0) {
+      return GetContents(*buffer_, file, data, size);
+    } else if (order < 0) {
+      begin = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  return false;
+}
+
+}  // namespace pindrop
@@ -0,0 +1,55 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_SOUND_BANK_ARCHIVE_H_
+#define PINDROP_SOUND_BANK_ARCHIVE_H_
+
+#include <cstddef>
+#include <memory>
+
+#include "file_buffer.h"
+
+namespace pindrop {
+
+struct SoundBankArchiveDef;
+
+// A loaded .pinarchive file. The archive holds the SoundBankDef, the
+// SoundCollectionDefs and the audio files of a sound bank in a single buffer,
+// and hands out pointers into that buffer in place of the files. Sound
+// collections loaded from an archive keep it alive, since they may outlive
+// the bank that loaded them.
+class SoundBankArchive {
+ public:
+  // Returns true if the given buffer holds an archive rather than a
+  // SoundBankDef.
+  static bool IsArchive(const FileBuffer& buffer);
+
+  explicit SoundBankArchive(const std::shared_ptr<FileBuffer>& buffer);
+
+  // Find the contents of the SoundBankDef the archive was built from. Returns
+  // false if the archive is malformed.
+  bool FindSoundBank(const char** data, size_t* size) const;
+
+  // Find the contents of the named file. Returns false if the archive does
+  // not contain the file.
+  bool Find(const char* filename, const char** data, size_t* size) const;
+
+ private:
+  std::shared_ptr<FileBuffer> buffer_;
+  const SoundBankArchiveDef* def_;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_SOUND_BANK_ARCHIVE_H_
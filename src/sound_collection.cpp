@@ -14,7 +14,8 @@
 
 #include "sound_collection.h"
 
-#include <cstdlib>
+#include <algorithm>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <vector>
@@ -27,21 +28,107 @@
 
 namespace pindrop {
 
+// The number of times the NoRepeat selection chooses again before giving up on
+// avoiding the last sound by chance.
+static const int kMaxReselections = 4;
+
+void SoundCollectionParams::Initialize(const SoundCollectionDef* def) {
+  priority = def->priority();
+  gain = def->gain();
+  positional = def->mode() == Mode_Positional;
+  loop = def->loop() != 0;
+  stream = def->stream() != 0;
+  compressed = def->storage() == Storage_Compressed;
+  min_audible_radius = def->min_audible_radius();
+  max_audible_radius = def->max_audible_radius();
+  min_audible_radius_squared = min_audible_radius * min_audible_radius;
+  max_audible_radius_squared = max_audible_radius * max_audible_radius;
+  roll_in_radius = def->roll_in_radius();
+  roll_out_radius = def->roll_out_radius();
+  roll_in_range = roll_in_radius - min_audible_radius;
+  roll_out_range = max_audible_radius - roll_out_radius;
+  roll_in_curve_factor = def->roll_in_curve_factor();
+  roll_out_curve_factor = def->roll_out_curve_factor();
+  max_instances = def->max_instances();
+  instance_limit_policy = def->instance_limit_policy();
+  min_retrigger_interval = def->min_retrigger_interval();
+  sample_selection = def->sample_selection();
+}
+
 bool SoundCollection::LoadSoundCollectionDef(const std::string& source,
                                              AudioEngineInternalState* state) {
-  source_ = source;
+  source_.Assign(source);
+  def_source_ = source_.data();
+  return InitializeFromSource(state);
+}
+
+bool SoundCollection::LoadSoundCollectionDefFromFile(
+    const std::string& filename, AudioEngineInternalState* state) {
+  if (!source_.Load(filename.c_str())) {
+    return false;
+  }
+  def_source_ = source_.data();
+  return InitializeFromSource(state);
+}
+
+bool SoundCollection::LoadSoundCollectionDefFromBuffer(
+    FileBuffer* buffer, AudioEngineInternalState* state) {
+  source_.Swap(buffer);
+  buffer->Release();
+  def_source_ = source_.data();
+  return InitializeFromSource(state);
+}
+
+bool SoundCollection::LoadSoundCollectionDefFromArchive(
+    const std::string& filename,
+    const std::shared_ptr<SoundBankArchive>& archive,
+    AudioEngineInternalState* state) {
+  size_t size;
+  if (!archive->Find(filename.c_str(), &def_source_, &size)) {
+    CallLogFunc("Sound collection %s is not in its sound bank archive.\n",
+                filename.c_str());
+    return false;
+  }
+  archive_ = archive;
+  return InitializeFromSource(state);
+}
+
+bool SoundCollection::InitializeFromSource(AudioEngineInternalState* state) {
   const SoundCollectionDef* def = GetSoundCollectionDef();
+  params_.Initialize(def);
+  id_ = def->id();
+  if (id_ == 0 && def->name()) {
+    id_ = HashSoundName(def->name()->c_str());
+  }
+  if (state && state->attenuation_lut_size > 0 && params_.positional) {
+    BuildAttenuationTable(state->attenuation_lut_size);
+  }
   flatbuffers::uoffset_t sample_count =
       def->audio_sample_set() ? def->audio_sample_set()->Length() : 0;
-  sounds_.resize(sample_count);
+  sounds_.reserve(sample_count);
+  // The weights are only needed to build the alias table, so they are kept off
+  // the arena, which would hold on to them until the collection is destroyed.
+  std::vector<float> weights;
+  weights.reserve(sample_count);
   for (flatbuffers::uoffset_t i = 0; i < sample_count; ++i) {
     const AudioSampleSetEntry* entry = def->audio_sample_set()->Get(i);
     const char* entry_filename = entry->audio_sample()->filename()->c_str();
-    sum_of_probabilities_ += entry->playback_probability();
+    weights.push_back(entry->playback_probability());
+    sample_filenames_.insert(sample_filenames_.end(), entry_filename,
+                             entry_filename + strlen(entry_filename) + 1);
 
-    Sound& sound = sounds_[i];
-    sound.Initialize(this);
-    sound.LoadFile(entry_filename, &state->loader);
+    LoadGroupId load_group;
+    sounds_.push_back(state->assets->sample_cache.Acquire(
+        entry_filename, this, archive_, &state->assets->loader, &load_group));
+    if (std::find(load_groups_.begin(), load_groups_.end(), load_group) ==
+        load_groups_.end()) {
+      load_groups_.push_back(load_group);
+    }
+  }
+  BuildAliasTable(weights);
+  if (params_.sample_selection == SampleSelection_Shuffle) {
+    // Reserve the bag now so that the first play does not allocate it.
+    shuffle_bag_.reserve(sample_count);
   }
   if (!def->bus()) {
     CallLogFunc("Sound collection %s does not specify a bus", def->name());
@@ -58,36 +145,268 @@ bool SoundCollection::LoadSoundCollectionDef(const std::string& source,
   return true;
 }
 
-bool SoundCollection::LoadSoundCollectionDefFromFile(
-    const std::string& filename, AudioEngineInternalState* state) {
-  std::string source;
-  return LoadFile(filename.c_str(), &source) &&
-         LoadSoundCollectionDef(source, state);
+// Return true if the def lists the given null separated audio sample files in
+// the same order, so that it can be swapped in without loading audio.
+static bool SameAudioSamples(const ArenaVector<char>& filenames,
+                             const SoundCollectionDef* def) {
+  flatbuffers::uoffset_t count =
+      def->audio_sample_set() ? def->audio_sample_set()->Length() : 0;
+  size_t offset = 0;
+  for (flatbuffers::uoffset_t i = 0; i < count; ++i) {
+    const char* filename =
+        def->audio_sample_set()->Get(i)->audio_sample()->filename()->c_str();
+    if (offset >= filenames.size() ||
+        strcmp(&filenames[offset], filename) != 0) {
+      return false;
+    }
+    offset += strlen(filename) + 1;
+  }
+  return offset == filenames.size();
+}
+
+bool SoundCollection::ReloadSoundCollectionDef(
+    FileBuffer* buffer, AudioEngineInternalState* state) {
+  // Only the new def and what was decoded from the old one are read here.
+  // The old def may be mapped from the file the new one was just written to.
+  const SoundCollectionDef* def =
+      pindrop::GetSoundCollectionDef(buffer->data());
+  const char* name = def->name() ? def->name()->c_str() : "";
+  SoundId id = def->id();
+  if (id == 0 && def->name()) {
+    id = HashSoundName(def->name()->c_str());
+  }
+  if (id != id_) {
+    CallLogFunc("Sound collection %s cannot change its id or name when it is "
+                "reloaded.\n",
+                name);
+    return false;
+  }
+  if (!SameAudioSamples(sample_filenames_, def)) {
+    CallLogFunc("Sound collection %s cannot change its audio samples when it "
+                "is reloaded.\n",
+                name);
+    return false;
+  }
+  // Streamed and buffered sounds load differently and play on different
+  // channels, so a collection must keep playing the way it was loaded.
+  if ((def->stream() != 0) != params_.stream) {
+    CallLogFunc("Sound collection %s cannot change whether it streams when it "
+                "is reloaded.\n",
+                name);
+    return false;
+  }
+  if (!def->bus()) {
+    CallLogFunc("Sound collection %s does not specify a bus.\n", name);
+    return false;
+  }
+  BusInternalState* bus = FindBusInternalState(state, def->bus()->c_str());
+  if (!bus) {
+    CallLogFunc("Sound collection %s specifies an unknown bus: %s.\n", name,
+                def->bus()->c_str());
+    return false;
+  }
+
+  // The old def is no longer needed once the new one has been checked, even if
+  // it was in an archive.
+  source_.Swap(buffer);
+  buffer->Release();
+  def_source_ = source_.data();
+  params_.Initialize(def);
+  BuildAttenuationTable(params_.positional ? state->attenuation_lut_size : 0);
+  flatbuffers::uoffset_t sample_count =
+      def->audio_sample_set() ? def->audio_sample_set()->Length() : 0;
+  // The weights are only needed to build the alias table, so they are kept off
+  // the arena, which would hold on to them until the collection is destroyed.
+  std::vector<float> weights;
+  weights.reserve(sample_count);
+  for (flatbuffers::uoffset_t i = 0; i < sample_count; ++i) {
+    weights.push_back(def->audio_sample_set()->Get(i)->playback_probability());
+  }
+  BuildAliasTable(weights);
+  bool bus_changed = bus != bus_;
+  bus_ = bus;
+  for (auto iter = instances_.begin(); iter != instances_.end(); ++iter) {
+    if (bus_changed) {
+      iter->UpdateBus();
+    }
+    iter->MarkDirty();
+  }
+  return true;
+}
+
+void SoundCollection::BuildAttenuationTable(size_t size) {
+  float range = params_.max_audible_radius_squared -
+                params_.min_audible_radius_squared;
+  params_.attenuation_table = nullptr;
+  params_.attenuation_table_size = 0;
+  if (size < 2 || range <= 0.0f) {
+    attenuation_table_.clear();
+    return;
+  }
+  attenuation_table_.resize(size);
+  float step = range / static_cast<float>(size - 1);
+  for (size_t i = 0; i < size; ++i) {
+    float distance_squared =
+        params_.min_audible_radius_squared + step * static_cast<float>(i);
+    attenuation_table_[i] =
+        CalculateDistanceAttenuation(distance_squared, params_);
+  }
+  // Make sure the end points sample inside the audible range.
+  attenuation_table_[size - 1] = CalculateDistanceAttenuation(
+      params_.max_audible_radius_squared, params_);
+  params_.attenuation_table = attenuation_table_.data();
+  params_.attenuation_table_size = size;
+  params_.attenuation_table_scale = static_cast<float>(size - 1) / range;
 }
 
 const SoundCollectionDef* SoundCollection::GetSoundCollectionDef() const {
-  assert(source_.size());
-  return pindrop::GetSoundCollectionDef(source_.c_str());
+  assert(def_source_);
+  return pindrop::GetSoundCollectionDef(def_source_);
 }
 
-Sound* SoundCollection::Select() {
-  const SoundCollectionDef* sound_def = GetSoundCollectionDef();
-  // Choose a random number between 0 and the sum of the probabilities, then
-  // iterate over the list, subtracting the weight of each entry until 0 is
-  // reached.
-  float selection =
-      rand() / static_cast<float>(RAND_MAX) * sum_of_probabilities_;
+void SoundCollection::ReleaseSounds(AudioEngineInternalState* state) {
   for (size_t i = 0; i < sounds_.size(); ++i) {
-    const AudioSampleSetEntry* entry = sound_def->audio_sample_set()->Get(
-        static_cast<flatbuffers::uoffset_t>(i));
-    selection -= entry->playback_probability();
-    if (selection <= 0) {
-      return &sounds_[i];
+    state->assets->sample_cache.Release(sounds_[i], &state->assets->loader);
+  }
+  sounds_.clear();
+  sample_filenames_.clear();
+  load_groups_.clear();
+}
+
+void SoundCollection::BuildAliasTable(const std::vector<float>& weights) {
+  // Vose's alias method: scale the weights so that they average one, then
+  // repeatedly pair a slot below one with a slot above one, which gives up
+  // enough of its weight to fill the smaller slot up.
+  size_t count = weights.size();
+  alias_probabilities_.assign(count, 1.0f);
+  aliases_.resize(count);
+  float sum = 0.0f;
+  for (size_t i = 0; i < count; ++i) {
+    aliases_[i] = static_cast<uint32_t>(i);
+    sum += std::max(weights[i], 0.0f);
+  }
+  if (sum <= 0.0f) {
+    // With no usable weights, every sound is equally likely.
+    return;
+  }
+  // The scratch space is freed once the table is built. It is rebuilt every
+  // time the collection is reloaded, and the arena would keep every copy.
+  std::vector<float> scaled(count, 0.0f);
+  std::vector<uint32_t> small;
+  std::vector<uint32_t> large;
+  small.reserve(count);
+  large.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    scaled[i] = std::max(weights[i], 0.0f) * static_cast<float>(count) / sum;
+    (scaled[i] < 1.0f ? small : large).push_back(static_cast<uint32_t>(i));
+  }
+  while (!small.empty() && !large.empty()) {
+    uint32_t less = small.back();
+    small.pop_back();
+    uint32_t more = large.back();
+    alias_probabilities_[less] = scaled[less];
+    aliases_[less] = more;
+    scaled[more] -= 1.0f - scaled[less];
+    if (scaled[more] < 1.0f) {
+      large.pop_back();
+      small.push_back(more);
     }
   }
-  // If we've reached here and didn't return a sound, assume there was some
-  // floating point rounding error and just return the last one.
-  return &sounds_.back();
+  // Whatever is left over is one, give or take rounding error.
+  for (size_t i = 0; i < small.size(); ++i) {
+    alias_probabilities_[small[i]] = 1.0f;
+  }
+  for (size_t i = 0; i < large.size(); ++i) {
+    alias_probabilities_[large[i]] = 1.0f;
+  }
+}
+
+size_t SoundCollection::SelectWeighted(Random* random) const {
+  uint32_t slot = random->Below(static_cast<uint32_t>(aliases_.size()));
+  return random->NextFloat() < alias_probabilities_[slot] ? slot
+                                                          : aliases_[slot];
+}
+
+size_t SoundCollection::NextWeighted(size_t index) const {
+  auto samples = GetSoundCollectionDef()->audio_sample_set();
+  size_t count = sounds_.size();
+  for (size_t i = 1; i < count; ++i) {
+    size_t next = (index + i) % count;
+    if (samples->Get(static_cast<flatbuffers::uoffset_t>(next))
+            ->playback_probability() > 0.0f) {
+      return next;
+    }
+  }
+  bool weighted =
+      samples->Get(static_cast<flatbuffers::uoffset_t>(index))
+          ->playback_probability() > 0.0f;
+  return weighted ? index : (index + 1) % count;
+}
+
+size_t SoundCollection::SelectShuffled(Random* random) {
+  size_t count = sounds_.size();
+  if (shuffle_position_ >= shuffle_bag_.size()) {
+    shuffle_bag_.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      shuffle_bag_[i] = static_cast<uint32_t>(i);
+    }
+    for (size_t i = count - 1; i > 0; --i) {
+      size_t j = random->Below(static_cast<uint32_t>(i + 1));
+      std::swap(shuffle_bag_[i], shuffle_bag_[j]);
+    }
+    // Do not let the new order start with the sound the last one ended with.
+    if (count > 1 && shuffle_bag_[0] == last_selection_) {
+      size_t j = 1 + random->Below(static_cast<uint32_t>(count - 1));
+      std::swap(shuffle_bag_[0], shuffle_bag_[j]);
+    }
+    shuffle_position_ = 0;
+  }
+  return shuffle_bag_[shuffle_position_++];
+}
+
+Sound* SoundCollection::Select(Random* random) {
+  if (sounds_.empty()) {
+    return nullptr;
+  }
+  size_t selection;
+  switch (params_.sample_selection) {
+    case SampleSelection_NoRepeat:
+      selection = SelectWeighted(random);
+      if (selection == last_selection_ && sounds_.size() > 1) {
+        // Choose again from the other sounds. If the last sound has most of
+        // the weight this could take many tries, so give up after a few and
+        // take the next sound along that can be chosen instead.
+        for (int i = 0; i < kMaxReselections && selection == last_selection_;
+             ++i) {
+          selection = SelectWeighted(random);
+        }
+        if (selection == last_selection_) {
+          selection = NextWeighted(selection);
+        }
+      }
+      break;
+    case SampleSelection_Shuffle:
+      selection = SelectShuffled(random);
+      break;
+    default:
+      selection = SelectWeighted(random);
+      break;
+  }
+  last_selection_ = selection;
+  return sounds_[selection];
+}
+
+void SoundCollection::AddInstance(ChannelInternalState* channel) {
+  assert(!channel->instance_node.in_list());
+  instances_.push_back(*channel);
+  ++instance_count_;
+}
+
+void SoundCollection::RemoveInstance(ChannelInternalState* channel) {
+  if (channel->instance_node.in_list()) {
+    channel->instance_node.remove();
+    --instance_count_;
+  }
 }
 
 }  // namespace pindrop
@@ -15,13 +15,22 @@
 #ifndef PINDROP_SOUND_COLLECTION_H_
 #define PINDROP_SOUND_COLLECTION_H_
 
+#include <limits>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "arena.h"
+#include "channel_internal_state.h"
+#include "file_buffer.h"
+#include "file_loader.h"
+#include "fplutil/intrusive_list.h"
+#include "pindrop/audio_engine.h"
+#include "random.h"
 #include "real_channel.h"
 #include "ref_counter.h"
 #include "sound.h"
+#include "sound_bank_archive.h"
 
 namespace pindrop {
 
@@ -29,17 +38,142 @@ class BusInternalState;
 struct AudioEngineInternalState;
 struct SoundCollectionDef;
 
+typedef fplutil::intrusive_list<ChannelInternalState> InstanceList;
+
+// The fields of a SoundCollectionDef that are read every frame, decoded once
+// when the collection is loaded so that the per-channel update does not need to
+// go through the flatbuffer accessors. The radii are stored pre-squared and the
+// attenuation curve ranges are precomputed.
+struct SoundCollectionParams {
+  SoundCollectionParams()
+      : priority(0.0f),
+        gain(0.0f),
+        positional(false),
+        loop(false),
+        stream(false),
+        compressed(false),
+        min_audible_radius(0.0f),
+        max_audible_radius(0.0f),
+        min_audible_radius_squared(0.0f),
+        max_audible_radius_squared(0.0f),
+        roll_in_radius(0.0f),
+        roll_out_radius(0.0f),
+        roll_in_range(0.0f),
+        roll_out_range(0.0f),
+        roll_in_curve_factor(0.0f),
+        roll_out_curve_factor(0.0f),
+        attenuation_table(nullptr),
+        attenuation_table_size(0),
+        attenuation_table_scale(0.0f),
+        max_instances(0),
+        instance_limit_policy(0),
+        min_retrigger_interval(0.0f),
+        sample_selection(0) {}
+
+  // Decode the parameters from the given def.
+  void Initialize(const SoundCollectionDef* def);
+
+  float priority;
+  float gain;
+  bool positional;
+  bool loop;
+  bool stream;
+
+  // True if buffered audio is kept compressed and decoded when it plays.
+  bool compressed;
+
+  float min_audible_radius;
+  float max_audible_radius;
+  float min_audible_radius_squared;
+  float max_audible_radius_squared;
+  float roll_in_radius;
+  float roll_out_radius;
+
+  // The distances over which the roll in and roll out curves are applied.
+  float roll_in_range;
+  float roll_out_range;
+
+  float roll_in_curve_factor;
+  float roll_out_curve_factor;
+
+  // An optional table of attenuation values sampled evenly over squared
+  // distances from min_audible_radius_squared to max_audible_radius_squared.
+  // The scale converts a squared distance offset into a table position. Null
+  // if the collection has no table.
+  const float* attenuation_table;
+  size_t attenuation_table_size;
+  float attenuation_table_scale;
+
+  // The most instances that may play at once, or zero for no limit, and the
+  // InstanceLimitPolicy to apply when the limit is reached.
+  size_t max_instances;
+  int instance_limit_policy;
+
+  // The shortest time in seconds between two plays of the collection.
+  float min_retrigger_interval;
+
+  // The SampleSelection used to choose which sound to play.
+  int sample_selection;
+};
+
+typedef ArenaVector<Sound*> SoundList;
+typedef ArenaVector<LoadGroupId> LoadGroupList;
+
 // SoundCollection represent an abstract sound (like a 'whoosh'), which contains
 // a number of pieces of audio with weighted probabilities to choose between
 // randomly when played. It holds objects of type `Audio`, which can be either
 // Sounds or Music
+//
+// A collection loaded by a sound bank lives in the bank's arena, along with
+// its tables, so that unloading the bank frees them all at once. The
+// collection keeps the arena alive, like the archive it was loaded from, in
+// case it outlives the bank because another bank still uses it.
 class SoundCollection {
  public:
+  // Construct a collection whose tables are allocated from the heap.
   SoundCollection()
-      : bus_(nullptr),
+      : arena_(),
+        bus_(nullptr),
+        id_(0),
         source_(),
+        archive_(),
+        def_source_(nullptr),
+        params_(),
+        attenuation_table_(),
         sounds_(),
-        sum_of_probabilities_(0.0f),
+        sample_filenames_(),
+        alias_probabilities_(),
+        aliases_(),
+        shuffle_bag_(),
+        shuffle_position_(0),
+        last_selection_(kNoSelection),
+        load_groups_(),
+        instances_(&ChannelInternalState::instance_node),
+        instance_count_(0),
+        last_play_time_(-std::numeric_limits<double>::infinity()),
+        ref_counter_() {}
+
+  // Construct a collection whose tables are allocated from the given arena.
+  explicit SoundCollection(const std::shared_ptr<Arena>& arena)
+      : arena_(arena),
+        bus_(nullptr),
+        id_(0),
+        source_(),
+        archive_(),
+        def_source_(nullptr),
+        params_(),
+        attenuation_table_(ArenaAllocator<float>(arena.get())),
+        sounds_(ArenaAllocator<Sound*>(arena.get())),
+        sample_filenames_(ArenaAllocator<char>(arena.get())),
+        alias_probabilities_(ArenaAllocator<float>(arena.get())),
+        aliases_(ArenaAllocator<uint32_t>(arena.get())),
+        shuffle_bag_(ArenaAllocator<uint32_t>(arena.get())),
+        shuffle_position_(0),
+        last_selection_(kNoSelection),
+        load_groups_(ArenaAllocator<LoadGroupId>(arena.get())),
+        instances_(&ChannelInternalState::instance_node),
+        instance_count_(0),
+        last_play_time_(-std::numeric_limits<double>::infinity()),
         ref_counter_() {}
 
   // Load the given flatbuffer data representing a SoundCollectionDef.
@@ -50,24 +184,149 @@ class SoundCollection {
   bool LoadSoundCollectionDefFromFile(const std::string& filename,
                                       AudioEngineInternalState* state);
 
+  // Load a SoundCollectionDef file that has already been read into the given
+  // buffer. The collection takes the buffer's contents, leaving it empty.
+  bool LoadSoundCollectionDefFromBuffer(FileBuffer* buffer,
+                                        AudioEngineInternalState* state);
+
+  // Load the named SoundCollectionDef from a sound bank archive. The
+  // collection's audio is read from the archive too, and the collection keeps
+  // the archive alive.
+  bool LoadSoundCollectionDefFromArchive(
+      const std::string& filename,
+      const std::shared_ptr<SoundBankArchive>& archive,
+      AudioEngineInternalState* state);
+
+  // Replace the SoundCollectionDef with a recompiled one that has been read
+  // into the given buffer, which the collection takes. The decoded parameters
+  // and the tables built from them are rebuilt, and the channels playing the
+  // collection move to its new bus. The collection keeps its loaded sounds, so
+  // the new def must have the same id and audio samples as the old one.
+  // Returns false, leaving the collection as it was, if it does not.
+  bool ReloadSoundCollectionDef(FileBuffer* buffer,
+                                AudioEngineInternalState* state);
+
   // Return the SoundDef.
   const SoundCollectionDef* GetSoundCollectionDef() const;
 
-  // Return a random piece of audio from the set of audio for this sound.
-  Sound* Select();
+  // Return the id of this collection, the hash of its name.
+  SoundId id() const { return id_; }
+
+  // Return the decoded parameters of the SoundDef.
+  const SoundCollectionParams& params() const { return params_; }
+
+  // Sample the distance attenuation of this collection into a table of the
+  // given size, which CalculateDistanceAttenuation will use from then on.
+  void BuildAttenuationTable(size_t size);
+
+  // Return the audio this collection chooses between. The Sounds are owned by
+  // the engine's SampleCache, and may be shared with other collections.
+  const SoundList& sounds() const { return sounds_; }
+
+  // Give the collection's Sounds back to the engine's SampleCache. This must
+  // be done before a collection that was loaded with an engine is destroyed.
+  void ReleaseSounds(AudioEngineInternalState* state);
+
+  // Return a piece of audio from the set of audio for this sound, chosen using
+  // the given random number generator according to the collection's
+  // SampleSelection. Returns nullptr if the collection has no audio.
+  Sound* Select(Random* random);
 
   // Return the bus this SoundCollection will play on.
   BusInternalState* bus() { return bus_; }
 
   RefCounter* ref_counter() { return &ref_counter_; }
 
+  // Track the channels playing this collection, oldest first, so that its
+  // instance limit can be checked without searching the channels.
+  void AddInstance(ChannelInternalState* channel);
+  void RemoveInstance(ChannelInternalState* channel);
+  InstanceList& instances() { return instances_; }
+  size_t instance_count() const { return instance_count_; }
+
+  // Get or set the engine time, in seconds, at which this collection last
+  // started playing.
+  double last_play_time() const { return last_play_time_; }
+  void set_last_play_time(double time) { last_play_time_ = time; }
+
+  // The groups the collection's audio was queued for loading in. Audio the
+  // collection shares with other collections may have been queued with
+  // theirs.
+  const LoadGroupList& load_groups() const { return load_groups_; }
+
+  // Return the arena the collection and its tables are allocated from, or
+  // null if they are on the heap.
+  const std::shared_ptr<Arena>& arena() const { return arena_; }
+
  private:
+  SoundCollection(const SoundCollection&);
+  SoundCollection& operator=(const SoundCollection&);
+
+  static const size_t kNoSelection = static_cast<size_t>(-1);
+
+  // Decode the SoundCollectionDef pointed to by def_source_.
+  bool InitializeFromSource(AudioEngineInternalState* state);
+
+  // Build the alias table used to choose between the sounds in constant time,
+  // from the weight of each sound.
+  void BuildAliasTable(const std::vector<float>& weights);
+
+  // Choose a sound index from the alias table.
+  size_t SelectWeighted(Random* random) const;
+
+  // Return the index of the first sound after the given one that has a weight,
+  // wrapping around. If no other sound has a weight, the given index is
+  // returned, unless no sound has one, when every sound is equally likely.
+  size_t NextWeighted(size_t index) const;
+
+  // Choose the next sound index from the shuffle bag, reshuffling it when
+  // every sound has been played.
+  size_t SelectShuffled(Random* random);
+
+  std::shared_ptr<Arena> arena_;
+
   // The bus this SoundCollection will play on.
   BusInternalState* bus_;
 
-  std::string source_;
-  std::vector<Sound> sounds_;
-  float sum_of_probabilities_;
+  SoundId id_;
+
+  // The file the SoundCollectionDef was loaded from, if it was not loaded
+  // from an archive.
+  FileBuffer source_;
+
+  // The archive the SoundCollectionDef was loaded from, if any.
+  std::shared_ptr<SoundBankArchive> archive_;
+
+  // The SoundCollectionDef, in either source_ or archive_.
+  const char* def_source_;
+
+  SoundCollectionParams params_;
+  ArenaVector<float> attenuation_table_;
+  SoundList sounds_;
+
+  // The filenames of sounds_, each followed by a null character, copied from
+  // the def when it was loaded. A reloaded def is checked against these rather
+  // than the old def, whose file may have been rewritten in place.
+  ArenaVector<char> sample_filenames_;
+
+  // The alias table over sounds_. Sound i is chosen by a uniformly random
+  // slot i with probability alias_probabilities_[i], and aliases_[i] is chosen
+  // otherwise.
+  ArenaVector<float> alias_probabilities_;
+  ArenaVector<uint32_t> aliases_;
+
+  // The order sounds are played in by the Shuffle selection, and how far
+  // through it the collection has got.
+  ArenaVector<uint32_t> shuffle_bag_;
+  size_t shuffle_position_;
+
+  // The index of the sound chosen last, or kNoSelection.
+  size_t last_selection_;
+  LoadGroupList load_groups_;
+
+  InstanceList instances_;
+  size_t instance_count_;
+  double last_play_time_;
 
   RefCounter ref_counter_;
 };
@@ -0,0 +1,121 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sound_file_duration.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace pindrop {
+
+// The magic numbers of an Ogg page, and where the fields pindrop reads are in
+// its header. The page's segment table follows the fixed size header, and its
+// packet data follows the segment table.
+static const char kOggMagic[] = {'O', 'g', 'g', 'S'};
+static const size_t kOggGranuleOffset = 6;
+static const size_t kOggSegmentCountOffset = 26;
+static const size_t kOggPageHeaderSize = 27;
+
+// The start of a Vorbis identification header, and where its sample rate is.
+static const char kVorbisIdMagic[] = {1, 'v', 'o', 'r', 'b', 'i', 's'};
+static const size_t kVorbisRateOffset = 12;
+static const size_t kVorbisIdSize = 16;
+
+// The granule position of a page on which no packet ends.
+static const uint64_t kNoGranule = ~static_cast<uint64_t>(0);
+
+// The magic numbers of a wave file, and the size of the header of each chunk.
+static const char kRiffMagic[] = {'R', 'I', 'F', 'F'};
+static const char kWaveMagic[] = {'W', 'A', 'V', 'E'};
+static const char kFormatChunk[] = {'f', 'm', 't', ' '};
+static const char kDataChunk[] = {'d', 'a', 't', 'a'};
+static const size_t kRiffHeaderSize = 12;
+static const size_t kChunkHeaderSize = 8;
+static const size_t kFormatChunkSize = 16;
+
+static uint64_t ReadLittleEndian(const char* data, size_t size) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  uint64_t value = 0;
+  for (size_t i = size; i > 0; --i) {
+    value = (value << 8) | bytes[i - 1];
+  }
+  return value;
+}
+
+// Read the length of an Ogg Vorbis file from its first and last pages.
+static bool OggDuration(const char* data, size_t size, float* duration) {
+  if (size < kOggPageHeaderSize ||
+      memcmp(data, kOggMagic, sizeof(kOggMagic)) != 0) {
+    return false;
+  }
+  const size_t segments =
+      static_cast<unsigned char>(data[kOggSegmentCountOffset]);
+  const size_t packet = kOggPageHeaderSize + segments;
+  if (packet + kVorbisIdSize > size ||
+      memcmp(data + packet, kVorbisIdMagic, sizeof(kVorbisIdMagic)) != 0) {
+    return false;
+  }
+  const uint64_t rate = ReadLittleEndian(data + packet + kVorbisRateOffset, 4);
+  if (rate == 0) {
+    return false;
+  }
+  // Search back for the last page that ends a packet, whose granule position
+  // is the number of frames in the stream.
+  for (size_t page = size - kOggPageHeaderSize + 1; page > 0; --page) {
+    const char* header = data + page - 1;
+    if (memcmp(header, kOggMagic, sizeof(kOggMagic)) != 0) {
+      continue;
+    }
+    const uint64_t frames = ReadLittleEndian(header + kOggGranuleOffset, 8);
+    if (frames != kNoGranule) {
+      *duration = static_cast<float>(frames) / static_cast<float>(rate);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Read the length of a wave file from its format and data chunk headers.
+static bool WavDuration(const char* data, size_t size, float* duration) {
+  if (size < kRiffHeaderSize || memcmp(data, kRiffMagic, 4) != 0 ||
+      memcmp(data + 8, kWaveMagic, 4) != 0) {
+    return false;
+  }
+  uint64_t byte_rate = 0;
+  size_t offset = kRiffHeaderSize;
+  while (offset + kChunkHeaderSize <= size) {
+    const char* chunk = data + offset;
+    size_t chunk_size = static_cast<size_t>(ReadLittleEndian(chunk + 4, 4));
+    if (memcmp(chunk, kFormatChunk, 4) == 0 && chunk_size >= kFormatChunkSize &&
+        offset + kChunkHeaderSize + kFormatChunkSize <= size) {
+      byte_rate = ReadLittleEndian(chunk + kChunkHeaderSize + 8, 4);
+    } else if (memcmp(chunk, kDataChunk, 4) == 0) {
+      if (byte_rate == 0) {
+        return false;
+      }
+      *duration = static_cast<float>(chunk_size) / byte_rate;
+      return true;
+    }
+    // Chunks are padded to an even number of bytes.
+    offset += kChunkHeaderSize + chunk_size + (chunk_size & 1);
+  }
+  return false;
+}
+
+bool ReadSoundFileDuration(const char* data, size_t size, float* duration) {
+  return data && (OggDuration(data, size, duration) ||
+                  WavDuration(data, size, duration));
+}
+
+}  // namespace pindrop
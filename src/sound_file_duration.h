@@ -0,0 +1,31 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_SOUND_FILE_DURATION_H_
+#define PINDROP_SOUND_FILE_DURATION_H_
+
+#include <cstddef>
+
+namespace pindrop {
+
+// Read the length in seconds of an Ogg Vorbis or wave file from its headers,
+// without decoding any of it. An Ogg Vorbis file's length comes from the
+// sample rate in its identification header and the granule position of its
+// last page. Returns false, leaving duration unchanged, if the data holds
+// neither kind of file.
+bool ReadSoundFileDuration(const char* data, size_t size, float* duration);
+
+}  // namespace pindrop
+
+#endif  // PINDROP_SOUND_FILE_DURATION_H_
@@ -0,0 +1,116 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sound_id_table.h"
+
+namespace pindrop {
+
+SoundId HashSoundName(const char* name) {
+  // 32 bit FNV-1a. This must match the hash in scripts/build_assets.py.
+  SoundId hash = 2166136261u;
+  for (const unsigned char* c = reinterpret_cast<const unsigned char*>(name);
+       *c; ++c) {
+    hash ^= *c;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+size_t SoundIdTable::Slot(SoundId id) const {
+  // The ids are already hashes, but mix them again so that similar names do
+  // not land in neighboring slots.
+  return (id * 2654435761u) & (entries_.size() - 1);
+}
+
+void SoundIdTable::Grow() {
+  std::vector<Entry> old_entries;
+  old_entries.swap(entries_);
+  Entry empty = {0, nullptr};
+  entries_.resize(old_entries.empty() ? 16 : old_entries.size() * 2, empty);
+  size_ = 0;
+  for (size_t i = 0; i < old_entries.size(); ++i) {
+    if (old_entries[i].collection) {
+      Insert(old_entries[i].id, old_entries[i].collection);
+    }
+  }
+}
+
+void SoundIdTable::Insert(SoundId id, SoundCollection* collection) {
+  // Keep the load factor at or below one half.
+  if ((size_ + 1) * 2 > entries_.size()) {
+    Grow();
+  }
+  size_t mask = entries_.size() - 1;
+  for (size_t slot = Slot(id);; slot = (slot + 1) & mask) {
+    Entry& entry = entries_[slot];
+    if (!entry.collection) {
+      entry.id = id;
+      entry.collection = collection;
+      ++size_;
+      return;
+    }
+    if (entry.id == id) {
+      entry.collection = collection;
+      return;
+    }
+  }
+}
+
+SoundCollection* SoundIdTable::Find(SoundId id) const {
+  if (entries_.empty()) {
+    return nullptr;
+  }
+  size_t mask = entries_.size() - 1;
+  for (size_t slot = Slot(id);; slot = (slot + 1) & mask) {
+    const Entry& entry = entries_[slot];
+    if (!entry.collection) {
+      return nullptr;
+    }
+    if (entry.id == id) {
+      return entry.collection;
+    }
+  }
+}
+
+void SoundIdTable::Erase(SoundId id) {
+  if (entries_.empty()) {
+    return;
+  }
+  size_t mask = entries_.size() - 1;
+  size_t slot = Slot(id);
+  while (entries_[slot].collection && entries_[slot].id != id) {
+    slot = (slot + 1) & mask;
+  }
+  if (!entries_[slot].collection) {
+    return;
+  }
+  // Shift back any following entries that would no longer be reachable from
+  // their home slot once this one is empty.
+  size_t hole = slot;
+  for (size_t next = (hole + 1) & mask; entries_[next].collection;
+       next = (next + 1) & mask) {
+    size_t home = Slot(entries_[next].id);
+    // Move the entry unless its home lies cyclically in (hole, next].
+    bool reachable = hole <= next ? (hole < home && home <= next)
+                                  : (hole < home || home <= next);
+    if (!reachable) {
+      entries_[hole] = entries_[next];
+      hole = next;
+    }
+  }
+  entries_[hole].collection = nullptr;
+  --size_;
+}
+
+}  // namespace pindrop
@@ -0,0 +1,60 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_SOUND_ID_TABLE_H_
+#define PINDROP_SOUND_ID_TABLE_H_
+
+#include <vector>
+
+#include "pindrop/audio_engine.h"
+
+namespace pindrop {
+
+class SoundCollection;
+
+// A flat open addressing hash table from SoundIds to the SoundCollections
+// loaded with them. Collisions are resolved by linear probing, and entries are
+// erased by shifting the rest of the probe sequence back, so no tombstones are
+// needed.
+class SoundIdTable {
+ public:
+  SoundIdTable() : entries_(), size_(0) {}
+
+  // Add the collection under the given id, replacing any collection already
+  // there.
+  void Insert(SoundId id, SoundCollection* collection);
+
+  // Returns the collection with the given id, or nullptr if there is none.
+  SoundCollection* Find(SoundId id) const;
+
+  // Remove the collection with the given id, if there is one.
+  void Erase(SoundId id);
+
+ private:
+  struct Entry {
+    SoundId id;
+    // Null if the entry is empty.
+    SoundCollection* collection;
+  };
+
+  size_t Slot(SoundId id) const;
+  void Grow();
+
+  std::vector<Entry> entries_;
+  size_t size_;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_SOUND_ID_TABLE_H_
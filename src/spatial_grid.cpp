@@ -0,0 +1,167 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "spatial_grid.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace pindrop {
+
+// Cell coordinates are clamped to 21 bits each so that they can be packed into
+// a single key. Clamping only ever brings cells closer together, so a channel
+// beyond the limit may be kept awake but is never put to sleep wrongly.
+static const int32_t kCellCoordinateLimit = (1 << 20) - 1;
+static const int kCellCoordinateBits = 21;
+static const uint64_t kCellCoordinateMask = (1u << kCellCoordinateBits) - 1;
+
+static int32_t CellCoordinate(float value, float inverse_cell_size) {
+  float cell = std::floor(value * inverse_cell_size);
+  float limit = static_cast<float>(kCellCoordinateLimit);
+  return static_cast<int32_t>(std::max(-limit, std::min(limit, cell)));
+}
+
+// The number of whole cells between two cells along one axis.
+static float CellGap(int32_t a, int32_t b) {
+  int32_t gap = a > b ? a - b - 1 : b - a - 1;
+  return gap > 0 ? static_cast<float>(gap) : 0.0f;
+}
+
+SpatialGrid::SpatialGrid()
+    : cell_size_(0.0f), inverse_cell_size_(0.0f), asleep_(nullptr),
+      count_(0) {}
+
+void SpatialGrid::Initialize(std::vector<uint8_t>* asleep, size_t size) {
+  asleep_ = asleep;
+  asleep_->assign(size, 0);
+  channel_cells_.assign(size, GridCell());
+  channel_radii_.assign(size, 0.0f);
+  cells_.clear();
+  count_ = 0;
+  listener_cells_.clear();
+}
+
+void SpatialGrid::set_cell_size(float cell_size) {
+  // Sleeping channels were placed using the old size, so they are all woken
+  // and checked again.
+  WakeAll();
+  cell_size_ = std::max(cell_size, 0.0f);
+  inverse_cell_size_ = cell_size_ > 0.0f ? 1.0f / cell_size_ : 0.0f;
+}
+
+GridCell SpatialGrid::CellAt(float x, float y, float z) const {
+  return GridCell(CellCoordinate(x, inverse_cell_size_),
+                  CellCoordinate(y, inverse_cell_size_),
+                  CellCoordinate(z, inverse_cell_size_));
+}
+
+float SpatialGrid::MinDistanceSquared(const GridCell& a,
+                                      const GridCell& b) const {
+  float x = CellGap(a.x, b.x) * cell_size_;
+  float y = CellGap(a.y, b.y) * cell_size_;
+  float z = CellGap(a.z, b.z) * cell_size_;
+  return x * x + y * y + z * z;
+}
+
+bool SpatialGrid::OutOfRange(const GridCell& cell, float radius) const {
+  if (!enabled() || listener_cells_.empty()) {
+    return false;
+  }
+  float radius_squared = radius * radius;
+  for (size_t i = 0; i < listener_cells_.size(); ++i) {
+    if (MinDistanceSquared(cell, listener_cells_[i]) <= radius_squared) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint64_t SpatialGrid::Key(const GridCell& cell) {
+  return ((static_cast<uint64_t>(cell.x) & kCellCoordinateMask)
+          << (2 * kCellCoordinateBits)) |
+         ((static_cast<uint64_t>(cell.y) & kCellCoordinateMask)
+          << kCellCoordinateBits) |
+         (static_cast<uint64_t>(cell.z) & kCellCoordinateMask);
+}
+
+void SpatialGrid::Insert(size_t channel, const GridCell& cell, float radius) {
+  if (Contains(channel)) {
+    Remove(channel);
+  }
+  (*asleep_)[channel] = 1;
+  channel_cells_[channel] = cell;
+  channel_radii_[channel] = radius;
+  cells_[Key(cell)].push_back(static_cast<uint32_t>(channel));
+  ++count_;
+}
+
+void SpatialGrid::Remove(size_t channel) {
+  if (!Contains(channel)) {
+    return;
+  }
+  (*asleep_)[channel] = 0;
+  auto iter = cells_.find(Key(channel_cells_[channel]));
+  std::vector<uint32_t>& members = iter->second;
+  auto member = std::find(members.begin(), members.end(), channel);
+  *member = members.back();
+  members.pop_back();
+  if (members.empty()) {
+    cells_.erase(iter);
+  }
+  --count_;
+}
+
+void SpatialGrid::WakeNear(const GridCell& listener_cell) {
+  woken_.clear();
+  for (auto iter = cells_.begin(); iter != cells_.end(); ++iter) {
+    const std::vector<uint32_t>& members = iter->second;
+    float distance_squared =
+        MinDistanceSquared(channel_cells_[members[0]], listener_cell);
+    for (size_t i = 0; i < members.size(); ++i) {
+      float radius = channel_radii_[members[i]];
+      if (distance_squared <= radius * radius) {
+        woken_.push_back(members[i]);
+      }
+    }
+  }
+  for (size_t i = 0; i < woken_.size(); ++i) {
+    Remove(woken_[i]);
+  }
+}
+
+void SpatialGrid::WakeAll() {
+  if (asleep_) {
+    std::fill(asleep_->begin(), asleep_->end(), 0);
+  }
+  cells_.clear();
+  count_ = 0;
+}
+
+void SpatialGrid::UpdateListenerCells(
+    const std::vector<GridCell>& listener_cells) {
+  if (listener_cells.size() != listener_cells_.size()) {
+    // A listener was added or removed, and the listeners may have been
+    // reordered along with it, so every channel is checked again.
+    WakeAll();
+  } else if (count_ > 0) {
+    for (size_t i = 0; i < listener_cells.size(); ++i) {
+      if (listener_cells[i] != listener_cells_[i]) {
+        WakeNear(listener_cells[i]);
+      }
+    }
+  }
+  listener_cells_ = listener_cells;
+}
+
+}  // namespace pindrop
@@ -0,0 +1,129 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_SPATIAL_GRID_H_
+#define PINDROP_SPATIAL_GRID_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace pindrop {
+
+// The integer coordinates of a cell in a SpatialGrid.
+struct GridCell {
+  GridCell() : x(0), y(0), z(0) {}
+  GridCell(int32_t x, int32_t y, int32_t z) : x(x), y(y), z(z) {}
+
+  bool operator==(const GridCell& other) const {
+    return x == other.x && y == other.y && z == other.z;
+  }
+  bool operator!=(const GridCell& other) const { return !(*this == other); }
+
+  int32_t x;
+  int32_t y;
+  int32_t z;
+};
+
+// A uniform grid over the locations of the positional channels that are too
+// far from every listener to be heard. Those channels are asleep: the engine
+// skips them in its per-frame update, and they stay silent until they are
+// woken.
+//
+// The grid only compares cells, never exact locations. A channel is put to
+// sleep when no point of its cell is within its audible radius of any point of
+// a listener's cell, so it cannot become audible until it or a listener moves
+// to another cell. That is the only time it needs to be checked again: moving
+// a channel to a new cell wakes it, and moving a listener to a new cell wakes
+// the sleeping channels that could now be in range of it.
+//
+// Channels are referred to by their index in the channel pool, and whether
+// each one is asleep is written to the array given to Initialize.
+class SpatialGrid {
+ public:
+  SpatialGrid();
+
+  // Prepare the grid to hold up to size channels, and record which of them
+  // are asleep in asleep. All channels start awake.
+  void Initialize(std::vector<uint8_t>* asleep, size_t size);
+
+  // Set the length of the sides of the cells. If zero, the grid is disabled
+  // and no channel is ever put to sleep.
+  void set_cell_size(float cell_size);
+  float cell_size() const { return cell_size_; }
+  bool enabled() const { return cell_size_ > 0.0f; }
+
+  // Returns the cell that contains the given location.
+  GridCell CellAt(float x, float y, float z) const;
+
+  // Returns the smallest squared distance between any point in cell a and any
+  // point in cell b.
+  float MinDistanceSquared(const GridCell& a, const GridCell& b) const;
+
+  // Returns true if a channel in the given cell with the given audible radius
+  // cannot be heard by any listener without it or a listener changing cells.
+  bool OutOfRange(const GridCell& cell, float radius) const;
+
+  // Put a channel to sleep in the given cell.
+  void Insert(size_t channel, const GridCell& cell, float radius);
+
+  // Wake a channel. Does nothing if it is not asleep.
+  void Remove(size_t channel);
+
+  // Returns true if the channel is asleep.
+  bool Contains(size_t channel) const { return (*asleep_)[channel] != 0; }
+
+  // Returns the cell a sleeping channel is in.
+  const GridCell& cell(size_t channel) const { return channel_cells_[channel]; }
+
+  // Record the cells the listeners are in this frame, and wake every sleeping
+  // channel that is no longer out of range because a listener changed cells.
+  void UpdateListenerCells(const std::vector<GridCell>& listener_cells);
+
+  // Returns the number of sleeping channels.
+  size_t size() const { return count_; }
+
+ private:
+  static uint64_t Key(const GridCell& cell);
+
+  // Wake every sleeping channel within range of a listener in the given cell.
+  void WakeNear(const GridCell& listener_cell);
+
+  // Wake every sleeping channel.
+  void WakeAll();
+
+  float cell_size_;
+  float inverse_cell_size_;
+
+  std::vector<uint8_t>* asleep_;
+
+  // The cell and audible radius of each sleeping channel.
+  std::vector<GridCell> channel_cells_;
+  std::vector<float> channel_radii_;
+
+  // The sleeping channels in each occupied cell.
+  std::unordered_map<uint64_t, std::vector<uint32_t>> cells_;
+  size_t count_;
+
+  // The cells the listeners were in on the last update.
+  std::vector<GridCell> listener_cells_;
+
+  // Scratch space holding the channels to wake.
+  std::vector<uint32_t> woken_;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_SPATIAL_GRID_H_
@@ -19,6 +19,19 @@ namespace pindrop {
 void Resource::LoadFile(const char* filename, FileLoader* /*loader*/) {
   set_filename(filename);
   this->Load();
+  ready_.store(true, std::memory_order_release);
+}
+
+void Resource::LoadMemory(const char* filename, const char* data, size_t size,
+                          FileLoader* loader) {
+  data_ = data;
+  size_ = size;
+  LoadFile(filename, loader);
+}
+
+void Resource::Unload() {
+  ready_.store(false, std::memory_order_release);
+  Free();
 }
 
 }  // namespace pindrop
@@ -15,33 +15,85 @@
 #ifndef PINDROP_SYNCHRONOUS_LOADER_FILE_LOADER_H_
 #define PINDROP_SYNCHRONOUS_LOADER_FILE_LOADER_H_
 
+#include <atomic>
+#include <cstddef>
 #include <string>
 
 namespace pindrop {
 
 class FileLoader;
 
+// Identifies a group of resources queued together, such as the sounds of a
+// sound bank. Resources load as soon as they are queued, so every group is
+// loaded by the time it ends.
+typedef unsigned int LoadGroupId;
+
 class Resource {
  public:
+  Resource() : data_(nullptr), size_(0), ready_(false) {}
+
   virtual ~Resource() {}
 
   void LoadFile(const char* filename, FileLoader* loader);
 
+  // Load the resource from memory rather than from a file. The memory must
+  // stay valid for as long as the resource is in use. The filename is only
+  // used to identify the resource.
+  void LoadMemory(const char* filename, const char* data, size_t size,
+                  FileLoader* loader);
+
   void set_filename(const std::string& filename) { filename_ = filename; }
 
   const std::string& filename() const { return filename_; }
 
+  // The memory to load from, or null if the resource is loaded from a file.
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Return true once the resource has been loaded, until it is unloaded. Safe
+  // to call from any thread.
+  bool ready() const { return ready_.load(std::memory_order_acquire); }
+
+  // Free what was loaded, so that the resource can be loaded again later. The
+  // resource must not be queued or being loaded.
+  void Unload();
+
  private:
   virtual void Load() = 0;
 
+  // Called by Unload. Resources that can not be unloaded keep what they
+  // loaded.
+  virtual void Free() {}
+
   std::string filename_;
+  const char* data_;
+  size_t size_;
+  std::atomic<bool> ready_;
 };
 
 class FileLoader {
  public:
+  void Initialize(unsigned int /*thread_count*/) {}
+
+  LoadGroupId BeginGroup(int /*priority*/) { return 0; }
+
+  void EndGroup() {}
+
+  LoadGroupId current_group() const { return 0; }
+
+  void RaiseGroupPriority(LoadGroupId /*group*/, int /*priority*/) {}
+
+  void CancelJob(Resource* /*resource*/) {}
+
+  bool GroupLoaded(LoadGroupId /*group*/) const { return true; }
+
   void StartLoading() {}
 
   bool TryFinalize() { return true; }
+
+  float Progress() const { return 1.0f; }
+
+  size_t queue_depth() const { return 0; }
 };
 
 }  // namespace pindrop
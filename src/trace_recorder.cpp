@@ -0,0 +1,151 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "trace_recorder.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "channel_table.h"
+
+namespace pindrop {
+
+// The trace processes that channel and bus events are grouped under.
+static const int kChannelProcess = 1;
+static const int kBusProcess = 2;
+
+static const char* TraceEventName(TraceEventType type) {
+  switch (type) {
+    case kTracePlay:
+      return "play";
+    case kTraceEvict:
+      return "evict";
+    case kTraceVirtualize:
+      return "virtualize";
+    case kTraceDevirtualize:
+      return "devirtualize";
+    case kTraceStop:
+      return "stop";
+    case kTraceDuckStart:
+    case kTraceDuckEnd:
+      return "duck";
+  }
+  return "unknown";
+}
+
+// Append a JSON string literal holding the given text.
+static void AppendJsonString(std::string* json, const char* text) {
+  json->push_back('"');
+  for (const char* c = text; *c; ++c) {
+    if (*c == '"' || *c == '\\') {
+      json->push_back('\\');
+      json->push_back(*c);
+    } else if (static_cast<unsigned char>(*c) < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+      json->append(escaped);
+    } else {
+      json->push_back(*c);
+    }
+  }
+  json->push_back('"');
+}
+
+static void AppendProcessName(std::string* json, int process,
+                              const char* name) {
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer),
+           "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+           "\"args\":{\"name\":",
+           process);
+  json->append(buffer);
+  AppendJsonString(json, name);
+  json->append("}}");
+}
+
+static void AppendEvent(std::string* json, const TraceEvent& event) {
+  char buffer[192];
+  json->append("{\"name\":");
+  if (event.type == kTraceDuckStart || event.type == kTraceDuckEnd) {
+    // Ducking is shown as a span on the bus's track.
+    AppendJsonString(json, event.name);
+    snprintf(buffer, sizeof(buffer),
+             ",\"cat\":\"bus\",\"ph\":\"%s\",\"ts\":%lld,\"pid\":%d,"
+             "\"tid\":%u,\"args\":{\"frame\":%u}}",
+             event.type == kTraceDuckStart ? "B" : "E",
+             static_cast<long long>(event.microseconds), kBusProcess, event.id,
+             event.frame);
+    json->append(buffer);
+    return;
+  }
+  // Each channel gets its own track, keyed by its index in the channel pool
+  // rather than its id, so that the sounds played on it line up.
+  AppendJsonString(json, TraceEventName(event.type));
+  snprintf(buffer, sizeof(buffer),
+           ",\"cat\":\"channel\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,"
+           "\"pid\":%d,\"tid\":%u,\"args\":{\"frame\":%u,\"channel\":%u,"
+           "\"collection\":",
+           static_cast<long long>(event.microseconds), kChannelProcess,
+           static_cast<unsigned int>(ChannelIdIndex(event.id)), event.frame,
+           event.id);
+  json->append(buffer);
+  AppendJsonString(json, event.name);
+  json->append("}}");
+}
+
+void TraceRecorder::Start(size_t capacity) {
+  events_.assign(capacity, TraceEvent());
+  next_ = 0;
+  start_ = Clock::now();
+  recording_ = capacity > 0;
+}
+
+void TraceRecorder::Record(TraceEventType type, uint32_t id,
+                           const char* name) {
+  if (!recording_) {
+    return;
+  }
+  uint64_t slot = next_.fetch_add(1, std::memory_order_relaxed);
+  TraceEvent& event = events_[slot % events_.size()];
+  event.type = type;
+  event.frame = frame_;
+  event.microseconds =
+      std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() -
+                                                            start_)
+          .count();
+  event.id = id;
+  if (name) {
+    strncpy(event.name, name, TraceEvent::kNameLength - 1);
+    event.name[TraceEvent::kNameLength - 1] = '\0';
+  } else {
+    event.name[0] = '\0';
+  }
+}
+
+void TraceRecorder::WriteJson(std::string* json) const {
+  json->assign("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  AppendProcessName(json, kChannelProcess, "Channels");
+  json->push_back(',');
+  AppendProcessName(json, kBusProcess, "Buses");
+  uint64_t count = next_.load(std::memory_order_relaxed);
+  uint64_t capacity = events_.size();
+  uint64_t first = count > capacity ? count - capacity : 0;
+  for (uint64_t i = first; i < count; ++i) {
+    json->push_back(',');
+    AppendEvent(json, events_[i % capacity]);
+  }
+  json->append("]}\n");
+}
+
+}  // namespace pindrop
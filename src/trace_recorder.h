@@ -0,0 +1,112 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PINDROP_TRACE_RECORDER_H_
+#define PINDROP_TRACE_RECORDER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pindrop {
+
+// The channel and bus events a TraceRecorder records.
+enum TraceEventType {
+  // A channel started playing a sound.
+  kTracePlay,
+  // A channel was stopped so that its channel could play another sound.
+  kTraceEvict,
+  // A channel's real channel was given to another channel.
+  kTraceVirtualize,
+  // A channel was given a real channel.
+  kTraceDevirtualize,
+  // A channel stopped and was returned to the free lists.
+  kTraceStop,
+  // A bus started ducking the buses listed in its definition.
+  kTraceDuckStart,
+  // A bus stopped ducking them.
+  kTraceDuckEnd
+};
+
+// One recorded event. The name of the sound collection or bus is copied, so
+// the event can still be written out after the collection is unloaded.
+struct TraceEvent {
+  static const size_t kNameLength = 48;
+
+  TraceEventType type;
+
+  // The engine frame the event happened on.
+  uint32_t frame;
+
+  // The time of the event since recording started.
+  int64_t microseconds;
+
+  // The ChannelId of the channel, or the index of the bus.
+  uint32_t id;
+
+  char name[kNameLength];
+};
+
+// Records channel and bus events into a fixed size ring buffer, overwriting
+// the oldest once it is full, and writes them out in the Chrome trace event
+// format read by about:tracing and Perfetto.
+//
+// Recording never allocates or takes a lock. Writers claim a slot with an
+// atomic counter and fill it in, so the cost of an event is a clock read and a
+// copy of its name. The events are only read while the engine is not updating,
+// so a reader never sees a slot being written.
+class TraceRecorder {
+ public:
+  TraceRecorder() : next_(0), recording_(false), frame_(0) {}
+
+  // Discard any recorded events and start recording into a buffer that holds
+  // the given number of events.
+  void Start(size_t capacity);
+
+  // Stop recording. The recorded events are kept until the next Start.
+  void Stop() { recording_ = false; }
+
+  bool recording() const { return recording_; }
+
+  // Set the engine frame that events recorded from now on happened on.
+  void set_frame(uint32_t frame) { frame_ = frame; }
+
+  // Record an event if recording. The name may be null.
+  void Record(TraceEventType type, uint32_t id, const char* name);
+
+  // Write the recorded events, oldest first, as a Chrome trace event JSON
+  // document. Channel events appear on one track per channel, and duck events
+  // as spans on one track per bus.
+  void WriteJson(std::string* json) const;
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  std::vector<TraceEvent> events_;
+
+  // The number of events recorded since Start. The next event is written to
+  // slot next_ modulo the capacity.
+  std::atomic<uint64_t> next_;
+
+  bool recording_;
+  uint32_t frame_;
+  Clock::time_point start_;
+};
+
+}  // namespace pindrop
+
+#endif  // PINDROP_TRACE_RECORDER_H_
@@ -14,25 +14,51 @@
 // misrepresented as being the original software.
 // 3. This notice may not be removed or altered from any source distribution.
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "SDL_mixer.h"
+#include "arena.h"
+#include "asset_store_internal_state.h"
+#include "audio_config_generated.h"
 #include "audio_engine_internal_state.h"
+#include "buses_generated.h"
 #include "channel_internal_state.h"
+#include "decode_cache.h"
+#include "engine_test_fixture.h"
+#include "file_buffer.h"
 #include "fplutil/intrusive_list.h"
 #include "gtest/gtest.h"
 #include "listener_internal_state.h"
+#include "mathfu/constants.h"
+#include "pcm_file.h"
 #include "pindrop/pindrop.h"
+#include "random.h"
+#include "sample_cache.h"
 #include "sound.h"
+#include "sound_bank_archive.h"
+#include "sound_bank_archive_generated.h"
+#include "sound_bank_def_generated.h"
 #include "sound_collection.h"
 #include "sound_collection_def_generated.h"
+#include "spatial_grid.h"
+#include "trace_recorder.h"
 
 // Stubs for SDL_mixer functions which are not actually part of the tests being
 // run.
 extern "C" {
 Mix_Chunk* Mix_LoadWAV_RW(SDL_RWops*, int) { return NULL; }
 Mix_Music* Mix_LoadMUS(const char*) { return NULL; }
+Mix_Music* Mix_LoadMUS_RW(SDL_RWops*, int) { return NULL; }
+Mix_Chunk* Mix_QuickLoad_RAW(Uint8*, Uint32) { return NULL; }
+Mix_Chunk* Mix_GetChunk(int) { return NULL; }
+int Mix_QuerySpec(int*, Uint16*, int*) { return 0; }
 int Mix_AllocateChannels(int) { return 0; }
 int Mix_FadeOutChannel(int, int) { return 0; }
 int Mix_HaltChannel(int) { return 0; }
@@ -64,6 +90,7 @@ int Mix_PausedMusic() { return 0; }
 int Mix_PlayChannelTimed(int, Mix_Chunk*, int, int) { return 0; }
 int Mix_PlayMusic(Mix_Music*, int) { return 0; }
 int Mix_PlayingMusic() { return 0; }
+int Mix_SetMusicPosition(double) { return 0; }
 int Mix_VolumeMusic(int) { return MIX_MAX_VOLUME; }
 void Mix_HookMusicFinished(void (*)(void)) {}
 void Mix_Pause(int) {}
@@ -100,6 +127,11 @@ class ChannelInternalStatePriorityTests : public ::testing::Test {
           nullptr);
     }
 
+    table_.Resize(kSoundCount);
+    for (size_t i = 0; i < kSoundCount; ++i) {
+      channels_[i].AttachToTable(&table_, i);
+    }
+
     list_.push_back(channels_[0]);
     list_.push_back(channels_[1]);
     list_.push_back(channels_[2]);
@@ -123,6 +155,7 @@ class ChannelInternalStatePriorityTests : public ::testing::Test {
 
   PriorityList list_;
   static const std::size_t kSoundCount = 4;
+  ChannelTable table_;
   ChannelInternalState channels_[kSoundCount];
 };
 
@@ -154,6 +187,38 @@ TEST_F(ChannelInternalStatePriorityTests, FindInsertionPointLowest) {
   EXPECT_EQ(list_.end(), FindInsertionPoint(&list_, -1.0f));
 }
 
+TEST_F(ChannelInternalStatePriorityTests, PriorityIndexMatchesList) {
+  PriorityIndex& index = table_.priority_index;
+  index.Rebuild(list_.begin(), list_.end());
+  const float priorities[] = {2.5f, 2.0f, 1.5f, 1.0f, 0.5f, 0.0f, -1.0f};
+  for (size_t i = 0; i < sizeof(priorities) / sizeof(priorities[0]); ++i) {
+    PriorityList::iterator iter = FindInsertionPoint(&list_, priorities[i]);
+    int expected = iter == list_.end() ? PriorityIndex::kEnd
+                                       : static_cast<int>(iter->index());
+    EXPECT_EQ(expected, index.FindInsertionPoint(priorities[i]));
+  }
+}
+
+TEST_F(ChannelInternalStatePriorityTests, PriorityIndexInsertAndRemove) {
+  PriorityIndex& index = table_.priority_index;
+  index.Rebuild(list_.begin(), list_.end());
+  EXPECT_TRUE(index.Contains(0));
+  EXPECT_EQ(0, index.FindInsertionPoint(2.5f));
+
+  index.Remove(0);
+  EXPECT_FALSE(index.Contains(0));
+  EXPECT_EQ(1, index.FindInsertionPoint(2.5f));
+
+  // Channel 0 goes back in ahead of the two channels with priority 1.
+  EXPECT_EQ(1, index.Insert(0, 2.0f));
+  EXPECT_TRUE(index.Contains(0));
+  EXPECT_EQ(0, index.FindInsertionPoint(2.5f));
+
+  // The lowest priority channel has nothing after it.
+  index.Remove(3);
+  EXPECT_EQ(PriorityIndex::kEnd, index.Insert(3, 0.0f));
+}
+
 class BestListenerTests : public ::testing::Test {
  public:
   MATHFU_DEFINE_CLASS_SIMD_AWARE_NEW_DELETE
@@ -265,6 +330,138 @@ TEST_F(BestListenerTests, SingleClosestListener) {
   EXPECT_EQ(&listeners_[3], &*listener_);
 }
 
+// A buffered listener only moves once it has been published and consumed.
+TEST_F(BestListenerTests, BufferedListenerWaitsForPublish) {
+  listeners_[1].set_buffered(true);
+  Listener listener(&listeners_[1]);
+  listener.SetLocation(mathfu::Vector<float, 3>(100.0f, 0.0f, 0.0f));
+  EXPECT_FLOAT_EQ(100.0f, listener.Matrix().TranslationVector3D().x);
+
+  const mathfu::Vector<float, 3> location(10.0f, 0.0f, 0.0f);
+  EXPECT_TRUE(BestListener(&listener_, &distance_squared_,
+                           &transformed_location_, listener_list_, location));
+  EXPECT_EQ(0.0f, distance_squared_);
+  EXPECT_EQ(&listeners_[1], &*listener_);
+
+  listeners_[1].Publish();
+  EXPECT_TRUE(BestListener(&listener_, &distance_squared_,
+                           &transformed_location_, listener_list_, location));
+  EXPECT_EQ(&listeners_[1], &*listener_);
+
+  listeners_[1].Consume();
+  EXPECT_TRUE(BestListener(&listener_, &distance_squared_,
+                           &transformed_location_, listener_list_, location));
+  EXPECT_EQ(100.0f, distance_squared_);
+  EXPECT_NE(&listeners_[1], &*listener_);
+}
+
+// A listener's location and matrix are kept alongside its inverse, so they
+// can be read back without inverting anything.
+TEST_F(BestListenerTests, LocationMatchesMatrix) {
+  Listener listener(&listeners_[2]);
+  EXPECT_FLOAT_EQ(10.0f, listener.Location().x);
+  EXPECT_FLOAT_EQ(0.0f, listener.Location().y);
+  EXPECT_FLOAT_EQ(10.0f, listener.Location().z);
+  EXPECT_FLOAT_EQ(10.0f, listener.Matrix().TranslationVector3D().z);
+  EXPECT_FLOAT_EQ(10.0f, listeners_[2].location().x);
+}
+
+// Batched results match BestListener, including locations that do not fill a
+// full set of SIMD lanes.
+TEST_F(BestListenerTests, BatchMatchesBestListener) {
+  const size_t kCount = 6;
+  const float x[kCount] = {1.0f, 8.0f, 7.0f, 4.0f, 5.0f, -3.0f};
+  const float y[kCount] = {0.0f, 0.0f, 0.0f, 0.0f, 2.0f, 1.0f};
+  const float z[kCount] = {1.0f, 2.0f, 7.0f, 6.0f, 5.0f, 12.0f};
+  float distance_squared[kCount];
+  float listener_space_x[kCount];
+  float listener_space_y[kCount];
+  float listener_space_z[kCount];
+  EXPECT_TRUE(BestListenerBatch(distance_squared, listener_space_x,
+                                listener_space_y, listener_space_z,
+                                listener_list_, x, y, z, kCount));
+  for (size_t i = 0; i < kCount; ++i) {
+    EXPECT_TRUE(BestListener(&listener_, &distance_squared_,
+                             &transformed_location_, listener_list_,
+                             mathfu::Vector<float, 3>(x[i], y[i], z[i])));
+    EXPECT_NEAR(distance_squared_, distance_squared[i], kEpsilon);
+    EXPECT_NEAR(transformed_location_.x, listener_space_x[i], kEpsilon);
+    EXPECT_NEAR(transformed_location_.y, listener_space_y[i], kEpsilon);
+    EXPECT_NEAR(transformed_location_.z, listener_space_z[i], kEpsilon);
+  }
+}
+
+// A listener whose matrix scales is nearest by its listener space distance,
+// both one location at a time and batched.
+TEST_F(BestListenerTests, ScaledListenerComparesInListenerSpace) {
+  Listener(&listeners_[0]).SetMatrix(mathfu::Matrix<float, 4>::FromScaleVector(
+      mathfu::Vector<float, 3>(10.0f, 10.0f, 10.0f)));
+  EXPECT_FALSE(listeners_[0].rigid());
+  EXPECT_TRUE(listeners_[1].rigid());
+
+  // In world space this location is nearest to listeners_[1], 2 units away,
+  // but it is only 0.8 units from listeners_[0] in that listener's space.
+  EXPECT_TRUE(BestListener(&listener_, &distance_squared_,
+                           &transformed_location_, listener_list_,
+                           mathfu::Vector<float, 3>(8.0f, 0.0f, 0.0f)));
+  EXPECT_EQ(&listeners_[0], &*listener_);
+  EXPECT_NEAR(0.64f, distance_squared_, kEpsilon);
+
+  const size_t kCount = 5;
+  const float x[kCount] = {8.0f, 8.0f, 7.0f, 40.0f, 5.0f};
+  const float y[kCount] = {0.0f, 0.0f, 0.0f, 0.0f, 2.0f};
+  const float z[kCount] = {0.0f, 2.0f, 7.0f, 6.0f, 5.0f};
+  float distance_squared[kCount];
+  float listener_space_x[kCount];
+  float listener_space_y[kCount];
+  float listener_space_z[kCount];
+  EXPECT_TRUE(BestListenerBatch(distance_squared, listener_space_x,
+                                listener_space_y, listener_space_z,
+                                listener_list_, x, y, z, kCount));
+  for (size_t i = 0; i < kCount; ++i) {
+    EXPECT_TRUE(BestListener(&listener_, &distance_squared_,
+                             &transformed_location_, listener_list_,
+                             mathfu::Vector<float, 3>(x[i], y[i], z[i])));
+    EXPECT_NEAR(distance_squared_, distance_squared[i], kEpsilon);
+    EXPECT_NEAR(transformed_location_.x, listener_space_x[i], kEpsilon);
+    EXPECT_NEAR(transformed_location_.y, listener_space_y[i], kEpsilon);
+    EXPECT_NEAR(transformed_location_.z, listener_space_z[i], kEpsilon);
+  }
+}
+
+TEST_F(BestListenerTests, BatchWithNoListeners) {
+  ListenerList empty_list(&ListenerInternalState::node);
+  const float x = 0.0f;
+  float distance_squared;
+  float listener_space_x;
+  float listener_space_y;
+  float listener_space_z;
+  EXPECT_FALSE(BestListenerBatch(&distance_squared, &listener_space_x,
+                                 &listener_space_y, &listener_space_z,
+                                 empty_list, &x, &x, &x, 1));
+}
+
+// The engine only recomputes every channel when a listener has changed, so the
+// table reports whether gathering the listeners changed anything.
+TEST(ListenerTable, GatherReportsChanges) {
+  ListenerList list(&ListenerInternalState::node);
+  ListenerInternalState listener;
+  list.push_back(listener);
+  ListenerTable table;
+  EXPECT_TRUE(table.Gather(list.cbegin(), list.cend()));
+  EXPECT_FALSE(table.Gather(list.cbegin(), list.cend()));
+
+  listener.set_matrix(mathfu::Matrix<float, 4>::FromTranslationVector(
+      mathfu::Vector<float, 3>(1.0f, 0.0f, 0.0f)));
+  EXPECT_TRUE(table.Gather(list.cbegin(), list.cend()));
+  EXPECT_EQ(1.0f, table.location_x[0]);
+  EXPECT_FALSE(table.Gather(list.cbegin(), list.cend()));
+
+  listener.node.remove();
+  EXPECT_TRUE(table.Gather(list.cbegin(), list.cend()));
+  EXPECT_TRUE(table.empty());
+}
+
 TEST(CalculateDistanceAttenuation, RollOutCentered) {
   flatbuffers::FlatBufferBuilder fbb;
   SoundCollectionDefBuilder builder(fbb);
@@ -479,6 +676,564 @@ TEST_F(ListenerSpaceTests, Diagonal) {
   EXPECT_GT(0.0f, transformed_location_.z);
 }
 
+// Batched results match BestListener for rotated and translated listeners.
+TEST_F(ListenerSpaceTests, BatchMatchesBestListener) {
+  const size_t kCount = 4;
+  const float x[kCount] = {1.0f, -1.0f, 0.0f, 10.0f};
+  const float y[kCount] = {0.0f, 0.0f, 10.0f, 10.0f};
+  const float z[kCount] = {0.0f, 0.0f, 100.0f, -100.0f};
+  float distance_squared[kCount];
+  float listener_space_x[kCount];
+  float listener_space_y[kCount];
+  float listener_space_z[kCount];
+  const ListenerList* lists[] = {&listener_list_1_, &listener_list_2_,
+                                 &listener_list_3_};
+  for (size_t list = 0; list < 3; ++list) {
+    EXPECT_TRUE(BestListenerBatch(distance_squared, listener_space_x,
+                                  listener_space_y, listener_space_z,
+                                  *lists[list], x, y, z, kCount));
+    for (size_t i = 0; i < kCount; ++i) {
+      EXPECT_TRUE(BestListener(&best_state_, &distance_squared_,
+                               &transformed_location_, *lists[list],
+                               mathfu::Vector<float, 3>(x[i], y[i], z[i])));
+      EXPECT_NEAR(transformed_location_.x, listener_space_x[i], kEpsilon);
+      EXPECT_NEAR(transformed_location_.y, listener_space_y[i], kEpsilon);
+      EXPECT_NEAR(transformed_location_.z, listener_space_z[i], kEpsilon);
+    }
+  }
+}
+
+TEST(CalculateDistanceAttenuation, LookupTable) {
+  flatbuffers::FlatBufferBuilder fbb;
+  auto name = fbb.CreateString("");
+  SoundCollectionDefBuilder builder(fbb);
+  builder.add_name(name);
+  builder.add_mode(Mode_Positional);
+  builder.add_roll_in_curve_factor(2.0f);
+  builder.add_roll_out_curve_factor(0.5f);
+  builder.add_min_audible_radius(10.0f);
+  builder.add_roll_in_radius(20.f);
+  builder.add_roll_out_radius(30.0f);
+  builder.add_max_audible_radius(40.0f);
+  auto offset = builder.Finish();
+  FinishSoundCollectionDefBuffer(fbb, offset);
+  auto def = GetSoundCollectionDef(fbb.GetBufferPointer());
+
+  SoundCollection collection;
+  collection.LoadSoundCollectionDef(
+      std::string(reinterpret_cast<const char*>(fbb.GetBufferPointer()),
+                  fbb.GetSize()),
+      nullptr);
+  collection.BuildAttenuationTable(4096);
+  ASSERT_NE(nullptr, collection.params().attenuation_table);
+
+  for (float distance = 0.0f; distance <= 50.0f; distance += 0.5f) {
+    float distance_squared = distance * distance;
+    EXPECT_NEAR(CalculateDistanceAttenuation(distance_squared, def),
+                CalculateDistanceAttenuation(distance_squared,
+                                             collection.params()),
+                0.01f);
+  }
+}
+
+TEST(HashSoundName, Fnv1a) {
+  EXPECT_EQ(2166136261u, HashSoundName(""));
+  EXPECT_EQ(0xe81e7ab8u, HashSoundName("my_sounds"));
+  EXPECT_NE(HashSoundName("a"), HashSoundName("b"));
+}
+
+TEST(SoundIdTable, InsertFindErase) {
+  SoundCollection collections[64];
+  SoundIdTable table;
+  EXPECT_EQ(nullptr, table.Find(1));
+  table.Erase(1);
+
+  // Use ids that are multiples of a large power of two so that many of them
+  // share a slot and exercise the probing.
+  for (SoundId i = 0; i < 64; ++i) {
+    table.Insert(i << 20, &collections[i]);
+  }
+  for (SoundId i = 0; i < 64; ++i) {
+    EXPECT_EQ(&collections[i], table.Find(i << 20));
+  }
+  EXPECT_EQ(nullptr, table.Find(12345));
+
+  // Erase every other entry; the rest must still be found.
+  for (SoundId i = 0; i < 64; i += 2) {
+    table.Erase(i << 20);
+  }
+  for (SoundId i = 0; i < 64; ++i) {
+    EXPECT_EQ(i % 2 ? &collections[i] : nullptr, table.Find(i << 20));
+  }
+
+  // Inserting an existing id replaces its collection.
+  table.Insert(1 << 20, &collections[0]);
+  EXPECT_EQ(&collections[0], table.Find(1 << 20));
+}
+
+// Load a SoundCollection with no audio of its own, for its parameters.
+static void LoadEmptyCollection(bool stream, SoundCollection* collection) {
+  flatbuffers::FlatBufferBuilder fbb;
+  auto name = fbb.CreateString("");
+  SoundCollectionDefBuilder builder(fbb);
+  builder.add_name(name);
+  builder.add_stream(stream);
+  FinishSoundCollectionDefBuffer(fbb, builder.Finish());
+  collection->LoadSoundCollectionDef(
+      std::string(reinterpret_cast<const char*>(fbb.GetBufferPointer()),
+                  fbb.GetSize()),
+      nullptr);
+}
+
+TEST(SampleCache, SharesSoundsBetweenCollections) {
+  SoundCollection collection;
+  SoundCollection streamed_collection;
+  LoadEmptyCollection(false, &collection);
+  LoadEmptyCollection(true, &streamed_collection);
+  SampleCache cache;
+  FileLoader loader;
+  std::shared_ptr<SoundBankArchive> no_archive;
+  LoadGroupId group;
+
+  Sound* shared =
+      cache.Acquire("shared.wav", &collection, no_archive, &loader, &group);
+  EXPECT_EQ(shared, cache.Acquire("shared.wav", &collection, no_archive,
+                                  &loader, &group));
+  Sound* other =
+      cache.Acquire("other.wav", &collection, no_archive, &loader, &group);
+  EXPECT_NE(shared, other);
+  // A file played in a different way is loaded again.
+  Sound* streamed = cache.Acquire("shared.wav", &streamed_collection,
+                                  no_archive, &loader, &group);
+  EXPECT_NE(shared, streamed);
+  EXPECT_EQ(3u, cache.size());
+
+  cache.Release(shared, &loader);
+  EXPECT_EQ(3u, cache.size());
+  cache.Release(shared, &loader);
+  cache.Release(streamed, &loader);
+  EXPECT_EQ(1u, cache.size());
+  cache.Release(other, &loader);
+  EXPECT_EQ(0u, cache.size());
+}
+
+// With a sample budget, sounds are only loaded once they are played or
+// prefetched.
+TEST(SampleCache, LoadsOnDemandWithBudget) {
+  SoundCollection collection;
+  LoadEmptyCollection(false, &collection);
+  SampleCache cache;
+  cache.set_budget(1);
+  FileLoader loader;
+  std::shared_ptr<SoundBankArchive> no_archive;
+  LoadGroupId group;
+
+  Sound* played =
+      cache.Acquire("played.wav", &collection, no_archive, &loader, &group);
+  Sound* prefetched =
+      cache.Acquire("prefetched.wav", &collection, no_archive, &loader, &group);
+  Sound* unused =
+      cache.Acquire("unused.wav", &collection, no_archive, &loader, &group);
+  EXPECT_FALSE(played->ready());
+  cache.Pin(played, &loader);
+  cache.Prefetch(prefetched, &loader);
+  loader.StartLoading();
+  while (!loader.TryFinalize()) {
+  }
+  EXPECT_TRUE(played->ready());
+  EXPECT_TRUE(prefetched->ready());
+  EXPECT_FALSE(unused->ready());
+
+  // The files are missing, so the sounds hold no audio and fit the budget.
+  cache.Trim(&loader);
+  EXPECT_EQ(0u, cache.loaded_bytes());
+  EXPECT_TRUE(prefetched->ready());
+
+  cache.Unpin(played);
+  cache.Release(played, &loader);
+  cache.Release(prefetched, &loader);
+  cache.Release(unused, &loader);
+  EXPECT_EQ(0u, cache.size());
+}
+
+// Collections keep track of the channels playing them, oldest first, so their
+// instance limits can be enforced without searching the channels.
+TEST(SoundCollection, TracksInstances) {
+  SoundCollection collection;
+  SoundCollection other_collection;
+  LoadEmptyCollection(false, &collection);
+  LoadEmptyCollection(false, &other_collection);
+  ChannelTable table;
+  table.Resize(2);
+  ChannelInternalState channels[2];
+  for (size_t i = 0; i < 2; ++i) {
+    channels[i].AttachToTable(&table, i);
+  }
+
+  channels[0].SetSoundCollection(&collection);
+  channels[1].SetSoundCollection(&collection);
+  EXPECT_EQ(2u, collection.instance_count());
+  EXPECT_EQ(&channels[0], &collection.instances().front());
+
+  // Moving a channel on to another collection moves its instance with it.
+  channels[0].SetSoundCollection(&other_collection);
+  EXPECT_EQ(1u, collection.instance_count());
+  EXPECT_EQ(&channels[1], &collection.instances().front());
+  EXPECT_EQ(1u, other_collection.instance_count());
+
+  collection.RemoveInstance(&channels[1]);
+  collection.RemoveInstance(&channels[1]);
+  EXPECT_EQ(0u, collection.instance_count());
+  EXPECT_TRUE(collection.instances().empty());
+  other_collection.RemoveInstance(&channels[0]);
+}
+
+// A reloaded definition is rejected if it is for a different collection, and
+// the collection carries on with its old one.
+TEST(SoundCollection, ReloadRejectsRename) {
+  SoundCollection collection;
+  LoadEmptyCollection(false, &collection);
+  float gain = collection.params().gain;
+  SoundId id = collection.id();
+
+  flatbuffers::FlatBufferBuilder fbb;
+  auto name = fbb.CreateString("renamed");
+  SoundCollectionDefBuilder builder(fbb);
+  builder.add_name(name);
+  builder.add_gain(gain + 0.5f);
+  FinishSoundCollectionDefBuffer(fbb, builder.Finish());
+  FileBuffer buffer;
+  buffer.Assign(std::string(
+      reinterpret_cast<const char*>(fbb.GetBufferPointer()), fbb.GetSize()));
+
+  EXPECT_FALSE(collection.ReloadSoundCollectionDef(&buffer, nullptr));
+  EXPECT_EQ(id, collection.id());
+  EXPECT_EQ(gain, collection.params().gain);
+  EXPECT_TRUE(buffer.data() != nullptr);
+}
+
+TEST(Arena, ReusesBlocksAfterReset) {
+  Arena arena(256);
+  char* first = static_cast<char*>(arena.Allocate(3, 1));
+  double* aligned = arena.Allocate<double>(2);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(aligned) % alignof(double));
+  EXPECT_LE(first + 3, reinterpret_cast<char*>(aligned));
+  // Too big for a block of the usual size, so it gets one of its own.
+  arena.Allocate(1024, 1);
+  EXPECT_EQ(3u + 2 * sizeof(double) + 1024u, arena.bytes_allocated());
+  size_t capacity = arena.capacity();
+
+  arena.Reset();
+  EXPECT_EQ(0u, arena.bytes_allocated());
+  EXPECT_EQ(first, arena.Allocate(3, 1));
+  arena.Allocate(1024, 1);
+  EXPECT_EQ(capacity, arena.capacity());
+
+  ArenaVector<int> values((ArenaAllocator<int>(&arena)));
+  values.reserve(8);
+  for (int i = 0; i < 8; ++i) {
+    values.push_back(i);
+  }
+  EXPECT_EQ(7, values.back());
+  EXPECT_EQ(&arena, values.get_allocator().arena());
+}
+
+// Copies of an AssetStore share their sounds, so a sound loaded through one
+// engine is found by every other engine using the store.
+TEST(AssetStore, CopiesShareSounds) {
+  SoundCollection collection;
+  LoadEmptyCollection(false, &collection);
+  AssetStore store;
+  AssetStore copy = store;
+  EXPECT_EQ(store.state(), copy.state());
+  EXPECT_NE(store.state(), AssetStore().state());
+
+  AssetStoreInternalState* assets = store.state().get();
+  std::shared_ptr<SoundBankArchive> no_archive;
+  LoadGroupId group;
+  Sound* sound = assets->sample_cache.Acquire("shared.wav", &collection,
+                                              no_archive, &assets->loader,
+                                              &group);
+  EXPECT_EQ(1u, copy.sound_count());
+  assets->sample_cache.Release(sound, &assets->loader);
+  EXPECT_EQ(0u, store.sound_count());
+}
+
+TEST(Random, SeedRepeatsSequence) {
+  Random random(7);
+  Random same_seed(7);
+  Random other_seed(8);
+  bool differs = false;
+  for (int i = 0; i < 16; ++i) {
+    uint32_t value = random.Next();
+    EXPECT_EQ(value, same_seed.Next());
+    differs = differs || value != other_seed.Next();
+  }
+  EXPECT_TRUE(differs);
+
+  random.Seed(7);
+  same_seed.Seed(7);
+  for (int i = 0; i < 256; ++i) {
+    uint32_t value = random.Below(5);
+    EXPECT_LT(value, 5u);
+    EXPECT_EQ(value, same_seed.Below(5));
+    float fraction = random.NextFloat();
+    EXPECT_LE(0.0f, fraction);
+    EXPECT_GT(1.0f, fraction);
+    same_seed.NextFloat();
+  }
+}
+
+TEST(TraceRecorder, KeepsNewestEvents) {
+  TraceRecorder trace;
+  trace.Record(kTracePlay, 1, "before_start");
+  trace.Start(2);
+  trace.Record(kTracePlay, 1, "oldest");
+  trace.Record(kTraceStop, 1, "newer");
+  trace.Record(kTraceDuckStart, 0, "quo\"ted");
+  trace.Stop();
+  trace.Record(kTracePlay, 2, "after_stop");
+
+  std::string json;
+  trace.WriteJson(&json);
+  EXPECT_EQ(std::string::npos, json.find("before_start"));
+  EXPECT_EQ(std::string::npos, json.find("oldest"));
+  EXPECT_EQ(std::string::npos, json.find("after_stop"));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"stop\""));
+  EXPECT_NE(std::string::npos, json.find("\"collection\":\"newer\""));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"quo\\\"ted\""));
+  EXPECT_LT(json.find("newer"), json.find("quo"));
+}
+
+TEST(ChannelId, GenerationInvalidatesOldIds) {
+  AudioEngineInternalState state;
+  state.channel_state_memory.resize(2);
+  state.channel_table.Resize(2);
+  for (size_t i = 0; i < 2; ++i) {
+    state.channel_state_memory[i].AttachToTable(&state.channel_table, i);
+  }
+  EXPECT_EQ(nullptr, FindChannelInternalState(&state, kNullChannelId));
+
+  ChannelInternalState& channel_state = state.channel_state_memory[1];
+  ChannelId id = channel_state.id();
+  EXPECT_EQ(1u, ChannelIdIndex(id));
+  EXPECT_EQ(&channel_state, FindChannelInternalState(&state, id));
+  EXPECT_TRUE(Channel(&state, id).Valid());
+
+  // Once the channel moves on to another sound, the old id no longer works.
+  channel_state.IncrementGeneration();
+  EXPECT_EQ(nullptr, FindChannelInternalState(&state, id));
+  EXPECT_FALSE(Channel(&state, id).Valid());
+  EXPECT_EQ(&channel_state,
+            FindChannelInternalState(&state, channel_state.id()));
+
+  // Generation zero is skipped when the count wraps around.
+  state.channel_table.generation[1] = kChannelIdGenerationMask;
+  channel_state.IncrementGeneration();
+  EXPECT_EQ(1u, state.channel_table.generation[1]);
+}
+
+// Channels out of range of every listener sleep until they or a listener move
+// to a cell that could be in range.
+TEST(SpatialGrid, WakesChannelsThatChangeRange) {
+  ChannelTable table;
+  table.Resize(1);
+  ChannelInternalState channel;
+  channel.AttachToTable(&table, 0);
+  SpatialGrid& grid = table.grid;
+  grid.set_cell_size(10.0f);
+  std::vector<GridCell> listener_cells(1, grid.CellAt(0.0f, 0.0f, 0.0f));
+  grid.UpdateListenerCells(listener_cells);
+
+  // A channel in the neighbouring cell may be in range, but one nine cells
+  // away from the listener's cell cannot be.
+  EXPECT_FALSE(grid.OutOfRange(grid.CellAt(15.0f, 0.0f, 0.0f), 5.0f));
+  GridCell far_cell = grid.CellAt(105.0f, 0.0f, 0.0f);
+  EXPECT_TRUE(grid.OutOfRange(far_cell, 5.0f));
+  channel.SetLocation(mathfu::Vector<float, 3>(105.0f, 0.0f, 0.0f));
+  grid.Insert(0, far_cell, 5.0f);
+  EXPECT_EQ(1u, table.asleep[0]);
+  EXPECT_EQ(1u, grid.size());
+
+  // Moving within a cell wakes nothing.
+  channel.SetLocation(mathfu::Vector<float, 3>(109.0f, 0.0f, 0.0f));
+  listener_cells[0] = grid.CellAt(9.0f, 0.0f, 0.0f);
+  grid.UpdateListenerCells(listener_cells);
+  EXPECT_TRUE(grid.Contains(0));
+
+  // The listener moving next to the channel's cell wakes it.
+  listener_cells[0] = grid.CellAt(95.0f, 0.0f, 0.0f);
+  grid.UpdateListenerCells(listener_cells);
+  EXPECT_FALSE(grid.Contains(0));
+  EXPECT_EQ(0u, table.asleep[0]);
+
+  // So does the channel moving to another cell.
+  grid.Insert(0, far_cell, 5.0f);
+  channel.SetLocation(mathfu::Vector<float, 3>(115.0f, 0.0f, 0.0f));
+  EXPECT_FALSE(grid.Contains(0));
+  EXPECT_EQ(0u, grid.size());
+}
+
+TEST(CommandQueue, PushAndPop) {
+  CommandQueue queue;
+  Command command;
+  // An uninitialized queue accepts nothing.
+  EXPECT_FALSE(queue.Push(command));
+  EXPECT_FALSE(queue.Pop(&command));
+
+  // The capacity is rounded up to a power of two.
+  queue.Initialize(3);
+  EXPECT_EQ(4u, queue.capacity());
+
+  // Go around the ring a few times, filling it each time.
+  uint32_t next_push = 1;
+  uint32_t next_pop = 1;
+  for (int lap = 0; lap < 3; ++lap) {
+    for (size_t i = 0; i < queue.capacity(); ++i) {
+      command.ticket = next_push++;
+      EXPECT_TRUE(queue.Push(command));
+    }
+    command.ticket = 0;
+    EXPECT_FALSE(queue.Push(command));
+    for (size_t i = 0; i < queue.capacity(); ++i) {
+      EXPECT_TRUE(queue.Pop(&command));
+      EXPECT_EQ(next_pop++, command.ticket);
+    }
+    EXPECT_FALSE(queue.Pop(&command));
+  }
+}
+
+TEST(FileBuffer, LoadAndAssign) {
+  const char kFilename[] = "file_buffer_test.bin";
+  const std::string contents("pindrop\0data", 12);
+  FILE* file = fopen(kFilename, "wb");
+  ASSERT_TRUE(file != nullptr);
+  fwrite(contents.data(), 1, contents.size(), file);
+  fclose(file);
+
+  FileBuffer buffer;
+  EXPECT_TRUE(buffer.Load(kFilename));
+  remove(kFilename);
+  ASSERT_EQ(contents.size(), buffer.size());
+  EXPECT_EQ(contents, std::string(buffer.data(), buffer.size()));
+
+  buffer.Assign("other");
+  EXPECT_EQ(std::string("other"), std::string(buffer.data(), buffer.size()));
+
+  buffer.Release();
+  EXPECT_TRUE(buffer.data() == nullptr);
+  EXPECT_EQ(0u, buffer.size());
+  EXPECT_FALSE(buffer.Load(kFilename));
+}
+
+TEST(FileBuffer, Swap) {
+  FileBuffer first;
+  first.Assign("first");
+  FileBuffer second;
+  second.Assign("second buffer");
+  first.Swap(&second);
+  EXPECT_EQ(std::string("second buffer"),
+            std::string(first.data(), first.size()));
+  EXPECT_EQ(std::string("first"), std::string(second.data(), second.size()));
+
+  FileBuffer empty;
+  empty.Swap(&first);
+  EXPECT_TRUE(first.data() == nullptr);
+  EXPECT_EQ(std::string("second buffer"),
+            std::string(empty.data(), empty.size()));
+}
+
+TEST(SoundBankArchive, FindFiles) {
+  // Place the file contents well past the end of the index.
+  const flatbuffers::uoffset_t kContentsOffset = 1024;
+  const std::string contents("bank....collectionaudio");
+  flatbuffers::FlatBufferBuilder fbb;
+  auto sound_bank = CreateArchiveFileDef(fbb, fbb.CreateString("bank"),
+                                         kContentsOffset, 4);
+  std::vector<flatbuffers::Offset<ArchiveFileDef>> files;
+  files.push_back(CreateArchiveFileDef(fbb, fbb.CreateString("a.pinsound"),
+                                       kContentsOffset + 8, 10));
+  files.push_back(CreateArchiveFileDef(fbb, fbb.CreateString("b.ogg"),
+                                       kContentsOffset + 18, 5));
+  // An entry that runs past the end of the archive.
+  files.push_back(CreateArchiveFileDef(fbb, fbb.CreateString("c.ogg"),
+                                       kContentsOffset + 18, 6));
+  FinishSoundBankArchiveDefBuffer(
+      fbb, CreateSoundBankArchiveDef(fbb, sound_bank, fbb.CreateVector(files)));
+  ASSERT_LT(fbb.GetSize(), kContentsOffset);
+
+  std::string source(reinterpret_cast<const char*>(fbb.GetBufferPointer()),
+                     fbb.GetSize());
+  source.resize(kContentsOffset, 0);
+  source += contents;
+  std::shared_ptr<FileBuffer> buffer(new FileBuffer());
+  buffer->Assign(source);
+  ASSERT_TRUE(SoundBankArchive::IsArchive(*buffer));
+
+  SoundBankArchive archive(buffer);
+  const char* data;
+  size_t size;
+  ASSERT_TRUE(archive.FindSoundBank(&data, &size));
+  EXPECT_EQ(std::string("bank"), std::string(data, size));
+  ASSERT_TRUE(archive.Find("a.pinsound", &data, &size));
+  EXPECT_EQ(std::string("collection"), std::string(data, size));
+  ASSERT_TRUE(archive.Find("b.ogg", &data, &size));
+  EXPECT_EQ(std::string("audio"), std::string(data, size));
+  EXPECT_FALSE(archive.Find("c.ogg", &data, &size));
+  EXPECT_FALSE(archive.Find("missing.ogg", &data, &size));
+}
+
+TEST(PcmFile, ParseHeader) {
+  EXPECT_TRUE(HasPcmFileExtension("assets/sounds/throw_01.pcm"));
+  EXPECT_FALSE(HasPcmFileExtension("assets/sounds/throw_01.ogg"));
+  EXPECT_FALSE(HasPcmFileExtension("pcm"));
+
+  // 44100Hz, AUDIO_S16LSB, stereo, with a single frame of samples.
+  const unsigned char header[] = {'P',  'P',  'C', 'M', 0x44, 0xac, 0, 0,
+                                  0x10, 0x80, 2,   0,   4,    0,    0, 0};
+  std::string source(reinterpret_cast<const char*>(header), sizeof(header));
+  source += std::string("\x01\x02\x03\x04", 4);
+  PcmFile pcm;
+  ASSERT_TRUE(ParsePcmFile(source.data(), source.size(), &pcm));
+  EXPECT_EQ(44100u, pcm.frequency);
+  EXPECT_EQ(0x8010, pcm.format);
+  EXPECT_EQ(2, pcm.channels);
+  EXPECT_EQ(4u, pcm.size);
+  EXPECT_EQ(source.data() + kPcmFileHeaderSize, pcm.samples);
+
+  // The samples must all be present.
+  EXPECT_FALSE(ParsePcmFile(source.data(), source.size() - 1, &pcm));
+  EXPECT_FALSE(ParsePcmFile("OggS", 4, &pcm));
+}
+
+TEST(DecodeCache, EvictsLeastRecentlyPlayed) {
+  Mix_Chunk chunks[3];
+  chunks[0].alen = 60;
+  chunks[1].alen = 60;
+  chunks[2].alen = 200;
+  Sound sounds[3];
+
+  DecodeCache cache;
+  cache.set_capacity(100);
+  cache.Insert(&sounds[0], &chunks[0]);
+  EXPECT_EQ(60u, cache.size());
+
+  // Making room for the second chunk evicts the first.
+  cache.Insert(&sounds[1], &chunks[1]);
+  EXPECT_EQ(60u, cache.size());
+  EXPECT_TRUE(cache.Find(&sounds[0]) == nullptr);
+  EXPECT_EQ(&chunks[1], cache.Find(&sounds[1]));
+
+  // A chunk larger than the whole cache is still kept.
+  cache.Insert(&sounds[2], &chunks[2]);
+  EXPECT_EQ(200u, cache.size());
+  EXPECT_TRUE(cache.Find(&sounds[1]) == nullptr);
+  EXPECT_EQ(&chunks[2], cache.Find(&sounds[2]));
+
+  cache.Remove(&sounds[2]);
+  EXPECT_EQ(0u, cache.size());
+}
+
 TEST(AttenuationCurve, Linear) {
   EXPECT_EQ(0.0f, AttenuationCurve(0.0f, 0.0f, 1.0f, 1.0f));
   EXPECT_EQ(0.5f, AttenuationCurve(0.5f, 0.0f, 1.0f, 1.0f));
@@ -521,6 +1276,439 @@ TEST(AttenuationCurve, EaseIn) {
   EXPECT_NEAR(1.0f, AttenuationCurve(200.0f, 100.0f, 200.0f, 0.5f), kEpsilon);
 }
 
+// A batch that runs short of channels stops its own earlier sounds to play the
+// later ones. The handles returned for it must never share a voice.
+TEST_F(EngineTests, PlaySoundsReturnsDistinctChannels) {
+  virtual_channels_ = 2;
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(
+      1, TestCollectionDef("batch"))));
+
+  const size_t kCount = 4;
+  std::vector<PlayRequest> requests(
+      kCount, PlayRequest(Handle("batch"), mathfu::kZeros3f, 1.0f));
+  Channel channels[kCount];
+  engine_->PlaySounds(requests.data(), kCount, channels);
+  EXPECT_EQ(2u, CountDistinctChannels(channels, kCount));
+}
+
+// The same holds when the batch goes over a collection's instance limit.
+TEST_F(EngineTests, PlaySoundsOverInstanceLimitReturnsDistinctChannels) {
+  TestCollectionDef def("limited");
+  def.max_instances = 2;
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(1, def)));
+
+  const size_t kCount = 3;
+  std::vector<PlayRequest> requests(
+      kCount, PlayRequest(Handle("limited"), mathfu::kZeros3f, 1.0f));
+  Channel channels[kCount];
+  engine_->PlaySounds(requests.data(), kCount, channels);
+  EXPECT_EQ(2u, CountDistinctChannels(channels, kCount));
+  EXPECT_EQ(2u, Handle("limited")->instance_count());
+}
+
+// Sleeping is decided in world space, so a channel must not sleep while a
+// listener scales, or it could stay asleep when the listener comes within
+// range in its own space but not in the world's.
+TEST_F(EngineTests, ScaledListenerWakesSleepingChannels) {
+  culling_cell_size_ = 10.0f;
+  TestCollectionDef def("positional");
+  def.positional = true;
+  def.max_audible_radius = 10.0f;
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(1, def)));
+  Listener listener = engine_->AddListener();
+  Channel channel = engine_->PlaySound(
+      Handle("positional"), mathfu::Vector<float, 3>(100.0f, 0.0f, 0.0f));
+  ASSERT_TRUE(channel.Valid());
+  AdvanceFrame();
+  EXPECT_EQ(1u, engine_->sleeping_channel_count());
+
+  // The channel is 30 units away in the world, but only 7.5 in the space of
+  // the listener, which scales by four.
+  listener.SetMatrix(mathfu::Matrix<float, 4>::FromTranslationVector(
+                         mathfu::Vector<float, 3>(70.0f, 0.0f, 0.0f)) *
+                     mathfu::Matrix<float, 4>::FromScaleVector(
+                         mathfu::Vector<float, 3>(4.0f, 4.0f, 4.0f)));
+  AdvanceFrame();
+  AdvanceFrame();
+  EXPECT_EQ(0u, engine_->sleeping_channel_count());
+  const ChannelTable& table = engine_->state()->channel_table;
+  EXPECT_GT(table.gain[ChannelIdIndex(channel.id())], 0.0f);
+
+  // Out of range of the scaled listener, it still stays awake.
+  listener.SetMatrix(mathfu::Matrix<float, 4>::FromScaleVector(
+      mathfu::Vector<float, 3>(4.0f, 4.0f, 4.0f)));
+  AdvanceFrame();
+  AdvanceFrame();
+  EXPECT_EQ(0u, engine_->sleeping_channel_count());
+  EXPECT_EQ(0.0f, table.gain[ChannelIdIndex(channel.id())]);
+}
+
+// A collection with a minimum retrigger interval rejects plays that come too
+// soon after the last one.
+TEST_F(EngineTests, RejectsRetriggerWithinInterval) {
+  TestCollectionDef def("retrigger");
+  def.min_retrigger_interval = 1.0f;
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(1, def)));
+  EXPECT_TRUE(engine_->PlaySound(Handle("retrigger")).Valid());
+  EXPECT_FALSE(engine_->PlaySound(Handle("retrigger")).Valid());
+  engine_->AdvanceFrame(0.6f);
+  EXPECT_FALSE(engine_->PlaySound(Handle("retrigger")).Valid());
+  engine_->AdvanceFrame(0.6f);
+  EXPECT_TRUE(engine_->PlaySound(Handle("retrigger")).Valid());
+}
+
+// At its instance limit, a collection with the Reject policy keeps the
+// instances it has and does not play the new one.
+TEST_F(EngineTests, RejectsInstancesOverLimit) {
+  TestCollectionDef def("reject");
+  def.max_instances = 2;
+  def.instance_limit_policy = InstanceLimitPolicy_Reject;
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(1, def)));
+  Channel first = engine_->PlaySound(Handle("reject"));
+  Channel second = engine_->PlaySound(Handle("reject"));
+  EXPECT_FALSE(engine_->PlaySound(Handle("reject")).Valid());
+  EXPECT_TRUE(first.Playing());
+  EXPECT_TRUE(second.Playing());
+  EXPECT_EQ(2u, Handle("reject")->instance_count());
+}
+
+// The StealOldest policy stops the instance that started first.
+TEST_F(EngineTests, StealsOldestInstance) {
+  TestCollectionDef def("oldest");
+  def.max_instances = 2;
+  def.instance_limit_policy = InstanceLimitPolicy_StealOldest;
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(1, def)));
+  Channel first = engine_->PlaySound(Handle("oldest"));
+  Channel second = engine_->PlaySound(Handle("oldest"));
+  Channel third = engine_->PlaySound(Handle("oldest"));
+  EXPECT_FALSE(first.Playing());
+  EXPECT_TRUE(second.Playing());
+  EXPECT_TRUE(third.Playing());
+  EXPECT_EQ(2u, Handle("oldest")->instance_count());
+}
+
+// The StealQuietest policy stops the instance with the lowest gain, wherever
+// it is in the order they started in.
+TEST_F(EngineTests, StealsQuietestInstance) {
+  TestCollectionDef def("quietest");
+  def.max_instances = 2;
+  def.instance_limit_policy = InstanceLimitPolicy_StealQuietest;
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(1, def)));
+  Channel loud =
+      engine_->PlaySound(Handle("quietest"), mathfu::kZeros3f, 1.0f);
+  Channel quiet =
+      engine_->PlaySound(Handle("quietest"), mathfu::kZeros3f, 0.25f);
+  Channel third =
+      engine_->PlaySound(Handle("quietest"), mathfu::kZeros3f, 0.5f);
+  EXPECT_TRUE(loud.Playing());
+  EXPECT_FALSE(quiet.Playing());
+  EXPECT_TRUE(third.Playing());
+  EXPECT_EQ(2u, Handle("quietest")->instance_count());
+}
+
+// Records the banks whose loaded callbacks have been called.
+static void RecordLoadedBank(const std::string& filename, void* userdata) {
+  static_cast<std::vector<std::string>*>(userdata)->push_back(filename);
+}
+
+// Banks loaded together have their sounds registered once their files are
+// read, and each has its callback called once its sound files have loaded.
+TEST_F(EngineTests, LoadsSoundBanksAsynchronously) {
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(
+      1, TestCollectionDef("resident"))));
+  std::vector<std::string> banks;
+  banks.push_back("pindrop_test_first.pinbank");
+  banks.push_back("pindrop_test_second.pinbank");
+  ASSERT_TRUE(WriteBank(banks[0], std::vector<TestCollectionDef>(
+                                      1, TestCollectionDef("first"))));
+  ASSERT_TRUE(WriteBank(banks[1], std::vector<TestCollectionDef>(
+                                      1, TestCollectionDef("second"))));
+
+  // Sounds in a bank that has not been loaded can not be played.
+  EXPECT_FALSE(engine_->PlaySound("first").Valid());
+  EXPECT_FALSE(engine_->SoundBankLoaded(banks[0]));
+
+  std::vector<std::string> loaded;
+  engine_->LoadSoundBanksAsync(banks, RecordLoadedBank, &loaded);
+  for (int i = 0; i < 1000 && loaded.size() < banks.size(); ++i) {
+    AdvanceFrame();
+  }
+  std::sort(loaded.begin(), loaded.end());
+  EXPECT_EQ(banks, loaded);
+  for (size_t i = 0; i < banks.size(); ++i) {
+    EXPECT_TRUE(engine_->SoundBankLoaded(banks[i]));
+  }
+  EXPECT_TRUE(engine_->PlaySound("first").Valid());
+  EXPECT_TRUE(engine_->PlaySound("second").Valid());
+
+  // Each callback is only called once.
+  AdvanceFrame();
+  EXPECT_EQ(banks.size(), loaded.size());
+}
+
+// Returns the index among the collection's sounds of the one it selects next.
+static size_t SelectIndex(SoundCollection* collection, Random* random) {
+  const SoundList& sounds = collection->sounds();
+  Sound* sound = collection->Select(random);
+  return static_cast<size_t>(std::find(sounds.begin(), sounds.end(), sound) -
+                             sounds.begin());
+}
+
+// The alias table chooses each sound in proportion to its weight. Sounds with
+// no weight, or a negative one, are never chosen.
+TEST_F(EngineTests, SelectsSamplesByWeight) {
+  TestCollectionDef def("weighted");
+  def.weights = {1.0f, 3.0f, 0.0f, -1.0f};
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(1, def)));
+  SoundCollection* collection = Handle("weighted");
+  Random random(7);
+  const int kDraws = 40000;
+  int counts[4] = {0, 0, 0, 0};
+  for (int i = 0; i < kDraws; ++i) {
+    size_t index = SelectIndex(collection, &random);
+    ASSERT_LT(index, 4u);
+    ++counts[index];
+  }
+  EXPECT_NEAR(0.25f, counts[0] / static_cast<float>(kDraws), 0.02f);
+  EXPECT_NEAR(0.75f, counts[1] / static_cast<float>(kDraws), 0.02f);
+  EXPECT_EQ(0, counts[2]);
+  EXPECT_EQ(0, counts[3]);
+}
+
+// NoRepeat never plays the same sound twice in a row, even when one sound has
+// so much of the weight that choosing again rarely avoids it. When it gives up
+// choosing again, it skips over sounds with no weight.
+TEST_F(EngineTests, NoRepeatNeverRepeats) {
+  TestCollectionDef even("even");
+  even.sample_selection = SampleSelection_NoRepeat;
+  even.weights = {1.0f, 1.0f, 1.0f};
+  TestCollectionDef skewed("skewed");
+  skewed.sample_selection = SampleSelection_NoRepeat;
+  skewed.weights = {100.0f, 1.0f};
+  TestCollectionDef gapped("gapped");
+  gapped.sample_selection = SampleSelection_NoRepeat;
+  gapped.weights = {100.0f, 0.0f, 1.0f};
+  std::vector<TestCollectionDef> defs;
+  defs.push_back(even);
+  defs.push_back(skewed);
+  defs.push_back(gapped);
+  ASSERT_TRUE(Initialize(defs));
+  Random random(7);
+  const char* names[] = {"even", "skewed", "gapped"};
+  for (size_t n = 0; n < 3; ++n) {
+    SoundCollection* collection = Handle(names[n]);
+    size_t last = SelectIndex(collection, &random);
+    for (int i = 0; i < 1000; ++i) {
+      size_t index = SelectIndex(collection, &random);
+      EXPECT_NE(last, index);
+      last = index;
+    }
+  }
+  SoundCollection* collection = Handle("gapped");
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_NE(1u, SelectIndex(collection, &random));
+  }
+}
+
+// Shuffle plays every sound once per round, and a new round does not start
+// with the sound the last one ended with.
+TEST_F(EngineTests, ShufflePlaysEverySampleEachRound) {
+  TestCollectionDef def("shuffled");
+  def.sample_selection = SampleSelection_Shuffle;
+  def.weights = {1.0f, 1.0f, 1.0f, 1.0f};
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(1, def)));
+  SoundCollection* collection = Handle("shuffled");
+  Random random(7);
+  size_t last = def.weights.size();
+  for (int round = 0; round < 50; ++round) {
+    std::vector<bool> played(def.weights.size(), false);
+    for (size_t i = 0; i < def.weights.size(); ++i) {
+      size_t index = SelectIndex(collection, &random);
+      ASSERT_LT(index, played.size());
+      EXPECT_FALSE(played[index]);
+      EXPECT_NE(last, index);
+      played[index] = true;
+      last = index;
+    }
+  }
+}
+
+// A sound evicted to make room for another lets go of its pin, so that the
+// sample budget can unload it.
+TEST_F(EngineTests, EvictedSoundCanBeTrimmed) {
+  virtual_channels_ = 1;
+  sample_budget_ = 1;
+  TestCollectionDef low("low");
+  low.compressed = true;
+  TestCollectionDef high("high");
+  high.compressed = true;
+  high.priority = 2.0f;
+  std::vector<TestCollectionDef> defs;
+  defs.push_back(low);
+  defs.push_back(high);
+  ASSERT_TRUE(Initialize(defs));
+
+  // Each sound holds its whole file, which is over the budget on its own, so
+  // only the sounds that are pinned stay loaded.
+  Channel low_channel = engine_->PlaySound(Handle("low"));
+  ASSERT_TRUE(low_channel.Valid());
+  AdvanceFrame();
+  SoundMemoryStats stats;
+  engine_->GetSoundMemoryStats(&stats);
+  size_t sound_bytes = stats.budgeted_bytes;
+  EXPECT_GT(sound_bytes, 0u);
+
+  Channel high_channel = engine_->PlaySound(Handle("high"));
+  ASSERT_TRUE(high_channel.Valid());
+  EXPECT_FALSE(low_channel.Playing());
+  AdvanceFrame();
+  engine_->GetSoundMemoryStats(&stats);
+  EXPECT_EQ(sound_bytes, stats.budgeted_bytes);
+}
+
+// A recompiled collection written over the file it was loaded from replaces
+// the loaded def, and the channels already playing it carry on.
+TEST_F(EngineTests, ReloadsRewrittenCollection) {
+  TestCollectionDef def("reloaded");
+  def.weights.push_back(1.0f);
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(1, def)));
+  Channel channel = engine_->PlaySound(Handle("reloaded"));
+  ASSERT_TRUE(channel.Valid());
+  AdvanceFrame();
+
+  def.priority = 3.0f;
+  ASSERT_TRUE(WriteCollection(def));
+  EXPECT_TRUE(engine_->ReloadSoundCollectionDef(CollectionFile(def.name)));
+  EXPECT_EQ(3.0f, Handle("reloaded")->params().priority);
+  AdvanceFrame();
+  EXPECT_TRUE(channel.Playing());
+
+  // A collection that has lost one of its samples can not be swapped in.
+  def.weights.pop_back();
+  ASSERT_TRUE(WriteCollection(def));
+  EXPECT_FALSE(engine_->ReloadSoundCollectionDef(CollectionFile(def.name)));
+}
+
+// A recompiled bus file written over the one the engine loaded replaces the
+// bus settings.
+TEST_F(EngineTests, ReloadsRewrittenBusFile) {
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(
+      1, TestCollectionDef("bused"))));
+  EXPECT_EQ(1.0f, engine_->FindBus("master").FinalGain());
+
+  flatbuffers::FlatBufferBuilder fbb;
+  std::vector<flatbuffers::Offset<BusDef>> buses(
+      1, CreateBusDef(fbb, fbb.CreateString("master"), 0.5f));
+  FinishBusDefListBuffer(fbb,
+                         CreateBusDefList(fbb, fbb.CreateVector(buses)));
+  ASSERT_TRUE(WriteFile(kBusFile, fbb));
+  EXPECT_TRUE(engine_->ReloadBusFile(kBusFile));
+  AdvanceFrame();
+  EXPECT_EQ(0.5f, engine_->FindBus("master").FinalGain());
+}
+
+// A channel whose gain and pan depend on nothing that has changed keeps them
+// without being updated. Moving the channel, fading its bus or moving the
+// listener each cause them to be computed again.
+TEST_F(EngineTests, SkipsUpdatesOfUnchangedChannels) {
+  TestCollectionDef def("static");
+  def.positional = true;
+  def.max_audible_radius = 100.0f;
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(1, def)));
+  Listener listener = engine_->AddListener();
+  Channel channel = engine_->PlaySound(
+      Handle("static"), mathfu::Vector<float, 3>(10.0f, 0.0f, 0.0f));
+  ASSERT_TRUE(channel.Valid());
+  const ChannelTable& table = engine_->state()->channel_table;
+  const size_t index = ChannelIdIndex(channel.id());
+  ChannelUpdateStats stats;
+
+  AdvanceFrame();
+  engine_->GetChannelUpdateStats(&stats);
+  EXPECT_EQ(1u, stats.every_frame);
+  EXPECT_EQ(0u, stats.unchanged);
+  float gain = table.gain[index];
+  float pan_x = table.pan_x[index];
+  EXPECT_GT(gain, 0.0f);
+
+  // Nothing moves, so the channel is skipped and its gain and pan are held.
+  for (int i = 0; i < 3; ++i) {
+    AdvanceFrame();
+    engine_->GetChannelUpdateStats(&stats);
+    EXPECT_EQ(0u, stats.every_frame);
+    EXPECT_EQ(1u, stats.unchanged);
+    EXPECT_EQ(gain, table.gain[index]);
+    EXPECT_EQ(pan_x, table.pan_x[index]);
+  }
+
+  channel.SetLocation(mathfu::Vector<float, 3>(-10.0f, 0.0f, 0.0f));
+  AdvanceFrame();
+  engine_->GetChannelUpdateStats(&stats);
+  EXPECT_EQ(1u, stats.every_frame);
+  EXPECT_EQ(0u, stats.unchanged);
+  EXPECT_NE(pan_x, table.pan_x[index]);
+  pan_x = table.pan_x[index];
+  AdvanceFrame();
+  engine_->GetChannelUpdateStats(&stats);
+  EXPECT_EQ(1u, stats.unchanged);
+
+  // The channel follows its bus through the fade, then is skipped again once
+  // the fade is over.
+  engine_->FindBus("master").FadeTo(0.5f, 4.0f * kDeltaTime);
+  AdvanceFrame();
+  engine_->GetChannelUpdateStats(&stats);
+  EXPECT_EQ(1u, stats.every_frame);
+  EXPECT_EQ(0u, stats.unchanged);
+  for (int i = 0; i < 8; ++i) {
+    AdvanceFrame();
+  }
+  engine_->GetChannelUpdateStats(&stats);
+  EXPECT_EQ(1u, stats.unchanged);
+  EXPECT_NEAR(0.5f * gain, table.gain[index], 1e-5f);
+
+  listener.SetLocation(mathfu::Vector<float, 3>(-20.0f, 0.0f, 0.0f));
+  AdvanceFrame();
+  engine_->GetChannelUpdateStats(&stats);
+  EXPECT_EQ(1u, stats.every_frame);
+  EXPECT_EQ(0u, stats.unchanged);
+  EXPECT_NE(pan_x, table.pan_x[index]);
+  AdvanceFrame();
+  engine_->GetChannelUpdateStats(&stats);
+  EXPECT_EQ(1u, stats.unchanged);
+}
+
+// While the engine updates on its own thread, PlaySound and Channel only queue
+// commands. A Channel reports its sound as it was played until the engine has
+// started it, and as the engine last published it after that.
+TEST_F(EngineTests, ThreadedChannelDoesNotWaitForUpdates) {
+  static const int kMaxWaits = 1000;
+  update_frequency_ = 1000.0f;
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(
+      1, TestCollectionDef("threaded"))));
+
+  const mathfu::Vector<float, 3> location(1.0f, 2.0f, 3.0f);
+  Channel channel = engine_->PlaySound(Handle("threaded"), location, 0.5f);
+  EXPECT_NE(kInvalidChannelTicket, channel.ticket());
+  EXPECT_TRUE(channel.Valid());
+  EXPECT_TRUE(channel.Playing());
+  EXPECT_FLOAT_EQ(0.5f, channel.Gain());
+  EXPECT_FLOAT_EQ(3.0f, channel.Location().z);
+
+  for (int i = 0; i < kMaxWaits && channel.id() == kNullChannelId; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_NE(kNullChannelId, channel.id());
+  EXPECT_TRUE(engine_->FindChannel(channel.id()).Valid());
+
+  channel.SetGain(0.25f);
+  channel.Stop();
+  for (int i = 0; i < kMaxWaits && channel.Playing(); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_FALSE(channel.Playing());
+  EXPECT_FLOAT_EQ(0.25f, channel.Gain());
+}
+
 }  // namespace pindrop
 
 int main(int argc, char** argv) {
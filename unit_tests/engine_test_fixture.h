@@ -0,0 +1,297 @@
+// Copyright (c) 2016 Google, Inc.
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software
+// in a product, an acknowledgment in the product documentation would be
+// appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#ifndef PINDROP_UNIT_TESTS_ENGINE_TEST_FIXTURE_H_
+#define PINDROP_UNIT_TESTS_ENGINE_TEST_FIXTURE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "audio_config_generated.h"
+#include "audio_engine_internal_state.h"
+#include "buses_generated.h"
+#include "flatbuffers/flatbuffers.h"
+#include "gtest/gtest.h"
+#include "pindrop/pindrop.h"
+#include "sound_bank_def_generated.h"
+#include "sound_collection_def_generated.h"
+
+namespace pindrop {
+
+// The parts of a SoundCollectionDef that the engine tests vary. The
+// collection has one sample for each weight, each in a silent 44.1kHz mono wave
+// file of its own.
+struct TestCollectionDef {
+  explicit TestCollectionDef(const std::string& name)
+      : name(name),
+        priority(1.0f),
+        loop(true),
+        positional(false),
+        max_audible_radius(0.0f),
+        compressed(false),
+        max_instances(0),
+        instance_limit_policy(InstanceLimitPolicy_StealOldest),
+        min_retrigger_interval(0.0f),
+        sample_selection(SampleSelection_Random),
+        weights(1, 1.0f),
+        sample_frames(2) {}
+
+  std::string name;
+  float priority;
+  bool loop;
+  bool positional;
+  float max_audible_radius;
+  bool compressed;
+  unsigned int max_instances;
+  InstanceLimitPolicy instance_limit_policy;
+  float min_retrigger_interval;
+  SampleSelection sample_selection;
+  std::vector<float> weights;
+
+  // The length of each sample, in frames.
+  unsigned int sample_frames;
+};
+
+// Runs a whole AudioEngine, with a sound bank of TestCollectionDefs written to
+// files of its own. By default the engine has no real channels, so every sound
+// plays on a virtual channel and the mixer is never asked to play anything.
+class EngineTests : public ::testing::Test {
+ protected:
+  static const float kDeltaTime;
+  static const char* kBusFile;
+  static const char* kBankFile;
+
+  EngineTests()
+      : real_channels_(0),
+        virtual_channels_(8),
+        sample_budget_(0),
+        culling_cell_size_(0.0f),
+        update_frequency_(0.0f),
+        steal_priority_margin_(0.0f),
+        min_real_channel_time_(0.0f),
+        steal_fade_time_(0.0f),
+        lod_update_interval_(1),
+        lod_cutoff_ratio_(0.5f) {}
+
+  virtual void TearDown() {
+    engine_.reset();
+    for (size_t i = 0; i < files_.size(); ++i) {
+      remove(files_[i].c_str());
+    }
+  }
+
+  // Write a file for the test, to be removed once it is over.
+  bool WriteFile(const std::string& filename, const void* data, size_t size) {
+    if (std::find(files_.begin(), files_.end(), filename) == files_.end()) {
+      files_.push_back(filename);
+    }
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (!file) {
+      return false;
+    }
+    bool written = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && written;
+  }
+
+  bool WriteFile(const std::string& filename,
+                 const flatbuffers::FlatBufferBuilder& fbb) {
+    return WriteFile(filename, fbb.GetBufferPointer(), fbb.GetSize());
+  }
+
+  static std::string CollectionFile(const std::string& name) {
+    return "pindrop_test_" + name + ".pinsound";
+  }
+
+  static std::string SampleFile(const std::string& name, size_t index) {
+    return "pindrop_test_" + name + "_" + std::to_string(index) + ".wav";
+  }
+
+  // Returns a silent 16 bit 44.1kHz mono wave file of the given length.
+  static std::vector<unsigned char> SilentWav(unsigned int frames) {
+    static const unsigned char kHeader[] = {
+        'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E', 'f', 'm', 't',
+        ' ', 16, 0, 0, 0, 1, 0, 1, 0, 0x44, 0xac, 0, 0, 0x88, 0x58, 0x01, 0,
+        2, 0, 16, 0, 'd', 'a', 't', 'a', 0, 0, 0, 0};
+    static const size_t kRiffSizeOffset = 4;
+    static const size_t kDataSizeOffset = 40;
+    const uint32_t data_size = frames * 2;
+    std::vector<unsigned char> wav(kHeader, kHeader + sizeof(kHeader));
+    wav.resize(wav.size() + data_size, 0);
+    const uint32_t riff_size = static_cast<uint32_t>(wav.size()) - 8;
+    for (size_t i = 0; i < 4; ++i) {
+      wav[kRiffSizeOffset + i] =
+          static_cast<unsigned char>(riff_size >> (8 * i));
+      wav[kDataSizeOffset + i] =
+          static_cast<unsigned char>(data_size >> (8 * i));
+    }
+    return wav;
+  }
+
+  // Write the collection's SoundCollectionDef and its silent sample files.
+  bool WriteCollection(const TestCollectionDef& def) {
+    const std::vector<unsigned char> wav = SilentWav(def.sample_frames);
+    flatbuffers::FlatBufferBuilder fbb;
+    std::vector<flatbuffers::Offset<AudioSampleSetEntry>> entries;
+    for (size_t i = 0; i < def.weights.size(); ++i) {
+      if (!WriteFile(SampleFile(def.name, i), wav.data(), wav.size())) {
+        return false;
+      }
+      auto filename = fbb.CreateString(SampleFile(def.name, i));
+      auto sample = CreateAudioSample(fbb, 1.0f, filename);
+      entries.push_back(CreateAudioSampleSetEntry(fbb, def.weights[i], sample));
+    }
+    auto name = fbb.CreateString(def.name);
+    auto bus = fbb.CreateString("master");
+    auto sample_set = fbb.CreateVector(entries);
+    SoundCollectionDefBuilder builder(fbb);
+    builder.add_name(name);
+    builder.add_priority(def.priority);
+    builder.add_bus(bus);
+    builder.add_loop(def.loop);
+    builder.add_audio_sample_set(sample_set);
+    builder.add_mode(def.positional ? Mode_Positional : Mode_Nonpositional);
+    builder.add_max_audible_radius(def.max_audible_radius);
+    builder.add_roll_out_radius(def.max_audible_radius);
+    builder.add_storage(def.compressed ? Storage_Compressed : Storage_Decoded);
+    builder.add_max_instances(def.max_instances);
+    builder.add_instance_limit_policy(def.instance_limit_policy);
+    builder.add_min_retrigger_interval(def.min_retrigger_interval);
+    builder.add_sample_selection(def.sample_selection);
+    FinishSoundCollectionDefBuffer(fbb, builder.Finish());
+    return WriteFile(CollectionFile(def.name), fbb);
+  }
+
+  // Write a sound bank holding the given collections, and their files.
+  bool WriteBank(const std::string& filename,
+                 const std::vector<TestCollectionDef>& defs) {
+    flatbuffers::FlatBufferBuilder fbb;
+    std::vector<flatbuffers::Offset<flatbuffers::String>> filenames;
+    for (size_t i = 0; i < defs.size(); ++i) {
+      if (!WriteCollection(defs[i])) {
+        return false;
+      }
+      filenames.push_back(fbb.CreateString(CollectionFile(defs[i].name)));
+    }
+    FinishSoundBankDefBuffer(
+        fbb, CreateSoundBankDef(fbb, fbb.CreateVector(filenames)));
+    return WriteFile(filename, fbb);
+  }
+
+  // Start the engine and load a sound bank holding the given collections.
+  bool Initialize(const std::vector<TestCollectionDef>& defs) {
+    flatbuffers::FlatBufferBuilder bus_fbb;
+    std::vector<flatbuffers::Offset<BusDef>> buses(
+        1, CreateBusDef(bus_fbb, bus_fbb.CreateString("master")));
+    FinishBusDefListBuffer(
+        bus_fbb, CreateBusDefList(bus_fbb, bus_fbb.CreateVector(buses)));
+    if (!WriteFile(kBusFile, bus_fbb) || !WriteBank(kBankFile, defs)) {
+      return false;
+    }
+
+    flatbuffers::FlatBufferBuilder fbb;
+    auto bus_file = fbb.CreateString(kBusFile);
+    AudioConfigBuilder builder(fbb);
+    builder.add_output_frequency(44100);
+    builder.add_output_channels(OutputChannels_Stereo);
+    builder.add_output_buffer_size(2048);
+    builder.add_mixer_channels(real_channels_);
+    builder.add_mixer_stream_channels(0);
+    builder.add_mixer_virtual_channels(virtual_channels_);
+    builder.add_listeners(1);
+    builder.add_bus_file(bus_file);
+    builder.add_sample_budget(sample_budget_);
+    builder.add_culling_cell_size(culling_cell_size_);
+    builder.add_random_seed(1);
+    builder.add_update_frequency(update_frequency_);
+    builder.add_steal_priority_margin(steal_priority_margin_);
+    builder.add_min_real_channel_time(min_real_channel_time_);
+    builder.add_steal_fade_time(steal_fade_time_);
+    builder.add_lod_update_interval(lod_update_interval_);
+    builder.add_lod_cutoff_ratio(lod_cutoff_ratio_);
+    fbb.Finish(builder.Finish());
+    config_source_.assign(reinterpret_cast<const char*>(fbb.GetBufferPointer()),
+                          fbb.GetSize());
+    engine_.reset(new AudioEngine());
+    if (!engine_->Initialize(GetAudioConfig(config_source_.data())) ||
+        !engine_->LoadSoundBank(kBankFile)) {
+      return false;
+    }
+    engine_->StartLoadingSoundFiles();
+    // Let the buses settle, so that sounds start with their full gain.
+    AdvanceFrame();
+    return true;
+  }
+
+  SoundHandle Handle(const std::string& name) {
+    return engine_->GetSoundHandle(name);
+  }
+
+  // Returns the number of valid channels, and checks that no two of them
+  // control the same voice.
+  static size_t CountDistinctChannels(const Channel* channels, size_t count) {
+    size_t valid = 0;
+    for (size_t i = 0; i < count; ++i) {
+      if (!channels[i].Valid()) {
+        continue;
+      }
+      ++valid;
+      for (size_t j = 0; j < i; ++j) {
+        EXPECT_FALSE(channels[j].Valid() &&
+                     channels[j].id() == channels[i].id());
+      }
+    }
+    return valid;
+  }
+
+  // Finish loading whatever has been queued, then update the engine.
+  void AdvanceFrame() {
+    while (!engine_->TryFinalize()) {
+    }
+    engine_->AdvanceFrame(kDeltaTime);
+  }
+
+  // Settings for the engine, which take effect when it is initialized.
+  unsigned int real_channels_;
+  unsigned int virtual_channels_;
+  unsigned int sample_budget_;
+  float culling_cell_size_;
+  float update_frequency_;
+  float steal_priority_margin_;
+  float min_real_channel_time_;
+  float steal_fade_time_;
+  unsigned int lod_update_interval_;
+  float lod_cutoff_ratio_;
+
+  std::unique_ptr<AudioEngine> engine_;
+
+ private:
+  std::string config_source_;
+  std::vector<std::string> files_;
+};
+
+// Each test program includes this header once, so the constants are defined
+// here.
+const float EngineTests::kDeltaTime = 1.0f / 60.0f;
+const char* EngineTests::kBusFile = "pindrop_test.pinbus";
+const char* EngineTests::kBankFile = "pindrop_test.pinbank";
+
+}  // namespace pindrop
+
+#endif  // PINDROP_UNIT_TESTS_ENGINE_TEST_FIXTURE_H_
@@ -0,0 +1,286 @@
+// Copyright (c) 2016 Google, Inc.
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software
+// in a product, an acknowledgment in the product documentation would be
+// appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "src/asynchronous_loader/file_loader.h"
+
+namespace pindrop {
+
+// The longest a test waits for the loader before giving up.
+static const int kMaxWaitMilliseconds = 5000;
+
+// Wait until the condition holds, or give up. Returns whether it held.
+static bool WaitFor(const std::function<bool()>& condition) {
+  for (int i = 0; i < kMaxWaitMilliseconds; ++i) {
+    if (condition()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return condition();
+}
+
+// Holds back the loads of the resources that wait on it until it is opened.
+class Gate {
+ public:
+  Gate() : open_(false) {}
+
+  void Open() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      open_ = true;
+    }
+    condition_.notify_all();
+  }
+
+  void Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this]() { return open_; });
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool open_;
+};
+
+// The order resources were loaded in, by name.
+class LoadLog {
+ public:
+  void Add(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    names_.push_back(name);
+  }
+
+  std::vector<std::string> names() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return names_;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::vector<std::string> names_;
+};
+
+// A resource that logs its load, optionally waiting for a gate to open first.
+class TestResource : public Resource {
+ public:
+  TestResource(const std::string& name, LoadLog* log, Gate* gate = nullptr)
+      : log_(log), gate_(gate), loading_(false) {
+    set_filename(name);
+  }
+
+  bool loading() const { return loading_; }
+
+ private:
+  virtual void Load() {
+    loading_ = true;
+    if (gate_) {
+      gate_->Wait();
+    }
+    log_->Add(filename());
+  }
+
+  LoadLog* log_;
+  Gate* gate_;
+  std::atomic<bool> loading_;
+};
+
+static std::vector<std::string> Names(const char* a, const char* b,
+                                      const char* c, const char* d) {
+  std::vector<std::string> names;
+  names.push_back(a);
+  names.push_back(b);
+  names.push_back(c);
+  names.push_back(d);
+  return names;
+}
+
+// With one worker, the resources of higher priority groups load first, and
+// resources of the same priority load in the order they were queued.
+TEST(FileLoader, LoadsHigherPriorityFirst) {
+  LoadLog log;
+  TestResource low_a("low_a", &log);
+  TestResource low_b("low_b", &log);
+  TestResource high("high", &log);
+  TestResource ungrouped("ungrouped", &log);
+  FileLoader loader;
+  loader.Initialize(1);
+
+  loader.BeginGroup(1);
+  loader.QueueJob(&low_a);
+  loader.QueueJob(&low_b);
+  loader.EndGroup();
+  loader.BeginGroup(5);
+  loader.QueueJob(&high);
+  loader.EndGroup();
+  loader.QueueJob(&ungrouped);
+
+  loader.StartLoading();
+  ASSERT_TRUE(WaitFor([&loader]() { return loader.TryFinalize(); }));
+  EXPECT_EQ(Names("high", "low_a", "low_b", "ungrouped"), log.names());
+}
+
+// Raising a group's priority moves its queued resources ahead.
+TEST(FileLoader, RaisedGroupLoadsFirst) {
+  LoadLog log;
+  TestResource first_a("first_a", &log);
+  TestResource first_b("first_b", &log);
+  TestResource second_a("second_a", &log);
+  TestResource second_b("second_b", &log);
+  FileLoader loader;
+  loader.Initialize(1);
+
+  LoadGroupId first = loader.BeginGroup(1);
+  loader.QueueJob(&first_a);
+  loader.QueueJob(&first_b);
+  loader.EndGroup();
+  LoadGroupId second = loader.BeginGroup(2);
+  loader.QueueJob(&second_a);
+  loader.QueueJob(&second_b);
+  loader.EndGroup();
+  loader.RaiseGroupPriority(first, 3);
+  // Lowering a priority does nothing.
+  loader.RaiseGroupPriority(second, 0);
+
+  loader.StartLoading();
+  ASSERT_TRUE(WaitFor([&loader]() { return loader.TryFinalize(); }));
+  EXPECT_EQ(Names("first_a", "first_b", "second_a", "second_b"), log.names());
+}
+
+// A cancelled resource that was still queued is never loaded, and a group
+// whose queued resources are all cancelled counts as loaded.
+TEST(FileLoader, CancelledJobsAreNotLoaded) {
+  LoadLog log;
+  TestResource kept("kept", &log);
+  TestResource cancelled("cancelled", &log);
+  TestResource alone("alone", &log);
+  FileLoader loader;
+  loader.Initialize(2);
+
+  LoadGroupId group = loader.BeginGroup(0);
+  loader.QueueJob(&kept);
+  loader.QueueJob(&cancelled);
+  loader.EndGroup();
+  LoadGroupId cancelled_group = loader.BeginGroup(0);
+  loader.QueueJob(&alone);
+  loader.EndGroup();
+  EXPECT_EQ(3u, loader.queue_depth());
+
+  loader.CancelJob(&alone);
+  EXPECT_TRUE(loader.GroupLoaded(cancelled_group));
+  EXPECT_FALSE(loader.GroupLoaded(group));
+  loader.CancelJob(&cancelled);
+  EXPECT_EQ(1u, loader.queue_depth());
+
+  loader.StartLoading();
+  ASSERT_TRUE(WaitFor([&loader]() { return loader.TryFinalize(); }));
+  EXPECT_TRUE(loader.GroupLoaded(group));
+  EXPECT_TRUE(kept.ready());
+  EXPECT_FALSE(cancelled.ready());
+  EXPECT_FALSE(alone.ready());
+  EXPECT_EQ(std::vector<std::string>(1, "kept"), log.names());
+  EXPECT_EQ(1.0f, loader.Progress());
+}
+
+// Cancelling a resource that is being loaded waits for the load to finish, so
+// that the resource can be destroyed straight after.
+TEST(FileLoader, CancelWaitsForJobBeingLoaded) {
+  LoadLog log;
+  Gate gate;
+  TestResource resource("resource", &log, &gate);
+  FileLoader loader;
+  loader.Initialize(1);
+  loader.QueueJob(&resource);
+  loader.StartLoading();
+  ASSERT_TRUE(WaitFor([&resource]() { return resource.loading(); }));
+
+  std::atomic<bool> cancelled(false);
+  std::thread canceller([&loader, &resource, &cancelled]() {
+    loader.CancelJob(&resource);
+    cancelled = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_FALSE(cancelled.load());
+  gate.Open();
+  canceller.join();
+  EXPECT_TRUE(cancelled.load());
+  EXPECT_TRUE(resource.ready());
+  EXPECT_TRUE(loader.TryFinalize());
+}
+
+// Progress counts the resources loaded since the loader was last idle, and
+// TryFinalize only succeeds once every queued resource is ready.
+TEST(FileLoader, ProgressAndFinalize) {
+  static const size_t kCount = 4;
+  LoadLog log;
+  Gate gates[kCount];
+  std::vector<std::unique_ptr<TestResource>> resources;
+  FileLoader loader;
+  loader.Initialize(1);
+  EXPECT_EQ(1.0f, loader.Progress());
+  EXPECT_TRUE(loader.TryFinalize());
+
+  for (size_t i = 0; i < kCount; ++i) {
+    resources.push_back(std::unique_ptr<TestResource>(
+        new TestResource(std::to_string(i), &log, &gates[i])));
+    loader.QueueJob(resources[i].get());
+  }
+  EXPECT_EQ(0.0f, loader.Progress());
+  EXPECT_FALSE(loader.TryFinalize());
+
+  loader.StartLoading();
+  for (size_t i = 0; i < kCount; ++i) {
+    gates[i].Open();
+    ASSERT_TRUE(WaitFor([&loader, i]() {
+      return loader.Progress() >= static_cast<float>(i + 1) / kCount;
+    }));
+    EXPECT_FLOAT_EQ(static_cast<float>(i + 1) / kCount, loader.Progress());
+    EXPECT_TRUE(resources[i]->ready());
+    EXPECT_EQ(i + 1 == kCount, loader.TryFinalize());
+  }
+  for (size_t i = 0; i < kCount; ++i) {
+    EXPECT_TRUE(resources[i]->ready());
+  }
+
+  // Queueing more once the loader is idle starts counting afresh.
+  Gate gate;
+  TestResource late("late", &log, &gate);
+  loader.QueueJob(&late);
+  EXPECT_EQ(0.0f, loader.Progress());
+  EXPECT_FALSE(loader.TryFinalize());
+  gate.Open();
+  ASSERT_TRUE(WaitFor([&loader]() { return loader.TryFinalize(); }));
+  EXPECT_EQ(1.0f, loader.Progress());
+  EXPECT_TRUE(late.ready());
+}
+
+}  // namespace pindrop
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
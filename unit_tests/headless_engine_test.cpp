@@ -0,0 +1,439 @@
+// Copyright (c) 2016 Google, Inc.
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+// claim that you wrote the original software. If you use this software
+// in a product, an acknowledgment in the product documentation would be
+// appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+// misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include <cmath>
+#include <vector>
+
+#include "audio_engine_internal_state.h"
+#include "channel_table.h"
+#include "engine_test_fixture.h"
+#include "gtest/gtest.h"
+#include "mathfu/constants.h"
+#include "mixer.h"
+#include "pindrop/pindrop.h"
+
+// These tests run the engine with the headless mixer, so that sounds really
+// play on real channels, on a clock that only moves when the engine updates.
+
+namespace pindrop {
+
+// One second of samples at 44.1kHz.
+static const unsigned int kOneSecond = 44100;
+
+// The most frames a steal is waited on for before a test gives up.
+static const int kMaxFrames = 60;
+
+// Plays a low priority sound on the only real channel, and a higher priority
+// one that wants it.
+class StealTests : public EngineTests {
+ protected:
+  StealTests() { real_channels_ = 1; }
+
+  bool InitializeAndPlay(float high_priority) {
+    TestCollectionDef low("low");
+    low.sample_frames = kOneSecond;
+    TestCollectionDef high("high");
+    high.sample_frames = kOneSecond;
+    high.priority = high_priority;
+    std::vector<TestCollectionDef> defs;
+    defs.push_back(low);
+    defs.push_back(high);
+    if (!Initialize(defs)) {
+      return false;
+    }
+    low_ = engine_->PlaySound(Handle("low"));
+    high_ = engine_->PlaySound(Handle("high"));
+    return low_.Valid() && high_.Valid();
+  }
+
+  const ChannelTable& table() const {
+    return engine_->state()->channel_table;
+  }
+
+  bool Real(const Channel& channel) const {
+    return table().real[ChannelIdIndex(channel.id())] != 0;
+  }
+
+  bool Stealing(const Channel& channel) const {
+    return table().stealing[ChannelIdIndex(channel.id())] != 0;
+  }
+
+  ChannelUpdateStats Stats() const {
+    ChannelUpdateStats stats;
+    engine_->GetChannelUpdateStats(&stats);
+    return stats;
+  }
+
+  // The voice of the only real channel.
+  const Voice& RealVoice() { return *engine_->state()->mixer.voice(0); }
+
+  Channel low_;
+  Channel high_;
+};
+
+// A channel has to beat the priority of a real channel by more than the margin
+// to take it.
+TEST_F(StealTests, PriorityMarginPreventsSwap) {
+  steal_priority_margin_ = 0.5f;
+  ASSERT_TRUE(InitializeAndPlay(1.25f));
+  EXPECT_TRUE(Real(low_));
+  EXPECT_FALSE(Real(high_));
+
+  for (int i = 0; i < 3; ++i) {
+    AdvanceFrame();
+    EXPECT_EQ(0u, Stats().swaps);
+    EXPECT_TRUE(Real(low_));
+    EXPECT_FALSE(Real(high_));
+  }
+
+  low_.SetGain(0.5f);
+  AdvanceFrame();
+  EXPECT_EQ(1u, Stats().swaps);
+  EXPECT_FALSE(Real(low_));
+  EXPECT_TRUE(Real(high_));
+  EXPECT_TRUE(low_.Playing());
+}
+
+// Without a margin, any higher priority channel takes the real channel.
+TEST_F(StealTests, ZeroMarginSwapsAtOnce) {
+  ASSERT_TRUE(InitializeAndPlay(1.25f));
+  AdvanceFrame();
+  EXPECT_EQ(1u, Stats().swaps);
+  EXPECT_FALSE(Real(low_));
+  EXPECT_TRUE(Real(high_));
+}
+
+// A channel keeps its real channel for the minimum time before it can be
+// taken away.
+TEST_F(StealTests, MinRealChannelTimeDelaysSwap) {
+  min_real_channel_time_ = 6.0f * kDeltaTime;
+  ASSERT_TRUE(InitializeAndPlay(2.0f));
+  for (int i = 0; i < 5; ++i) {
+    AdvanceFrame();
+    EXPECT_EQ(0u, Stats().swaps);
+    EXPECT_TRUE(Real(low_));
+  }
+  unsigned int swaps = 0;
+  for (int i = 0; i < 2; ++i) {
+    AdvanceFrame();
+    swaps += static_cast<unsigned int>(Stats().swaps);
+  }
+  EXPECT_EQ(1u, swaps);
+  EXPECT_FALSE(Real(low_));
+  EXPECT_TRUE(Real(high_));
+
+  // The channel that took it now keeps it for the minimum time in turn.
+  high_.SetGain(0.25f);
+  AdvanceFrame();
+  EXPECT_EQ(0u, Stats().swaps);
+  EXPECT_TRUE(Real(high_));
+}
+
+// The real channel is faded out, and only handed over once the fade is over.
+// The channel it was taken from plays on virtually in the meantime.
+TEST_F(StealTests, FadeHandsOverStolenChannel) {
+  steal_fade_time_ = 3.0f * kDeltaTime;
+  ASSERT_TRUE(InitializeAndPlay(2.0f));
+  AdvanceFrame();
+  EXPECT_EQ(0u, Stats().swaps);
+  EXPECT_EQ(1u, Stats().stealing);
+  EXPECT_TRUE(Stealing(low_));
+  EXPECT_TRUE(Real(low_));
+  EXPECT_TRUE(RealVoice().fading);
+
+  int frames = 0;
+  while (frames < kMaxFrames && Stats().swaps == 0) {
+    EXPECT_TRUE(low_.Playing());
+    AdvanceFrame();
+    ++frames;
+  }
+  EXPECT_GE(frames, 2);
+  EXPECT_LE(frames, 4);
+  EXPECT_EQ(1u, Stats().swaps);
+  EXPECT_EQ(0u, Stats().stealing);
+  EXPECT_FALSE(Stealing(low_));
+  EXPECT_FALSE(Real(low_));
+  EXPECT_TRUE(low_.Playing());
+  EXPECT_TRUE(Real(high_));
+  EXPECT_TRUE(RealVoice().playing);
+  EXPECT_FALSE(RealVoice().fading);
+}
+
+// When the channel that wanted the real channel goes away during the fade, the
+// faded channel keeps it, and fades back in from where it has got to rather
+// than from where the fade began.
+TEST_F(StealTests, CancelledStealResumesFromCurrentPosition) {
+  steal_fade_time_ = 3.0f * kDeltaTime;
+  ASSERT_TRUE(InitializeAndPlay(2.0f));
+  AdvanceFrame();
+  ASSERT_TRUE(Stealing(low_));
+  const float fade_start = RealVoice().position;
+  high_.Stop();
+
+  int frames = 0;
+  while (frames < kMaxFrames && Stats().stealing != 0) {
+    AdvanceFrame();
+    ++frames;
+  }
+  EXPECT_EQ(0u, Stats().stealing);
+  EXPECT_EQ(0u, Stats().swaps);
+  EXPECT_FALSE(Stealing(low_));
+  EXPECT_TRUE(Real(low_));
+  EXPECT_TRUE(low_.Playing());
+  EXPECT_TRUE(RealVoice().playing);
+  EXPECT_FALSE(RealVoice().fading);
+  EXPECT_NEAR(fade_start + frames * kDeltaTime, RealVoice().position, 1e-4f);
+  EXPECT_NEAR(steal_fade_time_, RealVoice().fade_in_time, 1e-4f);
+
+  for (int i = 0; i < 4; ++i) {
+    AdvanceFrame();
+  }
+  EXPECT_EQ(0.0f, RealVoice().fade_in_time);
+  EXPECT_TRUE(Real(low_));
+}
+
+// A new instance that stops an older one to stay within its collection's limit
+// plays on the older one's channel, so it keeps the real channel and no other
+// sound is stopped for it.
+TEST_F(EngineTests, InstanceLimitReusesVictimChannel) {
+  real_channels_ = 1;
+  virtual_channels_ = 1;
+  TestCollectionDef limited("limited");
+  limited.max_instances = 1;
+  std::vector<TestCollectionDef> defs;
+  defs.push_back(limited);
+  defs.push_back(TestCollectionDef("other"));
+  ASSERT_TRUE(Initialize(defs));
+  Channel first = engine_->PlaySound(Handle("limited"));
+  Channel other =
+      engine_->PlaySound(Handle("other"), mathfu::kZeros3f, 0.5f);
+  ASSERT_TRUE(first.Valid());
+  ASSERT_TRUE(other.Valid());
+  const ChannelTable& table = engine_->state()->channel_table;
+  EXPECT_NE(0, table.real[ChannelIdIndex(first.id())]);
+
+  Channel second = engine_->PlaySound(Handle("limited"));
+  ASSERT_TRUE(second.Valid());
+  EXPECT_FALSE(first.Valid());
+  EXPECT_TRUE(second.Playing());
+  EXPECT_TRUE(other.Playing());
+  EXPECT_NE(0, table.real[ChannelIdIndex(second.id())]);
+  EXPECT_TRUE(engine_->state()->mixer.voice(0)->playing);
+  EXPECT_EQ(1u, Handle("limited")->instance_count());
+}
+
+// A quarter of a second of samples at 44.1kHz, fifteen frames of the engine.
+static const unsigned int kQuarterSecond = 11025;
+static const float kQuarterSecondDuration = 0.25f;
+
+// A virtual one shot sound plays on for as long as the sound would have taken,
+// then stops.
+TEST_F(EngineTests, VirtualOneShotRetiresAtItsDuration) {
+  TestCollectionDef def("one_shot");
+  def.loop = false;
+  def.sample_frames = kQuarterSecond;
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(1, def)));
+  Channel channel = engine_->PlaySound(Handle("one_shot"));
+  ASSERT_TRUE(channel.Valid());
+  for (int i = 0; i < 13; ++i) {
+    AdvanceFrame();
+    EXPECT_TRUE(channel.Playing());
+  }
+  for (int i = 0; i < 4; ++i) {
+    AdvanceFrame();
+  }
+  EXPECT_FALSE(channel.Playing());
+  EXPECT_FALSE(channel.Valid());
+}
+
+// Plays a sound on the only real channel, and the sound under test virtually
+// behind it, until the first is turned down and hands its real channel over.
+class PlayheadTests : public EngineTests {
+ protected:
+  PlayheadTests() { real_channels_ = 1; }
+
+  bool InitializeAndPlay(bool loop) {
+    TestCollectionDef blocker("blocker");
+    blocker.priority = 2.0f;
+    TestCollectionDef played("played");
+    played.loop = loop;
+    played.sample_frames = kQuarterSecond;
+    std::vector<TestCollectionDef> defs;
+    defs.push_back(blocker);
+    defs.push_back(played);
+    if (!Initialize(defs)) {
+      return false;
+    }
+    blocker_ = engine_->PlaySound(Handle("blocker"));
+    played_ = engine_->PlaySound(Handle("played"));
+    return blocker_.Valid() && played_.Valid();
+  }
+
+  // Play for the given number of frames, and give the sound under test the
+  // real channel on the last of them.
+  void PlayThenDevirtualize(int frames) {
+    for (int i = 1; i < frames; ++i) {
+      AdvanceFrame();
+    }
+    blocker_.SetGain(0.25f);
+    AdvanceFrame();
+  }
+
+  bool Real(const Channel& channel) const {
+    return engine_->state()
+               ->channel_table.real[ChannelIdIndex(channel.id())] != 0;
+  }
+
+  const Voice& RealVoice() { return *engine_->state()->mixer.voice(0); }
+
+  Channel blocker_;
+  Channel played_;
+};
+
+// A looping sound that was virtual picks up where it would have got to,
+// wrapped around its length.
+TEST_F(PlayheadTests, VirtualLoopWrapsAndResumes) {
+  static const int kFrames = 21;
+  ASSERT_TRUE(InitializeAndPlay(true));
+  EXPECT_FALSE(Real(played_));
+  PlayThenDevirtualize(kFrames);
+  ASSERT_TRUE(Real(played_));
+  EXPECT_TRUE(played_.Playing());
+  EXPECT_NEAR(std::fmod(kFrames * kDeltaTime, kQuarterSecondDuration),
+              RealVoice().position, 1e-3f);
+}
+
+// A one shot sound that was virtual picks up where it would have got to.
+TEST_F(PlayheadTests, VirtualOneShotResumesAtOffset) {
+  static const int kFrames = 9;
+  ASSERT_TRUE(InitializeAndPlay(false));
+  PlayThenDevirtualize(kFrames);
+  ASSERT_TRUE(Real(played_));
+  EXPECT_TRUE(played_.Playing());
+  EXPECT_NEAR(kFrames * kDeltaTime, RealVoice().position, 1e-3f);
+}
+
+// With an update interval, the far virtual channels take turns to be updated,
+// staggered by their index, and have their gain carried on at the rate it last
+// changed in between. The real channel is updated every frame.
+TEST_F(EngineTests, FarVirtualChannelsTakeTurnsToUpdate) {
+  static const unsigned int kInterval = 4;
+  static const size_t kQuietCount = 3;
+  static const float kQuietGain = 0.1f;
+  real_channels_ = 1;
+  lod_update_interval_ = kInterval;
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(
+      1, TestCollectionDef("lod"))));
+  Channel loud = engine_->PlaySound(Handle("lod"));
+  std::vector<size_t> quiet;
+  for (size_t i = 0; i < kQuietCount; ++i) {
+    Channel channel =
+        engine_->PlaySound(Handle("lod"), mathfu::kZeros3f, kQuietGain);
+    ASSERT_TRUE(channel.Valid());
+    quiet.push_back(ChannelIdIndex(channel.id()));
+  }
+  ASSERT_TRUE(loud.Valid());
+  const ChannelTable& table = engine_->state()->channel_table;
+  const size_t loud_index = ChannelIdIndex(loud.id());
+
+  // A steady fade keeps every channel changing, at a rate the extrapolation
+  // can follow.
+  engine_->FindBus("master").FadeTo(0.0f, 2.0f);
+  ChannelUpdateStats stats;
+
+  // Channels that have just started are updated straight away.
+  AdvanceFrame();
+  engine_->GetChannelUpdateStats(&stats);
+  EXPECT_EQ(1 + kQuietCount, stats.every_frame);
+
+  // Let each quiet channel have two turns, so that it has a rate to
+  // extrapolate at.
+  for (unsigned int i = 0; i < 2 * kInterval; ++i) {
+    AdvanceFrame();
+  }
+
+  size_t scheduled = 0;
+  size_t extrapolated = 0;
+  for (unsigned int frame = 0; frame < kInterval; ++frame) {
+    AdvanceFrame();
+    engine_->GetChannelUpdateStats(&stats);
+    EXPECT_EQ(1u, stats.every_frame);
+    EXPECT_EQ(kQuietCount, stats.scheduled + stats.extrapolated);
+    scheduled += stats.scheduled;
+    extrapolated += stats.extrapolated;
+
+    const uint32_t current_frame = engine_->state()->current_frame;
+    EXPECT_EQ(current_frame, table.lod_frame[loud_index]);
+    for (size_t i = 0; i < quiet.size(); ++i) {
+      const size_t index = quiet[i];
+      EXPECT_FALSE(table.real[index]);
+      const bool turn = (index + current_frame) % kInterval == 0;
+      EXPECT_EQ(turn, table.lod_frame[index] == current_frame);
+      EXPECT_NEAR(kQuietGain * table.gain[loud_index], table.gain[index],
+                  1e-5f);
+    }
+  }
+  // Over a whole interval every quiet channel has had exactly one turn.
+  EXPECT_EQ(kQuietCount, scheduled);
+  EXPECT_EQ(kQuietCount * (kInterval - 1), extrapolated);
+}
+
+// Gain changes smaller than the mixer update threshold are held back while
+// the gain is still changing, but are sent once it settles or reaches zero.
+TEST_F(EngineTests, SmallGainChangesAreSentOnceSettled) {
+  real_channels_ = 1;
+  ASSERT_TRUE(Initialize(std::vector<TestCollectionDef>(
+      1, TestCollectionDef("gain"))));
+  Channel channel = engine_->PlaySound(Handle("gain"));
+  ASSERT_TRUE(channel.Valid());
+  AdvanceFrame();
+  const ChannelTable& table = engine_->state()->channel_table;
+  const size_t index = ChannelIdIndex(channel.id());
+  const Voice& voice = *engine_->state()->mixer.voice(0);
+  ASSERT_NE(0, table.real[index]);
+  EXPECT_EQ(table.gain[index], voice.gain);
+  const uint64_t skipped = engine_->skipped_mixer_updates();
+
+  // A change below the default threshold of 0.001 is held back on the frame
+  // it is made, and sent on the next, once the gain has stopped changing.
+  const float before = voice.gain;
+  channel.SetGain(0.9995f);
+  AdvanceFrame();
+  EXPECT_NE(voice.gain, table.gain[index]);
+  EXPECT_EQ(before, voice.gain);
+  EXPECT_EQ(skipped + 1, engine_->skipped_mixer_updates());
+  AdvanceFrame();
+  EXPECT_EQ(table.gain[index], voice.gain);
+  EXPECT_EQ(skipped + 1, engine_->skipped_mixer_updates());
+
+  // A small change that reaches silence is sent straight away.
+  channel.SetGain(0.0005f);
+  AdvanceFrame();
+  AdvanceFrame();
+  EXPECT_EQ(table.gain[index], voice.gain);
+  const uint64_t skipped_before_zero = engine_->skipped_mixer_updates();
+  channel.SetGain(0.0f);
+  AdvanceFrame();
+  EXPECT_EQ(0.0f, voice.gain);
+  EXPECT_EQ(skipped_before_zero, engine_->skipped_mixer_updates());
+}
+
+}  // namespace pindrop
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,195 @@
+// Copyright 2016 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "src/mixer/software_mixer/mix_kernels.h"
+
+namespace pindrop {
+
+// The kernels step their gain ramps by repeated addition, so they may drift
+// slightly from the reference, which computes each gain directly.
+static const float kTolerance = 1e-5f;
+
+// Frame counts around the vector widths, so that both the vector loops and
+// the scalar tails that finish them are covered.
+static const size_t kFrameCounts[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 13, 64, 255};
+
+// Samples in [-1, 1] that differ from frame to frame.
+static std::vector<float> TestSamples(size_t count, float phase) {
+  std::vector<float> samples(count);
+  for (size_t i = 0; i < count; ++i) {
+    samples[i] = std::sin(phase + 0.37f * static_cast<float>(i));
+  }
+  return samples;
+}
+
+static void ReferenceMix(float* output, const float* input, size_t frame_count,
+                         int channel_count, float left_start,
+                         float right_start, float left_end, float right_end) {
+  for (size_t i = 0; i < frame_count; ++i) {
+    const double t = static_cast<double>(i) / frame_count;
+    const double left = left_start + (left_end - left_start) * t;
+    const double right = right_start + (right_end - right_start) * t;
+    const float* frame = input + i * channel_count;
+    output[2 * i] += static_cast<float>(frame[0] * left);
+    output[2 * i + 1] +=
+        static_cast<float>(frame[channel_count - 1] * right);
+  }
+}
+
+static void ExpectSamplesNear(const std::vector<float>& expected,
+                              const std::vector<float>& actual,
+                              size_t frame_count) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(expected[i], actual[i], kTolerance)
+        << "sample " << i << " of " << frame_count << " frames";
+  }
+}
+
+// The mono kernel adds the ramped left and right gains of each frame to what
+// is already in the output.
+TEST(MixKernels, MixMonoToStereoMatchesReference) {
+  for (size_t n = 0; n < sizeof(kFrameCounts) / sizeof(kFrameCounts[0]); ++n) {
+    const size_t frames = kFrameCounts[n];
+    const std::vector<float> input = TestSamples(frames, 0.0f);
+    std::vector<float> expected = TestSamples(frames * 2, 1.0f);
+    std::vector<float> actual = expected;
+    ReferenceMix(expected.data(), input.data(), frames, 1, 0.25f, 0.9f, 0.75f,
+                 0.1f);
+    MixMonoToStereo(actual.data(), input.data(), frames, 0.25f, 0.9f, 0.75f,
+                    0.1f);
+    ExpectSamplesNear(expected, actual, frames);
+  }
+}
+
+TEST(MixKernels, MixStereoToStereoMatchesReference) {
+  for (size_t n = 0; n < sizeof(kFrameCounts) / sizeof(kFrameCounts[0]); ++n) {
+    const size_t frames = kFrameCounts[n];
+    const std::vector<float> input = TestSamples(frames * 2, 0.0f);
+    std::vector<float> expected = TestSamples(frames * 2, 1.0f);
+    std::vector<float> actual = expected;
+    ReferenceMix(expected.data(), input.data(), frames, 2, 1.0f, 0.5f, 0.0f,
+                 0.8f);
+    MixStereoToStereo(actual.data(), input.data(), frames, 1.0f, 0.5f, 0.0f,
+                      0.8f);
+    ExpectSamplesNear(expected, actual, frames);
+  }
+}
+
+// Mixing at a constant gain of one is an exact sum.
+TEST(MixKernels, UnityGainIsExact) {
+  const size_t frames = 13;
+  const std::vector<float> input = TestSamples(frames, 0.0f);
+  std::vector<float> output(frames * 2, 0.0f);
+  MixMonoToStereo(output.data(), input.data(), frames, 1.0f, 1.0f, 1.0f, 1.0f);
+  for (size_t i = 0; i < frames; ++i) {
+    EXPECT_EQ(input[i], output[2 * i]);
+    EXPECT_EQ(input[i], output[2 * i + 1]);
+  }
+}
+
+static uint64_t ReferenceResample(float* output, const float* input,
+                                  size_t input_frame_count, int channel_count,
+                                  uint64_t position, uint64_t step,
+                                  size_t frame_count) {
+  for (size_t i = 0; i < frame_count; ++i) {
+    const double x = static_cast<double>(position) / kFixedPointOne;
+    const double last = static_cast<double>(input_frame_count - 1);
+    const double clamped = std::min(x, last);
+    const size_t a = static_cast<size_t>(clamped);
+    const size_t b = std::min(a + 1, input_frame_count - 1);
+    const double fraction = x - std::floor(x);
+    for (int channel = 0; channel < channel_count; ++channel) {
+      const double sa = input[a * channel_count + channel];
+      const double sb = input[b * channel_count + channel];
+      *output++ = static_cast<float>(sa + (sb - sa) * fraction);
+    }
+    position += step;
+  }
+  return position;
+}
+
+static void ExpectResampleMatches(int channel_count, uint64_t position,
+                                  uint64_t step, size_t frame_count) {
+  static const size_t kInputFrames = 37;
+  const std::vector<float> input =
+      TestSamples(kInputFrames * channel_count, 0.5f);
+  std::vector<float> expected(frame_count * channel_count);
+  std::vector<float> actual(frame_count * channel_count);
+  const uint64_t expected_end =
+      ReferenceResample(expected.data(), input.data(), kInputFrames,
+                        channel_count, position, step, frame_count);
+  const uint64_t actual_end =
+      Resample(actual.data(), input.data(), kInputFrames, channel_count,
+               position, step, frame_count);
+  EXPECT_EQ(expected_end, actual_end);
+  ExpectSamplesNear(expected, actual, frame_count);
+}
+
+// Steps that are not a whole number of frames interpolate between input
+// frames, and reads past the last frame hold it.
+TEST(MixKernels, ResampleMatchesReference) {
+  // 44.1kHz played at 48kHz, 22.05kHz played at 48kHz, and an octave up.
+  const uint64_t steps[] = {kFixedPointOne * 44100 / 48000,
+                            kFixedPointOne * 22050 / 48000,
+                            kFixedPointOne * 2, kFixedPointOne};
+  const uint64_t start = kFixedPointOne * 3 + kFixedPointOne / 3;
+  for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); ++s) {
+    for (int channels = 1; channels <= 2; ++channels) {
+      ExpectResampleMatches(channels, 0, steps[s], 13);
+      ExpectResampleMatches(channels, start, steps[s], 29);
+    }
+  }
+}
+
+TEST(MixKernels, ResampleHoldsLastFrame) {
+  const float input[] = {0.25f, -0.5f};
+  float output[3];
+  const uint64_t end = Resample(output, input, 2, 1, kFixedPointOne / 2,
+                                kFixedPointOne, 3);
+  EXPECT_FLOAT_EQ(-0.125f, output[0]);
+  EXPECT_FLOAT_EQ(-0.5f, output[1]);
+  EXPECT_FLOAT_EQ(-0.5f, output[2]);
+  EXPECT_EQ(kFixedPointOne * 7 / 2, end);
+}
+
+TEST(MixKernels, ClampSamples) {
+  for (size_t n = 0; n < sizeof(kFrameCounts) / sizeof(kFrameCounts[0]); ++n) {
+    const size_t count = kFrameCounts[n];
+    std::vector<float> samples = TestSamples(count, 0.0f);
+    for (size_t i = 0; i < count; ++i) {
+      samples[i] *= 3.0f;
+    }
+    std::vector<float> expected = samples;
+    for (size_t i = 0; i < count; ++i) {
+      expected[i] = std::min(std::max(expected[i], -1.0f), 1.0f);
+    }
+    ClampSamples(samples.data(), count);
+    EXPECT_EQ(expected, samples) << count << " samples";
+  }
+}
+
+}  // namespace pindrop
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}